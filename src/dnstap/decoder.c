@@ -0,0 +1,203 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "libknot/errcode.h"
+#include "dnstap/convert.h"
+#include "dnstap/decoder.h"
+#include "dnstap/wire.h"
+
+/*! \brief Input cursor. */
+struct rbuf {
+	const uint8_t *pos;
+	const uint8_t *end;
+};
+
+/*! \brief Decoded field. */
+struct field {
+	unsigned number;
+	unsigned wire_type;
+	uint64_t value;          /*!< Varint or fixed value. */
+	const uint8_t *data;     /*!< Length-delimited value. */
+	size_t len;
+};
+
+static int get_varint(struct rbuf *r, uint64_t *value)
+{
+	*value = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		if (r->pos >= r->end) {
+			return KNOT_EMALF;
+		}
+		uint8_t byte = *r->pos++;
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return KNOT_EOK;
+		}
+	}
+
+	return KNOT_EMALF;
+}
+
+static int get_fixed(struct rbuf *r, unsigned size, uint64_t *value)
+{
+	if (r->end - r->pos < size) {
+		return KNOT_EMALF;
+	}
+
+	*value = 0;
+	for (unsigned i = 0; i < size; ++i) {
+		*value |= (uint64_t)r->pos[i] << (8 * i);
+	}
+	r->pos += size;
+
+	return KNOT_EOK;
+}
+
+static int get_field(struct rbuf *r, struct field *f)
+{
+	uint64_t tag = 0;
+	int ret = get_varint(r, &tag);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+	f->number = tag >> 3;
+	f->wire_type = tag & 0x07;
+
+	switch (f->wire_type) {
+	case DT_WT_VARINT:
+		return get_varint(r, &f->value);
+	case DT_WT_FIXED64:
+		return get_fixed(r, 8, &f->value);
+	case DT_WT_FIXED32:
+		return get_fixed(r, 4, &f->value);
+	case DT_WT_BYTES:
+		ret = get_varint(r, &f->value);
+		if (ret != KNOT_EOK || f->value > r->end - r->pos) {
+			return KNOT_EMALF;
+		}
+		f->data = r->pos;
+		f->len = f->value;
+		r->pos += f->len;
+		return KNOT_EOK;
+	default:
+		return KNOT_EMALF;
+	}
+}
+
+static int decode_message(const uint8_t *data, size_t len, dt_message_t *msg)
+{
+	struct rbuf r = { data, data + len };
+	bool has_type = false;
+
+	while (r.pos < r.end) {
+		struct field f = { 0 };
+		int ret = get_field(&r, &f);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+
+		bool bytes = (f.wire_type == DT_WT_BYTES);
+		switch (f.number) {
+		case DT_MSG_TYPE:
+			msg->type = f.value;
+			has_type = !bytes;
+			break;
+		case DT_MSG_SOCKET_FAMILY:
+			msg->socket_family = dt_family_decode(f.value);
+			break;
+		case DT_MSG_SOCKET_PROTOCOL:
+			msg->socket_protocol = dt_protocol_decode(f.value);
+			break;
+		case DT_MSG_QUERY_ADDRESS:
+			msg->query_address = f.data;
+			msg->query_address_len = f.len;
+			break;
+		case DT_MSG_RESPONSE_ADDRESS:
+			msg->response_address = f.data;
+			msg->response_address_len = f.len;
+			break;
+		case DT_MSG_QUERY_PORT:
+			msg->query_port = f.value;
+			break;
+		case DT_MSG_RESPONSE_PORT:
+			msg->response_port = f.value;
+			break;
+		case DT_MSG_QUERY_TIME_SEC:
+			msg->query_time.tv_sec = f.value;
+			msg->has_query_time = true;
+			break;
+		case DT_MSG_QUERY_TIME_NSEC:
+			msg->query_time.tv_nsec = f.value;
+			break;
+		case DT_MSG_QUERY_MESSAGE:
+			msg->query_message = f.data;
+			msg->query_message_len = f.len;
+			break;
+		case DT_MSG_RESPONSE_TIME_SEC:
+			msg->response_time.tv_sec = f.value;
+			msg->has_response_time = true;
+			break;
+		case DT_MSG_RESPONSE_TIME_NSEC:
+			msg->response_time.tv_nsec = f.value;
+			break;
+		case DT_MSG_RESPONSE_MESSAGE:
+			msg->response_message = f.data;
+			msg->response_message_len = f.len;
+			break;
+		default:
+			break; /* Unknown or unused field. */
+		}
+	}
+
+	return has_type ? KNOT_EOK : KNOT_EMALF;
+}
+
+int dt_decode_message(const uint8_t *frame, size_t len, dt_message_t *msg)
+{
+	if (frame == NULL || msg == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	memset(msg, 0, sizeof(*msg));
+
+	struct rbuf r = { frame, frame + len };
+	const uint8_t *message = NULL;
+	size_t message_len = 0;
+	uint64_t type = 0;
+
+	while (r.pos < r.end) {
+		struct field f = { 0 };
+		int ret = get_field(&r, &f);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+
+		if (f.number == DT_DNSTAP_MESSAGE && f.wire_type == DT_WT_BYTES) {
+			message = f.data;
+			message_len = f.len;
+		} else if (f.number == DT_DNSTAP_TYPE && f.wire_type == DT_WT_VARINT) {
+			type = f.value;
+		}
+	}
+
+	if (type != DNSTAP__DNSTAP__TYPE__MESSAGE || message == NULL) {
+		return KNOT_ENOENT;
+	}
+
+	return decode_message(message, message_len, msg);
+}
@@ -0,0 +1,71 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ * \file decoder.h
+ *
+ * \brief Direct dnstap message decoder.
+ *
+ * Parses a serialized Dnstap envelope in place, the decoded message points
+ * into the frame, so nothing is allocated and the frame must outlive it.
+ *
+ * \addtogroup dnstap
+ * @{
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "dnstap/dnstap.pb-c.h"
+
+/*! \brief Decoded dnstap Message. */
+typedef struct {
+	Dnstap__Message__Type type;
+	int socket_family;              /*!< AF_INET, AF_INET6 or 0 if not set. */
+	int socket_protocol;            /*!< IPPROTO_UDP, IPPROTO_TCP or 0. */
+	const uint8_t *query_address;
+	size_t query_address_len;
+	const uint8_t *response_address;
+	size_t response_address_len;
+	uint16_t query_port;
+	uint16_t response_port;
+	bool has_query_time;
+	struct timespec query_time;
+	bool has_response_time;
+	struct timespec response_time;
+	const uint8_t *query_message;
+	size_t query_message_len;
+	const uint8_t *response_message;
+	size_t response_message_len;
+} dt_message_t;
+
+/*!
+ * \brief Decode a Dnstap frame carrying a Message.
+ *
+ * \param frame  Serialized Dnstap envelope.
+ * \param len    Frame length.
+ * \param msg    Decoded message.
+ *
+ * \retval KNOT_EOK
+ * \retval KNOT_EMALF if the frame is malformed.
+ * \retval KNOT_ENOENT if the frame doesn't contain a Message.
+ */
+int dt_decode_message(const uint8_t *frame, size_t len, dt_message_t *msg);
+
+/*! @} */
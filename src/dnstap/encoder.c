@@ -0,0 +1,185 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <netinet/in.h>
+#include <string.h>
+
+#include "libknot/errcode.h"
+#include "dnstap/convert.h"
+#include "dnstap/encoder.h"
+#include "dnstap/wire.h"
+
+/*!
+ * \brief Output cursor.
+ *
+ * With NULL position, only the length is counted, so that the same code
+ * computes the size of the nested message and writes it.
+ */
+struct wbuf {
+	uint8_t *pos;
+	size_t len;
+};
+
+static void put_raw(struct wbuf *w, const void *data, size_t len)
+{
+	if (w->pos != NULL) {
+		memcpy(w->pos, data, len);
+		w->pos += len;
+	}
+	w->len += len;
+}
+
+static void put_varint(struct wbuf *w, uint64_t value)
+{
+	uint8_t buf[10];
+	size_t len = 0;
+	while (value >= 0x80) {
+		buf[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	buf[len++] = value;
+	put_raw(w, buf, len);
+}
+
+static void put_tag(struct wbuf *w, unsigned field, unsigned wire_type)
+{
+	put_varint(w, (field << 3) | wire_type);
+}
+
+static void put_uint(struct wbuf *w, unsigned field, uint64_t value)
+{
+	put_tag(w, field, DT_WT_VARINT);
+	put_varint(w, value);
+}
+
+static void put_fixed32(struct wbuf *w, unsigned field, uint32_t value)
+{
+	uint8_t buf[4] = { value, value >> 8, value >> 16, value >> 24 };
+	put_tag(w, field, DT_WT_FIXED32);
+	put_raw(w, buf, sizeof(buf));
+}
+
+static void put_bytes(struct wbuf *w, unsigned field, const void *data, size_t len)
+{
+	put_tag(w, field, DT_WT_BYTES);
+	put_varint(w, len);
+	put_raw(w, data, len);
+}
+
+static void put_address(struct wbuf *w, unsigned addr_field, unsigned port_field,
+                        const struct sockaddr *sa, bool addr)
+{
+	if (sa == NULL) {
+		return;
+	}
+
+	if (sa->sa_family == AF_INET) {
+		const struct sockaddr_in *sai = (const struct sockaddr_in *)sa;
+		if (addr) {
+			put_bytes(w, addr_field, &sai->sin_addr, sizeof(sai->sin_addr));
+		} else {
+			put_uint(w, port_field, ntohs(sai->sin_port));
+		}
+	} else if (sa->sa_family == AF_INET6) {
+		const struct sockaddr_in6 *sai6 = (const struct sockaddr_in6 *)sa;
+		if (addr) {
+			put_bytes(w, addr_field, &sai6->sin6_addr, sizeof(sai6->sin6_addr));
+		} else {
+			put_uint(w, port_field, ntohs(sai6->sin6_port));
+		}
+	}
+}
+
+/*! \brief Encode the Message, fields in the order of their numbers. */
+static void put_message(struct wbuf *w, Dnstap__Message__Type type,
+                        const struct sockaddr *query_sa,
+                        const struct sockaddr *response_sa,
+                        int protocol, const uint8_t *wire, size_t len_wire,
+                        const struct timespec *qtime,
+                        const struct timespec *rtime)
+{
+	put_uint(w, DT_MSG_TYPE, type);
+
+	const struct sockaddr *source = query_sa ? query_sa : response_sa;
+	if (source != NULL) {
+		int family = dt_family_encode(source->sa_family);
+		if (family != 0) {
+			put_uint(w, DT_MSG_SOCKET_FAMILY, family);
+		}
+	}
+	int dt_protocol = dt_protocol_encode(protocol);
+	if (dt_protocol != 0) {
+		put_uint(w, DT_MSG_SOCKET_PROTOCOL, dt_protocol);
+	}
+
+	put_address(w, DT_MSG_QUERY_ADDRESS, DT_MSG_QUERY_PORT, query_sa, true);
+	put_address(w, DT_MSG_RESPONSE_ADDRESS, DT_MSG_RESPONSE_PORT, response_sa, true);
+	put_address(w, DT_MSG_QUERY_ADDRESS, DT_MSG_QUERY_PORT, query_sa, false);
+	put_address(w, DT_MSG_RESPONSE_ADDRESS, DT_MSG_RESPONSE_PORT, response_sa, false);
+
+	if (qtime != NULL) {
+		put_uint(w, DT_MSG_QUERY_TIME_SEC, qtime->tv_sec);
+		put_fixed32(w, DT_MSG_QUERY_TIME_NSEC, qtime->tv_nsec);
+	}
+	if (dt_message_type_is_query(type)) {
+		put_bytes(w, DT_MSG_QUERY_MESSAGE, wire, len_wire);
+	}
+	if (rtime != NULL) {
+		put_uint(w, DT_MSG_RESPONSE_TIME_SEC, rtime->tv_sec);
+		put_fixed32(w, DT_MSG_RESPONSE_TIME_NSEC, rtime->tv_nsec);
+	}
+	if (dt_message_type_is_response(type)) {
+		put_bytes(w, DT_MSG_RESPONSE_MESSAGE, wire, len_wire);
+	}
+}
+
+int dt_encode_message(uint8_t *buf, size_t maxlen,
+                      Dnstap__Message__Type type,
+                      const struct sockaddr *query_sa,
+                      const struct sockaddr *response_sa,
+                      int protocol,
+                      const uint8_t *wire, size_t len_wire,
+                      const struct timespec *qtime,
+                      const struct timespec *rtime)
+{
+	if (buf == NULL || (wire == NULL && len_wire > 0)) {
+		return KNOT_EINVAL;
+	}
+
+	/* Size the nested message first. */
+	struct wbuf w = { NULL, 0 };
+	put_message(&w, type, query_sa, response_sa, protocol, wire, len_wire,
+	            qtime, rtime);
+	size_t msg_len = w.len;
+
+	/* Size the envelope. */
+	put_tag(&w, DT_DNSTAP_MESSAGE, DT_WT_BYTES);
+	put_varint(&w, msg_len);
+	put_uint(&w, DT_DNSTAP_TYPE, DNSTAP__DNSTAP__TYPE__MESSAGE);
+	if (w.len > maxlen || w.len > INT32_MAX) {
+		return KNOT_ESPACE;
+	}
+
+	w.pos = buf;
+	w.len = 0;
+	put_tag(&w, DT_DNSTAP_MESSAGE, DT_WT_BYTES);
+	put_varint(&w, msg_len);
+	put_message(&w, type, query_sa, response_sa, protocol, wire, len_wire,
+	            qtime, rtime);
+	put_uint(&w, DT_DNSTAP_TYPE, DNSTAP__DNSTAP__TYPE__MESSAGE);
+
+	return w.len;
+}
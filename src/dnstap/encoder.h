@@ -0,0 +1,66 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ * \file encoder.h
+ *
+ * \brief Direct dnstap message encoder.
+ *
+ * Serializes a dnstap Message wrapped in the Dnstap envelope directly into
+ * a caller supplied buffer, without building the protobuf-c structures.
+ * The output is identical to packing a structure filled by dt_message_fill().
+ *
+ * \addtogroup dnstap
+ * @{
+ */
+
+#pragma once
+
+#include <sys/socket.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "dnstap/dnstap.pb-c.h"
+
+/*! \brief Upper bound of the encoded size without the DNS message. */
+#define DT_ENCODE_OVERHEAD 128
+
+/*!
+ * \brief Encode a dnstap message into the buffer.
+ *
+ * \param buf          Output buffer.
+ * \param maxlen       Output buffer size.
+ * \param type         One of the DNSTAP__MESSAGE__TYPE__* values.
+ * \param query_sa     Query address (sockaddr_in or sockaddr_in6), may be NULL.
+ * \param response_sa  Response address, may be NULL.
+ * \param protocol     \c IPPROTO_UDP or \c IPPROTO_TCP.
+ * \param wire         Wire-format query or response (depending on 'type').
+ * \param len_wire     Length of 'wire'.
+ * \param qtime        Query time, may be NULL.
+ * \param rtime        Response time, may be NULL.
+ *
+ * \return Encoded size, KNOT_EINVAL or KNOT_ESPACE.
+ */
+int dt_encode_message(uint8_t *buf, size_t maxlen,
+                      Dnstap__Message__Type type,
+                      const struct sockaddr *query_sa,
+                      const struct sockaddr *response_sa,
+                      int protocol,
+                      const uint8_t *wire, size_t len_wire,
+                      const struct timespec *qtime,
+                      const struct timespec *rtime);
+
+/*! @} */
@@ -0,0 +1,188 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libknot/errcode.h"
+#include "libknot/internal/utils.h"
+#include "dnstap/dnstap.h"
+#include "dnstap/mmap_reader.h"
+
+/*! \brief Frame Streams control frame types and fields. */
+enum {
+	FSTRM_CONTROL_START        = 0x02,
+	FSTRM_CONTROL_STOP         = 0x03,
+	FSTRM_FIELD_CONTENT_TYPE   = 0x01,
+	FSTRM_CONTROL_LENGTH_MAX   = 512
+};
+
+/*! \brief Check the content type in the START control frame. */
+static int parse_start(dt_mmap_reader_t *reader)
+{
+	const uint8_t *data = reader->data;
+	if (reader->size < 12 || wire_read_u32(data) != 0) {
+		return KNOT_EMALF;
+	}
+
+	uint32_t len = wire_read_u32(data + 4);
+	if (len < 4 || len > FSTRM_CONTROL_LENGTH_MAX || 8 + len > reader->size ||
+	    wire_read_u32(data + 8) != FSTRM_CONTROL_START) {
+		return KNOT_EMALF;
+	}
+
+	/* Without content type fields, any content is accepted. */
+	bool content_types = false;
+	const uint8_t *pos = data + 12;
+	const uint8_t *end = data + 8 + len;
+	while (end - pos >= 8) {
+		uint32_t field = wire_read_u32(pos);
+		uint32_t field_len = wire_read_u32(pos + 4);
+		pos += 8;
+		if (field_len > end - pos) {
+			return KNOT_EMALF;
+		}
+		if (field == FSTRM_FIELD_CONTENT_TYPE) {
+			if (field_len == strlen(DNSTAP_CONTENT_TYPE) &&
+			    memcmp(pos, DNSTAP_CONTENT_TYPE, field_len) == 0) {
+				content_types = false;
+				break;
+			}
+			content_types = true;
+		}
+		pos += field_len;
+	}
+	if (content_types) {
+		return KNOT_EMALF;
+	}
+
+	reader->first = 8 + len;
+	reader->pos = reader->first;
+
+	return KNOT_EOK;
+}
+
+int dt_mmap_reader_open(dt_mmap_reader_t *reader, const char *file_path)
+{
+	if (reader == NULL || file_path == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	memset(reader, 0, sizeof(*reader));
+
+	int fd = open(file_path, O_RDONLY);
+	if (fd < 0) {
+		return knot_map_errno(errno);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		int ret = knot_map_errno(errno);
+		close(fd);
+		return ret;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return KNOT_EMALF;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		int ret = knot_map_errno(errno);
+		close(fd);
+		return ret;
+	}
+	close(fd);
+
+	/* Frames are read once from the start to the end. */
+	(void)madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	reader->data = data;
+	reader->size = st.st_size;
+
+	int ret = parse_start(reader);
+	if (ret != KNOT_EOK) {
+		dt_mmap_reader_close(reader);
+	}
+
+	return ret;
+}
+
+void dt_mmap_reader_close(dt_mmap_reader_t *reader)
+{
+	if (reader == NULL || reader->data == NULL) {
+		return;
+	}
+
+	munmap(reader->data, reader->size);
+	memset(reader, 0, sizeof(*reader));
+}
+
+int dt_mmap_reader_next(dt_mmap_reader_t *reader, const uint8_t **frame, size_t *len)
+{
+	if (reader == NULL || frame == NULL || len == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	while (reader->pos < reader->size) {
+		const uint8_t *pos = reader->data + reader->pos;
+		size_t left = reader->size - reader->pos;
+		if (left < 4) {
+			return KNOT_EMALF;
+		}
+
+		/* Data frame. */
+		uint32_t frame_len = wire_read_u32(pos);
+		if (frame_len > 0) {
+			if (frame_len > left - 4) {
+				return KNOT_EMALF;
+			}
+			*frame = pos + 4;
+			*len = frame_len;
+			reader->pos += 4 + frame_len;
+			return KNOT_EOK;
+		}
+
+		/* Control frame, only STOP is of interest. */
+		if (left < 12) {
+			return KNOT_EMALF;
+		}
+		uint32_t control_len = wire_read_u32(pos + 4);
+		if (control_len < 4 || control_len > left - 8) {
+			return KNOT_EMALF;
+		}
+		if (wire_read_u32(pos + 8) == FSTRM_CONTROL_STOP) {
+			reader->pos = reader->size;
+			break;
+		}
+		reader->pos += 8 + control_len;
+	}
+
+	/* Missing STOP frame is tolerated, the writer may have been killed. */
+	return KNOT_EOF;
+}
+
+void dt_mmap_reader_rewind(dt_mmap_reader_t *reader)
+{
+	if (reader != NULL) {
+		reader->pos = reader->first;
+	}
+}
@@ -0,0 +1,77 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ * \file mmap_reader.h
+ *
+ * \brief Memory-mapped dnstap file reader.
+ *
+ * Iterates over the data frames of a Frame Streams file mapped into memory,
+ * without copying the frames. Intended for bulk processing of captures
+ * together with dt_decode_message().
+ *
+ * \addtogroup dnstap
+ * @{
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*! \brief Memory-mapped dnstap file. */
+typedef struct {
+	uint8_t *data;       /*!< Mapped file. */
+	size_t size;         /*!< File size. */
+	size_t first;        /*!< Offset of the first data frame. */
+	size_t pos;          /*!< Offset of the next frame. */
+} dt_mmap_reader_t;
+
+/*!
+ * \brief Map the file and check its content type.
+ *
+ * \param reader     Reader to initialize.
+ * \param file_path  Frame Streams file with dnstap content.
+ *
+ * \retval KNOT_EOK
+ * \retval KNOT_EMALF if the file is not a dnstap capture.
+ * \retval KNOT_E* if the file can't be mapped.
+ */
+int dt_mmap_reader_open(dt_mmap_reader_t *reader, const char *file_path);
+
+/*!
+ * \brief Unmap the file.
+ */
+void dt_mmap_reader_close(dt_mmap_reader_t *reader);
+
+/*!
+ * \brief Get the next data frame.
+ *
+ * \param reader  Reader.
+ * \param frame   Frame pointing into the mapped file.
+ * \param len     Frame length.
+ *
+ * \retval KNOT_EOK
+ * \retval KNOT_EOF at the end of the stream.
+ * \retval KNOT_EMALF if the file is truncated or malformed.
+ */
+int dt_mmap_reader_next(dt_mmap_reader_t *reader, const uint8_t **frame, size_t *len);
+
+/*!
+ * \brief Restart reading from the first frame.
+ */
+void dt_mmap_reader_rewind(dt_mmap_reader_t *reader);
+
+/*! @} */
@@ -0,0 +1,59 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ * \file wire.h
+ *
+ * \brief Protobuf wire format of the dnstap messages, see dnstap.proto.
+ *
+ * \addtogroup dnstap
+ * @{
+ */
+
+#pragma once
+
+/*! \brief Protobuf wire types. */
+enum {
+	DT_WT_VARINT  = 0,
+	DT_WT_FIXED64 = 1,
+	DT_WT_BYTES   = 2,
+	DT_WT_FIXED32 = 5
+};
+
+/*! \brief Field numbers of the Message. */
+enum {
+	DT_MSG_TYPE               = 1,
+	DT_MSG_SOCKET_FAMILY      = 2,
+	DT_MSG_SOCKET_PROTOCOL    = 3,
+	DT_MSG_QUERY_ADDRESS      = 4,
+	DT_MSG_RESPONSE_ADDRESS   = 5,
+	DT_MSG_QUERY_PORT         = 6,
+	DT_MSG_RESPONSE_PORT      = 7,
+	DT_MSG_QUERY_TIME_SEC     = 8,
+	DT_MSG_QUERY_TIME_NSEC    = 9,
+	DT_MSG_QUERY_MESSAGE      = 10,
+	DT_MSG_QUERY_ZONE         = 11,
+	DT_MSG_RESPONSE_TIME_SEC  = 12,
+	DT_MSG_RESPONSE_TIME_NSEC = 13,
+	DT_MSG_RESPONSE_MESSAGE   = 14
+};
+
+/*! \brief Field numbers of the Dnstap envelope. */
+enum {
+	DT_DNSTAP_MESSAGE = 14,
+	DT_DNSTAP_TYPE    = 15
+};
+
+/*! @} */
@@ -0,0 +1,226 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libknot/errcode.h"
+#include "knot/common/conn_pool.h"
+
+/*! \brief Idle connection. */
+struct conn {
+	struct sockaddr_storage src;
+	struct sockaddr_storage dst;
+	time_t since;  /*!< Parked at. */
+	int fd;        /*!< Socket, -1 if the slot is free. */
+};
+
+/*! \brief Global connection pool state. */
+static struct {
+	pthread_mutex_t lock;
+	bool enabled;
+	unsigned idle;
+	uint64_t reused;
+	uint64_t parked;
+	uint64_t expired;
+	struct conn conns[CONN_POOL_CAPACITY];
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*! \brief Check that the remote hasn't closed the connection or sent data. */
+static bool conn_alive(int fd)
+{
+	uint8_t byte = 0;
+	ssize_t ret = recv(fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+	return ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+/*! \brief Remove connection from its slot, return the socket. */
+static int conn_take(struct conn *conn)
+{
+	int fd = conn->fd;
+	conn->fd = -1;
+	pool.idle -= 1;
+	return fd;
+}
+
+int conn_pool_init(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	if (!pool.enabled) {
+		for (int i = 0; i < CONN_POOL_CAPACITY; ++i) {
+			pool.conns[i].fd = -1;
+		}
+		pool.idle = 0;
+		pool.enabled = true;
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return KNOT_EOK;
+}
+
+void conn_pool_deinit(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	if (pool.enabled) {
+		for (int i = 0; i < CONN_POOL_CAPACITY; ++i) {
+			if (pool.conns[i].fd >= 0) {
+				close(conn_take(&pool.conns[i]));
+			}
+		}
+		pool.enabled = false;
+	}
+	pthread_mutex_unlock(&pool.lock);
+}
+
+int conn_pool_get(const struct sockaddr_storage *src,
+                  const struct sockaddr_storage *dst)
+{
+	if (src == NULL || dst == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&pool.lock);
+
+		/* The most recently parked connection is the least likely closed. */
+		struct conn *found = NULL;
+		for (int i = 0; pool.enabled && i < CONN_POOL_CAPACITY; ++i) {
+			struct conn *conn = &pool.conns[i];
+			if (conn->fd >= 0 && (found == NULL || conn->since > found->since) &&
+			    sockaddr_cmp(&conn->dst, dst) == 0 &&
+			    sockaddr_cmp(&conn->src, src) == 0) {
+				found = conn;
+			}
+		}
+
+		if (found == NULL) {
+			pthread_mutex_unlock(&pool.lock);
+			return KNOT_ENOENT;
+		}
+
+		int fd = conn_take(found);
+		pthread_mutex_unlock(&pool.lock);
+
+		bool alive = conn_alive(fd);
+
+		pthread_mutex_lock(&pool.lock);
+		if (alive) {
+			pool.reused += 1;
+		} else {
+			pool.expired += 1;
+		}
+		pthread_mutex_unlock(&pool.lock);
+
+		if (alive) {
+			return fd;
+		}
+
+		close(fd);
+	}
+}
+
+void conn_pool_put(const struct sockaddr_storage *src,
+                   const struct sockaddr_storage *dst, int fd)
+{
+	if (fd < 0) {
+		return;
+	}
+
+	if (src == NULL || dst == NULL) {
+		close(fd);
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+
+	if (!pool.enabled) {
+		pthread_mutex_unlock(&pool.lock);
+		close(fd);
+		return;
+	}
+
+	/* Take a free slot or evict the oldest connection. */
+	struct conn *slot = &pool.conns[0];
+	for (int i = 0; i < CONN_POOL_CAPACITY; ++i) {
+		struct conn *conn = &pool.conns[i];
+		if (conn->fd < 0) {
+			slot = conn;
+			break;
+		}
+		if (conn->since < slot->since) {
+			slot = conn;
+		}
+	}
+
+	int evicted = -1;
+	if (slot->fd >= 0) {
+		evicted = conn_take(slot);
+		pool.expired += 1;
+	}
+
+	memcpy(&slot->src, src, sizeof(struct sockaddr_storage));
+	memcpy(&slot->dst, dst, sizeof(struct sockaddr_storage));
+	slot->since = time(NULL);
+	slot->fd = fd;
+	pool.idle += 1;
+	pool.parked += 1;
+
+	pthread_mutex_unlock(&pool.lock);
+
+	if (evicted >= 0) {
+		close(evicted);
+	}
+}
+
+void conn_pool_expire(void)
+{
+	int expired[CONN_POOL_CAPACITY];
+	int count = 0;
+	time_t oldest = time(NULL) - CONN_POOL_TIMEOUT;
+
+	pthread_mutex_lock(&pool.lock);
+	for (int i = 0; pool.enabled && i < CONN_POOL_CAPACITY; ++i) {
+		struct conn *conn = &pool.conns[i];
+		if (conn->fd >= 0 && conn->since <= oldest) {
+			expired[count++] = conn_take(conn);
+		}
+	}
+	pool.expired += count;
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < count; ++i) {
+		close(expired[i]);
+	}
+}
+
+void conn_pool_stats(conn_pool_stats_t *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	stats->idle = pool.idle;
+	stats->reused = pool.reused;
+	stats->parked = pool.parked;
+	stats->expired = pool.expired;
+	pthread_mutex_unlock(&pool.lock);
+}
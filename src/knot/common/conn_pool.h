@@ -0,0 +1,98 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*!
+ * \file conn_pool.h
+ *
+ * \brief Pool of idle outgoing TCP connections.
+ *
+ * Connections to masters left open after a finished SOA query or zone
+ * transfer are parked in the pool and picked up by the next request with
+ * the same endpoints, saving a TCP handshake per request. Idle connections
+ * are closed after CONN_POOL_TIMEOUT, the oldest one is closed when the
+ * pool is full.
+ *
+ * \addtogroup server
+ * @{
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "libknot/internal/sockaddr.h"
+
+/*! \brief Maximum number of idle connections. */
+#define CONN_POOL_CAPACITY 64
+/*! \brief Idle connection timeout, shorter than usual server timeouts [s]. */
+#define CONN_POOL_TIMEOUT 5
+
+/*! \brief Connection pool statistics. */
+typedef struct conn_pool_stats {
+	unsigned idle;     /*!< Idle connections in the pool. */
+	uint64_t reused;   /*!< Total connections taken from the pool. */
+	uint64_t parked;   /*!< Total connections put into the pool. */
+	uint64_t expired;  /*!< Total connections closed while idle. */
+} conn_pool_stats_t;
+
+/*!
+ * \brief Initialize the pool.
+ *
+ * \return KNOT_EOK or error
+ */
+int conn_pool_init(void);
+
+/*!
+ * \brief Close all idle connections and disable the pool.
+ */
+void conn_pool_deinit(void);
+
+/*!
+ * \brief Take an idle connection with given endpoints.
+ *
+ * Connections closed by the remote in the meantime are discarded.
+ *
+ * \param src  Source address (unspecified family for any).
+ * \param dst  Remote address.
+ *
+ * \return Connected socket or KNOT_ENOENT.
+ */
+int conn_pool_get(const struct sockaddr_storage *src,
+                  const struct sockaddr_storage *dst);
+
+/*!
+ * \brief Park an idle connection for reuse.
+ *
+ * \note The pool takes over the socket, it is closed if the pool is full
+ *       or not initialized.
+ *
+ * \param src  Source address (unspecified family for any).
+ * \param dst  Remote address.
+ * \param fd   Connected socket with no pending data.
+ */
+void conn_pool_put(const struct sockaddr_storage *src,
+                   const struct sockaddr_storage *dst, int fd);
+
+/*!
+ * \brief Close connections idle longer than CONN_POOL_TIMEOUT.
+ */
+void conn_pool_expire(void);
+
+/*!
+ * \brief Get connection pool statistics.
+ */
+void conn_pool_stats(conn_pool_stats_t *stats);
+
+/*! @} */
@@ -18,46 +18,302 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #include "libknot/errcode.h"
 #include "knot/common/evsched.h"
 
-/*! \brief Some implementations of timercmp >= are broken, this is for compat.*/
-static inline int timercmp_ge(struct timeval *a, struct timeval *b) {
-	return timercmp(a, b, >) || timercmp(a, b, ==);
+/*! \brief Number of time bits covered by one timer wheel level. */
+#define WHEEL_BITS 8
+#define WHEEL_MASK (EVSCHED_SLOTS - 1)
+
+/*! \brief Event level if the event is not scheduled. */
+#define EVENT_IDLE (-1)
+/*! \brief Event level if the event is in the expired list. */
+#define EVENT_EXPIRED EVSCHED_LEVELS
+/*! \brief Event level if the event is beyond the top level range. */
+#define EVENT_OVERFLOW (EVSCHED_LEVELS + 1)
+/*! \brief Number of time bits covered by all levels. */
+#define WHEEL_RANGE_BITS (WHEEL_BITS * EVSCHED_LEVELS)
+
+/*! \brief Current monotonic time in milliseconds. */
+static uint64_t time_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*! \brief Return timer wheel of the event. */
+static struct evsched_wheel *event_wheel(const event_t *ev)
+{
+	return &ev->sched->wheels[((uintptr_t)ev >> 4) % EVSCHED_SHARDS];
+}
+
+void evsched_wheel_init(struct evsched_wheel *w, uint64_t now)
+{
+	pthread_mutex_init(&w->lock, NULL);
+	w->now = now;
+	for (int level = 0; level < EVSCHED_LEVELS; ++level) {
+		for (int slot = 0; slot < EVSCHED_SLOTS; ++slot) {
+			init_list(&w->slots[level][slot]);
+		}
+	}
+	init_list(&w->expired);
+	init_list(&w->overflow);
 }
 
-static int compare_event_heap_nodes(event_t *e1, event_t *e2)
+static void wheel_free_list(list_t *list)
 {
-	if (timercmp(&e1->tv, &e2->tv, <)) return -1;
-	if (timercmp(&e1->tv, &e2->tv, >)) return 1;
-	return 0;
+	while (!EMPTY_LIST(*list)) {
+		event_t *ev = HEAD(*list);
+		rem_node(&ev->n);
+		evsched_event_free(ev);
+	}
+}
+
+void evsched_wheel_deinit(struct evsched_wheel *w)
+{
+	for (int level = 0; level < EVSCHED_LEVELS; ++level) {
+		for (int slot = 0; slot < EVSCHED_SLOTS; ++slot) {
+			wheel_free_list(&w->slots[level][slot]);
+		}
+	}
+	wheel_free_list(&w->expired);
+	wheel_free_list(&w->overflow);
+	pthread_mutex_destroy(&w->lock);
 }
 
 /*!
- * \brief Set event timer to T (now) + dt miliseconds.
+ * \brief Insert event into the wheel.
+ *
+ * The event is put into the lowest level, where the higher bits of its time
+ * equal to the current wheel time. Expired events go to the expired list,
+ * events beyond the top level range to the overflow list.
  */
-static void evsched_settimer(event_t *e, uint32_t dt)
+void evsched_wheel_insert(struct evsched_wheel *w, event_t *ev)
+{
+	if (ev->time <= w->now) {
+		add_tail(&w->expired, &ev->n);
+		ev->level = EVENT_EXPIRED;
+		return;
+	}
+
+	/* Out of range, reinserted when the top level wraps. */
+	if ((ev->time >> WHEEL_RANGE_BITS) != (w->now >> WHEEL_RANGE_BITS)) {
+		add_tail(&w->overflow, &ev->n);
+		ev->level = EVENT_OVERFLOW;
+		return;
+	}
+
+	int level = 0;
+	while (level < EVSCHED_LEVELS - 1 &&
+	       (ev->time >> (WHEEL_BITS * (level + 1))) !=
+	       (w->now >> (WHEEL_BITS * (level + 1)))) {
+		level += 1;
+	}
+
+	unsigned slot = (ev->time >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	add_tail(&w->slots[level][slot], &ev->n);
+	ev->level = level;
+	w->count[level] += 1;
+}
+
+/*! \brief Remove event from the wheel, return true if it was scheduled. */
+bool evsched_wheel_remove(struct evsched_wheel *w, event_t *ev)
+{
+	if (ev->level == EVENT_IDLE) {
+		return false;
+	}
+
+	rem_node(&ev->n);
+	if (ev->level < EVSCHED_LEVELS) {
+		w->count[ev->level] -= 1;
+	}
+	ev->level = EVENT_IDLE;
+
+	return true;
+}
+
+/*! \brief Reinsert events from the current slot of given level. */
+static void wheel_cascade(struct evsched_wheel *w, int level)
+{
+	list_t *list = &w->slots[level][(w->now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	while (!EMPTY_LIST(*list)) {
+		event_t *ev = HEAD(*list);
+		evsched_wheel_remove(w, ev);
+		evsched_wheel_insert(w, ev);
+	}
+}
+
+/*! \brief Reinsert overflown events, some may stay out of range. */
+static void wheel_cascade_overflow(struct evsched_wheel *w)
 {
-	if (!e) {
+	if (EMPTY_LIST(w->overflow)) {
 		return;
 	}
 
-	/* Get absolute time T. */
-	gettimeofday(&e->tv, 0);
+	list_t list;
+	init_list(&list);
+	add_tail_list(&list, &w->overflow);
+	init_list(&w->overflow);
+
+	while (!EMPTY_LIST(list)) {
+		event_t *ev = HEAD(list);
+		rem_node(&ev->n);
+		ev->level = EVENT_IDLE;
+		evsched_wheel_insert(w, ev);
+	}
+}
+
+/*! \brief Advance wheel time by one millisecond. */
+static void wheel_tick(struct evsched_wheel *w)
+{
+	w->now += 1;
+
+	if ((w->now & ((1ULL << WHEEL_RANGE_BITS) - 1)) == 0) {
+		wheel_cascade_overflow(w);
+	}
+
+	for (int level = EVSCHED_LEVELS - 1; level > 0; --level) {
+		uint64_t mask = (1ULL << (WHEEL_BITS * level)) - 1;
+		if ((w->now & mask) == 0) {
+			wheel_cascade(w, level);
+		}
+	}
+
+	/* Level 0 slot contains events scheduled exactly now. */
+	wheel_cascade(w, 0);
+}
+
+/*! \brief Advance wheel time, skip periods without events. */
+void evsched_wheel_advance(struct evsched_wheel *w, uint64_t target)
+{
+	while (w->now < target) {
+		int level = 0;
+		while (level < EVSCHED_LEVELS && w->count[level] == 0) {
+			level += 1;
+		}
+
+		if (level == EVSCHED_LEVELS && EMPTY_LIST(w->overflow)) {
+			w->now = target;
+			break;
+		}
+
+		/* Lower levels are empty, skip to the next cascade of this one
+		 * (or to the wrap of the top level for overflown events). */
+		if (level > 0) {
+			uint64_t last = w->now | ((1ULL << (WHEEL_BITS * level)) - 1);
+			if (last >= target) {
+				w->now = target;
+				break;
+			}
+			w->now = last;
+		}
+
+		wheel_tick(w);
+	}
+}
+
+/*! \brief Return the earliest time the next event may expire. */
+uint64_t evsched_wheel_next(struct evsched_wheel *w)
+{
+	if (!EMPTY_LIST(w->expired)) {
+		return w->now;
+	}
+
+	for (int level = 0; level < EVSCHED_LEVELS; ++level) {
+		if (w->count[level] == 0) {
+			continue;
+		}
+
+		unsigned shift = WHEEL_BITS * level;
+		unsigned current = (w->now >> shift) & WHEEL_MASK;
+		uint64_t base = w->now >> (shift + WHEEL_BITS) << (shift + WHEEL_BITS);
+		for (unsigned slot = current + 1; slot < EVSCHED_SLOTS; ++slot) {
+			if (!EMPTY_LIST(w->slots[level][slot])) {
+				return base | ((uint64_t)slot << shift);
+			}
+		}
+
+		/* Not reached, events of a level are ahead of its current slot. */
+		return base + (1ULL << (shift + WHEEL_BITS));
+	}
+
+	if (!EMPTY_LIST(w->overflow)) {
+		return ((w->now >> WHEEL_RANGE_BITS) + 1) << WHEEL_RANGE_BITS;
+	}
+
+	return UINT64_MAX;
+}
+
+/*! \brief Take an expired event, the scheduler is marked as running. */
+static event_t *take_expired(evsched_t *sched)
+{
+	for (unsigned i = 0; i < EVSCHED_SHARDS; ++i) {
+		unsigned idx = (sched->next_wheel + i) % EVSCHED_SHARDS;
+		struct evsched_wheel *w = &sched->wheels[idx];
+		pthread_mutex_lock(&w->lock);
+		if (!EMPTY_LIST(w->expired)) {
+			event_t *ev = HEAD(w->expired);
+			evsched_wheel_remove(w, ev);
+			(void)__sync_lock_test_and_set(&sched->last_ev, ev);
+			sched->running = true;
+			sched->next_wheel = idx;
+			pthread_mutex_unlock(&w->lock);
+			return ev;
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
 
-	/* Add number of seconds. */
-	e->tv.tv_sec += dt / 1000;
+	return NULL;
+}
 
-	/* Add the number of microseconds. */
-	e->tv.tv_usec += (dt % 1000) * 1000;
+/*!
+ * \brief Advance all wheels to current time and sleep if nothing expired.
+ */
+static void wait_expired(evsched_t *sched)
+{
+	pthread_mutex_lock(&sched->wait_lock);
+
+	/* Any event scheduled from now on wakes the scheduler. */
+	__sync_lock_test_and_set(&sched->wakeup, UINT64_MAX);
+	__sync_synchronize();
+
+	uint64_t now = time_now();
+	uint64_t next = UINT64_MAX;
+	for (unsigned i = 0; i < EVSCHED_SHARDS; ++i) {
+		struct evsched_wheel *w = &sched->wheels[i];
+		pthread_mutex_lock(&w->lock);
+		evsched_wheel_advance(w, now);
+		uint64_t wheel_next_time = evsched_wheel_next(w);
+		pthread_mutex_unlock(&w->lock);
+		if (wheel_next_time < next) {
+			next = wheel_next_time;
+		}
+	}
 
-	/* Check for overflow. */
-	while (e->tv.tv_usec > 999999) {
-		e->tv.tv_sec += 1;
-		e->tv.tv_usec -= 1 * 1000 * 1000;
+	if (next > now) {
+		__sync_lock_test_and_set(&sched->wakeup, next);
+		if (next == UINT64_MAX) {
+			pthread_cond_wait(&sched->notify, &sched->wait_lock);
+		} else {
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			uint64_t abs_usec = (uint64_t)tv.tv_usec + (next - now) * 1000;
+			struct timespec ts = {
+				.tv_sec = tv.tv_sec + abs_usec / 1000000,
+				.tv_nsec = (abs_usec % 1000000) * 1000
+			};
+			pthread_cond_timedwait(&sched->notify, &sched->wait_lock, &ts);
+		}
 	}
+
+	/* Awake, the wheels are checked before sleeping again. */
+	__sync_lock_test_and_set(&sched->wakeup, 0);
+
+	pthread_mutex_unlock(&sched->wait_lock);
 }
 
 int evsched_init(evsched_t *sched, void *ctx)
@@ -66,33 +322,39 @@ int evsched_init(evsched_t *sched, void *ctx)
 	sched->ctx = ctx;
 
 	/* Initialize event calendar. */
+	sched->wheels = malloc(EVSCHED_SHARDS * sizeof(struct evsched_wheel));
+	if (sched->wheels == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	uint64_t now = time_now();
+	for (unsigned i = 0; i < EVSCHED_SHARDS; ++i) {
+		evsched_wheel_init(&sched->wheels[i], now);
+	}
+
 	pthread_mutex_init(&sched->run_lock, 0);
-	pthread_mutex_init(&sched->heap_lock, 0);
+	pthread_mutex_init(&sched->wait_lock, 0);
 	pthread_cond_init(&sched->notify, 0);
-	heap_init(&sched->heap, compare_event_heap_nodes, 0);
 
 	return KNOT_EOK;
 }
 
 void evsched_deinit(evsched_t *sched)
 {
-	if (sched == NULL) {
+	if (sched == NULL || sched->wheels == NULL) {
 		return;
 	}
 
 	/* Deinitialize event calendar. */
 	pthread_mutex_destroy(&sched->run_lock);
-	pthread_mutex_destroy(&sched->heap_lock);
+	pthread_mutex_destroy(&sched->wait_lock);
 	pthread_cond_destroy(&sched->notify);
 
-	while (! EMPTY_HEAP(&sched->heap))
-	{
-		event_t *e = *HHEAD(&sched->heap);
-		heap_delmin(&sched->heap);
-		evsched_event_free(e);
+	for (unsigned i = 0; i < EVSCHED_SHARDS; ++i) {
+		evsched_wheel_deinit(&sched->wheels[i]);
 	}
 
-	free(sched->heap.data);
+	free(sched->wheels);
 
 	/* Clear the structure. */
 	memset(sched, 0, sizeof(evsched_t));
@@ -113,6 +375,7 @@ event_t *evsched_event_create(evsched_t *sched, event_cb_t cb, void *data)
 
 	/* Initialize. */
 	memset(e, 0, sizeof(event_t));
+	e->level = EVENT_IDLE;
 	e->sched = sched;
 	e->cb = cb;
 	e->data = data;
@@ -131,29 +394,28 @@ void evsched_event_free(event_t *ev)
 
 int evsched_schedule(event_t *ev, uint32_t dt)
 {
-	if (ev == NULL) {
+	if (ev == NULL || ev->sched == NULL) {
 		return KNOT_EINVAL;
 	}
 
-	/* Update event timer. */
-	evsched_settimer(ev, dt);
-
-	/* Lock calendar. */
 	evsched_t *sched = ev->sched;
-	pthread_mutex_lock(&sched->heap_lock);
-
-	/* Make sure it's not already enqueued. */
-	int found = 0;
-	if ((found = heap_find(&sched->heap, ev))) {
-		heap_delete(&sched->heap, found);
+	struct evsched_wheel *w = event_wheel(ev);
+
+	/* Replace the timer if it's already enqueued. */
+	pthread_mutex_lock(&w->lock);
+	evsched_wheel_remove(w, ev);
+	ev->time = time_now() + dt;
+	evsched_wheel_insert(w, ev);
+	uint64_t time = ev->time;
+	pthread_mutex_unlock(&w->lock);
+
+	/* Wake up the scheduler if it sleeps longer. */
+	if (time < __sync_add_and_fetch(&sched->wakeup, 0)) {
+		pthread_mutex_lock(&sched->wait_lock);
+		pthread_cond_signal(&sched->notify);
+		pthread_mutex_unlock(&sched->wait_lock);
 	}
 
-	heap_insert(&sched->heap, ev);
-
-	/* Unlock calendar. */
-	pthread_cond_broadcast(&sched->notify);
-	pthread_mutex_unlock(&sched->heap_lock);
-
 	return KNOT_EOK;
 }
 
@@ -164,29 +426,27 @@ static int evsched_try_cancel(evsched_t *sched, event_t *ev)
 	if (sched == NULL || ev == NULL) {
 		return KNOT_EINVAL;
 	}
-	
+
 	/* Make sure not running. If an event is starting, we race for this lock
-	 * and either win or lose. If we lose, we may find it in heap because
+	 * and either win or lose. If we lose, we may find it in calendar because
 	 * it rescheduled itself. Either way, it will be marked as last running. */
 	pthread_mutex_lock(&sched->run_lock);
-	
-	/* Lock calendar. */
-	pthread_mutex_lock(&sched->heap_lock);
-	
-	if ((found = heap_find(&sched->heap, ev))) {
-		heap_delete(&sched->heap, found);
-	}
 
-	/* Last running event was (probably) the one we're trying to cancel. */
-	if (sched->last_ev == ev) {
-		sched->last_ev = NULL;   /* Invalidate it. */
+	/* Lock event's wheel. */
+	struct evsched_wheel *w = event_wheel(ev);
+	pthread_mutex_lock(&w->lock);
+
+	found = evsched_wheel_remove(w, ev);
+
+	/* Last running event was (probably) the one we're trying to cancel.
+	 * Other wheels may be locked by the scheduler, invalidate atomically. */
+	if (__sync_bool_compare_and_swap(&sched->last_ev, ev, NULL)) {
 		found = KNOT_EAGAIN; /* Let's try again if it didn't reschedule itself. */
 	}
 
-	/* Unlock calendar. */
-	pthread_cond_broadcast(&sched->notify);
-	pthread_mutex_unlock(&sched->heap_lock);
-	
+	/* Unlock wheel. */
+	pthread_mutex_unlock(&w->lock);
+
 	/* Enable running events. */
 	pthread_mutex_unlock(&sched->run_lock);
 
@@ -212,7 +472,7 @@ int evsched_cancel(event_t *ev)
 	}
 
 	/* Reset event timer. */
-	memset(&ev->tv, 0, sizeof(struct timeval));
+	ev->time = 0;
 	/* Now we're sure event is canceled or finished. */
 	return KNOT_EOK;
 }
@@ -224,46 +484,19 @@ event_t* evsched_begin_process(evsched_t *sched)
 		return NULL;
 	}
 
-	/* Lock calendar. */
-	pthread_mutex_lock(&sched->heap_lock);
-
 	while(1) {
-
-		/* Check event heap. */
-		if (!EMPTY_HEAP(&sched->heap)) {
-
-			/* Get current time. */
-			struct timeval dt;
-			gettimeofday(&dt, 0);
-
-			/* Get next event. */
-			event_t *next_ev = *((event_t**)HHEAD(&sched->heap));
-			assert(next_ev != NULL);
-
-			/* Immediately return. */
-			if (timercmp_ge(&dt, &next_ev->tv)) {
-				sched->last_ev = next_ev;
-				sched->running = true;
-				heap_delmin(&sched->heap);
-				pthread_mutex_unlock(&sched->heap_lock);
-				pthread_mutex_lock(&sched->run_lock);
-				return next_ev;
-			}
-
-			/* Wait for next event or interrupt. Unlock calendar. */
-			/* FIXME: Blocks this the possibility to add any event earlier? */
-			struct timespec ts;
-			ts.tv_sec = next_ev->tv.tv_sec;
-			ts.tv_nsec = next_ev->tv.tv_usec * 1000L;
-			pthread_cond_timedwait(&sched->notify, &sched->heap_lock, &ts);
-		} else {
-			/* Block until an event is scheduled. Unlock calendar.*/
-			pthread_cond_wait(&sched->notify, &sched->heap_lock);
+		/* Return expired events from the last batch. */
+		event_t *next_ev = take_expired(sched);
+		if (next_ev != NULL) {
+			pthread_mutex_lock(&sched->run_lock);
+			return next_ev;
 		}
+
+		/* Collect next batch or wait for the next event. */
+		wait_expired(sched);
 	}
 
-	/* Unlock heap, this shouldn't happen. */
-	pthread_mutex_unlock(&sched->heap_lock);
+	/* This shouldn't happen. */
 	return NULL;
 }
 
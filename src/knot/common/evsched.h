@@ -30,7 +30,14 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/time.h>
-#include "libknot/internal/heap.h"
+#include "libknot/internal/lists.h"
+
+/*! \brief Number of timer wheel levels. */
+#define EVSCHED_LEVELS 4
+/*! \brief Number of slots in each timer wheel level (8 bits of time). */
+#define EVSCHED_SLOTS 256
+/*! \brief Number of independently locked timer wheels. */
+#define EVSCHED_SHARDS 16
 
 /* Forward decls. */
 struct evsched;
@@ -55,27 +62,64 @@ typedef int (*event_cb_t)(struct event *);
  * \brief Event structure.
  */
 typedef struct event {
-	struct timeval tv; /*!< Event scheduled time. */
+	node_t n;          /*!< Timer wheel slot node. */
+	uint64_t time;     /*!< Event scheduled time (monotonic, milliseconds). */
+	int level;         /*!< Timer wheel level, internal. */
 	void *data;        /*!< Usable data ptr. */
 	event_cb_t cb;     /*!< Event callback. */
 	struct evsched *sched; /*!< Scheduler for this event. */
 } event_t;
 
+/*!
+ * \brief Hierarchical timer wheel.
+ *
+ * Level L slots hold events which differ from the current time in the
+ * L-th byte (and not above), so an event is inserted and removed in O(1)
+ * and moves to the lower level when the wheel reaches its slot. Events
+ * differing above the top level wait in the overflow list until the top
+ * level wraps.
+ */
+struct evsched_wheel {
+	pthread_mutex_t lock;                 /*!< Wheel lock. */
+	uint64_t now;                         /*!< Current wheel time. */
+	unsigned count[EVSCHED_LEVELS];       /*!< Events in each level. */
+	list_t slots[EVSCHED_LEVELS][EVSCHED_SLOTS]; /*!< Event slots. */
+	list_t expired;                       /*!< Expired events. */
+	list_t overflow;                      /*!< Events beyond the top level. */
+};
+
 /*!
  * \brief Event scheduler structure.
  *
- * Events are executed in their scheduled time.
+ * Events are executed in their scheduled time. Events are spread over
+ * several timer wheels by their address, so concurrent scheduling of
+ * different events contends only on one of the wheel locks.
  */
 typedef struct evsched {
 	volatile bool running;     /*!< True if running. */
 	volatile event_t *last_ev; /*!< Last (or current) running event. */
 	pthread_mutex_t run_lock;  /*!< Event running lock. */
-	pthread_mutex_t heap_lock; /*!< Event heap locking. */
-	pthread_cond_t notify;     /*!< Event heap notification. */
-	struct heap heap;          /*!< Event heap. */
+	pthread_mutex_t wait_lock; /*!< Scheduler sleep lock. */
+	pthread_cond_t notify;     /*!< New event notification. */
+	uint64_t wakeup;           /*!< Planned scheduler wake up time. */
+	unsigned next_wheel;       /*!< Next wheel to take expired events from. */
+	struct evsched_wheel *wheels; /*!< Timer wheels. */
 	void *ctx;                 /*!< Scheduler context. */
 } evsched_t;
 
+/*!
+ * \brief Timer wheel interface, used by the scheduler with the wheel locked.
+ *
+ * Wheel time is in monotonic milliseconds, advancing the wheel moves the
+ * events scheduled up to the given time to the expired list.
+ */
+void evsched_wheel_init(struct evsched_wheel *w, uint64_t now);
+void evsched_wheel_deinit(struct evsched_wheel *w);
+void evsched_wheel_insert(struct evsched_wheel *w, event_t *ev);
+bool evsched_wheel_remove(struct evsched_wheel *w, event_t *ev);
+void evsched_wheel_advance(struct evsched_wheel *w, uint64_t target);
+uint64_t evsched_wheel_next(struct evsched_wheel *w);
+
 /*!
  * \brief Initialize event scheduler instance.
  *
@@ -149,7 +193,9 @@ int evsched_cancel(event_t *ev);
 /*!
  * \brief Fetch next-event.
  *
- * Scheduler may block until a next event is available.
+ * Scheduler may block until a next event is available. All timer wheels
+ * are advanced at once and the expired events are returned one by one
+ * before the time is checked again.
  *
  * \warning Returned event must be marked as finished, or deadlock occurs.
  *
@@ -26,16 +26,52 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #ifdef HAVE_CLOCK_GETTIME
 #include <time.h>
 #define time_now(x) clock_gettime(CLOCK_MONOTONIC, (x))
+#define time_subsec_us(x) ((x)->tv_nsec / 1000)
+#define time_subsec_ns(x) ((x)->tv_nsec)
 typedef struct timespec timev_t;
 #elif HAVE_GETTIMEOFDAY
 #include <sys/time.h>
 #define time_now(x) gettimeofday((x), NULL)
+#define time_subsec_us(x) ((x)->tv_usec)
+#define time_subsec_ns(x) ((x)->tv_usec * 1000)
 typedef struct timeval timev_t;
 #else
 #error Neither clock_gettime() nor gettimeofday() found. At least one is required.
 #endif
 
+/*!
+ * \brief Return microseconds elapsed since given time.
+ */
+static inline uint64_t time_elapsed_us(const timev_t *since)
+{
+	timev_t now;
+	time_now(&now);
+	int64_t us = (int64_t)(now.tv_sec - since->tv_sec) * 1000000 +
+	             time_subsec_us(&now) - time_subsec_us(since);
+	return us > 0 ? us : 0;
+}
+
+/*!
+ * \brief Return monotonic time in nanoseconds.
+ */
+static inline uint64_t time_now_ns(void)
+{
+	timev_t now;
+	time_now(&now);
+	return (uint64_t)now.tv_sec * 1000000000 + time_subsec_ns(&now);
+}
+
+/*!
+ * \brief Return monotonic time in milliseconds.
+ */
+static inline uint64_t time_now_ms(void)
+{
+	return time_now_ns() / 1000000;
+}
+
 /*! @} */
@@ -522,6 +522,10 @@ static void ident_auto(void *scanner, int tok, conf_t *conf, bool val)
 %token <tok> RATE_LIMIT_SIZE
 %token <tok> RATE_LIMIT_SLIP
 %token <tok> TRANSFERS
+%token <tok> MASTER_TRANSFERS
+%token <tok> REFRESH_RATE
+%token <tok> STATS_FILE
+%token <tok> STATS_INTERVAL
 %token <TOK> STORAGE
 %token <tok> DNSSEC_ENABLE
 %token <tok> DNSSEC_KEYDIR
@@ -674,6 +678,16 @@ system:
  | system TRANSFERS NUM ';' {
 	SET_INT(new_config->xfers, $3.i, "transfers");
  }
+ | system MASTER_TRANSFERS NUM ';' {
+	SET_INT(new_config->master_xfers, $3.i, "master-transfers");
+ }
+ | system REFRESH_RATE NUM ';' {
+	SET_INT(new_config->refresh_rate, $3.i, "refresh-rate");
+ }
+ | system STATS_FILE TEXT ';' { new_config->stats_file = $3.t; }
+ | system STATS_INTERVAL NUM ';' {
+	SET_NUM(new_config->stats_interval, $3.i, 1, 86400, "statistics-interval");
+ }
  ;
 
 keys:
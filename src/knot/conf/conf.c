@@ -29,6 +29,7 @@
 #include "libknot/internal/strlcpy.h"
 #include "libknot/internal/mem.h"
 #include "libknot/internal/macros.h"
+#include "libknot/internal/hash.h"
 #include "knot/conf/conf.h"
 #include "knot/conf/extra.h"
 #include "knot/ctl/remote.h"
@@ -182,6 +183,81 @@ static bool is_existing_dir(const char *path)
 	return S_ISDIR(st.st_mode);
 }
 
+/*! \brief Compiled ACL shared by the zones with the same list of rules. */
+struct acl_cache_entry {
+	struct acl_cache_entry *next; /*!< Entry with the same digest. */
+	list_t *acl;                  /*!< Rules of the first zone. */
+	acl_tree_t *tree;
+};
+
+/*! \brief Check if the ACLs consist of the same rules in the same order. */
+static bool acl_same_rules(list_t *a, list_t *b)
+{
+	node_t *na = HEAD(*a), *nb = HEAD(*b);
+	while (na->next != NULL && nb->next != NULL) {
+		if (((conf_remote_t *)na)->remote != ((conf_remote_t *)nb)->remote) {
+			return false;
+		}
+		na = na->next;
+		nb = nb->next;
+	}
+
+	return na->next == NULL && nb->next == NULL;
+}
+
+/*!
+ * \brief Compile zone ACL, zones with the same list of rules share the tree.
+ *
+ * The cache is keyed by a digest of the rule pointers, as the rules are
+ * shared by the zones referencing the same remote or group.
+ *
+ * \retval KNOT_EOK if compiled, the tree is NULL for an empty ACL.
+ * \retval KNOT_ENOMEM
+ */
+static int conf_acl_tree(hattrie_t *cache, list_t *acl, acl_tree_t **tree)
+{
+	*tree = NULL;
+	if (EMPTY_LIST(*acl)) {
+		return KNOT_EOK;
+	}
+
+	static const hash_key_t digest_key = { 0 };
+	uint64_t digest = 0;
+	conf_remote_t *remote = NULL;
+	WALK_LIST(remote, *acl) {
+		uint64_t block[2] = { digest, (uintptr_t)remote->remote };
+		digest = hash_keyed(&digest_key, (const char *)block, sizeof(block));
+	}
+
+	value_t *val = hattrie_get(cache, (const char *)&digest, sizeof(digest));
+	if (val == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	struct acl_cache_entry *entry = *val;
+	while (entry != NULL && !acl_same_rules(entry->acl, acl)) {
+		entry = entry->next;
+	}
+
+	if (entry == NULL) {
+		entry = malloc(sizeof(struct acl_cache_entry));
+		if (entry == NULL) {
+			return KNOT_ENOMEM;
+		}
+		entry->tree = acl_tree_build(acl);
+		if (entry->tree == NULL) {
+			free(entry);
+			return KNOT_ENOMEM;
+		}
+		entry->acl = acl;
+		entry->next = *val;
+		*val = entry;
+	}
+
+	*tree = acl_tree_ref(entry->tree);
+	return KNOT_EOK;
+}
+
 /*!
  * \brief Process parsed configuration.
  *
@@ -256,6 +332,15 @@ static int conf_process(conf_t *conf)
 	/* Default parallel transfers. */
 	if (conf->xfers <= 0)
 		conf->xfers = CONFIG_XFERS;
+	if (conf->master_xfers <= 0)
+		conf->master_xfers = CONFIG_MASTER_XFERS;
+	if (conf->refresh_rate < 0)
+		conf->refresh_rate = CONFIG_REFRESH_RATE;
+
+	/* Statistics dump. */
+	if (conf->stats_interval <= 0)
+		conf->stats_interval = CONFIG_STATS_INTERVAL;
+	conf->stats_file = conf_abs_path(conf->rundir, conf->stats_file);
 
 	/* Zones global configuration. */
 	if (conf->storage == NULL) {
@@ -292,6 +377,11 @@ static int conf_process(conf_t *conf)
 	if (z_iter == NULL) {
 		return KNOT_ERROR;
 	}
+	hattrie_t *acl_cache = hattrie_create();
+	if (acl_cache == NULL) {
+		hattrie_iter_free(z_iter);
+		return KNOT_ENOMEM;
+	}
 	for (; !hattrie_iter_finished(z_iter) && ret == KNOT_EOK; hattrie_iter_next(z_iter)) {
 
 		conf_zone_t *zone = (conf_zone_t *)*hattrie_iter_val(z_iter);
@@ -384,6 +474,22 @@ static int conf_process(conf_t *conf)
 			}
 		}
 
+		// Compile ACLs checked for each query
+		ret = conf_acl_tree(acl_cache, &zone->acl.xfr_out, &zone->acl_tree.xfr_out);
+		if (ret == KNOT_EOK) {
+			ret = conf_acl_tree(acl_cache, &zone->acl.notify_in,
+			                    &zone->acl_tree.notify_in);
+		}
+		if (ret == KNOT_EOK) {
+			ret = conf_acl_tree(acl_cache, &zone->acl.update_in,
+			                    &zone->acl_tree.update_in);
+		}
+		if (ret != KNOT_EOK) {
+			log_zone_str_error(zone->name, "failed to compile ACL (%s)",
+			                   knot_strerror(ret));
+			continue;
+		}
+
 		// Resolve relative paths everywhere
 		zone->storage = conf_abs_path(conf->storage, zone->storage);
 		zone->file = conf_abs_path(zone->storage, zone->file);
@@ -467,6 +573,20 @@ static int conf_process(conf_t *conf)
 	}
 	hattrie_iter_free(z_iter);
 
+	/* Drop the cache references, zones keep theirs. */
+	hattrie_iter_t *acl_iter = hattrie_iter_begin(acl_cache, sorted);
+	for (; acl_iter != NULL && !hattrie_iter_finished(acl_iter); hattrie_iter_next(acl_iter)) {
+		struct acl_cache_entry *entry = *hattrie_iter_val(acl_iter);
+		while (entry != NULL) {
+			struct acl_cache_entry *next = entry->next;
+			acl_tree_free(entry->tree);
+			free(entry);
+			entry = next;
+		}
+	}
+	hattrie_iter_free(acl_iter);
+	hattrie_free(acl_cache);
+
 	/* Update UID and GID. */
 	if (conf->uid < 0) conf->uid = getuid();
 	if (conf->gid < 0) conf->gid = getgid();
@@ -589,6 +709,9 @@ conf_t *conf_new(char* path)
 	c->uid = -1;
 	c->gid = -1;
 	c->xfers = -1;
+	c->master_xfers = -1;
+	c->refresh_rate = -1;
+	c->stats_interval = -1;
 	c->rrl_slip = -1;
 	c->build_diffs = 0; /* Disable by default. */
 
@@ -718,6 +841,10 @@ void conf_truncate(conf_t *conf, int unload_hooks)
 		free(conf->pidfile);
 		conf->pidfile = NULL;
 	}
+	if (conf->stats_file) {
+		free(conf->stats_file);
+		conf->stats_file = NULL;
+	}
 	if (conf->nsid) {
 		free(conf->nsid);
 		conf->nsid = NULL;
@@ -942,6 +1069,9 @@ void conf_free_zone(conf_zone_t *zone)
 	WALK_LIST_FREE(zone->acl.notify_in);
 	WALK_LIST_FREE(zone->acl.notify_out);
 	WALK_LIST_FREE(zone->acl.update_in);
+	acl_tree_free(zone->acl_tree.xfr_out);
+	acl_tree_free(zone->acl_tree.notify_in);
+	acl_tree_free(zone->acl_tree.update_in);
 
 	/* Unload query modules. */
 	struct query_module *module = NULL, *next = NULL;
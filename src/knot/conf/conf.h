@@ -56,6 +56,9 @@
 #define CONFIG_RRL_SLIP 1 /*!< Default slip value. */
 #define CONFIG_RRL_SIZE 393241 /*!< Htable default size. */
 #define CONFIG_XFERS 10
+#define CONFIG_MASTER_XFERS 2 /*!< Parallel transfers from one master. */
+#define CONFIG_REFRESH_RATE 100 /*!< SOA queries per second to one master. */
+#define CONFIG_STATS_INTERVAL 60 /*!< Statistics file dump interval [s]. */
 #define CONFIG_SERIAL_DEFAULT CONF_SERIAL_INCREMENT /*!< Default serial policy: increment. */
 
 /*!
@@ -135,6 +138,11 @@ typedef struct conf_zone {
 		list_t notify_out; /*!< Remotes accepted for notify-out.*/
 		list_t update_in;  /*!< Remotes accepted for DDNS.*/
 	} acl;
+	struct {
+		acl_tree_t *xfr_out;   /*!< Compiled xfr-out ACL. */
+		acl_tree_t *notify_in; /*!< Compiled notify-in ACL. */
+		acl_tree_t *update_in; /*!< Compiled DDNS ACL. */
+	} acl_tree;
 
 	struct query_plan *query_plan;
 	list_t query_modules;
@@ -205,6 +213,10 @@ typedef struct conf {
 	size_t rrl_size; /*!< Rate limit htable size. */
 	int    rrl_slip;  /*!< Rate limit SLIP. */
 	int    xfers;     /*!< Number of parallel transfers. */
+	int    master_xfers; /*!< Number of parallel transfers per master. */
+	int    refresh_rate; /*!< SOA queries per second per master. */
+	char  *stats_file;   /*!< Periodic statistics dump file. */
+	int    stats_interval; /*!< Statistics dump interval [s]. */
 
 	/*
 	 * Log
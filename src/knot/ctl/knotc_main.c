@@ -74,6 +74,12 @@ static int cmd_checkconf(int argc, char *argv[], unsigned flags);
 static int cmd_checkzone(int argc, char *argv[], unsigned flags);
 static int cmd_memstats(int argc, char *argv[], unsigned flags);
 static int cmd_signzone(int argc, char *argv[], unsigned flags);
+static int cmd_workers(int argc, char *argv[], unsigned flags);
+static int cmd_transfers(int argc, char *argv[], unsigned flags);
+static int cmd_notifications(int argc, char *argv[], unsigned flags);
+static int cmd_stats(int argc, char *argv[], unsigned flags);
+static int cmd_zonestats(int argc, char *argv[], unsigned flags);
+static int cmd_latency(int argc, char *argv[], unsigned flags);
 
 /*! \brief Table of remote commands. */
 knot_cmd_t knot_cmd_tbl[] = {
@@ -89,6 +95,13 @@ knot_cmd_t knot_cmd_tbl[] = {
 	{&cmd_checkzone,  1, "checkzone",  "[<zone>...]", "Check zones."},
 	{&cmd_memstats,   1, "memstats",   "[<zone>...]", "Estimate memory use for zones."},
 	{&cmd_signzone,   0, "signzone",   "<zone>...",   "Sign zones with available DNSSEC keys."},
+	{&cmd_workers,    0, "workers",    "",            "Show background worker queues statistics."},
+	{&cmd_transfers,  0, "transfers",  "",            "Show pending and running refreshes and transfers."},
+	{&cmd_notifications, 0, "notifications", "",      "Show outgoing NOTIFY queue statistics."},
+	{&cmd_stats,      0, "stats",      "",            "Show query processing statistics."},
+	{&cmd_zonestats,  0, "zonestats",  "[<zone>...]", "Show query statistics of particular zones\n"
+	                   "                                or of all queried zones."},
+	{&cmd_latency,    0, "latency",    "",            "Show query processing time percentiles."},
 	{NULL, 0, NULL, NULL, NULL}
 };
 
@@ -652,6 +665,78 @@ static int cmd_signzone(int argc, char *argv[], unsigned flags)
 	return cmd_remote("signzone", KNOT_RRTYPE_NS, argc, argv);
 }
 
+static int cmd_workers(int argc, char *argv[], unsigned flags)
+{
+	UNUSED(argv);
+	UNUSED(flags);
+
+	if (argc > 0) {
+		printf("command does not take arguments\n");
+		return KNOT_EINVAL;
+	}
+
+	return cmd_remote("workers", KNOT_RRTYPE_TXT, 0, NULL);
+}
+
+static int cmd_transfers(int argc, char *argv[], unsigned flags)
+{
+	UNUSED(argv);
+	UNUSED(flags);
+
+	if (argc > 0) {
+		printf("command does not take arguments\n");
+		return KNOT_EINVAL;
+	}
+
+	return cmd_remote("transfers", KNOT_RRTYPE_TXT, 0, NULL);
+}
+
+static int cmd_notifications(int argc, char *argv[], unsigned flags)
+{
+	UNUSED(argv);
+	UNUSED(flags);
+
+	if (argc > 0) {
+		printf("command does not take arguments\n");
+		return KNOT_EINVAL;
+	}
+
+	return cmd_remote("notifications", KNOT_RRTYPE_TXT, 0, NULL);
+}
+
+static int cmd_stats(int argc, char *argv[], unsigned flags)
+{
+	UNUSED(argv);
+	UNUSED(flags);
+
+	if (argc > 0) {
+		printf("command does not take arguments\n");
+		return KNOT_EINVAL;
+	}
+
+	return cmd_remote("stats", KNOT_RRTYPE_TXT, 0, NULL);
+}
+
+static int cmd_zonestats(int argc, char *argv[], unsigned flags)
+{
+	UNUSED(flags);
+
+	return cmd_remote("zonestats", KNOT_RRTYPE_NS, argc, argv);
+}
+
+static int cmd_latency(int argc, char *argv[], unsigned flags)
+{
+	UNUSED(argv);
+	UNUSED(flags);
+
+	if (argc > 0) {
+		printf("command does not take arguments\n");
+		return KNOT_EINVAL;
+	}
+
+	return cmd_remote("latency", KNOT_RRTYPE_TXT, 0, NULL);
+}
+
 static int cmd_checkconf(int argc, char *argv[], unsigned flags)
 {
 	UNUSED(argc);
@@ -15,7 +15,9 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
 #include <sys/stat.h>
+#include "knot/common/conn_pool.h"
 #include "knot/common/debug.h"
 #include "knot/common/fdset.h"
 #include "knot/common/log.h"
@@ -25,6 +27,9 @@
 #include "knot/dnssec/zone-nsec.h"
 #include "knot/server/tcp-handler.h"
 #include "knot/zone/timers.h"
+#include "knot/zone/zone-stats.h"
+#include "knot/zone/events/notifier.h"
+#include "knot/zone/events/refresh.h"
 #include "libknot/libknot.h"
 #include "libknot/internal/macros.h"
 #include "libknot/internal/mem.h"
@@ -115,6 +120,12 @@ static int remote_c_status(server_t *s, remote_cmdargs_t* a);
 static int remote_c_zonestatus(server_t *s, remote_cmdargs_t* a);
 static int remote_c_flush(server_t *s, remote_cmdargs_t* a);
 static int remote_c_signzone(server_t *s, remote_cmdargs_t* a);
+static int remote_c_workers(server_t *s, remote_cmdargs_t* a);
+static int remote_c_transfers(server_t *s, remote_cmdargs_t* a);
+static int remote_c_notifications(server_t *s, remote_cmdargs_t* a);
+static int remote_c_stats(server_t *s, remote_cmdargs_t* a);
+static int remote_c_zonestats(server_t *s, remote_cmdargs_t* a);
+static int remote_c_latency(server_t *s, remote_cmdargs_t* a);
 
 /*! \brief Table of remote commands. */
 struct remote_cmd remote_cmd_tbl[] = {
@@ -126,6 +137,12 @@ struct remote_cmd remote_cmd_tbl[] = {
 	{ "zonestatus",&remote_c_zonestatus },
 	{ "flush",     &remote_c_flush },
 	{ "signzone",  &remote_c_signzone },
+	{ "workers",   &remote_c_workers },
+	{ "transfers", &remote_c_transfers },
+	{ "notifications", &remote_c_notifications },
+	{ "stats",     &remote_c_stats },
+	{ "zonestats", &remote_c_zonestats },
+	{ "latency",   &remote_c_latency },
 	{ NULL,        NULL }
 };
 
@@ -478,6 +495,272 @@ static int remote_c_signzone(server_t *server, remote_cmdargs_t* arguments)
 	return KNOT_CTL_ACCEPTED;
 }
 
+/*!
+ * \brief Remote command 'workers' handler.
+ *
+ * QNAME: workers
+ * DATA: NONE
+ */
+static int remote_c_workers(server_t *s, remote_cmdargs_t* a)
+{
+	dbg_server("remote: %s\n", __func__);
+
+	for (int type = 0; type < ZONE_EVENT_COUNT; ++type) {
+		worker_stats_t stats = { 0 };
+		worker_pool_stats(s->workers, type, &stats);
+
+		char buf[256] = { '\0' };
+		uint64_t wait_avg = stats.executed > 0 ?
+		                    stats.wait_total / stats.executed : 0;
+		int n = snprintf(buf, sizeof(buf),
+		                 "%s\tqueued=%"PRIu64" | executed=%"PRIu64" | "
+		                 "wait avg=%"PRIu64"ms max=%"PRIu64"ms\n",
+		                 zone_events_get_name(type), stats.queued,
+		                 stats.executed, wait_avg, stats.wait_max);
+		if (n < 0 || n >= sizeof(buf)) {
+			return KNOT_ESPACE;
+		}
+
+		int ret = cmdargs_assure_avail(a, n);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+		memcpy(a->response + a->response_size, buf, n);
+		a->response_size += n;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Append formatted line to the command response. */
+static int transfers_append(remote_cmdargs_t *a, const char *buf, int n)
+{
+	if (n < 0) {
+		return KNOT_ESPACE;
+	}
+
+	int ret = cmdargs_assure_avail(a, n);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+	memcpy(a->response + a->response_size, buf, n);
+	a->response_size += n;
+
+	return KNOT_EOK;
+}
+
+/*! \brief Print operations in progress with a single master. */
+static int transfers_master(const struct sockaddr_storage *addr,
+                            const unsigned *inflight, void *ctx)
+{
+	char addr_str[SOCKADDR_STRLEN] = { '\0' };
+	sockaddr_tostr(addr_str, sizeof(addr_str), addr);
+
+	char buf[256] = { '\0' };
+	int n = snprintf(buf, sizeof(buf), "%s\tSOA queries=%u | transfers=%u\n",
+	                 addr_str, inflight[REFRESH_QUERY], inflight[REFRESH_XFER]);
+	if (n >= sizeof(buf)) {
+		return KNOT_ESPACE;
+	}
+
+	return transfers_append(ctx, buf, n);
+}
+
+/*!
+ * \brief Remote command 'transfers' handler.
+ *
+ * QNAME: transfers
+ * DATA: NONE
+ */
+static int remote_c_transfers(server_t *s, remote_cmdargs_t* a)
+{
+	dbg_server("remote: %s\n", __func__);
+
+	refresh_stats_t stats = { 0 };
+	refresh_stats(&stats);
+	conn_pool_stats_t pool = { 0 };
+	conn_pool_stats(&pool);
+
+	char buf[512] = { '\0' };
+	int n = snprintf(buf, sizeof(buf),
+	                 "pending=%u | SOA queries=%u deferred=%"PRIu64" | "
+	                 "transfers=%u deferred=%"PRIu64" queued=%u | masters=%u\n"
+	                 "connections idle=%u reused=%"PRIu64" parked=%"PRIu64" "
+	                 "expired=%"PRIu64"\n",
+	                 stats.pending,
+	                 stats.inflight[REFRESH_QUERY], stats.deferred[REFRESH_QUERY],
+	                 stats.inflight[REFRESH_XFER], stats.deferred[REFRESH_XFER],
+	                 stats.queued, stats.masters,
+	                 pool.idle, pool.reused, pool.parked, pool.expired);
+	if (n >= sizeof(buf)) {
+		return KNOT_ESPACE;
+	}
+
+	int ret = transfers_append(a, buf, n);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return refresh_walk(transfers_master, a);
+}
+
+/*!
+ * \brief Remote command 'notifications' handler.
+ *
+ * QNAME: notifications
+ * DATA: NONE
+ */
+static int remote_c_notifications(server_t *s, remote_cmdargs_t* a)
+{
+	dbg_server("remote: %s\n", __func__);
+
+	notifier_stats_t stats = { 0 };
+	notifier_stats(&stats);
+
+	char buf[256] = { '\0' };
+	int n = snprintf(buf, sizeof(buf),
+	                 "queued=%u in-flight=%u | sent=%"PRIu64" retries=%"PRIu64" "
+	                 "answered=%"PRIu64" failed=%"PRIu64" coalesced=%"PRIu64"\n",
+	                 stats.queued, stats.inflight, stats.sent, stats.retries,
+	                 stats.answered, stats.failed, stats.coalesced);
+	if (n >= sizeof(buf)) {
+		return KNOT_ESPACE;
+	}
+
+	return transfers_append(a, buf, n);
+}
+
+/*!
+ * \brief Remote command 'stats' handler.
+ *
+ * QNAME: stats
+ * DATA: NONE
+ */
+static int remote_c_stats(server_t *s, remote_cmdargs_t* a)
+{
+	dbg_server("remote: %s\n", __func__);
+
+	char buf[8192] = { '\0' };
+	int n = stats_print(&s->stats, buf, sizeof(buf));
+	if (n < 0) {
+		return n;
+	}
+
+	return transfers_append(a, buf, n);
+}
+
+/*!
+ * \brief Remote command 'latency' handler.
+ *
+ * QNAME: latency
+ * DATA: NONE
+ */
+static int remote_c_latency(server_t *s, remote_cmdargs_t* a)
+{
+	dbg_server("remote: %s\n", __func__);
+
+	char buf[2048] = { '\0' };
+	int n = stats_print_latency(&s->stats, buf, sizeof(buf));
+	if (n == KNOT_ENOTSUP) {
+		n = snprintf(buf, sizeof(buf), "latency timing not enabled at compile time\n");
+	}
+	if (n < 0) {
+		return n;
+	}
+
+	return transfers_append(a, buf, n);
+}
+
+/*! \brief Print counters of the zone query modules, one line per module. */
+static int remote_modstats(zone_t *zone, remote_cmdargs_t *a)
+{
+	struct query_module *module = NULL;
+	WALK_LIST(module, zone->conf->query_modules) {
+		if (module->stats == NULL) {
+			continue;
+		}
+
+		char buf[1024] = { '\0' };
+		int n = snprintf(buf, sizeof(buf), "%s\t", zone->conf->name);
+		if (n >= sizeof(buf)) {
+			return KNOT_ESPACE;
+		}
+		int ret = module->stats(module, buf + n, sizeof(buf) - n - 1);
+		if (ret < 0) {
+			return ret;
+		}
+		n += ret;
+		buf[n++] = '\n';
+
+		ret = transfers_append(a, buf, n);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Print statistics of a queried zone. */
+static int remote_zonestats(zone_t *zone, remote_cmdargs_t *a)
+{
+	char buf[4096] = { '\0' };
+	int n = zone_stats_print(zone, buf, sizeof(buf));
+	if (n <= 0) {
+		return n;
+	}
+
+	int ret = transfers_append(a, buf, n);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return remote_modstats(zone, a);
+}
+
+/*! \brief Print statistics of a requested zone, even if not queried. */
+static int remote_zonestats_any(zone_t *zone, remote_cmdargs_t *a)
+{
+	if (zone->stats != NULL) {
+		return remote_zonestats(zone, a);
+	}
+
+	char buf[512] = { '\0' };
+	int n = snprintf(buf, sizeof(buf), "%s\tqueries=0\n", zone->conf->name);
+	if (n >= sizeof(buf)) {
+		return KNOT_ESPACE;
+	}
+
+	int ret = transfers_append(a, buf, n);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return remote_modstats(zone, a);
+}
+
+/*!
+ * \brief Remote command 'zonestats' handler.
+ *
+ * QNAME: zonestats
+ * DATA: NONE for all queried zones
+ *       NS RRs with zones in RDATA
+ */
+static int remote_c_zonestats(server_t *s, remote_cmdargs_t* a)
+{
+	dbg_server("remote: %s\n", __func__);
+
+	rcu_read_lock();
+	if (a->argc == 0) {
+		knot_zonedb_foreach(s->zone_db, remote_zonestats, a);
+	} else {
+		remote_rdata_apply(s, a, &remote_zonestats_any);
+	}
+	rcu_read_unlock();
+
+	return KNOT_EOK;
+}
+
 /*!
  * \brief Prepare and send error response.
  * \param c Client fd.
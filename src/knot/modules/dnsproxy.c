@@ -14,30 +14,746 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
 #include "libknot/processing/requestor.h"
+#include "libknot/dnssec/random.h"
+#include "libknot/internal/macros.h"
+#include "libknot/internal/tolower.h"
+#include "libknot/internal/trie/hat-trie.h"
+#include "knot/common/conn_pool.h"
+#include "knot/common/time.h"
 #include "knot/modules/dnsproxy.h"
 #include "knot/nameserver/capture.h"
 #include "knot/nameserver/process_query.h"
+#include "knot/server/rrl.h"
+#include "knot/server/stats.h"
 
 #define MODULE_ERR(msg...) log_error("module 'dnsproxy', " msg)
 
+/*! \brief Upstream UDP sockets, each connected from a random source port. */
+#define DNSPROXY_SOCKETS 256
+/*! \brief Queries sent over a socket before it's replaced with a new one. */
+#define DNSPROXY_SOCKET_USES 16
+/*! \brief Maximum number of outstanding UDP queries. */
+#define DNSPROXY_MAX_PENDING 4096
+/*! \brief Cache key: QNAME, QTYPE, QCLASS and flags. */
+#define DNSPROXY_KEY_MAXLEN (KNOT_DNAME_MAXLEN + 5)
+
+/*! \brief Cached upstream answer. */
+struct cache_entry {
+	node_t node;          /*!< Position in the LRU list, most recent first. */
+	uint8_t key[DNSPROXY_KEY_MAXLEN];
+	size_t keylen;
+	time_t inserted;
+	time_t expires;
+	size_t size;
+	uint8_t wire[];
+};
+
+/*! \brief Bounded LRU cache of upstream answers. */
+struct dnsproxy_cache {
+	pthread_mutex_t lock;
+	hattrie_t *table;
+	list_t lru;
+	size_t count;
+	size_t capacity;
+};
+
+/*! \brief Upstream socket, re-opened after a few queries to change the port. */
+struct upstream_socket {
+	int fd;
+	unsigned uses;        /*!< Queries sent over the socket. */
+	unsigned refs;        /*!< Parked queries and sends in progress. */
+};
+
+/*! \brief Query parked until the upstream answers. */
+struct pending {
+	node_t node;          /*!< Position in the timeout queue. */
+	struct sockaddr_storage client;
+	int fd;               /*!< Server socket the query came from. */
+	server_t *server;     /*!< Server for rate limiting and statistics. */
+	int rrl_slip;         /*!< RRL slip ratio, -1 if not rate limited. */
+	timev_t begin;        /*!< Time the query was parked. */
+	uint16_t id;          /*!< Original message ID. */
+	uint16_t upstream_id;
+	unsigned socket;      /*!< Upstream socket the query was sent over. */
+	time_t deadline;
+	uint8_t key[DNSPROXY_KEY_MAXLEN];
+	size_t keylen;        /*!< Cache key length, 0 if not cacheable. */
+	size_t size;
+	uint8_t *sent;        /*!< Forwarded query, QNAME in random case. */
+	uint8_t wire[];       /*!< Original query, followed by the forwarded one. */
+};
+
 struct dnsproxy {
 	conf_iface_t remote;
+	bool async;           /*!< Park UDP queries (server query plan only). */
+	int timeout;          /*!< Upstream reply timeout [s]. */
+	int rrl_slip;         /*!< RRL slip ratio for the parked queries. */
+
+	/* Upstream I/O. */
+	pthread_t thread;
+	bool running;
+	int wakeup[2];
+	bool rotate;          /*!< Wake up to replace used up sockets. */
+
+	/* Outstanding queries indexed by the upstream message ID. */
+	pthread_mutex_t lock;
+	struct upstream_socket sockets[DNSPROXY_SOCKETS];
+	struct pending **pending;
+	list_t timeouts;
+	unsigned outstanding;
+
+	struct dnsproxy_cache cache;
 };
 
-static int dnsproxy_fwd(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+/*!
+ * \brief Walk TTLs of all records in the message except OPT.
+ *
+ * \param wire      Message.
+ * \param size      Message size.
+ * \param decrease  Subtract from each TTL (saturated at zero).
+ * \param min_ttl   Minimum TTL before the decrease (UINT32_MAX if no records).
+ *
+ * \return KNOT_EOK, KNOT_EMALF if malformed or KNOT_ENOTSUP if signed.
+ */
+static int ttl_walk(uint8_t *wire, size_t size, uint32_t decrease, uint32_t *min_ttl)
 {
-	if (pkt == NULL || qdata == NULL || ctx == NULL) {
-		return KNOT_NS_PROC_FAIL;
+	if (size < KNOT_WIRE_HEADER_SIZE) {
+		return KNOT_EMALF;
 	}
 
-	/* If not already satisfied. */
-	if (state == KNOT_NS_PROC_DONE) {
-		return state;
+	const uint8_t *end = wire + size;
+	uint8_t *pos = wire + KNOT_WIRE_HEADER_SIZE;
+	*min_ttl = UINT32_MAX;
+
+	for (unsigned i = 0; i < knot_wire_get_qdcount(wire); ++i) {
+		int len = knot_dname_wire_check(pos, end, wire);
+		if (len <= 0 || pos + len + 4 > end) {
+			return KNOT_EMALF;
+		}
+		pos += len + 4;
 	}
 
-	struct dnsproxy *proxy = ctx;
+	unsigned count = knot_wire_get_ancount(wire) + knot_wire_get_nscount(wire) +
+	                 knot_wire_get_arcount(wire);
+	for (unsigned i = 0; i < count; ++i) {
+		int len = knot_dname_wire_check(pos, end, wire);
+		if (len <= 0 || pos + len + 10 > end) {
+			return KNOT_EMALF;
+		}
+		uint16_t type = wire_read_u16(pos + len);
+		uint8_t *ttl_pos = pos + len + 4;
+		uint16_t rdlen = wire_read_u16(pos + len + 8);
+		pos += len + 10 + rdlen;
+		if (pos > end) {
+			return KNOT_EMALF;
+		}
+		if (type == KNOT_RRTYPE_TSIG) {
+			return KNOT_ENOTSUP;
+		}
+		if (type == KNOT_RRTYPE_OPT) {
+			continue;
+		}
+		uint32_t ttl = wire_read_u32(ttl_pos);
+		if (ttl < *min_ttl) {
+			*min_ttl = ttl;
+		}
+		if (decrease > 0) {
+			wire_write_u32(ttl_pos, ttl > decrease ? ttl - decrease : 0);
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Make cache key for the query, return its length or 0 if not cacheable. */
+static size_t cache_key(const knot_pkt_t *query, uint8_t *key)
+{
+	const knot_dname_t *qname = knot_pkt_qname(query);
+	if (qname == NULL || knot_pkt_has_tsig(query)) {
+		return 0;
+	}
+
+	int len = knot_dname_to_wire(key, qname, KNOT_DNAME_MAXLEN);
+	if (len < 0) {
+		return 0;
+	}
+	knot_dname_to_lower(key);
+
+	wire_write_u16(key + len, knot_pkt_qtype(query));
+	wire_write_u16(key + len + 2, knot_pkt_qclass(query));
+	key[len + 4] = (knot_wire_get_rd(query->wire) ? 1 : 0) |
+	               (knot_wire_get_cd(query->wire) ? 2 : 0) |
+	               (knot_pkt_has_dnssec(query) ? 4 : 0);
+
+	return len + 5;
+}
+
+static void cache_remove(struct dnsproxy_cache *cache, struct cache_entry *entry)
+{
+	hattrie_del(cache->table, (const char *)entry->key, entry->keylen);
+	rem_node(&entry->node);
+	cache->count -= 1;
+	free(entry);
+}
+
+/*!
+ * \brief Find cached answer and copy it into the buffer.
+ *
+ * \return Answer size, 0 if not found or doesn't fit.
+ */
+static size_t cache_lookup(struct dnsproxy_cache *cache, const uint8_t *key,
+                           size_t keylen, uint8_t *buf, size_t buflen)
+{
+	if (cache->capacity == 0 || keylen == 0) {
+		return 0;
+	}
+
+	size_t size = 0;
+	uint32_t elapsed = 0;
+	time_t now = time(NULL);
+
+	pthread_mutex_lock(&cache->lock);
+	value_t *val = hattrie_tryget(cache->table, (const char *)key, keylen);
+	if (val != NULL) {
+		struct cache_entry *entry = *val;
+		if (entry->expires <= now) {
+			cache_remove(cache, entry);
+		} else if (entry->size <= buflen) {
+			rem_node(&entry->node);
+			add_head(&cache->lru, &entry->node);
+			memcpy(buf, entry->wire, entry->size);
+			size = entry->size;
+			elapsed = now - entry->inserted;
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	/* Age the records. */
+	if (size > 0 && elapsed > 0) {
+		uint32_t min_ttl = 0;
+		ttl_walk(buf, size, elapsed, &min_ttl);
+	}
+
+	return size;
+}
+
+/*! \brief Store cacheable upstream answer. */
+static void cache_insert(struct dnsproxy_cache *cache, const uint8_t *key,
+                         size_t keylen, const uint8_t *wire, size_t size)
+{
+	if (cache->capacity == 0 || keylen == 0 || size < KNOT_WIRE_HEADER_SIZE) {
+		return;
+	}
+
+	/* Only complete positive and negative answers. */
+	uint8_t rcode = knot_wire_get_rcode(wire);
+	if (knot_wire_get_tc(wire) ||
+	    (rcode != KNOT_RCODE_NOERROR && rcode != KNOT_RCODE_NXDOMAIN)) {
+		return;
+	}
+
+	struct cache_entry *entry = malloc(sizeof(struct cache_entry) + size);
+	if (entry == NULL) {
+		return;
+	}
+	memcpy(entry->wire, wire, size);
+
+	uint32_t min_ttl = 0;
+	if (ttl_walk(entry->wire, size, 0, &min_ttl) != KNOT_EOK ||
+	    min_ttl == 0 || min_ttl == UINT32_MAX) {
+		free(entry);
+		return;
+	}
+
+	memcpy(entry->key, key, keylen);
+	entry->keylen = keylen;
+	entry->size = size;
+	entry->inserted = time(NULL);
+	entry->expires = entry->inserted + min_ttl;
+
+	pthread_mutex_lock(&cache->lock);
+	value_t *val = hattrie_tryget(cache->table, (const char *)key, keylen);
+	if (val != NULL) {
+		cache_remove(cache, *val);
+	} else if (cache->count >= cache->capacity) {
+		cache_remove(cache, TAIL(cache->lru));
+	}
+	*hattrie_get(cache->table, (const char *)key, keylen) = entry;
+	add_head(&cache->lru, &entry->node);
+	cache->count += 1;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*! \brief Answer from the cache, the question is copied from the query. */
+static bool cache_answer(struct dnsproxy *proxy, knot_pkt_t *pkt,
+                         struct query_data *qdata, const uint8_t *key,
+                         size_t keylen)
+{
+	knot_pkt_t *query = qdata->query;
+	uint8_t *buf = mm_alloc(qdata->mm, pkt->max_size);
+	if (buf == NULL) {
+		return false;
+	}
+
+	bool answered = false;
+	size_t size = cache_lookup(&proxy->cache, key, keylen, buf, pkt->max_size);
+	size_t question = KNOT_WIRE_HEADER_SIZE + query->qname_size + 4;
+	if (size >= question) {
+		knot_wire_set_id(buf, knot_wire_get_id(query->wire));
+		memcpy(buf + KNOT_WIRE_HEADER_SIZE, query->wire + KNOT_WIRE_HEADER_SIZE,
+		       question - KNOT_WIRE_HEADER_SIZE);
+		knot_pkt_t *cached = knot_pkt_new(buf, size, qdata->mm);
+		answered = cached != NULL && knot_pkt_parse(cached, 0) == KNOT_EOK &&
+		           knot_pkt_copy(pkt, cached) == KNOT_EOK;
+		knot_pkt_free(&cached);
+	}
+
+	mm_free(qdata->mm, buf);
+	return answered;
+}
+
+/*! \brief Strip the message down to the header and question, return its size. */
+static size_t strip_to_question(uint8_t *wire, size_t size)
+{
+	size_t question = KNOT_WIRE_HEADER_SIZE;
+	if (knot_wire_get_qdcount(wire) > 0) {
+		int len = knot_dname_wire_check(wire + question, wire + size, wire);
+		if (len > 0 && question + len + 4 <= size) {
+			question += len + 4;
+		}
+	}
+
+	knot_wire_set_qdcount(wire, question > KNOT_WIRE_HEADER_SIZE ? 1 : 0);
+	knot_wire_set_ancount(wire, 0);
+	knot_wire_set_nscount(wire, 0);
+	knot_wire_set_arcount(wire, 0);
+
+	return question;
+}
+
+/*!
+ * \brief Send the answer to the parked query.
+ *
+ * The answer is rate limited and counted the same way as the answers sent
+ * from the I/O threads, the counters are the deferred ones.
+ */
+static void pending_answer(struct pending *p, uint8_t *wire, size_t size)
+{
+	knot_wire_set_id(p->wire, p->id);
+	knot_wire_set_id(wire, p->id);
+
+	knot_pkt_t *query = knot_pkt_new(p->wire, p->size, NULL);
+	if (query != NULL && knot_pkt_parse(query, 0) != KNOT_EOK) {
+		knot_pkt_free(&query);
+	}
 
+	/* Rate limits (if applicable). */
+	server_t *server = p->server;
+	bool limited = false;
+	bool slip = false;
+	if (p->rrl_slip >= 0 && server->rrl != NULL) {
+		rrl_req_t rrl_rq = {0};
+		rrl_rq.w = wire;
+		rrl_rq.len = size;
+		rrl_rq.query = query;
+		if (rrl_query(server->rrl, &p->client, &rrl_rq, NULL) != KNOT_EOK) {
+			limited = true;
+			slip = rrl_slip_roll(p->rrl_slip);
+			if (slip) {
+				size = strip_to_question(wire, size);
+				knot_wire_set_tc(wire);
+			} else {
+				size = 0;
+			}
+		}
+	}
+
+	knot_pkt_t *resp = knot_pkt_new(wire, size, NULL);
+	enum stats_proto proto = (p->client.ss_family == AF_INET6) ?
+	                         STATS_UDP6 : STATS_UDP4;
+	stats_counters_t *counters = stats_deferred_lock(&server->stats);
+	if (limited) {
+		stats_rrl(counters, slip);
+	}
+	stats_query(counters, proto, query, resp, size, time_elapsed_us(&p->begin));
+	stats_deferred_unlock(&server->stats);
+	knot_pkt_free(&resp);
+	knot_pkt_free(&query);
+
+	if (size > 0) {
+		(void)sendto(p->fd, wire, size, MSG_DONTWAIT,
+		             (struct sockaddr *)&p->client,
+		             sockaddr_len((struct sockaddr *)&p->client));
+	}
+}
+
+/*! \brief Send a header-only SERVFAIL for the parked query. */
+static void pending_fail(struct pending *p)
+{
+	uint8_t wire[KNOT_WIRE_HEADER_SIZE + KNOT_DNAME_MAXLEN + 4];
+	size_t size = MIN(p->size, sizeof(wire));
+	memcpy(wire, p->wire, size);
+
+	size = strip_to_question(wire, size);
+	knot_wire_set_qr(wire);
+	knot_wire_set_rcode(wire, KNOT_RCODE_SERVFAIL);
+
+	pending_answer(p, wire, size);
+}
+
+/*! \brief Release the upstream socket, must hold the lock. */
+static void socket_release(struct dnsproxy *proxy, unsigned i)
+{
+	struct upstream_socket *s = &proxy->sockets[i];
+	s->refs -= 1;
+
+	/* Used up socket can be replaced once nothing waits on it. */
+	if (s->refs == 0 && s->uses >= DNSPROXY_SOCKET_USES && !proxy->rotate) {
+		proxy->rotate = true;
+		(void)write(proxy->wakeup[1], "r", 1);
+	}
+}
+
+/*! \brief Remove the query from the outstanding set, must hold the lock. */
+static void pending_take(struct dnsproxy *proxy, struct pending *p)
+{
+	proxy->pending[p->upstream_id] = NULL;
+	rem_node(&p->node);
+	proxy->outstanding -= 1;
+	socket_release(proxy, p->socket);
+}
+
+/*! \brief Randomize letter case of the QNAME (the 0x20 bit). */
+static void qname_randomize_case(uint8_t *qname)
+{
+	uint8_t bits[KNOT_DNAME_MAXLEN / 8 + 1];
+	knot_random_buffer(bits, sizeof(bits));
+
+	for (unsigned i = 0; qname[i] != '\0'; i += qname[i] + 1) {
+		for (unsigned j = i + 1; j <= i + qname[i]; ++j) {
+			uint8_t c = knot_tolower(qname[j]);
+			if (c >= 'a' && c <= 'z' && (bits[j / 8] & (1 << (j % 8)))) {
+				qname[j] ^= 0x20;
+			}
+		}
+	}
+}
+
+/*!
+ * \brief Compare the echoed question with the forwarded one.
+ *
+ * \retval 1 if identical including the QNAME case.
+ * \retval 0 if the QNAME differs only in case.
+ * \retval -1 if not the same question.
+ */
+static int question_cmp(const uint8_t *echoed, const uint8_t *sent, size_t len)
+{
+	if (memcmp(echoed, sent, len) == 0) {
+		return 1;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		if (knot_tolower(echoed[i]) != knot_tolower(sent[i])) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Match the upstream reply with a parked query and answer it.
+ *
+ * The reply must come over the socket the query was sent over (the sockets
+ * are connected, so from the upstream address and port), with the message ID
+ * and the question. Only the replies echoing the QNAME in the random case
+ * are cached, the others are relayed to the client only.
+ */
+static void upstream_reply(struct dnsproxy *proxy, unsigned sock,
+                           uint8_t *wire, size_t size)
+{
+	if (size < KNOT_WIRE_HEADER_SIZE || !knot_wire_get_qr(wire)) {
+		return;
+	}
+
+	pthread_mutex_lock(&proxy->lock);
+	struct pending *p = proxy->pending[knot_wire_get_id(wire)];
+	if (p == NULL || p->socket != sock) {
+		pthread_mutex_unlock(&proxy->lock);
+		return;
+	}
+
+	/* The question must be echoed back. */
+	int qlen = knot_dname_wire_check(p->sent + KNOT_WIRE_HEADER_SIZE,
+	                                 p->sent + p->size, p->sent);
+	size_t question = KNOT_WIRE_HEADER_SIZE + qlen + 4;
+	int match = -1;
+	if (qlen > 0 && size >= question) {
+		match = question_cmp(wire + KNOT_WIRE_HEADER_SIZE,
+		                     p->sent + KNOT_WIRE_HEADER_SIZE,
+		                     question - KNOT_WIRE_HEADER_SIZE);
+	}
+	if (match < 0) {
+		pthread_mutex_unlock(&proxy->lock);
+		return;
+	}
+
+	pending_take(proxy, p);
+	pthread_mutex_unlock(&proxy->lock);
+
+	/* Restore the QNAME case of the original query. */
+	memcpy(wire + KNOT_WIRE_HEADER_SIZE, p->wire + KNOT_WIRE_HEADER_SIZE, qlen);
+
+	if (match > 0) {
+		cache_insert(&proxy->cache, p->key, p->keylen, wire, size);
+	}
+
+	pending_answer(p, wire, size);
+	free(p);
+}
+
+/*! \brief Answer expired queries with SERVFAIL, return time to the next expiry [ms]. */
+static int upstream_expire(struct dnsproxy *proxy)
+{
+	time_t now = time(NULL);
+	list_t expired;
+	init_list(&expired);
+
+	pthread_mutex_lock(&proxy->lock);
+	struct pending *p = NULL, *nxt = NULL;
+	WALK_LIST_DELSAFE(p, nxt, proxy->timeouts) {
+		if (p->deadline > now) {
+			break;
+		}
+		pending_take(proxy, p);
+		add_tail(&expired, &p->node);
+	}
+	int wait = 1000;
+	if (!EMPTY_LIST(proxy->timeouts)) {
+		struct pending *first = HEAD(proxy->timeouts);
+		wait = (first->deadline - now) * 1000;
+		if (wait > 1000) {
+			wait = 1000;
+		}
+	}
+	pthread_mutex_unlock(&proxy->lock);
+
+	WALK_LIST_DELSAFE(p, nxt, expired) {
+		pending_fail(p);
+		free(p);
+	}
+
+	return wait;
+}
+
+/*! \brief Open upstream socket, the OS picks a random source port. */
+static int upstream_open(struct dnsproxy *proxy)
+{
+	return net_connected_socket(SOCK_DGRAM, &proxy->remote.addr, NULL, O_NONBLOCK);
+}
+
+/*!
+ * \brief Replace the used up sockets with new ones.
+ *
+ * Only the upstream thread closes the sockets, so the descriptors in its
+ * poll set are valid until the next rotation.
+ */
+static void upstream_rotate(struct dnsproxy *proxy)
+{
+	int old[DNSPROXY_SOCKETS];
+	unsigned index[DNSPROXY_SOCKETS];
+	unsigned count = 0;
+
+	pthread_mutex_lock(&proxy->lock);
+	proxy->rotate = false;
+	for (unsigned i = 0; i < DNSPROXY_SOCKETS; ++i) {
+		struct upstream_socket *s = &proxy->sockets[i];
+		if (s->refs == 0 && (s->fd < 0 || s->uses >= DNSPROXY_SOCKET_USES)) {
+			old[count] = s->fd;
+			index[count++] = i;
+			s->fd = -1;
+		}
+	}
+	pthread_mutex_unlock(&proxy->lock);
+
+	if (count == 0) {
+		return;
+	}
+
+	for (unsigned i = 0; i < count; ++i) {
+		if (old[i] >= 0) {
+			close(old[i]);
+		}
+		old[i] = upstream_open(proxy);
+	}
+
+	pthread_mutex_lock(&proxy->lock);
+	for (unsigned i = 0; i < count; ++i) {
+		proxy->sockets[index[i]].fd = old[i];
+		proxy->sockets[index[i]].uses = 0;
+	}
+	pthread_mutex_unlock(&proxy->lock);
+}
+
+/*! \brief Upstream I/O thread, receives replies for the parked queries. */
+static void *upstream_thread(void *arg)
+{
+	struct dnsproxy *proxy = arg;
+
+	struct pollfd fds[DNSPROXY_SOCKETS + 1];
+	unsigned index[DNSPROXY_SOCKETS];
+	uint8_t buf[KNOT_WIRE_MAX_PKTSIZE];
+	for (;;) {
+		int wait = upstream_expire(proxy);
+		upstream_rotate(proxy);
+
+		/* Descriptors change only in this thread. */
+		unsigned nfds = 0;
+		for (unsigned i = 0; i < DNSPROXY_SOCKETS; ++i) {
+			if (proxy->sockets[i].fd >= 0) {
+				fds[nfds].fd = proxy->sockets[i].fd;
+				fds[nfds].events = POLLIN;
+				index[nfds++] = i;
+			}
+		}
+		fds[nfds].fd = proxy->wakeup[0];
+		fds[nfds].events = POLLIN;
+
+		if (poll(fds, nfds + 1, wait) < 0 && errno != EINTR) {
+			break;
+		}
+
+		if (fds[nfds].revents != 0) {
+			char cmd = '\0';
+			if (read(proxy->wakeup[0], &cmd, 1) != 1 || cmd == '\0') {
+				break; /* Module unloaded. */
+			}
+		}
+
+		for (unsigned i = 0; i < nfds; ++i) {
+			if (!(fds[i].revents & POLLIN)) {
+				continue;
+			}
+			ssize_t len = 0;
+			while ((len = recv(fds[i].fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+				upstream_reply(proxy, index[i], buf, len);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*! \brief Pick a random socket with queries left and take it, must hold the lock. */
+static int socket_acquire(struct dnsproxy *proxy)
+{
+	unsigned start = knot_random_uint16_t() % DNSPROXY_SOCKETS;
+	for (unsigned i = 0; i < DNSPROXY_SOCKETS; ++i) {
+		unsigned pos = (start + i) % DNSPROXY_SOCKETS;
+		struct upstream_socket *s = &proxy->sockets[pos];
+		if (s->fd >= 0 && s->uses < DNSPROXY_SOCKET_USES) {
+			s->uses += 1;
+			s->refs += 1;
+			return pos;
+		}
+	}
+
+	return KNOT_ELIMIT;
+}
+
+/*!
+ * \brief Forward the query over a random upstream socket and park it.
+ *
+ * Each query gets an independently drawn message ID, a source port from a set
+ * of sockets that are re-opened after a few queries, and a QNAME in random
+ * case, all of which the reply has to match.
+ */
+static int dnsproxy_park(struct dnsproxy *proxy, struct query_data *qdata,
+                         const uint8_t *key, size_t keylen)
+{
+	knot_pkt_t *query = qdata->query;
+	struct pending *p = malloc(sizeof(struct pending) + 2 * query->size);
+	if (p == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	memcpy(&p->client, qdata->param->remote, sizeof(struct sockaddr_storage));
+	p->fd = qdata->param->socket;
+	p->server = qdata->param->server;
+	p->rrl_slip = -1;
+	if (qdata->param->proc_flags & NS_QUERY_LIMIT_RATE) {
+		p->rrl_slip = proxy->rrl_slip;
+	}
+	time_now(&p->begin);
+	p->id = knot_wire_get_id(query->wire);
+	p->deadline = time(NULL) + proxy->timeout;
+	memcpy(p->key, key, keylen);
+	p->keylen = keylen;
+	p->size = query->size;
+	memcpy(p->wire, query->wire, query->size);
+	p->sent = p->wire + query->size;
+	memcpy(p->sent, query->wire, query->size);
+	if (query->qname_size > 0) {
+		qname_randomize_case(p->sent + KNOT_WIRE_HEADER_SIZE);
+	}
+
+	pthread_mutex_lock(&proxy->lock);
+	int sock = KNOT_ELIMIT;
+	if (proxy->outstanding < DNSPROXY_MAX_PENDING) {
+		sock = socket_acquire(proxy);
+	}
+	if (sock < 0) {
+		pthread_mutex_unlock(&proxy->lock);
+		free(p);
+		return sock;
+	}
+
+	/* Draw random message IDs until an unused one. */
+	uint16_t id = knot_random_uint16_t();
+	while (proxy->pending[id] != NULL) {
+		id = knot_random_uint16_t();
+	}
+	p->upstream_id = id;
+	knot_wire_set_id(p->sent, id);
+	p->socket = sock;
+	proxy->pending[id] = p;
+	add_tail(&proxy->timeouts, &p->node);
+	proxy->outstanding += 1;
+
+	/* Keep the socket open until sent, the query may be answered sooner. */
+	struct upstream_socket *s = &proxy->sockets[sock];
+	s->refs += 1;
+	int fd = s->fd;
+	pthread_mutex_unlock(&proxy->lock);
+
+	int ret = KNOT_EOK;
+	if (send(fd, p->sent, p->size, MSG_DONTWAIT) != p->size) {
+		ret = KNOT_ECONN;
+	}
+
+	pthread_mutex_lock(&proxy->lock);
+	if (ret != KNOT_EOK && proxy->pending[id] == p) {
+		pending_take(proxy, p);
+		free(p);
+	} else {
+		ret = KNOT_EOK; /* Already answered. */
+	}
+	socket_release(proxy, sock);
+	pthread_mutex_unlock(&proxy->lock);
+
+	return ret;
+}
+
+/*! \brief Forward the query and wait for the answer, reuse idle connections. */
+static int dnsproxy_exec(struct dnsproxy *proxy, knot_pkt_t *pkt,
+                         struct query_data *qdata, bool is_tcp)
+{
 	/* Create a forwarding request. */
 	struct knot_requestor re;
 	knot_requestor_init(&re, qdata->mm);
@@ -45,27 +761,80 @@ static int dnsproxy_fwd(int state, knot_pkt_t *pkt, struct query_data *qdata, vo
 	param.sink = pkt;
 	int ret = knot_requestor_overlay(&re, LAYER_CAPTURE, &param);
 	if (ret != KNOT_EOK) {
-		return KNOT_NS_PROC_FAIL;
+		return ret;
 	}
 
-	bool is_tcp = net_is_connected(qdata->param->socket);
-	struct knot_request *req = knot_request_make(re.mm, (struct sockaddr *)&proxy->remote.addr,
-	                                             NULL, qdata->query, is_tcp ? 0 : KNOT_RQ_UDP);
+	struct sockaddr_storage *src = &proxy->remote.via;
+	struct sockaddr_storage *dst = &proxy->remote.addr;
+	struct knot_request *req = knot_request_make(re.mm, (struct sockaddr *)dst,
+	                                             NULL, qdata->query,
+	                                             is_tcp ? KNOT_RQ_KEEP : KNOT_RQ_UDP);
 	if (req == NULL) {
-		return state; /* Ignore, not enough memory. */
+		knot_requestor_clear(&re);
+		return KNOT_ENOMEM;
+	}
+	if (is_tcp) {
+		int fd = conn_pool_get(src, dst);
+		req->fd = fd >= 0 ? fd : -1;
 	}
 
 	/* Forward request. */
 	ret = knot_requestor_enqueue(&re, req);
 	if (ret == KNOT_EOK) {
-		struct timeval tv = { conf()->max_conn_hs, 0 };
+		int fd = req->fd;
+		struct timeval tv = { proxy->timeout, 0 };
 		ret = knot_requestor_exec(&re, &tv);
+		if (ret == KNOT_EOK && is_tcp) {
+			conn_pool_put(src, dst, fd);
+		}
 	} else {
+		if (is_tcp && req->fd >= 0) {
+			close(req->fd);
+		}
 		knot_request_free(re.mm, req);
 	}
 
 	knot_requestor_clear(&re);
 
+	return ret;
+}
+
+static int dnsproxy_fwd(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+{
+	if (pkt == NULL || qdata == NULL || ctx == NULL) {
+		return KNOT_NS_PROC_FAIL;
+	}
+
+	/* If not already satisfied. */
+	if (state == KNOT_NS_PROC_DONE) {
+		return state;
+	}
+
+	struct dnsproxy *proxy = ctx;
+
+	/* Answer from the cache. */
+	uint8_t key[DNSPROXY_KEY_MAXLEN];
+	size_t keylen = cache_key(qdata->query, key);
+	if (cache_answer(proxy, pkt, qdata, key, keylen)) {
+		return KNOT_NS_PROC_DONE;
+	}
+
+	/* Park UDP query, the upstream thread sends the answer. */
+	bool is_tcp = net_is_connected(qdata->param->socket);
+	int ret = KNOT_EOK;
+	if (proxy->async && !is_tcp) {
+		ret = dnsproxy_park(proxy, qdata, key, keylen);
+		if (ret == KNOT_EOK) {
+			return KNOT_NS_PROC_NOOP;
+		}
+	} else {
+		ret = dnsproxy_exec(proxy, pkt, qdata, is_tcp);
+		/* UDP query is forwarded with the client's message ID. */
+		if (ret == KNOT_EOK && is_tcp) {
+			cache_insert(&proxy->cache, key, keylen, pkt->wire, pkt->size);
+		}
+	}
+
 	/* Check result. */
 	if (ret != KNOT_EOK) {
 		qdata->rcode = KNOT_RCODE_SERVFAIL;
@@ -75,6 +844,70 @@ static int dnsproxy_fwd(int state, knot_pkt_t *pkt, struct query_data *qdata, vo
 	return KNOT_NS_PROC_DONE;
 }
 
+/*! \brief Open upstream sockets and start the upstream thread. */
+static int upstream_start(struct dnsproxy *proxy)
+{
+	proxy->pending = calloc(UINT16_MAX + 1, sizeof(struct pending *));
+	if (proxy->pending == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	for (unsigned i = 0; i < DNSPROXY_SOCKETS; ++i) {
+		proxy->sockets[i].fd = upstream_open(proxy);
+		if (proxy->sockets[i].fd < 0) {
+			return proxy->sockets[i].fd;
+		}
+	}
+
+	if (pipe(proxy->wakeup) != 0) {
+		proxy->wakeup[0] = proxy->wakeup[1] = -1;
+		return knot_map_errno(errno);
+	}
+
+	if (pthread_create(&proxy->thread, NULL, upstream_thread, proxy) != 0) {
+		return KNOT_ERROR;
+	}
+	proxy->running = true;
+
+	return KNOT_EOK;
+}
+
+static void dnsproxy_free(struct query_module *self, struct dnsproxy *proxy)
+{
+	if (proxy->running) {
+		(void)write(proxy->wakeup[1], "", 1);
+		pthread_join(proxy->thread, NULL);
+	}
+
+	/* Parked queries are left unanswered. */
+	struct pending *p = NULL, *nxt = NULL;
+	WALK_LIST_DELSAFE(p, nxt, proxy->timeouts) {
+		free(p);
+	}
+	free(proxy->pending);
+
+	for (unsigned i = 0; i < DNSPROXY_SOCKETS; ++i) {
+		if (proxy->sockets[i].fd >= 0) {
+			close(proxy->sockets[i].fd);
+		}
+	}
+	for (unsigned i = 0; i < 2; ++i) {
+		if (proxy->wakeup[i] >= 0) {
+			close(proxy->wakeup[i]);
+		}
+	}
+
+	struct cache_entry *entry = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(entry, next, proxy->cache.lru) {
+		free(entry);
+	}
+	hattrie_free(proxy->cache.table);
+
+	pthread_mutex_destroy(&proxy->cache.lock);
+	pthread_mutex_destroy(&proxy->lock);
+	mm_free(self->mm, proxy);
+}
+
 int dnsproxy_load(struct query_plan *plan, struct query_module *self)
 {
 	struct dnsproxy *proxy = mm_alloc(self->mm, sizeof(struct dnsproxy));
@@ -83,26 +916,80 @@ int dnsproxy_load(struct query_plan *plan, struct query_module *self)
 		return KNOT_ENOMEM;
 	}
 	memset(proxy, 0, sizeof(struct dnsproxy));
+	pthread_mutex_init(&proxy->lock, NULL);
+	pthread_mutex_init(&proxy->cache.lock, NULL);
+	init_list(&proxy->timeouts);
+	init_list(&proxy->cache.lru);
+	proxy->wakeup[0] = proxy->wakeup[1] = -1;
+	for (unsigned i = 0; i < DNSPROXY_SOCKETS; ++i) {
+		proxy->sockets[i].fd = -1;
+	}
+	self->ctx = proxy;
+
+	/* Parse address and optional port. */
+	char *saveptr = NULL;
+	char *addr = strtok_r(self->param, " ", &saveptr);
+	if (addr == NULL) {
+		MODULE_ERR("missing proxy address");
+		dnsproxy_free(self, proxy);
+		return KNOT_EINVAL;
+	}
+	int port = 53;
+	char *port_str = strchr(addr, '@');
+	if (port_str != NULL) {
+		*port_str = '\0';
+		port = strtol(port_str + 1, NULL, 10);
+	}
 
 	/* Determine IPv4/IPv6 */
 	int family = AF_INET;
-	if (strchr(self->param, ':')) {
+	if (strchr(addr, ':')) {
 		family = AF_INET6;
 	}
 
-	int ret = sockaddr_set(&proxy->remote.addr, family, self->param, 53);
-	if (ret != KNOT_EOK) {
-		MODULE_ERR("invalid proxy address: '%s'", self->param);
-		mm_free(self->mm, proxy);
+	int ret = sockaddr_set(&proxy->remote.addr, family, addr, port);
+	if (ret != KNOT_EOK || port <= 0 || port > UINT16_MAX) {
+		MODULE_ERR("invalid proxy address: '%s'", addr);
+		dnsproxy_free(self, proxy);
 		return KNOT_EINVAL;
 	}
 
+	/* Parse optional cache size. */
+	char *cache_str = strtok_r(NULL, " ", &saveptr);
+	if (cache_str != NULL) {
+		char *end = NULL;
+		long capacity = strtol(cache_str, &end, 10);
+		if (*end != '\0' || capacity < 0) {
+			MODULE_ERR("invalid cache size: '%s'", cache_str);
+			dnsproxy_free(self, proxy);
+			return KNOT_EINVAL;
+		}
+		proxy->cache.capacity = capacity;
+	}
+	proxy->cache.table = hattrie_create();
+	if (proxy->cache.table == NULL) {
+		dnsproxy_free(self, proxy);
+		return KNOT_ENOMEM;
+	}
+
+	/* Queries can be parked only in the server query plan. */
+	proxy->timeout = self->config->max_conn_hs;
+	proxy->rrl_slip = self->config->rrl_slip;
+	proxy->async = (plan == self->config->query_plan);
+	if (proxy->async) {
+		ret = upstream_start(proxy);
+		if (ret != KNOT_EOK) {
+			MODULE_ERR("failed to start upstream I/O (%s)", knot_strerror(ret));
+			dnsproxy_free(self, proxy);
+			return ret;
+		}
+	}
+
 	return query_plan_step(plan, QPLAN_BEGIN, dnsproxy_fwd, proxy);
 }
 
 int dnsproxy_unload(struct query_module *self)
 {
-	mm_free(self->mm, self->ctx);
+	dnsproxy_free(self, self->ctx);
 	return KNOT_EOK;
 }
-
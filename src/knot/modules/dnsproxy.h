@@ -6,12 +6,18 @@
  * \brief DNS proxy module
  *
  * Accepted configurations:
- *  * "<address>"
+ *  * "<address>[@<port>] [<cache-size>]"
  *
  * Module forwards all unsatisfied queries to the specified server in
  * order to solve them, and then sends the response back, i.e. a tiny
  * DNS proxy.
  *
+ * In the server query plan, UDP queries are parked and answered from the
+ * module thread when the upstream responds, so that the server threads
+ * don't wait. The answers are rate limited and counted in the server
+ * statistics like the synchronous ones. Answers may be cached in a bounded
+ * LRU cache.
+ *
  * \addtogroup query_processing
  * @{
  */
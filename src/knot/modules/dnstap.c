@@ -14,88 +14,211 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
 #include <sys/stat.h>
 
 #include "knot/modules/dnstap.h"
 #include "knot/nameserver/query_module.h"
 #include "knot/nameserver/process_query.h"
 #include "dnstap/dnstap.pb-c.h"
+#include "dnstap/encoder.h"
 #include "dnstap/writer.h"
-#include "dnstap/message.h"
 #include "dnstap/dnstap.h"
 #include "libknot/descriptor.h"
 
 /* Defines. */
 #define MODULE_ERR(msg...) log_error("module 'dnstap', " msg)
 
-static int log_message(int state, const knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+/*! \brief Per-thread frame buffer size. */
+#define DNSTAP_RING_SIZE (1024 * 1024)
+
+/*! \brief Frame header in the ring buffer. */
+struct frame {
+	uint64_t end; /*!< Ring offset past the frame, including the skipped tail. */
+};
+
+#define FRAME_SIZE(len) (((sizeof(struct frame) + (len)) + 7) & ~(size_t)7)
+
+/*!
+ * \brief Per-thread ring buffer of encoded frames.
+ *
+ * Frames are written by the owning server thread and released in the same
+ * order by the fstrm I/O thread once written out, so the buffer is a simple
+ * single-producer, single-consumer ring.
+ */
+struct dnstap_ring {
+	uint8_t *data;
+	uint64_t head;                 /*!< Written by the server thread. */
+	uint64_t tail;                 /*!< Written by the I/O thread. */
+	struct fstrm_iothr_queue *ioq;
+	unsigned sample_count;
+	bool sampled;                  /*!< Log the response to the current query. */
+	struct timespec qtime;         /*!< Current query time. */
+} __attribute__((aligned(64)));
+
+struct dnstap {
+	struct fstrm_iothr *iothread;
+	struct dnstap_ring *rings;
+	unsigned ring_count;
+	unsigned sample;               /*!< Log one of this many queries. */
+	bool log_queries;
+	bool log_responses;
+};
+
+/*! \brief Reserve space for a frame, NULL if the ring is full. */
+static uint8_t *ring_reserve(struct dnstap_ring *ring, size_t len)
 {
-	if (pkt == NULL || qdata == NULL || ctx == NULL) {
-		return KNOT_NS_PROC_FAIL;
+	size_t total = FRAME_SIZE(len);
+	if (total > DNSTAP_RING_SIZE / 2) {
+		return NULL;
 	}
 
-	int ret = KNOT_ERROR;
-	struct fstrm_iothr* iothread = ctx;
-	struct fstrm_iothr_queue *ioq = fstrm_iothr_get_input_queue_idx(iothread, qdata->param->thread_id);
+	/* Frames are contiguous, skip the remainder at the end of the buffer. */
+	uint64_t tail = __sync_fetch_and_add(&ring->tail, 0);
+	size_t pos = ring->head % DNSTAP_RING_SIZE;
+	size_t skip = (pos + total > DNSTAP_RING_SIZE) ? DNSTAP_RING_SIZE - pos : 0;
+	if (ring->head + skip + total - tail > DNSTAP_RING_SIZE) {
+		return NULL;
+	}
 
-	/* Unless we want to measure the time it takes to process each query,
-	 * we can treat Q/R times the same. */
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
+	uint64_t start = ring->head + skip;
+	struct frame *frame = (struct frame *)(ring->data + start % DNSTAP_RING_SIZE);
+	frame->end = start;
+	return (uint8_t *)(frame + 1);
+}
 
-	/* Determine query / response. */
-	Dnstap__Message__Type msgtype = DNSTAP__MESSAGE__TYPE__AUTH_QUERY;
-	if (knot_wire_get_qr(pkt->wire)) {
-		msgtype = DNSTAP__MESSAGE__TYPE__AUTH_RESPONSE;
-	}
+/*! \brief Commit reserved frame of the final length. */
+static void ring_commit(struct dnstap_ring *ring, uint8_t *data, size_t len)
+{
+	struct frame *frame = (struct frame *)data - 1;
+	frame->end += FRAME_SIZE(len);
+	ring->head = frame->end;
+}
+
+/*! \brief Release the oldest frame, called by the I/O thread. */
+static void ring_release(void *data, void *ctx)
+{
+	struct dnstap_ring *ring = ctx;
+	struct frame *frame = (struct frame *)data - 1;
+	__sync_synchronize();
+	ring->tail = frame->end;
+}
 
+static int log_message(struct dnstap *ctx, Dnstap__Message__Type msgtype,
+                       const knot_pkt_t *pkt, struct query_data *qdata,
+                       struct dnstap_ring *ring, const struct timespec *rtime)
+{
 	/* Determine whether we run on UDP/TCP. */
 	int protocol = IPPROTO_TCP;
 	if (qdata->param->proc_flags & NS_QUERY_LIMIT_SIZE) {
 		protocol = IPPROTO_UDP;
 	}
 
-	/* Create a dnstap message. */
-	Dnstap__Message msg;
-	ret = dt_message_fill(&msg, msgtype,
-	                      (const struct sockaddr *)qdata->param->remote,
-	                      NULL, /* todo: fill me! */
-	                      protocol,
-	                      pkt->wire, pkt->size, &tv, &tv);
-	if (ret != KNOT_EOK) {
-		return KNOT_NS_PROC_FAIL; 
-	}
-	Dnstap__Dnstap dnstap = DNSTAP__DNSTAP__INIT;
-	dnstap.type = DNSTAP__DNSTAP__TYPE__MESSAGE;
-	dnstap.message = (Dnstap__Message *)&msg;
-
-	/* Pack the message. */
-	uint8_t *frame = NULL;
-	size_t size = 0;
-	dt_pack(&dnstap, &frame, &size);
+	/* Encode the frame directly into the ring, drop it if full. */
+	uint64_t head = ring->head;
+	uint8_t *frame = ring_reserve(ring, DT_ENCODE_OVERHEAD + pkt->size);
 	if (frame == NULL) {
-		return KNOT_NS_PROC_FAIL;
+		return KNOT_ESPACE;
 	}
+	int len = dt_encode_message(frame, DT_ENCODE_OVERHEAD + pkt->size, msgtype,
+	                            (const struct sockaddr *)qdata->param->remote,
+	                            NULL, /* todo: fill me! */
+	                            protocol, pkt->wire, pkt->size,
+	                            &ring->qtime, rtime);
+	if (len < 0) {
+		return len;
+	}
+	ring_commit(ring, frame, len);
 
 	/* Submit a request. */
-	fstrm_res res = fstrm_iothr_submit(iothread, ioq, frame, size,
-	                                   fstrm_free_wrapper, NULL);
+	fstrm_res res = fstrm_iothr_submit(ctx->iothread, ring->ioq, frame, len,
+	                                   ring_release, ring);
 	if (res != fstrm_res_success) {
-		free(frame);
-		state = KNOT_NS_PROC_FAIL;
+		ring->head = head; /* Not queued, reuse the space. */
+		return KNOT_ERROR;
 	}
 
+	return KNOT_EOK;
+}
+
+/*! \brief Ring of the current thread or NULL. */
+static struct dnstap_ring *thread_ring(struct dnstap *ctx, struct query_data *qdata)
+{
+	unsigned thread_id = qdata->param->thread_id;
+	if (thread_id >= ctx->ring_count) {
+		return NULL;
+	}
+
+	return &ctx->rings[thread_id];
+}
+
+/*! \brief Decide whether to log the current query. */
+static bool sample(struct dnstap *ctx, struct dnstap_ring *ring)
+{
+	ring->sampled = (++ring->sample_count >= ctx->sample);
+	if (!ring->sampled) {
+		return false;
+	}
+	ring->sample_count = 0;
+
+	/* Unless we want to measure the time it takes to process each query,
+	 * we can treat Q/R times the same. */
+	clock_gettime(CLOCK_REALTIME, &ring->qtime);
+
+	return true;
+}
+
+/*! \brief Sample the query and log it. */
+static int dnstap_query_log(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+{
+	if (pkt == NULL || qdata == NULL || ctx == NULL) {
+		return KNOT_NS_PROC_FAIL;
+	}
+
+	struct dnstap *dnstap = ctx;
+	struct dnstap_ring *ring = thread_ring(dnstap, qdata);
+	if (ring == NULL) {
+		return state;
+	}
+
+	if (!sample(dnstap, ring)) {
+		return state;
+	}
+
+	/* Logging is best effort, dropped frames don't affect the answer. */
+	(void)log_message(dnstap, DNSTAP__MESSAGE__TYPE__AUTH_QUERY, qdata->query,
+	                  qdata, ring, NULL);
+
 	return state;
 }
 
-/*! \brief Submit message. */
-static int dnstap_message_log(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+/*! \brief Log the response to a sampled query. */
+static int dnstap_response_log(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
 {
 	if (pkt == NULL || qdata == NULL || ctx == NULL) {
 		return KNOT_NS_PROC_FAIL;
 	}
 
-	return log_message(state, pkt, qdata, ctx);
+	struct dnstap *dnstap = ctx;
+	struct dnstap_ring *ring = thread_ring(dnstap, qdata);
+	if (ring == NULL) {
+		return state;
+	}
+
+	/* Without query logging, the response is sampled. */
+	bool sampled = dnstap->log_queries ? ring->sampled : sample(dnstap, ring);
+	ring->sampled = false;
+	if (!sampled) {
+		return state;
+	}
+
+	struct timespec rtime;
+	clock_gettime(CLOCK_REALTIME, &rtime);
+
+	(void)log_message(dnstap, DNSTAP__MESSAGE__TYPE__AUTH_RESPONSE, pkt, qdata,
+	                  ring, &rtime);
+
+	return state;
 }
 
 /*! \brief Create a UNIX socket sink. */
@@ -168,11 +291,72 @@ static struct fstrm_writer* dnstap_writer(const char *path)
 	return dnstap_file_writer(path);
 }
 
+/*! \brief Parse the optional filter and sampling parameters. */
+static int dnstap_params(struct dnstap *ctx, char *saveptr)
+{
+	ctx->log_queries = true;
+	ctx->log_responses = true;
+	ctx->sample = 1;
+
+	char *token = NULL;
+	while ((token = strtok_r(NULL, " ", &saveptr)) != NULL) {
+		if (strcmp(token, "queries") == 0) {
+			ctx->log_responses = false;
+		} else if (strcmp(token, "responses") == 0) {
+			ctx->log_queries = false;
+		} else if (strcmp(token, "sample") == 0) {
+			token = strtok_r(NULL, " ", &saveptr);
+			char *end = NULL;
+			long sample = token ? strtol(token, &end, 10) : 0;
+			if (sample < 1 || sample > UINT32_MAX || *end != '\0') {
+				return KNOT_EINVAL;
+			}
+			ctx->sample = sample;
+		} else {
+			return KNOT_EINVAL;
+		}
+	}
+
+	if (!ctx->log_queries && !ctx->log_responses) {
+		return KNOT_EINVAL;
+	}
+
+	return KNOT_EOK;
+}
+
+static void dnstap_free(struct dnstap *ctx)
+{
+	/* Pending frames are released before the I/O thread exits. */
+	if (ctx->iothread != NULL) {
+		fstrm_iothr_destroy(&ctx->iothread);
+	}
+
+	for (unsigned i = 0; i < ctx->ring_count; ++i) {
+		free(ctx->rings[i].data);
+	}
+	free(ctx->rings);
+	free(ctx);
+}
+
 int dnstap_load(struct query_plan *plan, struct query_module *self)
 {
+	struct dnstap *ctx = calloc(1, sizeof(struct dnstap));
+	if (ctx == NULL) {
+		MODULE_ERR("not enough memory");
+		return KNOT_ENOMEM;
+	}
+
+	/* Parse the sink and options. */
+	int ret = KNOT_EINVAL;
+	char *saveptr = NULL;
+	char *path = strtok_r(self->param, " ", &saveptr);
+	if (path == NULL || dnstap_params(ctx, saveptr) != KNOT_EOK) {
+		goto fail;
+	}
+
 	/* Initialize the writer and the options. */
-	int ret = KNOT_ENOMEM;
-	struct fstrm_writer *writer = dnstap_writer(self->param);
+	ret = KNOT_ENOMEM;
+	struct fstrm_writer *writer = dnstap_writer(path);
 	if (writer == NULL) {
 		goto fail;
 	}
@@ -188,29 +372,48 @@ int dnstap_load(struct query_plan *plan, struct query_module *self)
 	fstrm_iothr_options_set_num_input_queues(opt, qcount);
 
 	/* Create the I/O thread. */
-	struct fstrm_iothr* iothread = fstrm_iothr_init(opt, &writer);
+	ctx->iothread = fstrm_iothr_init(opt, &writer);
 	fstrm_iothr_options_destroy(&opt);
 
-	if (iothread == NULL) {
+	if (ctx->iothread == NULL) {
 		fstrm_writer_destroy(&writer);
 		goto fail;
 	}
-	self->ctx = iothread;
+
+	/* Frame buffer for each input queue. */
+	if (posix_memalign((void **)&ctx->rings, 64, qcount * sizeof(struct dnstap_ring)) != 0) {
+		ctx->rings = NULL;
+		goto fail;
+	}
+	memset(ctx->rings, 0, qcount * sizeof(struct dnstap_ring));
+	for (; ctx->ring_count < qcount; ++ctx->ring_count) {
+		struct dnstap_ring *ring = &ctx->rings[ctx->ring_count];
+		ring->data = malloc(DNSTAP_RING_SIZE);
+		if (ring->data == NULL) {
+			goto fail;
+		}
+		ring->ioq = fstrm_iothr_get_input_queue_idx(ctx->iothread, ctx->ring_count);
+	}
+	self->ctx = ctx;
 
 	/* Hook to the query plan. */
-	query_plan_step(plan, QPLAN_BEGIN, dnstap_message_log, self->ctx);
-	query_plan_step(plan, QPLAN_END, dnstap_message_log, self->ctx);
+	if (ctx->log_queries) {
+		query_plan_step(plan, QPLAN_BEGIN, dnstap_query_log, self->ctx);
+	}
+	if (ctx->log_responses) {
+		query_plan_step(plan, QPLAN_END, dnstap_response_log, self->ctx);
+	}
 
 	return KNOT_EOK;
 
 fail:
 	MODULE_ERR("init failed, params '%s' (%s)", self->param, knot_strerror(ret));
+	dnstap_free(ctx);
 	return ret;
 }
 
 int dnstap_unload(struct query_module *self)
 {
-	struct fstrm_iothr* iothread = self->ctx;
-	fstrm_iothr_destroy(&iothread);
+	dnstap_free(self->ctx);
 	return KNOT_EOK;
 }
@@ -3,6 +3,11 @@
  *
  * \author Marek Vavrusa <marek.vavrusa@nic.cz>
  *
+ * \brief dnstap query logging module
+ *
+ * Accepted configurations:
+ *  * "<sink> [queries|responses] [sample <N>]"
+ *
  * \addtogroup query_processing
  * @{
  */
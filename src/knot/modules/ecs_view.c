@@ -0,0 +1,462 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "knot/modules/ecs_view.h"
+#include "knot/nameserver/query_module.h"
+#include "knot/nameserver/process_query.h"
+#include "knot/nameserver/internet.h"
+#include "knot/zone/zonedb.h"
+#include "knot/conf/conf.h"
+#include "libknot/rrtype/opt.h"
+
+/* Defines. */
+#define ECS_NONE 0 /* No child, the roots are never children. */
+#define ECS_ROOT(family) ((family) == AF_INET6 ? 1 : 0)
+#define ECS_BIT(addr, i) (((addr)[(i) / 8] >> (7 - (i) % 8)) & 1)
+#define MODULE_ERR(msg...) log_error("module 'ecs_view', " msg)
+
+/*! \brief Node of the compiled prefix trie, children are indices in the trie. */
+struct ecs_node {
+	uint32_t child[2];
+	int32_t view; /*!< Index of the view, -1 if none. */
+};
+
+/*!
+ * \brief Views of all ecs_view modules in a query plan.
+ *
+ * The subnets are compiled into a binary trie in a single array with a root
+ * for each address family, so the lookup doesn't allocate and visits at most
+ * one node per address bit. The table replaces the zone answer step and falls
+ * back to it if the view can't answer.
+ */
+struct ecs_table {
+	struct query_shared shared; /*!< Replaces the answer step. */
+	list_t views;
+	struct ecs_node *trie;
+	struct ecs_view **index;    /*!< Views by the trie index. */
+};
+
+/*! \brief Client subnet view. */
+struct ecs_view {
+	node_t node;
+	conf_iface_t subnet;
+	knot_dname_t *zone;
+	struct ecs_table *table;
+};
+
+/*! \brief Client address the answer is selected for. */
+struct ecs_client {
+	int family;       /*!< AF_INET or AF_INET6, AF_UNSPEC if unknown. */
+	uint8_t addr[16];
+	unsigned source;  /*!< Source prefix length. */
+	bool ecs;         /*!< Address from the client subnet option. */
+};
+
+static const uint8_t *addr_bytes(const struct sockaddr_storage *ss)
+{
+	if (ss->ss_family == AF_INET6) {
+		return (const uint8_t *)&((const struct sockaddr_in6 *)ss)->sin6_addr;
+	} else {
+		return (const uint8_t *)&((const struct sockaddr_in *)ss)->sin_addr;
+	}
+}
+
+/*! \brief Compile the views into the trie, the first view of a subnet wins. */
+static int table_compile(struct ecs_table *table)
+{
+	mm_ctx_t *mm = table->shared.plan->mm;
+	size_t count = 0;
+	size_t nodes = 2;
+	struct ecs_view *view = NULL;
+	WALK_LIST(view, table->views) {
+		count += 1;
+		nodes += view->subnet.prefix;
+	}
+
+	struct ecs_node *trie = mm_alloc(mm, nodes * sizeof(struct ecs_node));
+	struct ecs_view **index = mm_alloc(mm, (count + 1) * sizeof(struct ecs_view *));
+	if (trie == NULL || index == NULL) {
+		mm_free(mm, trie);
+		mm_free(mm, index);
+		return KNOT_ENOMEM;
+	}
+
+	memset(trie, 0, 2 * sizeof(struct ecs_node));
+	trie[0].view = trie[1].view = -1;
+	uint32_t len = 2;
+	int32_t i = 0;
+	WALK_LIST(view, table->views) {
+		const uint8_t *addr = addr_bytes(&view->subnet.addr);
+		uint32_t cur = ECS_ROOT(view->subnet.addr.ss_family);
+		for (unsigned bit = 0; bit < view->subnet.prefix; ++bit) {
+			uint32_t *child = &trie[cur].child[ECS_BIT(addr, bit)];
+			if (*child == ECS_NONE) {
+				memset(&trie[len], 0, sizeof(struct ecs_node));
+				trie[len].view = -1;
+				*child = len++;
+			}
+			cur = *child;
+		}
+		if (trie[cur].view < 0) {
+			trie[cur].view = i;
+		}
+		index[i++] = view;
+	}
+
+	mm_free(mm, table->trie);
+	mm_free(mm, table->index);
+	table->trie = trie;
+	table->index = index;
+
+	return KNOT_EOK;
+}
+
+static void table_free(void *ctx)
+{
+	struct ecs_table *table = ctx;
+	mm_free(table->shared.plan->mm, table->trie);
+	mm_free(table->shared.plan->mm, table->index);
+}
+
+/*!
+ * \brief Find the view with the longest prefix matching the client.
+ *
+ * The scope is the number of address bits the result depends on.
+ */
+static const struct ecs_view *table_find(const struct ecs_table *table,
+                                         const struct ecs_client *client,
+                                         unsigned *scope)
+{
+	const struct ecs_node *trie = table->trie;
+	uint32_t cur = ECS_ROOT(client->family);
+	int32_t view = -1;
+	unsigned depth = 0;
+	while (true) {
+		const struct ecs_node *node = &trie[cur];
+		if (node->view >= 0) {
+			view = node->view;
+		}
+		if (depth == client->source ||
+		    (node->child[0] == ECS_NONE && node->child[1] == ECS_NONE)) {
+			break;
+		}
+		cur = node->child[ECS_BIT(client->addr, depth)];
+		depth += 1;
+		if (cur == ECS_NONE) {
+			break;
+		}
+	}
+
+	*scope = depth;
+	return (view >= 0) ? table->index[view] : NULL;
+}
+
+/*! \brief Get the client subnet from the query option or the source address. */
+static int client_get(struct query_data *qdata, struct ecs_client *client)
+{
+	const knot_pkt_t *query = qdata->query;
+	const uint8_t *opt = NULL;
+	if (knot_pkt_has_edns(query)) {
+		opt = knot_edns_get_option(query->opt_rr, KNOT_EDNS_OPTION_CLIENT_SUBNET);
+	}
+
+	memset(client, 0, sizeof(*client));
+	if (opt == NULL) {
+		const struct sockaddr_storage *remote = qdata->param->remote;
+		if (remote->ss_family == AF_INET) {
+			client->family = AF_INET;
+			client->source = IPV4_PREFIXLEN;
+			memcpy(client->addr, addr_bytes(remote), sizeof(struct in_addr));
+		} else if (remote->ss_family == AF_INET6) {
+			client->family = AF_INET6;
+			client->source = IPV6_PREFIXLEN;
+			memcpy(client->addr, addr_bytes(remote), sizeof(struct in6_addr));
+		} else {
+			client->family = AF_UNSPEC;
+		}
+		return KNOT_EOK;
+	}
+
+	knot_addr_family_t family = 0;
+	uint16_t addr_len = sizeof(client->addr);
+	uint8_t source = 0, scope = 0;
+	int ret = knot_edns_client_subnet_parse(knot_edns_opt_get_data(opt),
+	                                        knot_edns_opt_get_length(opt),
+	                                        &family, client->addr, &addr_len,
+	                                        &source, &scope);
+	if (ret != KNOT_EOK) {
+		return KNOT_EMALF;
+	}
+
+	/* RFC 7871, section 7.1.2: exact address length, no bits set after the
+	 * source prefix and zero scope in queries. */
+	unsigned prefix_max = 0;
+	switch (family) {
+	case KNOT_ADDR_FAMILY_IPV4:
+		client->family = AF_INET;
+		prefix_max = IPV4_PREFIXLEN;
+		break;
+	case KNOT_ADDR_FAMILY_IPV6:
+		client->family = AF_INET6;
+		prefix_max = IPV6_PREFIXLEN;
+		break;
+	default:
+		return KNOT_EMALF;
+	}
+	if (source > prefix_max || scope != 0 || addr_len != (source + 7) / 8 ||
+	    (source % 8 > 0 && (client->addr[addr_len - 1] & (0xff >> (source % 8))))) {
+		return KNOT_EMALF;
+	}
+
+	client->source = source;
+	client->ecs = true;
+	return KNOT_EOK;
+}
+
+/*! \brief Write the client subnet with the scope into the response OPT RR. */
+static int client_scope_put(knot_pkt_t *pkt, struct query_data *qdata,
+                            const struct ecs_client *client, unsigned scope)
+{
+	if (knot_rrset_empty(&qdata->opt_rr)) {
+		return KNOT_EOK;
+	}
+
+	uint8_t data[KNOT_EDNS_MAX_OPTION_CLIENT_SUBNET];
+	uint16_t data_len = sizeof(data);
+	knot_addr_family_t family = (client->family == AF_INET6) ?
+	                            KNOT_ADDR_FAMILY_IPV6 : KNOT_ADDR_FAMILY_IPV4;
+	int ret = knot_edns_client_subnet_create(family, client->addr,
+	                                         sizeof(client->addr),
+	                                         client->source, scope,
+	                                         data, &data_len);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	/* The OPT RR space is already reserved in the response. */
+	ret = knot_pkt_reserve(pkt, KNOT_EDNS_OPTION_HDRLEN + data_len);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return knot_edns_add_option(&qdata->opt_rr, KNOT_EDNS_OPTION_CLIENT_SUBNET,
+	                            data_len, data, qdata->mm);
+}
+
+/*! \brief Write the query name relative to the view zone. */
+static int view_name(uint8_t *dst, const struct query_data *qdata,
+                     const knot_dname_t *view_zone)
+{
+	/* Labels below the zone apex, the question name is not compressed. */
+	int labels = knot_dname_labels(qdata->name, NULL) -
+	             knot_dname_labels(qdata->zone->name, NULL);
+	size_t len = 0;
+	for (int i = 0; i < labels; ++i) {
+		len += qdata->name[len] + 1;
+	}
+
+	size_t zone_size = knot_dname_size(view_zone);
+	if (len + zone_size > KNOT_DNAME_MAXLEN) {
+		return KNOT_ESPACE;
+	}
+
+	memcpy(dst, qdata->name, len);
+	memcpy(dst + len, view_zone, zone_size);
+	return KNOT_EOK;
+}
+
+/*! \brief Answer with the RR set from the view, BEGIN if it has none. */
+static int view_answer(knot_pkt_t *pkt, struct query_data *qdata,
+                       const struct ecs_view *view)
+{
+	uint16_t qtype = knot_pkt_qtype(qdata->query);
+	if (qtype == KNOT_RRTYPE_ANY) {
+		return BEGIN;
+	}
+
+	/* View zone may be missing or not loaded yet. */
+	const zone_t *zone = knot_zonedb_find(qdata->param->server->zone_db, view->zone);
+	if (zone == NULL || zone->contents == NULL) {
+		return BEGIN;
+	}
+
+	uint8_t name[KNOT_DNAME_MAXLEN];
+	if (view_name(name, qdata, view->zone) != KNOT_EOK) {
+		return BEGIN;
+	}
+	const zone_node_t *node = zone_contents_find_node(zone->contents, name);
+	if (node == NULL) {
+		return BEGIN;
+	}
+	knot_rrset_t rrset = node_rrset(node, qtype);
+	if (knot_rrset_empty(&rrset)) {
+		return BEGIN;
+	}
+
+	/* The RR set is served under the query name. */
+	rrset.owner = (knot_dname_t *)qdata->name;
+	int ret = ns_put_rr(pkt, &rrset, NULL, KNOT_COMPR_HINT_QNAME, 0, qdata);
+	if (ret == KNOT_ESPACE) {
+		return TRUNC;
+	} else if (ret != KNOT_EOK) {
+		return ERROR;
+	}
+
+	/* Authority is from the queried zone, the view data can't be proven. */
+	ret = zone_contents_find_dname(qdata->zone->contents, qdata->name,
+	                               &qdata->node, &qdata->encloser,
+	                               &qdata->previous);
+	if (ret != ZONE_NAME_FOUND) {
+		qdata->node = NULL;
+	}
+	qdata->unsigned_answer = true;
+	knot_wire_set_aa(pkt->wire);
+	return HIT;
+}
+
+static int ecs_answer(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+{
+	if (pkt == NULL || qdata == NULL || ctx == NULL) {
+		return ERROR;
+	}
+
+	struct ecs_table *table = ctx;
+	struct ecs_client client;
+	if (client_get(qdata, &client) != KNOT_EOK) {
+		qdata->rcode = KNOT_RCODE_FORMERR;
+		return ERROR;
+	}
+
+	if (client.family != AF_UNSPEC) {
+		unsigned scope = 0;
+		const struct ecs_view *view = table_find(table, &client, &scope);
+		if (client.ecs && client_scope_put(pkt, qdata, &client, scope) != KNOT_EOK) {
+			return ERROR;
+		}
+		if (view != NULL) {
+			int next_state = view_answer(pkt, qdata, view);
+			if (next_state != BEGIN) {
+				return next_state;
+			}
+		}
+	}
+
+	return table->shared.next(state, pkt, qdata, table->shared.next_ctx);
+}
+
+/*! \brief Add view to the table of the query plan, create it if needed. */
+static int ecs_table_add(struct query_plan *plan, struct ecs_view *view)
+{
+	/* Take over the zone answer step. */
+	struct ecs_table *table = NULL;
+	int ret = query_shared_get(plan, QPLAN_ANSWER, QSHARED_REPLACE, ecs_answer,
+	                           sizeof(struct ecs_table), (void **)&table);
+	if (ret == KNOT_ENOTSUP) {
+		MODULE_ERR("zone answer step not found");
+	}
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	if (table->shared.refs == 1) {
+		init_list(&table->views);
+	}
+
+	add_tail(&table->views, &view->node);
+	view->table = table;
+
+	return table_compile(table);
+}
+
+int ecs_view_load(struct query_plan *plan, struct query_module *self)
+{
+	/* Parse subnet. */
+	char *saveptr = NULL;
+	char *token = strtok_r(self->param, " ", &saveptr);
+	if (token == NULL) {
+		return KNOT_EFEWDATA;
+	}
+
+	struct ecs_view *view = mm_alloc(self->mm, sizeof(struct ecs_view));
+	if (view == NULL) {
+		return KNOT_ENOMEM;
+	}
+	memset(view, 0, sizeof(struct ecs_view));
+
+	/* Save in query module, it takes ownership from now on. */
+	self->ctx = view;
+
+	int family = AF_INET;
+	unsigned prefix_max = IPV4_PREFIXLEN;
+	if (strchr(token, ':') != NULL) {
+		family = AF_INET6;
+		prefix_max = IPV6_PREFIXLEN;
+	}
+
+	view->subnet.prefix = prefix_max;
+	char *subnet = strchr(token, '/');
+	if (subnet) {
+		subnet[0] = '\0';
+		char *end = NULL;
+		view->subnet.prefix = strtoul(subnet + 1, &end, 10);
+		if (end == subnet + 1 || *end != '\0' || view->subnet.prefix > prefix_max) {
+			MODULE_ERR("invalid address prefix '%s'", subnet + 1);
+			return KNOT_EMALF;
+		}
+	}
+
+	int ret = sockaddr_set(&view->subnet.addr, family, token, 0);
+	if (ret != KNOT_EOK) {
+		MODULE_ERR("invalid address '%s'", token);
+		return KNOT_EMALF;
+	}
+
+	/* Parse view zone. */
+	token = strtok_r(NULL, " ", &saveptr);
+	if (token == NULL) {
+		MODULE_ERR("missing view zone");
+		return KNOT_EFEWDATA;
+	}
+	view->zone = knot_dname_from_str_alloc(token);
+	if (view->zone == NULL) {
+		MODULE_ERR("invalid view zone '%s'", token);
+		return KNOT_EMALF;
+	}
+	knot_dname_to_lower(view->zone);
+
+	return ecs_table_add(plan, view);
+}
+
+int ecs_view_unload(struct query_module *self)
+{
+	struct ecs_view *view = self->ctx;
+	if (view == NULL) {
+		return KNOT_EOK;
+	}
+
+	/* The table is shared by the modules in the same query plan. */
+	struct ecs_table *table = view->table;
+	if (table != NULL) {
+		rem_node(&view->node);
+		if (query_shared_release(&table->shared, table_free) > 0) {
+			(void) table_compile(table);
+		}
+	}
+
+	knot_dname_free(&view->zone, NULL);
+	mm_free(self->mm, view);
+	return KNOT_EOK;
+}
@@ -0,0 +1,40 @@
+/*!
+ * \file ecs_view.h
+ *
+ * \brief Client subnet views module
+ *
+ * Accepted configuration:
+ *  * "<address>/<prefix> <view zone>"
+ *
+ * Module answers the query from the view zone of the longest prefix matching
+ * the client subnet (RFC 7871) or the source address. The view zone overrides
+ * only the RR sets it contains, the rest is answered from the zone.
+ *
+ * \addtogroup query_processing
+ * @{
+ */
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "knot/nameserver/query_module.h"
+
+/*! \brief Module interface. */
+int ecs_view_load(struct query_plan *plan, struct query_module *self);
+int ecs_view_unload(struct query_module *self);
+
+/*! @} */
@@ -15,12 +15,18 @@
  */
 
 #include <lmdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
 
 #include "knot/modules/rosedb.h"
 #include "knot/nameserver/process_query.h"
 #include "libknot/rrtype/rdname.h"
 #include "libknot/dnssec/random.h"
 #include "libknot/rrset-dump.h"
+#include "libknot/internal/hash.h"
+#include "libknot/internal/mem.h"
 #include "libknot/internal/utils.h"
 
 /*! \note Below is an implementation of basic RR cache in LMDB,
@@ -30,12 +36,16 @@
  */
 
 #define LMDB_MAPSIZE (100 * 1024 * 1024)
+#define LMDB_MAXREADERS 1024 /* Each server thread keeps a reader slot. */
+
+#define INDEX_FILE "suffix.idx"
 
 struct cache
 {
 	MDB_dbi dbi;
 	MDB_env *env;
 	mm_ctx_t *pool;
+	char *index_path;
 };
 
 struct rdentry {
@@ -77,7 +87,14 @@ static int dbase_open(struct cache *cache, const char *handle)
 		return ret;
 	}
 
-	ret = mdb_env_open(cache->env, handle, 0, 0644);
+	ret = mdb_env_set_maxreaders(cache->env, LMDB_MAXREADERS);
+	if (ret != 0) {
+		mdb_env_close(cache->env);
+		return ret;
+	}
+
+	/* Read transactions are kept by the module, not bound to OS threads. */
+	ret = mdb_env_open(cache->env, handle, MDB_NOTLS, 0644);
 	if (ret != 0) {
 		mdb_env_close(cache->env);
 		return ret;
@@ -231,6 +248,7 @@ struct cache *cache_open(const char *handle, unsigned flags, mm_ctx_t *mm)
 	}
 
 	cache->pool = mm;
+	cache->index_path = sprintf_alloc("%s/%s", handle, INDEX_FILE);
 	return cache;
 }
 
@@ -241,6 +259,7 @@ void cache_close(struct cache *cache)
 	}
 
 	dbase_close(cache);
+	free(cache->index_path);
 	mm_free(cache->pool, cache);
 }
 
@@ -325,6 +344,356 @@ int cache_remove(MDB_txn *txn, MDB_dbi dbi, const knot_dname_t *name)
 	return ret;
 }
 
+/*                       suffix index                                   */
+
+/*!
+ * \note The index is an immutable trie of the database keys with labels in
+ *       the reverse order, so that the longest matching suffix of a name is
+ *       found in a single pass. It is built by rosedb_tool, written into
+ *       a new file and renamed over the old one, and the module maps it.
+ *
+ *       All numbers are in network byte order, offsets are from the file
+ *       start. A node is a 32-bit (child count << 1 | terminal flag) and
+ *       the sorted array of children (32-bit label offset, 32-bit node
+ *       offset). Labels are stored with the length byte.
+ */
+
+#define INDEX_MAGIC "KNOTRIDX"
+#define INDEX_HEADER_LEN 20 /* Magic, database transaction, root offset. */
+
+struct index {
+	uint8_t *data;
+	size_t size;
+	size_t txnid;       /*!< Database transaction the index was built from. */
+	uint32_t root;
+	int refs;
+};
+
+/*! \brief Compare labels, shorter first. */
+static int label_cmp(const uint8_t *a, const uint8_t *b)
+{
+	if (*a != *b) {
+		return *a - *b;
+	}
+
+	return memcmp(a + 1, b + 1, *a);
+}
+
+/*! \brief Split name to labels, the last one is the root label. */
+static int name_labels(const knot_dname_t *name, const uint8_t **labels)
+{
+	int count = 0;
+	while (*name != '\0') {
+		labels[count++] = name;
+		name += *name + 1;
+	}
+	labels[count] = name;
+
+	return count;
+}
+
+struct index *index_open(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct index *idx = NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < INDEX_HEADER_LEN) {
+		goto finish;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		goto finish;
+	}
+
+	uint32_t root = wire_read_u32(data + 16);
+	if (memcmp(data, INDEX_MAGIC, 8) != 0 || root > st.st_size - 4) {
+		munmap(data, st.st_size);
+		goto finish;
+	}
+
+	idx = malloc(sizeof(struct index));
+	if (idx == NULL) {
+		munmap(data, st.st_size);
+		goto finish;
+	}
+
+	idx->data = data;
+	idx->size = st.st_size;
+	idx->txnid = wire_read_u64(data + 8);
+	idx->root = root;
+	idx->refs = 1;
+
+finish:
+	close(fd);
+	return idx;
+}
+
+static void index_release(struct index *idx)
+{
+	if (idx != NULL && __sync_sub_and_fetch(&idx->refs, 1) == 0) {
+		munmap(idx->data, idx->size);
+		free(idx);
+	}
+}
+
+/*! \brief Child of the node with given label, 0 if not found. */
+static uint32_t index_child(const struct index *idx, uint32_t node, const uint8_t *label)
+{
+	uint32_t count = wire_read_u32(idx->data + node) >> 1;
+	if (count > (idx->size - node - 4) / 8) {
+		return 0;
+	}
+
+	const uint8_t *children = idx->data + node + 4;
+	uint32_t lo = 0, hi = count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		uint32_t label_off = wire_read_u32(children + mid * 8);
+		if (label_off >= idx->size || label_off + 1 + idx->data[label_off] > idx->size) {
+			return 0;
+		}
+		int cmp = label_cmp(idx->data + label_off, label);
+		if (cmp == 0) {
+			uint32_t child = wire_read_u32(children + mid * 8 + 4);
+			return (child <= idx->size - 4) ? child : 0;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief Find the longest suffix of the name present in the index. */
+static const knot_dname_t *index_find(const struct index *idx, const knot_dname_t *name)
+{
+	const uint8_t *labels[KNOT_DNAME_MAXLABELS + 1];
+	int count = name_labels(name, labels);
+
+	const knot_dname_t *match = NULL;
+	uint32_t node = idx->root;
+	for (int i = count; node != 0; --i) {
+		if (wire_read_u32(idx->data + node) & 1) {
+			match = labels[i];
+		}
+		if (i == 0) {
+			break;
+		}
+		node = index_child(idx, node, labels[i - 1]);
+	}
+
+	return match;
+}
+
+/*! \brief Growing output buffer of the index builder. */
+struct index_buf {
+	uint8_t *data;
+	size_t len;
+	size_t max;
+};
+
+static uint8_t *index_buf_reserve(struct index_buf *buf, size_t len)
+{
+	if (buf->len + len > buf->max) {
+		size_t max = (buf->max == 0) ? 4096 : buf->max;
+		while (buf->len + len > max) {
+			max *= 2;
+		}
+		uint8_t *data = realloc(buf->data, max);
+		if (data == NULL) {
+			return NULL;
+		}
+		buf->data = data;
+		buf->max = max;
+	}
+
+	uint8_t *pos = buf->data + buf->len;
+	buf->len += len;
+	return pos;
+}
+
+/*! \brief Compare names label by label from the root. */
+static int index_key_cmp(const void *a, const void *b)
+{
+	const uint8_t *labels_a[KNOT_DNAME_MAXLABELS + 1];
+	const uint8_t *labels_b[KNOT_DNAME_MAXLABELS + 1];
+	int count_a = name_labels(*(const knot_dname_t **)a, labels_a);
+	int count_b = name_labels(*(const knot_dname_t **)b, labels_b);
+
+	while (count_a > 0 && count_b > 0) {
+		int cmp = label_cmp(labels_a[--count_a], labels_b[--count_b]);
+		if (cmp != 0) {
+			return cmp;
+		}
+	}
+
+	return count_a - count_b;
+}
+
+/*! \brief Label of the name at given depth from the root. */
+static const uint8_t *key_label(const knot_dname_t *name, int depth, int *count)
+{
+	const uint8_t *labels[KNOT_DNAME_MAXLABELS + 1];
+	*count = name_labels(name, labels);
+	return (depth < *count) ? labels[*count - depth - 1] : NULL;
+}
+
+/*!
+ * \brief Write the node for sorted keys sharing 'depth' labels from the root.
+ *
+ * Children are written first, so the node offset is known to the parent.
+ */
+static int index_write_node(struct index_buf *buf, knot_dname_t **keys,
+                            size_t count, int depth, uint32_t *offset)
+{
+	int labels = 0;
+	key_label(keys[0], depth, &labels);
+	bool terminal = (labels == depth);
+	size_t pos = terminal ? 1 : 0;
+
+	/* At most one child per key. */
+	uint32_t *children = malloc(2 * (count - pos + 1) * sizeof(uint32_t));
+	if (children == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	uint32_t child_count = 0;
+	while (pos < count) {
+		const uint8_t *label = key_label(keys[pos], depth, &labels);
+		size_t end = pos + 1;
+		while (end < count &&
+		       label_cmp(key_label(keys[end], depth, &labels), label) == 0) {
+			++end;
+		}
+
+		/* Subtree first, then its label. */
+		int ret = index_write_node(buf, keys + pos, end - pos, depth + 1,
+		                           &children[2 * child_count + 1]);
+		uint8_t *dst = index_buf_reserve(buf, *label + 1);
+		if (ret != KNOT_EOK || dst == NULL) {
+			free(children);
+			return KNOT_ENOMEM;
+		}
+		memcpy(dst, label, *label + 1);
+		children[2 * child_count] = dst - buf->data;
+
+		child_count += 1;
+		pos = end;
+	}
+
+	uint8_t *node = index_buf_reserve(buf, 4 + 8 * child_count);
+	if (node == NULL || buf->len > UINT32_MAX) {
+		free(children);
+		return KNOT_ESPACE;
+	}
+	*offset = node - buf->data;
+	wire_write_u32(node, (child_count << 1) | terminal);
+	for (uint32_t i = 0; i < 2 * child_count; ++i) {
+		wire_write_u32(node + 4 + 4 * i, children[i]);
+	}
+
+	free(children);
+	return KNOT_EOK;
+}
+
+/*! \brief Build the index from the database keys and replace the index file. */
+int index_build(struct cache *cache, MDB_txn *txn)
+{
+	MDB_envinfo info;
+	mdb_env_info(cache->env, &info);
+
+	MDB_cursor *cursor = cursor_acquire(txn, cache->dbi);
+	if (cursor == NULL) {
+		return KNOT_ERROR;
+	}
+
+	/* Collect distinct keys. */
+	knot_dname_t **keys = NULL;
+	size_t count = 0, max = 0;
+	int ret = KNOT_EOK;
+	MDB_val key, val;
+	int found = mdb_cursor_get(cursor, &key, &val, MDB_FIRST);
+	while (found == 0) {
+		if (count == max) {
+			max = (max == 0) ? 1024 : 2 * max;
+			knot_dname_t **resized = realloc(keys, max * sizeof(*keys));
+			if (resized == NULL) {
+				ret = KNOT_ENOMEM;
+				break;
+			}
+			keys = resized;
+		}
+		keys[count] = malloc(key.mv_size);
+		if (keys[count] == NULL) {
+			ret = KNOT_ENOMEM;
+			break;
+		}
+		memcpy(keys[count++], key.mv_data, key.mv_size);
+		found = mdb_cursor_get(cursor, &key, &val, MDB_NEXT_NODUP);
+	}
+	cursor_release(cursor);
+
+	/* Header, then the trie. */
+	struct index_buf buf = { NULL, 0, 0 };
+	uint8_t *header = index_buf_reserve(&buf, INDEX_HEADER_LEN);
+	if (ret == KNOT_EOK && header == NULL) {
+		ret = KNOT_ENOMEM;
+	}
+	if (ret == KNOT_EOK) {
+		memcpy(header, INDEX_MAGIC, 8);
+		wire_write_u64(header + 8, info.me_last_txnid);
+		uint32_t root = 0;
+		if (count > 0) {
+			qsort(keys, count, sizeof(*keys), index_key_cmp);
+			ret = index_write_node(&buf, keys, count, 0, &root);
+		} else {
+			/* Empty root node. */
+			uint8_t *node = index_buf_reserve(&buf, 4);
+			if (node == NULL) {
+				ret = KNOT_ENOMEM;
+			} else {
+				root = node - buf.data;
+				wire_write_u32(node, 0);
+			}
+		}
+		wire_write_u32(buf.data + 16, root);
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		free(keys[i]);
+	}
+	free(keys);
+
+	/* Replace the index atomically. */
+	if (ret == KNOT_EOK) {
+		char *tmp_path = sprintf_alloc("%s.new", cache->index_path);
+		FILE *fp = (tmp_path != NULL) ? fopen(tmp_path, "w") : NULL;
+		if (fp == NULL) {
+			ret = KNOT_EACCES;
+		} else {
+			bool written = (fwrite(buf.data, 1, buf.len, fp) == buf.len);
+			written = (fflush(fp) == 0) && written;
+			written = (fsync(fileno(fp)) == 0) && written;
+			fclose(fp);
+			if (!written || rename(tmp_path, cache->index_path) != 0) {
+				unlink(tmp_path);
+				ret = KNOT_ERROR;
+			}
+		}
+		free(tmp_path);
+	}
+
+	free(buf.data);
+	return ret;
+}
+
 /*                       module callbacks                                   */
 
 #define DEFAULT_PORT 514
@@ -429,12 +798,11 @@ static int rosedb_log_message(char *stream, size_t *maxlen, knot_pkt_t *pkt,
 	return KNOT_EOK;
 }
 
-static int rosedb_send_log(int sock, struct sockaddr *dst_addr, knot_pkt_t *pkt,
-                           const char *threat_code, struct query_data *qdata)
+static int rosedb_format_log(char *buf, size_t *buflen, knot_pkt_t *pkt,
+                             const char *threat_code, struct query_data *qdata)
 {
-	char buf[SYSLOG_BUFLEN];
 	char *stream = buf;
-	size_t maxlen = sizeof(buf);
+	size_t maxlen = *buflen;
 
 	time_t now = time(NULL);
 	struct tm tm;
@@ -456,12 +824,298 @@ static int rosedb_send_log(int sock, struct sockaddr *dst_addr, knot_pkt_t *pkt,
 		return ret;
 	}
 
+	*buflen -= maxlen;
+	return KNOT_EOK;
+}
+
+static int rosedb_send_log(int sock, struct sockaddr *dst_addr, knot_pkt_t *pkt,
+                           const char *threat_code, struct query_data *qdata)
+{
+	char buf[SYSLOG_BUFLEN];
+	size_t len = sizeof(buf);
+	int ret = rosedb_format_log(buf, &len, pkt, threat_code, qdata);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
 	/* Send log message line. */
-	sendto(sock, buf, sizeof(buf) - maxlen, 0, dst_addr, sockaddr_len(dst_addr));
+	sendto(sock, buf, len, 0, dst_addr, sockaddr_len(dst_addr));
 
 	return ret;
 }
 
+/*                       per-thread state                                   */
+
+#define FRONT_CACHE_SIZE 512 /* Remembered QNAMEs per thread. */
+#define LOG_BATCH 16         /* Log messages sent at once. */
+#define LOG_DELAY 1          /* Maximum delay of a log message [s]. */
+
+/*! \brief Remembered result of the suffix search for a QNAME. */
+struct front_entry {
+	uint8_t qname[KNOT_DNAME_MAXLEN];
+	int16_t match;      /*!< Offset of the matching suffix, -1 if none. */
+	bool valid;
+};
+
+/*! \brief Pending syslog message. */
+struct log_msg {
+	struct sockaddr_storage dst;
+	size_t len;
+	char buf[SYSLOG_BUFLEN];
+};
+
+/*!
+ * \brief State owned by a single server thread.
+ *
+ * The read transaction is reset after each query and renewed by the next
+ * one, which is much cheaper than starting a new transaction.
+ */
+struct rosedb_thread {
+	MDB_txn *txn;
+	MDB_cursor *cursor;
+	size_t generation;  /*!< Last database transaction seen by the cache. */
+	struct index *index;
+	unsigned index_gen;
+	struct front_entry front[FRONT_CACHE_SIZE];
+	pthread_mutex_t log_lock; /*!< Pending messages are flushed by the timer too. */
+	int log_sock;
+	unsigned log_count;
+	time_t log_since;   /*!< Time of the oldest pending message. */
+	struct log_msg log[LOG_BATCH];
+};
+
+/*! \brief Module context. */
+struct rosedb {
+	struct cache *cache;
+	hash_key_t hash_key;
+	struct rosedb_thread *threads;
+	size_t thread_count;
+	pthread_mutex_t index_lock;
+	struct index *index;    /*!< Current index, may be NULL. */
+	unsigned index_gen;     /*!< Incremented on index replacement. */
+	time_t index_checked;   /*!< Last check of the index file. */
+	ino_t index_ino;
+	time_t index_mtime;
+	event_t *log_timer;     /*!< Flushes the messages of idle threads. */
+	bool log_armed;         /*!< Set while the timer is scheduled. */
+};
+
+/*! \brief Thread state of the current query or NULL. */
+static struct rosedb_thread *thread_state(struct rosedb *ctx, struct query_data *qdata)
+{
+	unsigned thread_id = qdata->param->thread_id;
+	if (thread_id >= ctx->thread_count) {
+		return NULL;
+	}
+
+	return &ctx->threads[thread_id];
+}
+
+/*! \brief Renew the read transaction, flush the front cache on database change. */
+static int thread_txn_renew(struct rosedb_thread *thr, struct cache *cache)
+{
+	/* Read before renewal, the snapshot is at least this recent. */
+	MDB_envinfo info;
+	mdb_env_info(cache->env, &info);
+
+	int ret = 0;
+	if (thr->txn == NULL) {
+		ret = mdb_txn_begin(cache->env, NULL, MDB_RDONLY, &thr->txn);
+		if (ret != 0) {
+			thr->txn = NULL;
+			return ret;
+		}
+		ret = mdb_cursor_open(thr->txn, cache->dbi, &thr->cursor);
+		if (ret != 0) {
+			mdb_txn_abort(thr->txn);
+			thr->txn = NULL;
+			return ret;
+		}
+	} else {
+		ret = mdb_txn_renew(thr->txn);
+		if (ret == 0) {
+			ret = mdb_cursor_renew(thr->txn, thr->cursor);
+		}
+	}
+	if (ret != 0) {
+		return ret;
+	}
+
+	if (info.me_last_txnid != thr->generation) {
+		memset(thr->front, 0, sizeof(thr->front));
+		thr->generation = info.me_last_txnid;
+	}
+
+	return 0;
+}
+
+/*! \brief Reload the index if the file was replaced, at most once a second. */
+static void index_check(struct rosedb *ctx)
+{
+	time_t now = time(NULL);
+	time_t last = ctx->index_checked;
+	if (now == last || !__sync_bool_compare_and_swap(&ctx->index_checked, last, now)) {
+		return;
+	}
+
+	struct stat st;
+	if (stat(ctx->cache->index_path, &st) != 0) {
+		memset(&st, 0, sizeof(st));
+	}
+	if (st.st_ino == ctx->index_ino && st.st_mtime == ctx->index_mtime) {
+		return;
+	}
+	ctx->index_ino = st.st_ino;
+	ctx->index_mtime = st.st_mtime;
+
+	struct index *idx = index_open(ctx->cache->index_path);
+
+	pthread_mutex_lock(&ctx->index_lock);
+	struct index *old = ctx->index;
+	ctx->index = idx;
+	ctx->index_gen += 1;
+	pthread_mutex_unlock(&ctx->index_lock);
+
+	index_release(old);
+}
+
+/*! \brief Index of the thread, switched to the current one if replaced. */
+static struct index *thread_index(struct rosedb *ctx, struct rosedb_thread *thr)
+{
+	if (thr->index_gen != ctx->index_gen) {
+		pthread_mutex_lock(&ctx->index_lock);
+		index_release(thr->index);
+		thr->index = ctx->index;
+		if (thr->index != NULL) {
+			__sync_add_and_fetch(&thr->index->refs, 1);
+		}
+		thr->index_gen = ctx->index_gen;
+		pthread_mutex_unlock(&ctx->index_lock);
+	}
+
+	/* Ignore the index built from a different database state. */
+	if (thr->index == NULL || thr->index->txnid != thr->generation) {
+		return NULL;
+	}
+
+	return thr->index;
+}
+
+static struct front_entry *front_lookup(struct rosedb *ctx, struct rosedb_thread *thr,
+                                        const knot_dname_t *qname)
+{
+	size_t len = knot_dname_size(qname);
+	uint64_t hash = hash_keyed(&ctx->hash_key, (const char *)qname, len);
+	return &thr->front[hash % FRONT_CACHE_SIZE];
+}
+
+/*! \brief Send pending log messages. */
+static void thread_log_flush(struct rosedb_thread *thr)
+{
+	if (thr->log_count == 0) {
+		return;
+	}
+
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[LOG_BATCH];
+	struct iovec iov[LOG_BATCH];
+	memset(msgs, 0, sizeof(msgs));
+	for (unsigned i = 0; i < thr->log_count; ++i) {
+		struct log_msg *msg = &thr->log[i];
+		iov[i].iov_base = msg->buf;
+		iov[i].iov_len = msg->len;
+		msgs[i].msg_hdr.msg_name = &msg->dst;
+		msgs[i].msg_hdr.msg_namelen = sockaddr_len((struct sockaddr *)&msg->dst);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	sendmmsg(thr->log_sock, msgs, thr->log_count, 0);
+#else
+	for (unsigned i = 0; i < thr->log_count; ++i) {
+		struct log_msg *msg = &thr->log[i];
+		sendto(thr->log_sock, msg->buf, msg->len, 0, (struct sockaddr *)&msg->dst,
+		       sockaddr_len((struct sockaddr *)&msg->dst));
+	}
+#endif
+
+	thr->log_count = 0;
+}
+
+/*! \brief Send the pending log messages of all threads. */
+static int log_timer_flush(event_t *ev)
+{
+	struct rosedb *ctx = ev->data;
+
+	/* Messages queued from now on schedule the timer again. */
+	ctx->log_armed = false;
+	__sync_synchronize();
+
+	for (size_t i = 0; i < ctx->thread_count; ++i) {
+		struct rosedb_thread *thr = &ctx->threads[i];
+		pthread_mutex_lock(&thr->log_lock);
+		thread_log_flush(thr);
+		pthread_mutex_unlock(&thr->log_lock);
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Schedule the flush of the pending log messages, unless scheduled already. */
+static void log_timer_arm(struct rosedb *ctx, server_t *server)
+{
+	if (!__sync_bool_compare_and_swap(&ctx->log_armed, false, true)) {
+		return;
+	}
+
+	if (ctx->log_timer == NULL) {
+		ctx->log_timer = evsched_event_create(&server->sched, log_timer_flush, ctx);
+	}
+	if (ctx->log_timer == NULL ||
+	    evsched_schedule(ctx->log_timer, LOG_DELAY * 1000) != KNOT_EOK) {
+		ctx->log_armed = false;
+	}
+}
+
+/*! \brief Queue a log message, the batch is sent when full or delayed too long. */
+static void thread_log(struct rosedb *ctx, struct rosedb_thread *thr,
+                       const struct sockaddr_storage *dst, knot_pkt_t *pkt,
+                       const char *threat_code, struct query_data *qdata)
+{
+	pthread_mutex_lock(&thr->log_lock);
+
+	if (thr->log_sock < 0) {
+		thr->log_sock = net_unbound_socket(AF_INET, dst);
+		if (thr->log_sock < 0) {
+			pthread_mutex_unlock(&thr->log_lock);
+			return;
+		}
+	}
+
+	struct log_msg *msg = &thr->log[thr->log_count];
+	msg->len = sizeof(msg->buf);
+	if (rosedb_format_log(msg->buf, &msg->len, pkt, threat_code, qdata) != KNOT_EOK) {
+		pthread_mutex_unlock(&thr->log_lock);
+		return;
+	}
+	memcpy(&msg->dst, dst, sizeof(*dst));
+
+	bool first = (thr->log_count++ == 0);
+	if (first) {
+		thr->log_since = time(NULL);
+	}
+	if (thr->log_count == LOG_BATCH) {
+		thread_log_flush(thr);
+		first = false;
+	}
+
+	pthread_mutex_unlock(&thr->log_lock);
+
+	/* The batch is sent even if the thread serves no more queries. */
+	if (first) {
+		log_timer_arm(ctx, qdata->param->server);
+	}
+}
+
 static int rosedb_synth_rr(knot_pkt_t *pkt, struct entry *entry, uint16_t qtype)
 {
 	if (qtype != entry->data.type) {
@@ -480,6 +1134,7 @@ static int rosedb_synth_rr(knot_pkt_t *pkt, struct entry *entry, uint16_t qtype)
 }
 
 static int rosedb_synth(knot_pkt_t *pkt, const knot_dname_t *key, struct iter *it,
+                        struct rosedb *ctx, struct rosedb_thread *thr,
                         struct query_data *qdata)
 {
 	struct entry entry;
@@ -521,7 +1176,12 @@ static int rosedb_synth(knot_pkt_t *pkt, const knot_dname_t *key, struct iter *i
 
 	/* Send message to syslog. */
 	struct sockaddr_storage syslog_addr;
-	if (sockaddr_set(&syslog_addr, AF_INET, entry.syslog_ip, DEFAULT_PORT) == KNOT_EOK) {
+	if (sockaddr_set(&syslog_addr, AF_INET, entry.syslog_ip, DEFAULT_PORT) != KNOT_EOK) {
+		return ret;
+	}
+	if (thr != NULL) {
+		thread_log(ctx, thr, &syslog_addr, pkt, entry.threat_code, qdata);
+	} else {
 		int sock = net_unbound_socket(AF_INET, &syslog_addr);
 		if (sock > 0) {
 			rosedb_send_log(sock, (struct sockaddr *)&syslog_addr, pkt,
@@ -533,41 +1193,114 @@ static int rosedb_synth(knot_pkt_t *pkt, const knot_dname_t *key, struct iter *i
 	return ret;
 }
 
-static int rosedb_query_txn(MDB_txn *txn, MDB_dbi dbi, knot_pkt_t *pkt, struct query_data *qdata)
+/*! \brief Find the closest database entry at or above QNAME. */
+static const knot_dname_t *rosedb_find(struct iter *it, const knot_dname_t *qname,
+                                       const uint8_t *wire, const struct index *idx)
 {
-	struct iter it;
-	int ret = KNOT_EOK;
-
-	/* Find suffix for QNAME. */
-	const knot_dname_t *qname = knot_pkt_qname(qdata->query);
-	const knot_dname_t *key = qname;
-	while (key) {
-		ret = cache_query_fetch(txn, dbi, &it, key);
-		if (ret == 0) { /* Found */
-			break;
+	/* Single lookup with an up-to-date index. */
+	if (idx != NULL) {
+		const knot_dname_t *key = index_find(idx, qname);
+		if (key == NULL || cache_iter_begin(it, key) == 0) {
+			return key;
 		}
+	}
 
+	const knot_dname_t *key = qname;
+	while (cache_iter_begin(it, key) != 0) {
 		if (*key == '\0') { /* Last label, not found. */
-			return KNOT_ENOENT;
+			return NULL;
 		}
 
-		key = knot_wire_next_label(key, qdata->query->wire);
+		key = knot_wire_next_label(key, wire);
+	}
+
+	return key;
+}
+
+static int rosedb_query_txn(MDB_txn *txn, MDB_dbi dbi, knot_pkt_t *pkt, struct query_data *qdata)
+{
+	struct iter it;
+	it.cur = cursor_acquire(txn, dbi);
+	if (it.cur == NULL) {
+		return KNOT_ERROR;
+	}
+
+	/* Find suffix for QNAME. */
+	const knot_dname_t *key = rosedb_find(&it, knot_pkt_qname(qdata->query),
+	                                      qdata->query->wire, NULL);
+	if (key == NULL) {
+		cache_iter_free(&it);
+		return KNOT_ENOENT;
 	}
 
 	/* Synthetize record to response. */
-	ret = rosedb_synth(pkt, key, &it, qdata);
+	int ret = rosedb_synth(pkt, key, &it, NULL, NULL, qdata);
 
 	cache_iter_free(&it);
 	return ret;
 }
 
+static int rosedb_query_thread(struct rosedb *ctx, struct rosedb_thread *thr,
+                               knot_pkt_t *pkt, struct query_data *qdata)
+{
+	struct iter it;
+	it.cur = thr->cursor;
+
+	/* Remembered suffix, the entry exists as the database did not change. */
+	const knot_dname_t *qname = knot_pkt_qname(qdata->query);
+	const knot_dname_t *key = NULL;
+	struct front_entry *front = front_lookup(ctx, thr, qname);
+	if (front->valid && memcmp(front->qname, qname, knot_dname_size(qname)) == 0) {
+		if (front->match < 0) {
+			return KNOT_ENOENT;
+		}
+		key = qname + front->match;
+		if (cache_iter_begin(&it, key) != 0) {
+			key = NULL;
+		}
+	}
+
+	if (key == NULL) {
+		key = rosedb_find(&it, qname, qdata->query->wire, thread_index(ctx, thr));
+		memcpy(front->qname, qname, knot_dname_size(qname));
+		front->match = (key != NULL) ? (key - qname) : -1;
+		front->valid = true;
+		if (key == NULL) {
+			return KNOT_ENOENT;
+		}
+	}
+
+	return rosedb_synth(pkt, key, &it, ctx, thr, qdata);
+}
+
 static int rosedb_query(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
 {
 	if (pkt == NULL || qdata == NULL || ctx == NULL) {
 		return KNOT_NS_PROC_FAIL;
 	}
 
-	struct cache *cache = ctx;
+	struct rosedb *rosedb = ctx;
+	struct cache *cache = rosedb->cache;
+
+	/* Reuse the thread transaction if possible. */
+	struct rosedb_thread *thr = thread_state(rosedb, qdata);
+	if (thr != NULL) {
+		index_check(rosedb);
+		if (thread_txn_renew(thr, cache) != 0) { /* Can't renew transaction, ignore. */
+			return state;
+		}
+
+		int ret = rosedb_query_thread(rosedb, thr, pkt, qdata);
+		mdb_txn_reset(thr->txn);
+
+		pthread_mutex_lock(&thr->log_lock);
+		if (thr->log_count > 0 && time(NULL) - thr->log_since >= LOG_DELAY) {
+			thread_log_flush(thr);
+		}
+		pthread_mutex_unlock(&thr->log_lock);
+
+		return (ret == 0) ? KNOT_NS_PROC_DONE : state;
+	}
 
 	MDB_txn *txn = NULL;
 	int ret = mdb_txn_begin(cache->env, NULL, MDB_RDONLY, &txn);
@@ -586,21 +1319,71 @@ static int rosedb_query(int state, knot_pkt_t *pkt, struct query_data *qdata, vo
 	return KNOT_NS_PROC_DONE;
 }
 
+static void rosedb_free(struct rosedb *ctx, mm_ctx_t *mm)
+{
+	if (ctx->log_timer != NULL) {
+		evsched_cancel(ctx->log_timer);
+		evsched_event_free(ctx->log_timer);
+	}
+
+	for (size_t i = 0; i < ctx->thread_count; ++i) {
+		struct rosedb_thread *thr = &ctx->threads[i];
+		if (thr->txn != NULL) {
+			mdb_cursor_close(thr->cursor);
+			mdb_txn_abort(thr->txn);
+		}
+		if (thr->log_sock >= 0) {
+			thread_log_flush(thr);
+			close(thr->log_sock);
+		}
+		pthread_mutex_destroy(&thr->log_lock);
+		index_release(thr->index);
+	}
+	free(ctx->threads);
+	index_release(ctx->index);
+	pthread_mutex_destroy(&ctx->index_lock);
+
+	cache_close(ctx->cache);
+	mm_free(mm, ctx);
+}
+
 int rosedb_load(struct query_plan *plan, struct query_module *self)
 {
 	if (self == NULL || plan == NULL) {
 		return KNOT_EINVAL;
 	}
-	
-	struct cache *cache = cache_open(self->param, 0, self->mm);
-	if (cache == NULL) {
+
+	struct rosedb *ctx = mm_alloc(self->mm, sizeof(struct rosedb));
+	if (ctx == NULL) {
+		return KNOT_ENOMEM;
+	}
+	memset(ctx, 0, sizeof(struct rosedb));
+	knot_random_buffer(&ctx->hash_key, sizeof(ctx->hash_key));
+	pthread_mutex_init(&ctx->index_lock, NULL);
+
+	ctx->cache = cache_open(self->param, 0, self->mm);
+	if (ctx->cache == NULL) {
 		MODULE_ERR("couldn't open db '%s'", self->param);
+		mm_free(self->mm, ctx);
 		return KNOT_ENOMEM;
 	}
 
-	self->ctx = cache;
+	/* State for each server thread. */
+	size_t count = conf_udp_threads(self->config) + conf_tcp_threads(self->config);
+	ctx->threads = calloc(count, sizeof(struct rosedb_thread));
+	if (ctx->threads == NULL) {
+		rosedb_free(ctx, self->mm);
+		return KNOT_ENOMEM;
+	}
+	for (; ctx->thread_count < count; ++ctx->thread_count) {
+		ctx->threads[ctx->thread_count].log_sock = -1;
+		pthread_mutex_init(&ctx->threads[ctx->thread_count].log_lock, NULL);
+	}
+	index_check(ctx);
 
-	return query_plan_step(plan, QPLAN_BEGIN, rosedb_query, cache);
+	self->ctx = ctx;
+
+	return query_plan_step(plan, QPLAN_BEGIN, rosedb_query, ctx);
 }
 
 int rosedb_unload(struct query_module *self)
@@ -609,7 +1392,6 @@ int rosedb_unload(struct query_module *self)
 		return KNOT_EINVAL;
 	}
 
-	cache_close(self->ctx);
+	rosedb_free(self->ctx, self->mm);
 	return KNOT_EOK;
 }
-
@@ -11,6 +11,7 @@ static int rosedb_del(struct cache *cache, MDB_txn *txn, int argc, char *argv[])
 static int rosedb_get(struct cache *cache, MDB_txn *txn, int argc, char *argv[]);
 static int rosedb_list(struct cache *cache, MDB_txn *txn, int argc, char *argv[]);
 static int rosedb_import(struct cache *cache, MDB_txn *txn, int argc, char *argv[]);
+static int rosedb_index(struct cache *cache, MDB_txn *txn, int argc, char *argv[]);
 
 struct tool_action {
 	const char *name;
@@ -20,12 +21,13 @@ struct tool_action {
 };
 
 #define TOOL_ACTION_MAXARG 7
-#define TOOL_ACTION_COUNT 5
+#define TOOL_ACTION_COUNT 6
 static struct tool_action TOOL_ACTION[TOOL_ACTION_COUNT] = {
 { "add",    rosedb_add,    6, "<zone> <rrtype> <ttl> <rdata> <threat_code> <syslog_ip>" },
 { "del",    rosedb_del,    1, "<zone> [rrtype]" },
 { "get",    rosedb_get,    1, "<zone> [rrtype]" },
 { "import", rosedb_import, 1, "<file>" },
+{ "index",  rosedb_index,  0, "" },
 { "list",   rosedb_list,   0, "" }
 };
 
@@ -232,6 +234,17 @@ static int rosedb_list(struct cache *cache, MDB_txn *txn, int argc, char *argv[]
 	return KNOT_EOK;
 }
 
+static int rosedb_index(struct cache *cache, MDB_txn *txn, int argc, char *argv[])
+{
+	int ret = index_build(cache, txn);
+	if (ret != KNOT_EOK) {
+		fprintf(stderr, "failed to write '%s' (%s)\n", cache->index_path,
+		        knot_strerror(ret));
+	}
+
+	return ret;
+}
+
 static char *trim(char *line)
 {
 	int last = strlen(line) - 1;
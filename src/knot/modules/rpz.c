@@ -0,0 +1,1235 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "knot/modules/rpz.h"
+#include "knot/nameserver/process_query.h"
+#include "knot/nameserver/internet.h"
+#include "knot/nameserver/nsec_proofs.h"
+#include "knot/server/journal.h"
+#include "knot/updates/changesets.h"
+#include "knot/zone/zone.h"
+#include "knot/conf/conf.h"
+#include "libknot/descriptor.h"
+#include "libknot/rrtype/rdname.h"
+#include "libknot/internal/utils.h"
+
+/* Defines. */
+#define IPTRIE_V4 0  /* Root of the IPv4 prefixes. */
+#define IPTRIE_V6 1  /* Root of the IPv6 prefixes. */
+#define IPTRIE_ROOTS 2
+#define MODULE_ERR(msg...) log_error("module 'rpz', " msg)
+
+/*! \brief Policy actions. */
+enum rpz_action {
+	RPZ_NXDOMAIN = 1, /*!< CNAME . */
+	RPZ_NODATA,       /*!< CNAME *. */
+	RPZ_PASSTHRU,     /*!< CNAME rpz-passthru. */
+	RPZ_LOCAL         /*!< Local data. */
+};
+
+/*! \brief Match counters. */
+enum rpz_match {
+	RPZ_MATCH_QNAME = 0,
+	RPZ_MATCH_WILDCARD,
+	RPZ_MATCH_IP,
+	RPZ_MATCH_PASSTHRU,
+	RPZ_MATCH_COUNT
+};
+
+/*! \brief Policy of a trigger. */
+struct rpz_rule {
+	int refs;
+	enum rpz_action action;
+	uint16_t count;          /*!< Local data RR sets. */
+	knot_rrset_t *rrsets;    /*!< Local data, owners are set when answering. */
+};
+
+/*!
+ * \brief Node of the trigger name trie.
+ *
+ * The trie is walked from the root label, so that the exact and the closest
+ * wildcard trigger for a name are found in a single pass. The nodes are not
+ * modified once published, an update copies the path to the changed node and
+ * shares the rest of the trie with the previous index.
+ */
+struct rpz_node {
+	int refs;
+	struct rpz_rule *rule;      /*!< Trigger for the name. */
+	struct rpz_rule *wildcard;  /*!< Trigger for the names below. */
+	struct rpz_node **children; /*!< Sorted by label. */
+	uint32_t count;
+	uint32_t max;               /*!< Allocated children. */
+	uint8_t label[];            /*!< Label with the length byte. */
+};
+
+/*! \brief Node of the response address prefix trie. */
+struct rpz_bit {
+	uint32_t child[2];          /*!< Node index, 0 if none (a root). */
+	struct rpz_rule *rule;
+};
+
+/*! \brief Response address prefix trie. */
+struct rpz_iptrie {
+	int refs;
+	struct rpz_bit *nodes;
+	uint32_t count;
+	uint32_t max;
+};
+
+/*! \brief Compiled triggers of a policy zone version. */
+struct rpz_index {
+	int refs;
+	const zone_contents_t *contents;
+	uint32_t serial;
+	size_t triggers;
+	struct rpz_node *names;     /*!< QNAME triggers. */
+	struct rpz_node *ips;       /*!< Response IP triggers by name. */
+	struct rpz_iptrie *iptrie;  /*!< Response IP triggers by prefix. */
+};
+
+/*! \brief State owned by a single server thread. */
+struct rpz_thread {
+	struct rpz_index *index;
+	uint64_t matches[RPZ_MATCH_COUNT];
+} __attribute__((aligned(64)));
+
+/*! \brief Policy zone. */
+struct rpz_policy {
+	node_t node;
+	knot_dname_t *zone;
+	pthread_mutex_t lock;       /*!< Serializes the index updates. */
+	struct rpz_index *index;    /*!< Latest index, NULL if the zone isn't loaded. */
+	struct rpz_thread *threads;
+	size_t thread_count;
+	struct rpz_ctx *ctx;
+};
+
+/*! \brief Policy zones of a query plan, in the configuration order. */
+struct rpz_ctx {
+	struct query_shared shared; /*!< Replaces the answer step. */
+	list_t policies;
+};
+
+/*                       policy rules                                   */
+
+static struct rpz_rule *rule_ref(struct rpz_rule *rule)
+{
+	if (rule != NULL) {
+		__sync_add_and_fetch(&rule->refs, 1);
+	}
+	return rule;
+}
+
+static void rule_release(struct rpz_rule *rule)
+{
+	if (rule == NULL || __sync_sub_and_fetch(&rule->refs, 1) > 0) {
+		return;
+	}
+
+	for (uint16_t i = 0; i < rule->count; ++i) {
+		knot_rdataset_clear(&rule->rrsets[i].rrs, NULL);
+	}
+	free(rule->rrsets);
+	free(rule);
+}
+
+/*! \brief Copy the local data of the policy node. */
+static int rule_copy_data(struct rpz_rule *rule, const zone_node_t *node)
+{
+	rule->rrsets = malloc(node->rrset_count * sizeof(knot_rrset_t));
+	if (rule->rrsets == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	for (uint16_t i = 0; i < node->rrset_count; ++i) {
+		knot_rrset_t rrset = node_rrset_at(node, i);
+		if (rrset.type == KNOT_RRTYPE_RRSIG || rrset.type == KNOT_RRTYPE_NSEC ||
+		    rrset.type == KNOT_RRTYPE_NSEC3) {
+			continue;
+		}
+		knot_rrset_t *copy = &rule->rrsets[rule->count];
+		knot_rrset_init(copy, NULL, rrset.type, rrset.rclass);
+		if (knot_rdataset_copy(&copy->rrs, &rrset.rrs, NULL) != KNOT_EOK) {
+			return KNOT_ENOMEM;
+		}
+		rule->count += 1;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Compile the policy of the trigger node, NULL if there is none. */
+static struct rpz_rule *rule_compile(const zone_node_t *node)
+{
+	if (node == NULL) {
+		return NULL;
+	}
+
+	struct rpz_rule *rule = malloc(sizeof(struct rpz_rule));
+	if (rule == NULL) {
+		return NULL;
+	}
+	memset(rule, 0, sizeof(struct rpz_rule));
+	rule->refs = 1;
+	rule->action = RPZ_LOCAL;
+
+	/* Actions are CNAMEs to special names. */
+	const knot_rdataset_t *cname = node_rdataset(node, KNOT_RRTYPE_CNAME);
+	if (cname != NULL) {
+		const knot_dname_t *target = knot_cname_name(cname);
+		if (*target == '\0') {
+			rule->action = RPZ_NXDOMAIN;
+		} else if (knot_dname_is_equal(target, (const uint8_t *)"\x01*")) {
+			rule->action = RPZ_NODATA;
+		} else if (knot_dname_is_equal(target, (const uint8_t *)"\x0c""rpz-passthru")) {
+			rule->action = RPZ_PASSTHRU;
+		} else if (target[0] > 4 && memcmp(target + 1, "rpz-", 4) == 0 &&
+		           target[target[0] + 1] == '\0') {
+			/* Other actions (drop, tcp-only) aren't supported. */
+			rule_release(rule);
+			return NULL;
+		}
+	}
+
+	if (rule->action == RPZ_LOCAL &&
+	    (rule_copy_data(rule, node) != KNOT_EOK || rule->count == 0)) {
+		rule_release(rule);
+		return NULL;
+	}
+
+	return rule;
+}
+
+/*                       trigger name trie                              */
+
+/*! \brief Compare labels, shorter first. */
+static int label_cmp(const uint8_t *a, const uint8_t *b)
+{
+	if (*a != *b) {
+		return *a - *b;
+	}
+
+	return memcmp(a + 1, b + 1, *a);
+}
+
+/*! \brief Split name to labels, the last one is the root label. */
+static int name_labels(const knot_dname_t *name, const uint8_t **labels)
+{
+	int count = 0;
+	while (*name != '\0') {
+		labels[count++] = name;
+		name += *name + 1;
+	}
+	labels[count] = name;
+
+	return count;
+}
+
+static struct rpz_node *trie_node_new(const uint8_t *label)
+{
+	struct rpz_node *node = malloc(sizeof(struct rpz_node) + *label + 1);
+	if (node == NULL) {
+		return NULL;
+	}
+	memset(node, 0, sizeof(struct rpz_node));
+	memcpy(node->label, label, *label + 1);
+	node->refs = 1;
+
+	return node;
+}
+
+static struct rpz_node *trie_node_ref(struct rpz_node *node)
+{
+	if (node != NULL) {
+		__sync_add_and_fetch(&node->refs, 1);
+	}
+	return node;
+}
+
+static void trie_node_release(struct rpz_node *node)
+{
+	if (node == NULL || __sync_sub_and_fetch(&node->refs, 1) > 0) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < node->count; ++i) {
+		trie_node_release(node->children[i]);
+	}
+	rule_release(node->rule);
+	rule_release(node->wildcard);
+	free(node->children);
+	free(node);
+}
+
+/*!
+ * \brief Get a node the update may modify, the node is copied if it is shared
+ *        with another index.
+ */
+static struct rpz_node *trie_node_own(struct rpz_node *node)
+{
+	if (node->refs == 1) {
+		return node;
+	}
+
+	struct rpz_node *copy = trie_node_new(node->label);
+	if (copy == NULL) {
+		return NULL;
+	}
+	if (node->count > 0) {
+		copy->children = malloc(node->count * sizeof(struct rpz_node *));
+		if (copy->children == NULL) {
+			free(copy);
+			return NULL;
+		}
+		for (uint32_t i = 0; i < node->count; ++i) {
+			copy->children[i] = trie_node_ref(node->children[i]);
+		}
+		copy->count = node->count;
+		copy->max = node->count;
+	}
+	copy->rule = rule_ref(node->rule);
+	copy->wildcard = rule_ref(node->wildcard);
+
+	trie_node_release(node);
+	return copy;
+}
+
+/*! \brief Position of the child with the label, or where it would be inserted. */
+static uint32_t trie_node_child_pos(const struct rpz_node *node, const uint8_t *label,
+                                    bool *found)
+{
+	uint32_t lo = 0, hi = node->count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = label_cmp(node->children[mid]->label, label);
+		if (cmp == 0) {
+			*found = true;
+			return mid;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	*found = false;
+	return lo;
+}
+
+static const struct rpz_node *trie_node_child(const struct rpz_node *node,
+                                              const uint8_t *label)
+{
+	bool found = false;
+	uint32_t pos = trie_node_child_pos(node, label, &found);
+	return found ? node->children[pos] : NULL;
+}
+
+/*!
+ * \brief Set (or remove) the trigger for the name given by labels in the name
+ *        order. The trie takes over the caller's reference to the rule.
+ */
+static int trie_set(struct rpz_node **root, const uint8_t **labels, int count,
+                    bool wildcard, struct rpz_rule *rule, int *delta)
+{
+	if (*root == NULL) {
+		*root = trie_node_new((const uint8_t *)"");
+		if (*root == NULL) {
+			rule_release(rule);
+			return KNOT_ENOMEM;
+		}
+	}
+
+	struct rpz_node **slot = root;
+	for (int i = count; ; --i) {
+		struct rpz_node *node = trie_node_own(*slot);
+		if (node == NULL) {
+			rule_release(rule);
+			return KNOT_ENOMEM;
+		}
+		*slot = node;
+		if (i == 0) {
+			break;
+		}
+
+		bool found = false;
+		uint32_t pos = trie_node_child_pos(node, labels[i - 1], &found);
+		if (!found) {
+			if (rule == NULL) {
+				return KNOT_EOK; /* Nothing to remove. */
+			}
+			if (node->count == node->max) {
+				uint32_t max = (node->max > 0) ? 2 * node->max : 4;
+				struct rpz_node **children = realloc(node->children,
+				                                     max * sizeof(*children));
+				if (children == NULL) {
+					rule_release(rule);
+					return KNOT_ENOMEM;
+				}
+				node->children = children;
+				node->max = max;
+			}
+			struct rpz_node **children = node->children;
+			struct rpz_node *child = trie_node_new(labels[i - 1]);
+			if (child == NULL) {
+				rule_release(rule);
+				return KNOT_ENOMEM;
+			}
+			memmove(children + pos + 1, children + pos,
+			        (node->count - pos) * sizeof(*children));
+			children[pos] = child;
+			node->count += 1;
+		}
+		slot = &node->children[pos];
+	}
+
+	struct rpz_rule **target = wildcard ? &(*slot)->wildcard : &(*slot)->rule;
+	*delta = (rule != NULL) - (*target != NULL);
+	rule_release(*target);
+	*target = rule;
+
+	return KNOT_EOK;
+}
+
+/*! \brief Find the exact trigger for the name, or the closest wildcard. */
+static const struct rpz_rule *trie_find(const struct rpz_node *root,
+                                        const knot_dname_t *name,
+                                        enum rpz_match *match)
+{
+	const uint8_t *labels[KNOT_DNAME_MAXLABELS + 1];
+	int count = name_labels(name, labels);
+
+	const struct rpz_rule *wildcard = NULL;
+	const struct rpz_node *node = root;
+	for (int i = count; node != NULL; --i) {
+		if (i == 0) {
+			if (node->rule != NULL) {
+				*match = RPZ_MATCH_QNAME;
+				return node->rule;
+			}
+			break;
+		}
+		if (node->wildcard != NULL) {
+			wildcard = node->wildcard;
+		}
+		node = trie_node_child(node, labels[i - 1]);
+	}
+
+	*match = RPZ_MATCH_WILDCARD;
+	return wildcard;
+}
+
+/*                       response address trie                          */
+
+static struct rpz_iptrie *iptrie_new(void)
+{
+	struct rpz_iptrie *trie = malloc(sizeof(struct rpz_iptrie));
+	if (trie == NULL) {
+		return NULL;
+	}
+
+	trie->max = 64;
+	trie->nodes = calloc(trie->max, sizeof(struct rpz_bit));
+	if (trie->nodes == NULL) {
+		free(trie);
+		return NULL;
+	}
+	trie->count = IPTRIE_ROOTS;
+	trie->refs = 1;
+
+	return trie;
+}
+
+static struct rpz_iptrie *iptrie_ref(struct rpz_iptrie *trie)
+{
+	if (trie != NULL) {
+		__sync_add_and_fetch(&trie->refs, 1);
+	}
+	return trie;
+}
+
+static void iptrie_release(struct rpz_iptrie *trie)
+{
+	if (trie == NULL || __sync_sub_and_fetch(&trie->refs, 1) > 0) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < trie->count; ++i) {
+		rule_release(trie->nodes[i].rule);
+	}
+	free(trie->nodes);
+	free(trie);
+}
+
+/*! \brief Append a node, return its index or 0 on error. */
+static uint32_t iptrie_append(struct rpz_iptrie *trie)
+{
+	if (trie->count == trie->max) {
+		struct rpz_bit *nodes = realloc(trie->nodes, 2 * trie->max * sizeof(struct rpz_bit));
+		if (nodes == NULL) {
+			return 0;
+		}
+		memset(nodes + trie->max, 0, trie->max * sizeof(struct rpz_bit));
+		trie->nodes = nodes;
+		trie->max *= 2;
+	}
+
+	return trie->count++;
+}
+
+static int iptrie_insert(struct rpz_iptrie *trie, int family, const uint8_t *addr,
+                         unsigned prefix, struct rpz_rule *rule)
+{
+	uint32_t id = (family == AF_INET6) ? IPTRIE_V6 : IPTRIE_V4;
+	for (unsigned bit = 0; bit < prefix; ++bit) {
+		int dir = (addr[bit / 8] >> (7 - bit % 8)) & 1;
+		if (trie->nodes[id].child[dir] == 0) {
+			uint32_t child = iptrie_append(trie);
+			if (child == 0) {
+				return KNOT_ENOMEM;
+			}
+			trie->nodes[id].child[dir] = child;
+		}
+		id = trie->nodes[id].child[dir];
+	}
+
+	/* The same prefix may be written in more ways, the first one is kept. */
+	if (trie->nodes[id].rule == NULL) {
+		trie->nodes[id].rule = rule_ref(rule);
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Find the trigger with the longest prefix matching the address. */
+static const struct rpz_rule *iptrie_find(const struct rpz_iptrie *trie, int family,
+                                          const uint8_t *addr, unsigned *prefix)
+{
+	unsigned bits = (family == AF_INET6) ? 128 : 32;
+	uint32_t id = (family == AF_INET6) ? IPTRIE_V6 : IPTRIE_V4;
+
+	const struct rpz_rule *match = NULL;
+	for (unsigned bit = 0; ; ++bit) {
+		if (trie->nodes[id].rule != NULL) {
+			match = trie->nodes[id].rule;
+			*prefix = bit;
+		}
+		if (bit == bits) {
+			break;
+		}
+		id = trie->nodes[id].child[(addr[bit / 8] >> (7 - bit % 8)) & 1];
+		if (id == 0) {
+			break;
+		}
+	}
+
+	return match;
+}
+
+/*! \brief Parse decimal or hexadecimal number from the label. */
+static int label_number(const uint8_t *label, unsigned base, unsigned max, unsigned *value)
+{
+	if (label[0] == 0 || label[0] > 4) {
+		return KNOT_EMALF;
+	}
+
+	unsigned number = 0;
+	for (uint8_t i = 1; i <= label[0]; ++i) {
+		unsigned digit = 0;
+		if (label[i] >= '0' && label[i] <= '9') {
+			digit = label[i] - '0';
+		} else if (base == 16 && label[i] >= 'a' && label[i] <= 'f') {
+			digit = label[i] - 'a' + 10;
+		} else {
+			return KNOT_EMALF;
+		}
+		number = number * base + digit;
+	}
+	if (number > max) {
+		return KNOT_EMALF;
+	}
+
+	*value = number;
+	return KNOT_EOK;
+}
+
+/*!
+ * \brief Parse the response IP trigger.
+ *
+ * The labels below 'rpz-ip' are the address in the reverse order and the
+ * prefix length, e.g. '24.0.2.0.192' or '64.zz.db8.2001' ('zz' stands for
+ * '::'). The labels are given from the most significant part of the address.
+ */
+static int ip_parse(const uint8_t **labels, int count, int *family, uint8_t *addr,
+                    unsigned *prefix)
+{
+	if (count < 2) {
+		return KNOT_EMALF;
+	}
+
+	int groups = count - 1;
+	unsigned value = 0;
+	memset(addr, 0, 16);
+
+	/* IPv4, four octets. */
+	bool ipv4 = (groups == 4);
+	for (int i = 0; ipv4 && i < groups; ++i) {
+		ipv4 = (label_number(labels[i], 10, 255, &value) == KNOT_EOK);
+		addr[i] = value;
+	}
+
+	if (ipv4) {
+		*family = AF_INET;
+	} else {
+		/* IPv6, eight groups with at most one 'zz'. */
+		memset(addr, 0, 16);
+		int pos = 0;
+		bool zz = false;
+		for (int i = 0; i < groups; ++i) {
+			if (label_cmp(labels[i], (const uint8_t *)"\x02""zz") == 0) {
+				if (zz) {
+					return KNOT_EMALF;
+				}
+				zz = true;
+				pos += 8 - (groups - 1);
+				continue;
+			}
+			if (pos >= 8 || label_number(labels[i], 16, 0xffff, &value) != KNOT_EOK) {
+				return KNOT_EMALF;
+			}
+			addr[2 * pos] = value >> 8;
+			addr[2 * pos + 1] = value & 0xff;
+			pos += 1;
+		}
+		if (pos != 8 || (zz && groups > 8)) {
+			return KNOT_EMALF;
+		}
+		*family = AF_INET6;
+	}
+
+	unsigned max = (*family == AF_INET6) ? 128 : 32;
+	if (label_number(labels[groups], 10, max, prefix) != KNOT_EOK || *prefix == 0) {
+		return KNOT_EMALF;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Insert the response IP triggers below the node, 'path' holds the labels above. */
+static int iptrie_walk(struct rpz_iptrie *trie, const struct rpz_node *node,
+                       const uint8_t **path, int depth)
+{
+	if (node->rule != NULL) {
+		int family = AF_UNSPEC;
+		uint8_t addr[16];
+		unsigned prefix = 0;
+		if (ip_parse(path, depth, &family, addr, &prefix) == KNOT_EOK) {
+			int ret = iptrie_insert(trie, family, addr, prefix, node->rule);
+			if (ret != KNOT_EOK) {
+				return ret;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < node->count && depth < KNOT_DNAME_MAXLABELS; ++i) {
+		path[depth] = node->children[i]->label;
+		int ret = iptrie_walk(trie, node->children[i], path, depth + 1);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+/*                       policy zone index                              */
+
+static void index_release(struct rpz_index *idx)
+{
+	if (idx == NULL || __sync_sub_and_fetch(&idx->refs, 1) > 0) {
+		return;
+	}
+
+	trie_node_release(idx->names);
+	trie_node_release(idx->ips);
+	iptrie_release(idx->iptrie);
+	free(idx);
+}
+
+static struct rpz_index *index_new(const zone_contents_t *contents)
+{
+	struct rpz_index *idx = malloc(sizeof(struct rpz_index));
+	if (idx == NULL) {
+		return NULL;
+	}
+	memset(idx, 0, sizeof(struct rpz_index));
+	idx->contents = contents;
+	idx->serial = zone_contents_serial(contents);
+	idx->refs = 1;
+
+	return idx;
+}
+
+static int index_build_iptrie(struct rpz_index *idx)
+{
+	idx->iptrie = iptrie_new();
+	if (idx->iptrie == NULL) {
+		return KNOT_ENOMEM;
+	}
+	if (idx->ips == NULL) {
+		return KNOT_EOK;
+	}
+
+	const uint8_t *path[KNOT_DNAME_MAXLABELS];
+	return iptrie_walk(idx->iptrie, idx->ips, path, 0);
+}
+
+/*!
+ * \brief Update the trigger of the policy zone name.
+ *
+ * \param idx     Index to update.
+ * \param origin  Policy zone name.
+ * \param owner   Name in the policy zone.
+ * \param node    Policy zone node of the name, NULL if removed.
+ * \param ip      Set if the name is a response IP trigger.
+ */
+static int index_set(struct rpz_index *idx, const knot_dname_t *origin,
+                     const knot_dname_t *owner, const zone_node_t *node, bool *ip)
+{
+	uint8_t name[KNOT_DNAME_MAXLEN];
+	memcpy(name, owner, knot_dname_size(owner));
+	knot_dname_to_lower(name);
+
+	/* Labels of the trigger, without the policy zone name. */
+	const uint8_t *labels[KNOT_DNAME_MAXLABELS + 1];
+	int count = name_labels(name, labels) - knot_dname_labels(origin, NULL);
+	if (count <= 0) {
+		return KNOT_EOK;
+	}
+
+	*ip = false;
+	const uint8_t *top = labels[count - 1];
+	if (top[0] > 4 && memcmp(top + 1, "rpz-", 4) == 0) {
+		/* Other triggers (client IP, NS name and IP) aren't supported. */
+		if (label_cmp(top, (const uint8_t *)"\x06""rpz-ip") != 0 || count == 1) {
+			return KNOT_EOK;
+		}
+		*ip = true;
+		count -= 1;
+	}
+
+	bool wildcard = (labels[0][0] == 1 && labels[0][1] == '*');
+	if (wildcard && *ip) {
+		return KNOT_EOK;
+	}
+
+	int skip = wildcard ? 1 : 0;
+	int delta = 0;
+	int ret = trie_set(*ip ? &idx->ips : &idx->names, labels + skip, count - skip,
+	                   wildcard, rule_compile(node), &delta);
+	idx->triggers += delta;
+
+	return ret;
+}
+
+struct index_walk {
+	struct rpz_index *idx;
+	const knot_dname_t *origin;
+};
+
+static int index_build_cb(zone_node_t **node, void *data)
+{
+	struct index_walk *walk = data;
+	bool ip = false;
+	return index_set(walk->idx, walk->origin, (*node)->owner, *node, &ip);
+}
+
+/*! \brief Compile the triggers of the whole policy zone. */
+static struct rpz_index *index_build(const zone_contents_t *contents)
+{
+	struct rpz_index *idx = index_new(contents);
+	if (idx == NULL) {
+		return NULL;
+	}
+
+	struct index_walk walk = { idx, contents->apex->owner };
+	int ret = zone_tree_apply(contents->nodes, index_build_cb, &walk);
+	if (ret == KNOT_EOK) {
+		ret = index_build_iptrie(idx);
+	}
+	if (ret != KNOT_EOK) {
+		index_release(idx);
+		return NULL;
+	}
+
+	return idx;
+}
+
+/*! \brief Update the triggers of the names changed since the previous index. */
+static struct rpz_index *index_patch(struct rpz_index *prev, list_t *chgs,
+                                     const zone_contents_t *contents)
+{
+	struct rpz_index *idx = index_new(contents);
+	if (idx == NULL) {
+		return NULL;
+	}
+	idx->names = trie_node_ref(prev->names);
+	idx->ips = trie_node_ref(prev->ips);
+	idx->triggers = prev->triggers;
+
+	int ret = KNOT_EOK;
+	bool ips_changed = false;
+	changeset_t *change = NULL;
+	WALK_LIST(change, *chgs) {
+		changeset_iter_t itt;
+		ret = changeset_iter_all(&itt, change, false);
+		if (ret != KNOT_EOK) {
+			break;
+		}
+		knot_rrset_t rr = changeset_iter_next(&itt);
+		while (!knot_rrset_empty(&rr) && ret == KNOT_EOK) {
+			bool ip = false;
+			const zone_node_t *node = zone_contents_find_node(contents, rr.owner);
+			ret = index_set(idx, contents->apex->owner, rr.owner, node, &ip);
+			ips_changed = ips_changed || ip;
+			rr = changeset_iter_next(&itt);
+		}
+		changeset_iter_clear(&itt);
+		if (ret != KNOT_EOK) {
+			break;
+		}
+	}
+
+	/* The prefix trie is shared unless a response IP trigger changed. */
+	if (ret == KNOT_EOK) {
+		if (ips_changed) {
+			ret = index_build_iptrie(idx);
+		} else {
+			idx->iptrie = iptrie_ref(prev->iptrie);
+		}
+	}
+	if (ret != KNOT_EOK) {
+		index_release(idx);
+		return NULL;
+	}
+
+	return idx;
+}
+
+/*!
+ * \brief Index for the policy zone contents, updated from the previous index
+ *        with the changes in the journal if possible.
+ */
+static struct rpz_index *index_update(struct rpz_index *prev, zone_t *zone,
+                                      const zone_contents_t *contents, bool *patched)
+{
+	uint32_t serial = zone_contents_serial(contents);
+	const char *journal = zone->conf->ixfr_db;
+
+	*patched = false;
+	if (prev != NULL && serial_compare(prev->serial, serial) < 0 &&
+	    journal != NULL && journal_exists(journal)) {
+		list_t chgs;
+		init_list(&chgs);
+		pthread_mutex_lock(&zone->journal_lock);
+		int ret = journal_load_changesets(zone, &chgs, prev->serial, serial);
+		pthread_mutex_unlock(&zone->journal_lock);
+
+		struct rpz_index *idx = NULL;
+		if (ret == KNOT_EOK) {
+			idx = index_patch(prev, &chgs, contents);
+		}
+		changesets_free(&chgs);
+		if (idx != NULL) {
+			*patched = true;
+			return idx;
+		}
+	}
+
+	return index_build(contents);
+}
+
+/*                       policy evaluation                              */
+
+static void policy_stats(const struct rpz_policy *policy, struct rpz_stats *sum)
+{
+	memset(sum, 0, sizeof(struct rpz_stats));
+	for (size_t i = 0; i < policy->thread_count; ++i) {
+		const uint64_t *matches = policy->threads[i].matches;
+		sum->qname += matches[RPZ_MATCH_QNAME];
+		sum->wildcard += matches[RPZ_MATCH_WILDCARD];
+		sum->ip += matches[RPZ_MATCH_IP];
+		sum->passthru += matches[RPZ_MATCH_PASSTHRU];
+	}
+}
+
+static void policy_report(const struct rpz_policy *policy, const struct rpz_index *idx,
+                          bool patched)
+{
+	struct rpz_stats sum;
+	policy_stats(policy, &sum);
+	log_zone_info(policy->zone, "RPZ, %s index for serial %u, %zu triggers, "
+	              "matched QNAME %" PRIu64 ", wildcard %" PRIu64 ", IP %" PRIu64
+	              ", passthru %" PRIu64, patched ? "updated" : "compiled",
+	              idx->serial, idx->triggers, sum.qname, sum.wildcard, sum.ip,
+	              sum.passthru);
+}
+
+/*!
+ * \brief Compile the index when the policy zone gets new contents.
+ *
+ * Runs from the zone hooks, outside of the query processing threads.
+ */
+static void policy_zone_hook(zone_t *zone, const zone_contents_t *contents, void *data)
+{
+	struct rpz_policy *policy = data;
+	if (!knot_dname_is_equal(zone->name, policy->zone)) {
+		return;
+	}
+
+	pthread_mutex_lock(&policy->lock);
+	struct rpz_index *idx = policy->index;
+	if (contents == NULL) {
+		policy->index = NULL;
+		index_release(idx);
+	} else if (idx == NULL || idx->contents != contents ||
+	           idx->serial != zone_contents_serial(contents)) {
+		bool patched = false;
+		struct rpz_index *update = index_update(idx, zone, contents, &patched);
+		if (update != NULL) {
+			policy_report(policy, update, patched);
+			policy->index = update;
+			index_release(idx);
+		} else {
+			log_zone_error(policy->zone, "RPZ, failed to compile index, "
+			               "keeping the previous one");
+		}
+	}
+	pthread_mutex_unlock(&policy->lock);
+}
+
+/*!
+ * \brief Index of the policy zone.
+ *
+ * The thread picks up the latest index only if it doesn't have to wait for
+ * the lock, and keeps using its previous index otherwise.
+ */
+static const struct rpz_index *policy_index(struct rpz_policy *policy,
+                                            struct rpz_thread *thr)
+{
+	if (thr->index == policy->index || pthread_mutex_trylock(&policy->lock) != 0) {
+		return thr->index;
+	}
+
+	if (thr->index != policy->index) {
+		index_release(thr->index);
+		thr->index = policy->index;
+		if (thr->index != NULL) {
+			__sync_add_and_fetch(&thr->index->refs, 1);
+		}
+	}
+	pthread_mutex_unlock(&policy->lock);
+
+	return thr->index;
+}
+
+/*! \brief Put the local data RR set under the query name. */
+static int rule_put(knot_pkt_t *pkt, struct query_data *qdata, const knot_rrset_t *rrset)
+{
+	knot_rrset_t rr = *rrset;
+	rr.owner = (knot_dname_t *)qdata->name;
+	return ns_put_rr(pkt, &rr, NULL, KNOT_COMPR_HINT_QNAME, 0, qdata);
+}
+
+/*! \brief Answer the query with the policy. */
+static int rule_answer(const struct rpz_rule *rule, knot_pkt_t *pkt, struct query_data *qdata)
+{
+	/* Policy answers contradict the zone data, they can't be proven. */
+	qdata->unsigned_answer = true;
+	knot_wire_set_aa(pkt->wire);
+
+	switch (rule->action) {
+	case RPZ_NXDOMAIN: return MISS;
+	case RPZ_NODATA:   return NODATA;
+	default:           break;
+	}
+
+	/* Local data of the query type, or CNAME. */
+	uint16_t qtype = knot_pkt_qtype(qdata->query);
+	const knot_rrset_t *cname = NULL;
+	bool answered = false;
+	for (uint16_t i = 0; i < rule->count; ++i) {
+		const knot_rrset_t *rrset = &rule->rrsets[i];
+		if (rrset->type == KNOT_RRTYPE_CNAME) {
+			cname = rrset;
+		}
+		if (qtype != KNOT_RRTYPE_ANY && rrset->type != qtype) {
+			continue;
+		}
+		int ret = rule_put(pkt, qdata, rrset);
+		if (ret != KNOT_EOK) {
+			return (ret == KNOT_ESPACE) ? TRUNC : ERROR;
+		}
+		answered = true;
+	}
+
+	if (!answered && cname != NULL) {
+		int ret = rule_put(pkt, qdata, cname);
+		if (ret != KNOT_EOK) {
+			return (ret == KNOT_ESPACE) ? TRUNC : ERROR;
+		}
+		answered = true;
+	}
+
+	return answered ? HIT : NODATA;
+}
+
+/*! \brief Find the response IP trigger with the longest prefix matching an answer address. */
+static const struct rpz_rule *answer_ip_find(const knot_pkt_t *pkt,
+                                             const struct rpz_iptrie *trie)
+{
+	const struct rpz_rule *best = NULL;
+	unsigned best_prefix = 0;
+
+	const knot_pktsection_t *answer = knot_pkt_section(pkt, KNOT_ANSWER);
+	for (uint16_t i = 0; i < answer->count; ++i) {
+		const knot_rrset_t *rr = &answer->rr[i];
+		int family = AF_UNSPEC;
+		if (rr->type == KNOT_RRTYPE_A) {
+			family = AF_INET;
+		} else if (rr->type == KNOT_RRTYPE_AAAA) {
+			family = AF_INET6;
+		} else {
+			continue;
+		}
+		for (uint16_t j = 0; j < rr->rrs.rr_count; ++j) {
+			const knot_rdata_t *rdata = knot_rdataset_at(&rr->rrs, j);
+			if (knot_rdata_rdlen(rdata) != ((family == AF_INET) ? 4 : 16)) {
+				continue;
+			}
+			unsigned prefix = 0;
+			const struct rpz_rule *rule = iptrie_find(trie, family,
+			                                          knot_rdata_data(rdata), &prefix);
+			if (rule != NULL && (best == NULL || prefix > best_prefix)) {
+				best = rule;
+				best_prefix = prefix;
+			}
+		}
+	}
+
+	return best;
+}
+
+/*! \brief Replace the answer with the policy of the response IP trigger. */
+static int answer_rewrite(const struct rpz_rule *rule, knot_pkt_t *pkt,
+                          struct query_data *qdata)
+{
+	if (knot_pkt_init_response(pkt, qdata->query) != KNOT_EOK) {
+		return ERROR;
+	}
+
+	/* Forget the zone answer. */
+	nsec_clear_rrsigs(qdata);
+	ptrlist_free(&qdata->wildcards, qdata->mm);
+	qdata->name = knot_pkt_qname(qdata->query);
+	qdata->node = NULL;
+	qdata->encloser = NULL;
+	qdata->previous = NULL;
+	qdata->rcode = KNOT_RCODE_NOERROR;
+
+	return rule_answer(rule, pkt, qdata);
+}
+
+static int rpz_answer(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+{
+	if (pkt == NULL || qdata == NULL || ctx == NULL) {
+		return ERROR;
+	}
+
+	struct rpz_ctx *rpz = ctx;
+	unsigned thread_id = qdata->param->thread_id;
+
+	/* QNAME triggers, the first matching policy zone applies. */
+	struct rpz_policy *policy = NULL;
+	WALK_LIST(policy, rpz->policies) {
+		if (thread_id >= policy->thread_count) {
+			continue;
+		}
+		struct rpz_thread *thr = &policy->threads[thread_id];
+		const struct rpz_index *idx = policy_index(policy, thr);
+		if (idx == NULL) {
+			continue;
+		}
+		enum rpz_match match = RPZ_MATCH_QNAME;
+		const struct rpz_rule *rule = trie_find(idx->names, qdata->name, &match);
+		if (rule != NULL) {
+			thr->matches[match] += 1;
+			if (rule->action == RPZ_PASSTHRU) {
+				thr->matches[RPZ_MATCH_PASSTHRU] += 1;
+				return rpz->shared.next(state, pkt, qdata, rpz->shared.next_ctx);
+			}
+			return rule_answer(rule, pkt, qdata);
+		}
+	}
+
+	state = rpz->shared.next(state, pkt, qdata, rpz->shared.next_ctx);
+	if (state != HIT) {
+		return state;
+	}
+
+	/* Response IP triggers. */
+	WALK_LIST(policy, rpz->policies) {
+		if (thread_id >= policy->thread_count) {
+			continue;
+		}
+		struct rpz_thread *thr = &policy->threads[thread_id];
+		const struct rpz_index *idx = thr->index;
+		if (idx == NULL) {
+			continue;
+		}
+		const struct rpz_rule *rule = answer_ip_find(pkt, idx->iptrie);
+		if (rule != NULL) {
+			thr->matches[RPZ_MATCH_IP] += 1;
+			if (rule->action == RPZ_PASSTHRU) {
+				thr->matches[RPZ_MATCH_PASSTHRU] += 1;
+				return state;
+			}
+			return answer_rewrite(rule, pkt, qdata);
+		}
+	}
+
+	return state;
+}
+
+/*! \brief Add policy to the query plan, take over the zone answer step if needed. */
+static int rpz_ctx_add(struct query_plan *plan, struct rpz_policy *policy)
+{
+	struct rpz_ctx *ctx = NULL;
+	int ret = query_shared_get(plan, QPLAN_ANSWER, QSHARED_REPLACE, rpz_answer,
+	                           sizeof(struct rpz_ctx), (void **)&ctx);
+	if (ret == KNOT_ENOTSUP) {
+		MODULE_ERR("zone answer step not found");
+	}
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	if (ctx->shared.refs == 1) {
+		init_list(&ctx->policies);
+	}
+
+	add_tail(&ctx->policies, &policy->node);
+	policy->ctx = ctx;
+
+	return KNOT_EOK;
+}
+
+int rpz_load(struct query_plan *plan, struct query_module *self)
+{
+	char *saveptr = NULL;
+	char *token = strtok_r(self->param, " ", &saveptr);
+	if (token == NULL) {
+		return KNOT_EFEWDATA;
+	}
+
+	struct rpz_policy *policy = mm_alloc(self->mm, sizeof(struct rpz_policy));
+	if (policy == NULL) {
+		return KNOT_ENOMEM;
+	}
+	memset(policy, 0, sizeof(struct rpz_policy));
+	pthread_mutex_init(&policy->lock, NULL);
+
+	/* Save in query module, it takes ownership from now on. */
+	self->ctx = policy;
+
+	policy->zone = knot_dname_from_str_alloc(token);
+	if (policy->zone == NULL) {
+		MODULE_ERR("invalid policy zone '%s'", token);
+		return KNOT_EMALF;
+	}
+	knot_dname_to_lower(policy->zone);
+
+	size_t count = conf_udp_threads(self->config) + conf_tcp_threads(self->config);
+	if (posix_memalign((void **)&policy->threads, 64, count * sizeof(struct rpz_thread)) != 0) {
+		return KNOT_ENOMEM;
+	}
+	memset(policy->threads, 0, count * sizeof(struct rpz_thread));
+	policy->thread_count = count;
+
+	/* The index is compiled when the policy zone is published. */
+	int ret = zone_hook_add(policy_zone_hook, policy);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return rpz_ctx_add(plan, policy);
+}
+
+int rpz_unload(struct query_module *self)
+{
+	struct rpz_policy *policy = self->ctx;
+	if (policy == NULL) {
+		return KNOT_EOK;
+	}
+
+	zone_hook_remove(policy_zone_hook, policy);
+
+	/* The answer step is shared by the modules in the same query plan. */
+	if (policy->ctx != NULL) {
+		rem_node(&policy->node);
+		query_shared_release(&policy->ctx->shared, NULL);
+	}
+
+	for (size_t i = 0; i < policy->thread_count; ++i) {
+		index_release(policy->threads[i].index);
+	}
+	free(policy->threads);
+	index_release(policy->index);
+	pthread_mutex_destroy(&policy->lock);
+	knot_dname_free(&policy->zone, NULL);
+	mm_free(self->mm, policy);
+	return KNOT_EOK;
+}
+
+void rpz_stats_sum(const struct query_module *self, struct rpz_stats *sum)
+{
+	const struct rpz_policy *policy = self->ctx;
+	if (policy == NULL) {
+		memset(sum, 0, sizeof(struct rpz_stats));
+		return;
+	}
+
+	policy_stats(policy, sum);
+}
+
+int rpz_stats_print(const struct query_module *self, char *buf, size_t buflen)
+{
+	struct rpz_stats sum;
+	rpz_stats_sum(self, &sum);
+
+	int n = snprintf(buf, buflen, "rpz %s\tqname=%" PRIu64 " wildcard=%" PRIu64
+	                 " ip=%" PRIu64 " passthru=%" PRIu64, self->param, sum.qname,
+	                 sum.wildcard, sum.ip, sum.passthru);
+	if (n < 0 || n >= buflen) {
+		return KNOT_ESPACE;
+	}
+
+	return n;
+}
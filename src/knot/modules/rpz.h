@@ -0,0 +1,56 @@
+/*!
+ * \file rpz.h
+ *
+ * \brief Response policy zone module
+ *
+ * Accepted configuration:
+ *  * "<policy zone>"
+ *
+ * Module applies the QNAME, wildcard and response IP triggers of a policy
+ * zone served by the server to the answers from the zone. The triggers are
+ * compiled into an immutable index whenever the policy zone is loaded or
+ * updated, incremental zone transfers of the policy zone update the index
+ * from the journal. Policy answers are not signed.
+ *
+ * \addtogroup query_processing
+ * @{
+ */
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "knot/nameserver/query_module.h"
+
+/*! \brief Policy match counters. */
+struct rpz_stats {
+	uint64_t qname;     /*!< Matched QNAME triggers. */
+	uint64_t wildcard;  /*!< Matched wildcard QNAME triggers. */
+	uint64_t ip;        /*!< Matched response IP triggers. */
+	uint64_t passthru;  /*!< Matches with the passthru action. */
+};
+
+/*! \brief Module interface. */
+int rpz_load(struct query_plan *plan, struct query_module *self);
+int rpz_unload(struct query_module *self);
+
+/*! \brief Sum the match counters of the module over the server threads. */
+void rpz_stats_sum(const struct query_module *self, struct rpz_stats *sum);
+
+/*! \brief Print the match counters (module stats callback). */
+int rpz_stats_print(const struct query_module *self, char *buf, size_t buflen);
+
+/*! @} */
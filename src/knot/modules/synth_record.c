@@ -19,10 +19,13 @@
 #include "knot/nameserver/process_query.h"
 #include "knot/nameserver/internet.h"
 #include "libknot/descriptor.h"
+#include "libknot/internal/macros.h"
 #include "knot/conf/conf.h"
 
 /* Defines. */
 #define ARPA_ZONE_LABELS 2
+#define IPV4_REVERSE_LABELS 4
+#define IPV6_REVERSE_LABELS 32
 #define MODULE_ERR(msg...) log_error("module 'synth_record', " msg)
 
 /*! \brief Supported answer synthesis template types. */
@@ -32,6 +35,18 @@ enum synth_template_type {
 	SYNTH_REVERSE
 };
 
+/*!
+ * \brief Templates of all synth_record modules in a query plan.
+ *
+ * The templates are compiled into groups parsing the address from the query
+ * name the same way, each with a subnet prefix trie.
+ */
+struct synth_table {
+	struct query_shared shared;
+	list_t templates;          /*!< Templates in the load order. */
+	list_t groups;             /*!< Compiled template groups. */
+};
+
 /*!
  * \brief Synthetic response template.
  */
@@ -39,29 +54,36 @@ typedef struct synth_template {
 	node_t node;
 	enum synth_template_type type;
 	const char *prefix;
+	size_t prefix_len;
 	const char *zone;
+	knot_dname_t *zone_name;
 	uint32_t ttl;
 	conf_iface_t subnet;
+	unsigned order;            /*!< Load order, the first one wins a tie. */
+	struct synth_table *table;
 } synth_template_t;
 
-/*! \brief Substitute all occurences of given character. */
-static void str_subst(char *str, size_t len, char from, char to)
-{
-	for (int i = 0; i < len; ++i) {
-		if (str[i] == from) {
-			str[i] = to;
-		}
-	}
-}
+/*! \brief Node of the subnet prefix trie. */
+struct synth_bit {
+	uint32_t child[2];         /*!< Node index, 0 if none (the root). */
+	synth_template_t *tpl;     /*!< First loaded template for the subnet. */
+};
 
-/*! \brief Separator character for address family. */
-static char str_separator(int addr_family)
-{
-	if (addr_family == AF_INET6) {
-		return ':';
-	}
-	return '.';
-}
+/*!
+ * \brief Templates of the same type and address family.
+ *
+ * Reverse templates share the address parsed from the query name, forward
+ * templates parse it after the prefix, so they are grouped by its length.
+ */
+struct synth_group {
+	node_t node;
+	enum synth_template_type type;
+	int family;
+	size_t prefix_len;
+	struct synth_bit *nodes;
+	uint32_t count;
+	uint32_t max;
+};
 
 /*! \brief Return true if query type is satisfied with provided address family. */
 static bool query_satisfied_by_family(uint16_t qtype, int family)
@@ -74,204 +96,293 @@ static bool query_satisfied_by_family(uint16_t qtype, int family)
 	}
 }
 
-/*! \brief Parse address from reverse query QNAME and return address family. */
-static int reverse_addr_parse(struct query_data *qdata, synth_template_t *tpl, char *addr_str)
+/*! \brief Raw address bytes of the socket address (read only). */
+static const uint8_t *addr_data(const struct sockaddr_storage *ss)
+{
+	if (ss->ss_family == AF_INET6) {
+		return (const uint8_t *)&((const struct sockaddr_in6 *)ss)->sin6_addr;
+	} else {
+		return (const uint8_t *)&((const struct sockaddr_in *)ss)->sin_addr;
+	}
+}
+
+/*! \brief Clear the socket address and return its raw address bytes. */
+static uint8_t *addr_bytes(struct sockaddr_storage *ss, int family)
+{
+	memset(ss, 0, sizeof(*ss));
+	ss->ss_family = family;
+	if (family == AF_INET6) {
+		return (uint8_t *)&((struct sockaddr_in6 *)ss)->sin6_addr;
+	} else {
+		return (uint8_t *)&((struct sockaddr_in *)ss)->sin_addr;
+	}
+}
+
+static int hex_digit(uint8_t c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c |= 0x20; /* Lower case. */
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+/*! \brief Parse decimal octet without leading zeros (as inet_pton()). */
+static int parse_octet(const uint8_t *str, size_t len)
+{
+	if (len == 0 || len > 3 || (len > 1 && str[0] == '0')) {
+		return -1;
+	}
+
+	int value = 0;
+	for (size_t i = 0; i < len; ++i) {
+		if (str[i] < '0' || str[i] > '9') {
+			return -1;
+		}
+		value = value * 10 + str[i] - '0';
+	}
+
+	return (value <= 255) ? value : -1;
+}
+
+/*! \brief Parse IPv4 address in dotted-decimal notation with given separator. */
+static int parse_ipv4(const uint8_t *str, size_t len, char sep, uint8_t *dst)
+{
+	const uint8_t *end = str + len;
+	for (int i = 0; i < 4; ++i) {
+		const uint8_t *pos = str;
+		while (pos < end && *pos != sep) {
+			++pos;
+		}
+		int octet = parse_octet(str, pos - str);
+		if (octet < 0 || (i < 3) != (pos < end)) {
+			return KNOT_EINVAL;
+		}
+		dst[i] = octet;
+		str = pos + 1;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Parse IPv6 address in text notation with given separator. */
+static int parse_ipv6(const uint8_t *str, size_t len, char sep, uint8_t *dst)
+{
+	uint16_t groups[8];
+	int count = 0;
+	int gap = -1; /* Position of the compressed zeros. */
+
+	size_t i = 0;
+	if (len >= 2 && str[0] == sep && str[1] == sep) {
+		gap = 0;
+		i = 2;
+	}
+	while (i < len) {
+		unsigned value = 0;
+		unsigned digits = 0;
+		for (; i < len && hex_digit(str[i]) >= 0; ++i) {
+			if (++digits > 4) {
+				return KNOT_EINVAL;
+			}
+			value = (value << 4) | hex_digit(str[i]);
+		}
+		if (digits == 0 || count == 8) {
+			return KNOT_EINVAL;
+		}
+		groups[count++] = value;
+
+		if (i == len) {
+			break;
+		}
+		if (str[i++] != sep || i == len) { /* No trailing single separator. */
+			return KNOT_EINVAL;
+		}
+		if (str[i] == sep) {
+			if (gap >= 0) {
+				return KNOT_EINVAL;
+			}
+			gap = count;
+			i += 1;
+		}
+	}
+
+	if ((gap < 0 && count != 8) || (gap >= 0 && count == 8)) {
+		return KNOT_EINVAL;
+	}
+
+	/* Groups after the gap are aligned to the end. */
+	memset(dst, 0, 16);
+	for (int g = 0; g < count; ++g) {
+		int pos = (gap >= 0 && g >= gap) ? 8 - count + g : g;
+		dst[2 * pos] = groups[g] >> 8;
+		dst[2 * pos + 1] = groups[g] & 0xff;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Parse address from reverse query QNAME, the family is given by the format. */
+static int reverse_addr_parse(struct query_data *qdata, struct sockaddr_storage *addr)
 {
 	/* QNAME required format is [address].[subnet/zone]
 	 * f.e.  [1.0...0].[h.g.f.e.0.0.0.0.d.c.b.a.ip6.arpa] represents
 	 *       [abcd:0:efgh::1] */
-	const knot_dname_t* label = qdata->name;
+	const knot_dname_t *label = qdata->name;
 	const uint8_t *query_wire = qdata->query->wire;
 
-	/* Push labels on stack for reverse walkthrough. */
-	const uint8_t* label_stack[KNOT_DNAME_MAXLABELS];
-	const uint8_t** sp = label_stack;
-	int label_count = knot_dname_labels(label, query_wire);
-	while(label_count > ARPA_ZONE_LABELS) {
-		*sp++ = label;
-		label = knot_wire_next_label(label, query_wire);
-		--label_count;
-	}
-
-	/* Write formatted address string. */
-	char sep = str_separator(tpl->subnet.addr.ss_family);
-	int sep_frequency = 1;
-	if (sep == ':') {
-		sep_frequency = 4; /* Separator per 4 hexdigits. */
-	}
-
-	char *dst = addr_str;
-	label_count = 0;
-	while(sp != label_stack) {
-		label = *--sp;
-		/* Write separator for each Nth label. */
-		if (label_count == sep_frequency) {
-			*dst = sep;
-			dst += 1;
-			label_count = 0;
+	int addr_labels = knot_dname_labels(label, query_wire) - ARPA_ZONE_LABELS;
+	if (addr_labels == IPV4_REVERSE_LABELS) {
+		/* Decimal octets, least significant first. */
+		uint8_t *dst = addr_bytes(addr, AF_INET);
+		for (int i = IPV4_REVERSE_LABELS - 1; i >= 0; --i) {
+			int octet = parse_octet(label + 1, label[0]);
+			if (octet < 0) {
+				return KNOT_EINVAL;
+			}
+			dst[i] = octet;
+			label = knot_wire_next_label(label, query_wire);
+		}
+	} else if (addr_labels == IPV6_REVERSE_LABELS) {
+		/* Hexadecimal nibbles, least significant first. */
+		uint8_t *dst = addr_bytes(addr, AF_INET6);
+		for (int i = IPV6_REVERSE_LABELS - 1; i >= 0; --i) {
+			int nibble = (label[0] == 1) ? hex_digit(label[1]) : -1;
+			if (nibble < 0) {
+				return KNOT_EINVAL;
+			}
+			dst[i / 2] |= (i % 2 == 0) ? nibble << 4 : nibble;
+			label = knot_wire_next_label(label, query_wire);
 		}
-		/* Write label */
-		memcpy(dst, label + 1, label[0]);
-		dst += label[0];
-		label_count += 1;
+	} else {
+		return KNOT_EINVAL;
 	}
 
 	return KNOT_EOK;
 }
 
-static int forward_addr_parse(struct query_data *qdata, synth_template_t *tpl, char *addr_str)
+/*! \brief Parse address from forward query QNAME, after the prefix of given length. */
+static int forward_addr_parse(struct query_data *qdata, size_t prefix_len, int family,
+                              struct sockaddr_storage *addr)
 {
 	/* Find prefix label count (additive to prefix length). */
 	const knot_dname_t *addr_label = qdata->name;
 
 	/* Mismatch if label shorter/equal than prefix. */
-	int prefix_len = strlen(tpl->prefix);
 	if (addr_label == NULL || addr_label[0] <= prefix_len) {
 		return KNOT_EINVAL;
 	}
 
-	int addr_len = *addr_label - prefix_len;
-	memcpy(addr_str, addr_label + 1 + prefix_len, addr_len);
-
-	/* Restore correct address format. */
-	char sep = str_separator(tpl->subnet.addr.ss_family);
-	str_subst(addr_str, addr_len, '-', sep);
-
-	return KNOT_EOK;
+	/* Address with '-' in place of the separator. */
+	const uint8_t *addr_str = addr_label + 1 + prefix_len;
+	size_t addr_len = *addr_label - prefix_len;
+	uint8_t *dst = addr_bytes(addr, family);
+	if (family == AF_INET6) {
+		return parse_ipv6(addr_str, addr_len, '-', dst);
+	} else {
+		return parse_ipv4(addr_str, addr_len, '-', dst);
+	}
 }
 
-static int addr_parse(struct query_data *qdata, synth_template_t *tpl, char *addr_str)
+/*! \brief Write the address in the label with '-' in place of the separator. */
+static int synth_addr_label(uint8_t *dst, size_t maxlen, const struct sockaddr_storage *addr)
 {
-	/* Check if we have at least 1 label below zone. */
-	int zone_labels = knot_dname_labels(qdata->zone->name, NULL);
-	int query_labels = knot_dname_labels(qdata->name, qdata->query->wire);
-	if (query_labels < zone_labels + 1) {
-		return KNOT_EINVAL;
+	char buf[SOCKADDR_STRLEN];
+	int len = 0;
+	if (addr->ss_family == AF_INET6) {
+		const uint8_t *ip = (const uint8_t *)&((const struct sockaddr_in6 *)addr)->sin6_addr;
+		for (int i = 0; i < 16; i += 2) {
+			len += snprintf(buf + len, sizeof(buf) - len, "%s%02x%02x",
+			                i > 0 ? "-" : "", ip[i], ip[i + 1]);
+		}
+	} else {
+		const uint8_t *ip = (const uint8_t *)&((const struct sockaddr_in *)addr)->sin_addr;
+		len = snprintf(buf, sizeof(buf), "%u-%u-%u-%u", ip[0], ip[1], ip[2], ip[3]);
 	}
 
-	switch (tpl->type) {
-	case SYNTH_REVERSE: return reverse_addr_parse(qdata, tpl, addr_str);
-	case SYNTH_FORWARD: return forward_addr_parse(qdata, tpl, addr_str);
-	default:            return KNOT_EINVAL;
+	if (len >= maxlen) {
+		return KNOT_ESPACE;
 	}
+	memcpy(dst, buf, len);
+	return len;
 }
 
-static knot_dname_t *synth_ptrname(const char *addr_str, synth_template_t *tpl)
+static int reverse_rr(const struct sockaddr_storage *addr, synth_template_t *tpl,
+                      knot_pkt_t *pkt, knot_rrset_t *rr)
 {
 	/* PTR right-hand value is [prefix][address][zone] */
-	char ptrname[KNOT_DNAME_MAXLEN] = {'\0'};
-	int prefix_len = strlen(tpl->prefix);
-	int addr_len = strlen(addr_str);
-	int zone_len = strlen(tpl->zone);
-
-	/* Check required space (zone requires extra leading dot). */
-	if (prefix_len + addr_len + zone_len + 1 >= KNOT_DNAME_MAXLEN) {
-		return NULL;
+	uint8_t ptrname[KNOT_DNAME_MAXLEN];
+	size_t zone_size = knot_dname_size(tpl->zone_name);
+	size_t label_max = MIN(KNOT_DNAME_MAXLABELLEN, sizeof(ptrname) - zone_size - 1);
+	if (tpl->prefix_len > label_max) {
+		return KNOT_ESPACE;
 	}
 
-	/* Write prefix string. */
-	memcpy(ptrname, tpl->prefix, prefix_len);
-	int written = prefix_len;
-
-	/* Write address with substituted separator to '-'. */
-	char sep = str_separator(tpl->subnet.addr.ss_family);
-	memcpy(ptrname + written, addr_str, addr_len);
-	str_subst(ptrname + written, addr_len, sep, '-');
-	written += addr_len;
-
-	/* Write zone name. */
-	ptrname[written] = '.';
-	written += 1;
-	memcpy(ptrname + written, tpl->zone, zone_len);
-
-	/* Convert to domain name. */
-	return knot_dname_from_str_alloc(ptrname);
-}
-
-static int reverse_rr(char *addr_str, synth_template_t *tpl, knot_pkt_t *pkt, knot_rrset_t *rr)
-{
-	/* Synthetize PTR record data. */
-	knot_dname_t *ptrname = synth_ptrname(addr_str, tpl);
-	if (ptrname == NULL) {
-		return KNOT_ENOMEM;
+	memcpy(ptrname + 1, tpl->prefix, tpl->prefix_len);
+	int ret = synth_addr_label(ptrname + 1 + tpl->prefix_len,
+	                           label_max - tpl->prefix_len + 1, addr);
+	if (ret < 0) {
+		return ret;
 	}
+	ptrname[0] = tpl->prefix_len + ret;
+	memcpy(ptrname + 1 + ptrname[0], tpl->zone_name, zone_size);
 
 	rr->type = KNOT_RRTYPE_PTR;
-	knot_rrset_add_rdata(rr, ptrname, knot_dname_size(ptrname), tpl->ttl, &pkt->mm);
-	knot_dname_free(&ptrname, NULL);
-
-	return KNOT_EOK;
+	return knot_rrset_add_rdata(rr, ptrname, 1 + ptrname[0] + zone_size, tpl->ttl, &pkt->mm);
 }
 
-static int forward_rr(char *addr_str, synth_template_t *tpl, knot_pkt_t *pkt, knot_rrset_t *rr)
+static int forward_rr(const struct sockaddr_storage *addr, synth_template_t *tpl,
+                      knot_pkt_t *pkt, knot_rrset_t *rr)
 {
-	struct sockaddr_storage query_addr = {'\0'};
-	sockaddr_set(&query_addr, tpl->subnet.addr.ss_family, addr_str, 0);
-
 	/* Specify address type and data. */
-	if (tpl->subnet.addr.ss_family == AF_INET6) {
+	if (addr->ss_family == AF_INET6) {
 		rr->type = KNOT_RRTYPE_AAAA;
-		const struct sockaddr_in6* ip = (const struct sockaddr_in6*)&query_addr;
-		knot_rrset_add_rdata(rr, (const uint8_t *)&ip->sin6_addr, sizeof(struct in6_addr),
-		                  tpl->ttl, &pkt->mm);
-	} else if (tpl->subnet.addr.ss_family == AF_INET) {
+		const struct sockaddr_in6* ip = (const struct sockaddr_in6*)addr;
+		return knot_rrset_add_rdata(rr, (const uint8_t *)&ip->sin6_addr,
+		                            sizeof(struct in6_addr), tpl->ttl, &pkt->mm);
+	} else if (addr->ss_family == AF_INET) {
 		rr->type = KNOT_RRTYPE_A;
-		const struct sockaddr_in* ip = (const struct sockaddr_in*)&query_addr;
-		knot_rrset_add_rdata(rr, (const uint8_t *)&ip->sin_addr, sizeof(struct in_addr),
-		                  tpl->ttl, &pkt->mm);
+		const struct sockaddr_in* ip = (const struct sockaddr_in*)addr;
+		return knot_rrset_add_rdata(rr, (const uint8_t *)&ip->sin_addr,
+		                            sizeof(struct in_addr), tpl->ttl, &pkt->mm);
 	} else {
 		return KNOT_EINVAL;
 	}
-
-	return KNOT_EOK;
 }
 
-static knot_rrset_t *synth_rr(char *addr_str, synth_template_t *tpl, knot_pkt_t *pkt, struct query_data *qdata)
+/*!
+ * \brief Synthetize the record into the packet.
+ *
+ * The RR data is allocated from the packet memory pool and released with it.
+ */
+static int synth_rr(const struct sockaddr_storage *addr, synth_template_t *tpl,
+                    knot_pkt_t *pkt, struct query_data *qdata)
 {
-	knot_rrset_t *rr = knot_rrset_new(qdata->name, 0, KNOT_CLASS_IN,
-	                                  &pkt->mm);
-	if (rr == NULL) {
-		return NULL;
-	}
+	knot_rrset_t rr;
+	knot_rrset_init(&rr, (knot_dname_t *)qdata->name, 0, KNOT_CLASS_IN);
 
 	/* Fill in the specific data. */
 	int ret = KNOT_ERROR;
 	switch (tpl->type) {
-	case SYNTH_REVERSE: ret = reverse_rr(addr_str, tpl, pkt, rr); break;
-	case SYNTH_FORWARD: ret = forward_rr(addr_str, tpl, pkt, rr); break;
+	case SYNTH_REVERSE: ret = reverse_rr(addr, tpl, pkt, &rr); break;
+	case SYNTH_FORWARD: ret = forward_rr(addr, tpl, pkt, &rr); break;
 	default: break;
 	}
-
 	if (ret != KNOT_EOK) {
-		knot_rrset_free(&rr, &pkt->mm);
-		return NULL;
+		return ret;
 	}
 
-	return rr;
+	return knot_pkt_put(pkt, 0, &rr, KNOT_PF_NULL);
 }
 
-/*! \brief Check if query fits the template requirements. */
-static int template_match(int state, synth_template_t *tpl, knot_pkt_t *pkt, struct query_data *qdata)
+/*! \brief Answer the query from the template matching the address. */
+static int template_answer(synth_template_t *tpl, const struct sockaddr_storage *query_addr,
+                           knot_pkt_t *pkt, struct query_data *qdata)
 {
-	/* Parse address from query name. */
-	char addr_str[SOCKADDR_STRLEN] = { '\0' };
-	int ret = addr_parse(qdata, tpl, addr_str);
-	if (ret != KNOT_EOK) {
-		return state; /* Can't identify addr in QNAME, not applicable. */
-	}
-
-	/* Match against template netblock. */
-	struct sockaddr_storage query_addr = { '\0' };
-	int provided_af = tpl->subnet.addr.ss_family;
-	ret = sockaddr_set(&query_addr, provided_af, addr_str, 0);
-	if (ret == KNOT_EOK) {
-		ret = netblock_match(&tpl->subnet, &query_addr);
-	}
-	if (ret != 0) {
-		return state; /* Out of our netblock, not applicable. */
-	}
-
 	/* Check if the request is for an available query type. */
+	int provided_af = tpl->subnet.addr.ss_family;
 	uint16_t qtype = knot_pkt_qtype(qdata->query);
 	switch (tpl->type) {
 	case SYNTH_FORWARD:
@@ -290,15 +401,12 @@ static int template_match(int state, synth_template_t *tpl, knot_pkt_t *pkt, str
 		break;
 	}
 
-	/* Synthetise record from template. */
-	knot_rrset_t *rr = synth_rr(addr_str, tpl, pkt, qdata);
-	if (rr == NULL) {
+	/* Synthetise record from template into the packet. */
+	int ret = synth_rr(query_addr, tpl, pkt, qdata);
+	if (ret == KNOT_ESPACE || ret == KNOT_ENOMEM) {
 		qdata->rcode = KNOT_RCODE_SERVFAIL;
 		return ERROR;
-	}
-
-	/* Insert synthetic response into packet. */
-	if (knot_pkt_put(pkt, 0, rr, KNOT_PF_FREE) != KNOT_EOK) {
+	} else if (ret != KNOT_EOK) {
 		return ERROR;
 	}
 
@@ -308,6 +416,145 @@ static int template_match(int state, synth_template_t *tpl, knot_pkt_t *pkt, str
 	return HIT;
 }
 
+/*                       subnet prefix trie                             */
+
+/*! \brief Append a node, return its index or 0 on error. */
+static uint32_t group_append(struct synth_group *group)
+{
+	if (group->count == group->max) {
+		uint32_t max = (group->max > 0) ? 2 * group->max : 64;
+		struct synth_bit *nodes = realloc(group->nodes, max * sizeof(struct synth_bit));
+		if (nodes == NULL) {
+			return 0;
+		}
+		memset(nodes + group->max, 0, (max - group->max) * sizeof(struct synth_bit));
+		group->nodes = nodes;
+		group->max = max;
+	}
+
+	return group->count++;
+}
+
+static int group_insert(struct synth_group *group, synth_template_t *tpl)
+{
+	const uint8_t *addr = addr_data(&tpl->subnet.addr);
+	uint32_t id = 0;
+	for (unsigned bit = 0; bit < tpl->subnet.prefix; ++bit) {
+		int dir = (addr[bit / 8] >> (7 - bit % 8)) & 1;
+		if (group->nodes[id].child[dir] == 0) {
+			uint32_t child = group_append(group);
+			if (child == 0) {
+				return KNOT_ENOMEM;
+			}
+			group->nodes[id].child[dir] = child;
+		}
+		id = group->nodes[id].child[dir];
+	}
+
+	/* Later templates for the same subnet are never reached. */
+	if (group->nodes[id].tpl == NULL) {
+		group->nodes[id].tpl = tpl;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Find the template with the longest subnet prefix matching the address. */
+static synth_template_t *group_find(const struct synth_group *group,
+                                    const struct sockaddr_storage *ss)
+{
+	const uint8_t *addr = addr_data(ss);
+	unsigned bits = (group->family == AF_INET6) ? IPV6_PREFIXLEN : IPV4_PREFIXLEN;
+
+	synth_template_t *match = NULL;
+	uint32_t id = 0;
+	for (unsigned bit = 0; ; ++bit) {
+		if (group->nodes[id].tpl != NULL) {
+			match = group->nodes[id].tpl;
+		}
+		if (bit == bits) {
+			break;
+		}
+		id = group->nodes[id].child[(addr[bit / 8] >> (7 - bit % 8)) & 1];
+		if (id == 0) {
+			break;
+		}
+	}
+
+	return match;
+}
+
+/*! \brief Get the group for the template, create it if needed. */
+static struct synth_group *group_get(struct synth_table *table, const synth_template_t *tpl)
+{
+	int family = tpl->subnet.addr.ss_family;
+	size_t prefix_len = (tpl->type == SYNTH_FORWARD) ? tpl->prefix_len : 0;
+
+	struct synth_group *group = NULL;
+	WALK_LIST(group, table->groups) {
+		if (group->type == tpl->type && group->family == family &&
+		    group->prefix_len == prefix_len) {
+			return group;
+		}
+	}
+
+	group = malloc(sizeof(struct synth_group));
+	if (group == NULL) {
+		return NULL;
+	}
+	memset(group, 0, sizeof(struct synth_group));
+	group->type = tpl->type;
+	group->family = family;
+	group->prefix_len = prefix_len;
+	if (group_append(group) != 0) { /* The root. */
+		free(group->nodes);
+		free(group);
+		return NULL;
+	}
+	add_tail(&table->groups, &group->node);
+
+	return group;
+}
+
+static void table_clear(struct synth_table *table)
+{
+	struct synth_group *group = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(group, next, table->groups) {
+		free(group->nodes);
+		free(group);
+	}
+	init_list(&table->groups);
+}
+
+static void table_free(void *ctx)
+{
+	table_clear(ctx);
+}
+
+/*! \brief Compile the template groups from the templates. */
+static int table_compile(struct synth_table *table)
+{
+	table_clear(table);
+
+	unsigned order = 0;
+	synth_template_t *tpl = NULL;
+	WALK_LIST(tpl, table->templates) {
+		tpl->order = order++;
+		struct synth_group *group = group_get(table, tpl);
+		if (group == NULL) {
+			table_clear(table);
+			return KNOT_ENOMEM;
+		}
+		int ret = group_insert(group, tpl);
+		if (ret != KNOT_EOK) {
+			table_clear(table);
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
 int solve_synth_record(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
 {
 	if (pkt == NULL || qdata == NULL || ctx == NULL) {
@@ -319,8 +566,71 @@ int solve_synth_record(int state, knot_pkt_t *pkt, struct query_data *qdata, voi
 		return state;
 	}
 
-	/* Check if template fits. */
-	return template_match(state, (synth_template_t *)ctx, pkt, qdata);
+	/* Check if we have at least 1 label below zone. */
+	int zone_labels = knot_dname_labels(qdata->zone->name, NULL);
+	int query_labels = knot_dname_labels(qdata->name, qdata->query->wire);
+	if (query_labels < zone_labels + 1) {
+		return state;
+	}
+
+	/* Address is parsed once for all reverse templates and once for each
+	 * forward template group. */
+	struct sockaddr_storage reverse = { 0 };
+	int reverse_ret = reverse_addr_parse(qdata, &reverse);
+
+	/* Template with the longest matching subnet prefix. */
+	struct synth_table *table = ctx;
+	synth_template_t *match = NULL;
+	struct sockaddr_storage match_addr;
+	struct synth_group *group = NULL;
+	WALK_LIST(group, table->groups) {
+		struct sockaddr_storage forward;
+		const struct sockaddr_storage *addr = &reverse;
+		if (group->type == SYNTH_FORWARD) {
+			if (forward_addr_parse(qdata, group->prefix_len, group->family,
+			                       &forward) != KNOT_EOK) {
+				continue;
+			}
+			addr = &forward;
+		} else if (reverse_ret != KNOT_EOK || reverse.ss_family != group->family) {
+			continue;
+		}
+
+		synth_template_t *tpl = group_find(group, addr);
+		if (tpl != NULL && (match == NULL ||
+		    tpl->subnet.prefix > match->subnet.prefix ||
+		    (tpl->subnet.prefix == match->subnet.prefix && tpl->order < match->order))) {
+			match = tpl;
+			memcpy(&match_addr, addr, sizeof(match_addr));
+		}
+	}
+
+	if (match == NULL) {
+		return state; /* Can't identify addr in QNAME or out of the netblocks. */
+	}
+
+	return template_answer(match, &match_addr, pkt, qdata);
+}
+
+/*! \brief Add template to the table of the query plan, create it if needed. */
+static int synth_table_add(struct query_plan *plan, synth_template_t *tpl)
+{
+	struct synth_table *table = NULL;
+	int ret = query_shared_get(plan, QPLAN_ANSWER, QSHARED_APPEND, solve_synth_record,
+	                           sizeof(struct synth_table), (void **)&table);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	if (table->shared.refs == 1) {
+		init_list(&table->templates);
+		init_list(&table->groups);
+	}
+
+	add_tail(&table->templates, &tpl->node);
+	tpl->table = table;
+
+	return table_compile(table);
 }
 
 int synth_record_load(struct query_plan *plan, struct query_module *self)
@@ -337,6 +647,7 @@ int synth_record_load(struct query_plan *plan, struct query_module *self)
 	if (tpl == NULL) {
 		return KNOT_ENOMEM;
 	}
+	memset(tpl, 0, sizeof(struct synth_template));
 
 	/* Save in query module, it takes ownership from now on. */
 	self->ctx = tpl;
@@ -357,16 +668,16 @@ int synth_record_load(struct query_plan *plan, struct query_module *self)
 		MODULE_ERR("dots '.' are not allowed in the prefix");
 		return KNOT_EMALF;
 	}
+	tpl->prefix_len = strlen(tpl->prefix);
 
 	/* Parse zone if generating reverse record. */
 	if (tpl->type == SYNTH_REVERSE) {
 		tpl->zone = strtok_r(NULL, " ", &saveptr);
-		knot_dname_t *check_name = knot_dname_from_str_alloc(tpl->zone);
-		if (check_name == NULL) {
+		tpl->zone_name = knot_dname_from_str_alloc(tpl->zone);
+		if (tpl->zone_name == NULL) {
 			MODULE_ERR("invalid zone '%s'", tpl->zone);
 			return KNOT_EMALF;
 		}
-		knot_dname_free(&check_name, NULL);
 	}
 
 	/* Parse TTL. */
@@ -400,11 +711,27 @@ int synth_record_load(struct query_plan *plan, struct query_module *self)
 		return KNOT_EMALF;
 	}
 
-	return query_plan_step(plan, QPLAN_ANSWER, solve_synth_record, tpl);
+	return synth_table_add(plan, tpl);
 }
 
 int synth_record_unload(struct query_module *self)
 {
-	mm_free(self->mm, self->ctx);
+	synth_template_t *tpl = self->ctx;
+	if (tpl == NULL) {
+		return KNOT_EOK;
+	}
+
+	/* The table is shared by the modules in the same query plan. */
+	if (tpl->table != NULL) {
+		struct synth_table *table = tpl->table;
+		rem_node(&tpl->node);
+		if (query_shared_release(&table->shared, table_free) > 0 &&
+		    table_compile(table) != KNOT_EOK) {
+			MODULE_ERR("failed to compile templates");
+		}
+	}
+
+	knot_dname_free(&tpl->zone_name, NULL);
+	mm_free(self->mm, tpl);
 	return KNOT_EOK;
 }
@@ -0,0 +1,552 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include "knot/modules/weighted_rr.h"
+#include "knot/nameserver/query_module.h"
+#include "knot/nameserver/process_query.h"
+#include "knot/nameserver/internet.h"
+#include "knot/zone/zone.h"
+#include "knot/conf/conf.h"
+#include "libknot/descriptor.h"
+#include "libknot/dnssec/random.h"
+#include "libknot/internal/macros.h"
+#include "libknot/internal/utils.h"
+
+/* Defines. */
+#define WRR_MAX_RRS 255       /* Record indices are stored in bytes. */
+#define WRR_MAX_VARIANTS 256
+#define WRR_MAX_WEIGHT 65535
+#define MODULE_ERR(msg...) log_error("module 'weighted_rr', " msg)
+
+/*! \brief Weight of an address. */
+struct wrr_weight {
+	uint16_t type;     /*!< A or AAAA. */
+	uint8_t addr[16];
+	unsigned weight;
+};
+
+/*! \brief Configured name. */
+struct wrr_name {
+	node_t node;
+	knot_dname_t *owner;
+	unsigned variants;
+	struct wrr_weight *weights;
+	size_t weight_count;
+	struct wrr_ctx *ctx;
+};
+
+/*! \brief Precomputed record orders of a single RR set. */
+struct wrr_entry {
+	knot_dname_t *owner;
+	uint16_t type;
+	uint16_t rr_count;
+	uint16_t variants;
+	uint8_t *perm;      /*!< Variants, 'rr_count' record indices each. */
+};
+
+/*!
+ * \brief Record orders for a zone version.
+ *
+ * The set is built when the zone gets new contents. It is immutable and shared
+ * by the threads, and released when the last thread switches to a newer one.
+ */
+struct wrr_set {
+	size_t count;
+	struct wrr_entry *entries;
+	int refs;
+};
+
+/*! \brief State owned by a single server thread. */
+struct wrr_thread {
+	uint32_t prng;
+	struct wrr_set *set;
+} __attribute__((aligned(64)));
+
+/*!
+ * \brief Names of all weighted_rr modules in a query plan.
+ */
+struct wrr_ctx {
+	struct query_shared shared;
+	list_t names;
+	pthread_mutex_t lock;  /*!< Serializes the set updates. */
+	struct wrr_set *set;   /*!< Latest built set. */
+	struct wrr_thread *threads;
+	size_t thread_count;
+};
+
+/*! \brief Cheap per-thread generator (xorshift32), never returns to zero. */
+static uint32_t prng_next(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static uint32_t prng_seed(void)
+{
+	uint32_t seed = 0;
+	while (seed == 0) {
+		if (knot_random_buffer(&seed, sizeof(seed)) != KNOT_EOK) {
+			seed = 0x9e3779b9;
+		}
+	}
+	return seed;
+}
+
+static void set_release(struct wrr_set *set)
+{
+	if (set == NULL || __sync_sub_and_fetch(&set->refs, 1) > 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < set->count; ++i) {
+		knot_dname_free(&set->entries[i].owner, NULL);
+		free(set->entries[i].perm);
+	}
+	free(set->entries);
+	free(set);
+}
+
+/*! \brief Weight of the record, 1 if not configured. */
+static unsigned record_weight(const struct wrr_name *name, uint16_t type,
+                              const knot_rdata_t *rr)
+{
+	for (size_t i = 0; i < name->weight_count; ++i) {
+		const struct wrr_weight *w = &name->weights[i];
+		if (w->type == type &&
+		    memcmp(w->addr, knot_rdata_data(rr), knot_rdata_rdlen(rr)) == 0) {
+			return w->weight;
+		}
+	}
+
+	return 1;
+}
+
+/*!
+ * \brief Precompute the record orders of the RR set.
+ *
+ * Without weights, the variants are evenly spaced rotations. With weights,
+ * each variant is drawn without replacement, so a record comes first in the
+ * proportion of its weight to the total.
+ */
+static int entry_build(struct wrr_entry *entry, const struct wrr_name *name,
+                       const zone_node_t *node, uint16_t type)
+{
+	const knot_rdataset_t *rrs = node_rdataset(node, type);
+	uint16_t n = rrs->rr_count;
+	entry->type = type;
+	entry->rr_count = n;
+	entry->variants = (name->weight_count == 0) ? MIN(name->variants, n) : name->variants;
+	entry->owner = knot_dname_copy(node->owner, NULL);
+	entry->perm = malloc(entry->variants * n);
+	if (entry->owner == NULL || entry->perm == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	if (name->weight_count == 0) {
+		for (unsigned v = 0; v < entry->variants; ++v) {
+			unsigned start = v * n / entry->variants;
+			for (unsigned i = 0; i < n; ++i) {
+				entry->perm[v * n + i] = (start + i) % n;
+			}
+		}
+		return KNOT_EOK;
+	}
+
+	unsigned weights[WRR_MAX_RRS];
+	uint32_t prng = prng_seed();
+	for (unsigned v = 0; v < entry->variants; ++v) {
+		uint64_t total = 0;
+		for (unsigned i = 0; i < n; ++i) {
+			weights[i] = record_weight(name, type, knot_rdataset_at(rrs, i));
+			total += weights[i];
+		}
+		for (unsigned pos = 0; pos < n; ++pos) {
+			uint64_t pick = prng_next(&prng) % total;
+			unsigned i = 0;
+			while (weights[i] == 0 || pick >= weights[i]) {
+				pick -= weights[i];
+				i += 1;
+			}
+			entry->perm[v * n + pos] = i;
+			total -= weights[i];
+			weights[i] = 0;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Build the record orders of the configured names in the zone version. */
+static struct wrr_set *set_build(const struct wrr_ctx *ctx, const zone_contents_t *contents)
+{
+	struct wrr_set *set = malloc(sizeof(struct wrr_set));
+	if (set == NULL) {
+		return NULL;
+	}
+	memset(set, 0, sizeof(struct wrr_set));
+	set->refs = 1;
+
+	const uint16_t types[] = { KNOT_RRTYPE_A, KNOT_RRTYPE_AAAA };
+	set->entries = calloc(2 * list_size(&ctx->names), sizeof(struct wrr_entry));
+	if (set->entries == NULL && !EMPTY_LIST(ctx->names)) {
+		set_release(set);
+		return NULL;
+	}
+
+	struct wrr_name *name = NULL;
+	WALK_LIST(name, ctx->names) {
+		const zone_node_t *node = zone_contents_find_node(contents, name->owner);
+		if (node == NULL) {
+			continue;
+		}
+		for (int t = 0; t < 2; ++t) {
+			const knot_rdataset_t *rrs = node_rdataset(node, types[t]);
+			if (rrs == NULL || rrs->rr_count < 2 || rrs->rr_count > WRR_MAX_RRS) {
+				continue;
+			}
+			set->count += 1;
+			if (entry_build(&set->entries[set->count - 1], name, node, types[t]) != KNOT_EOK) {
+				set_release(set);
+				return NULL;
+			}
+		}
+	}
+
+	return set;
+}
+
+/*!
+ * \brief Build the record orders when the zone gets new contents.
+ *
+ * Runs from the zone hooks, outside of the query processing threads.
+ */
+static void wrr_zone_hook(zone_t *zone, const zone_contents_t *contents, void *data)
+{
+	struct wrr_ctx *ctx = data;
+	if (zone->conf == NULL || zone->conf->query_plan != ctx->shared.plan) {
+		return;
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+	struct wrr_set *set = NULL;
+	if (contents != NULL) {
+		set = set_build(ctx, contents);
+		if (set == NULL) {
+			log_zone_error(zone->name, "weighted_rr, failed to build record "
+			               "orders, keeping the previous ones");
+			pthread_mutex_unlock(&ctx->lock);
+			return;
+		}
+	}
+	set_release(ctx->set);
+	ctx->set = set;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/*!
+ * \brief Record orders of the thread.
+ *
+ * The thread picks up the latest set only if it doesn't have to wait for
+ * the lock, and keeps using its previous set otherwise.
+ */
+static const struct wrr_set *thread_set(struct wrr_ctx *ctx, struct wrr_thread *thr)
+{
+	if (thr->set == ctx->set || pthread_mutex_trylock(&ctx->lock) != 0) {
+		return thr->set;
+	}
+
+	if (thr->set != ctx->set) {
+		set_release(thr->set);
+		thr->set = ctx->set;
+		if (thr->set != NULL) {
+			__sync_add_and_fetch(&thr->set->refs, 1);
+		}
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	return thr->set;
+}
+
+/*!
+ * \brief Find the record orders of the RR set.
+ *
+ * The set may be built for a different zone version than the answer, so the
+ * record count is checked too.
+ */
+static const struct wrr_entry *set_find(const struct wrr_set *set, const knot_rrset_t *rr)
+{
+	for (size_t i = 0; i < set->count; ++i) {
+		const struct wrr_entry *entry = &set->entries[i];
+		if (entry->type == rr->type && entry->rr_count == rr->rrs.rr_count &&
+		    knot_dname_is_equal(entry->owner, rr->owner)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Reorder the record data of the RR set written in the packet.
+ *
+ * The records of an A or AAAA RR set differ only in the data of the same
+ * length, so the data are swapped in place and the owners, the compression
+ * pointers and the positions of the following RRs (RRSIGs) are kept.
+ */
+static void rrset_reorder(knot_pkt_t *pkt, const knot_rrinfo_t *info,
+                          const struct wrr_entry *entry, unsigned variant)
+{
+	uint8_t *rdata[WRR_MAX_RRS];
+	uint8_t *pos = pkt->wire + info->pos;
+	const uint8_t *end = pkt->wire + pkt->size;
+	uint16_t len = 0;
+	for (unsigned i = 0; i < entry->rr_count; ++i) {
+		int owner_len = knot_dname_wire_check(pos, end, pkt->wire);
+		if (owner_len <= 0 || pos + owner_len + 10 > end) {
+			return;
+		}
+		pos += owner_len;
+		uint16_t rr_len = wire_read_u16(pos + 8);
+		if ((i > 0 && rr_len != len) || pos + 10 + rr_len > end) {
+			return;
+		}
+		len = rr_len;
+		rdata[i] = pos + 10;
+		pos += 10 + rr_len;
+	}
+
+	uint8_t buf[WRR_MAX_RRS * 16];
+	if (len > 16) {
+		return;
+	}
+	for (unsigned i = 0; i < entry->rr_count; ++i) {
+		memcpy(buf + i * len, rdata[i], len);
+	}
+	const uint8_t *perm = entry->perm + variant * entry->rr_count;
+	for (unsigned i = 0; i < entry->rr_count; ++i) {
+		memcpy(rdata[i], buf + perm[i] * len, len);
+	}
+}
+
+static int weighted_rr_answer(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+{
+	if (pkt == NULL || qdata == NULL || ctx == NULL || state != HIT) {
+		return state;
+	}
+
+	struct wrr_ctx *wrr = ctx;
+	unsigned thread_id = qdata->param->thread_id;
+	if (thread_id >= wrr->thread_count) {
+		return state;
+	}
+	struct wrr_thread *thr = &wrr->threads[thread_id];
+
+	/* Only the RR sets written by the answer step are reordered. */
+	const knot_pktsection_t *answer = knot_pkt_section(pkt, KNOT_ANSWER);
+	const struct wrr_set *set = NULL;
+	for (uint16_t i = 0; i < answer->count; ++i) {
+		const knot_rrset_t *rr = &answer->rr[i];
+		if ((rr->type != KNOT_RRTYPE_A && rr->type != KNOT_RRTYPE_AAAA) ||
+		    rr->rrs.rr_count < 2) {
+			continue;
+		}
+		if (set == NULL) {
+			set = thread_set(wrr, thr);
+			if (set == NULL) {
+				break;
+			}
+		}
+		const struct wrr_entry *entry = set_find(set, rr);
+		if (entry != NULL) {
+			unsigned variant = prng_next(&thr->prng) % entry->variants;
+			rrset_reorder(pkt, &answer->rrinfo[i], entry, variant);
+		}
+	}
+
+	return state;
+}
+
+/*! \brief Parse '<address>=<weight>'. */
+static int weight_parse(char *token, struct wrr_weight *weight)
+{
+	char *sep = strchr(token, '=');
+	if (sep == NULL) {
+		return KNOT_EMALF;
+	}
+	*sep = '\0';
+
+	char *end = NULL;
+	unsigned long value = strtoul(sep + 1, &end, 10);
+	if (end == sep + 1 || *end != '\0' || value == 0 || value > WRR_MAX_WEIGHT) {
+		return KNOT_EMALF;
+	}
+	weight->weight = value;
+
+	memset(weight->addr, 0, sizeof(weight->addr));
+	if (inet_pton(AF_INET6, token, weight->addr) == 1) {
+		weight->type = KNOT_RRTYPE_AAAA;
+	} else if (inet_pton(AF_INET, token, weight->addr) == 1) {
+		weight->type = KNOT_RRTYPE_A;
+	} else {
+		return KNOT_EMALF;
+	}
+
+	return KNOT_EOK;
+}
+
+static void wrr_ctx_clear(void *data)
+{
+	struct wrr_ctx *ctx = data;
+	zone_hook_remove(wrr_zone_hook, ctx);
+	for (size_t i = 0; i < ctx->thread_count; ++i) {
+		set_release(ctx->threads[i].set);
+	}
+	free(ctx->threads);
+	set_release(ctx->set);
+	pthread_mutex_destroy(&ctx->lock);
+}
+
+static int wrr_ctx_init(struct wrr_ctx *ctx, struct query_module *self)
+{
+	init_list(&ctx->names);
+	pthread_mutex_init(&ctx->lock, NULL);
+
+	size_t count = conf_udp_threads(self->config) + conf_tcp_threads(self->config);
+	if (posix_memalign((void **)&ctx->threads, 64, count * sizeof(struct wrr_thread)) != 0) {
+		return KNOT_ENOMEM;
+	}
+	memset(ctx->threads, 0, count * sizeof(struct wrr_thread));
+	for (size_t i = 0; i < count; ++i) {
+		ctx->threads[i].prng = prng_seed();
+	}
+	ctx->thread_count = count;
+
+	/* The orders are built when the zone is published. */
+	return zone_hook_add(wrr_zone_hook, ctx);
+}
+
+/*! \brief Add name to the context of the query plan, create it if needed. */
+static int wrr_ctx_add(struct query_plan *plan, struct wrr_name *name,
+                       struct query_module *self)
+{
+	/* Right after the zone answer step, before the RRSIGs are added. */
+	struct wrr_ctx *ctx = NULL;
+	int ret = query_shared_get(plan, QPLAN_ANSWER, QSHARED_FOLLOW, weighted_rr_answer,
+	                           sizeof(struct wrr_ctx), (void **)&ctx);
+	if (ret == KNOT_ENOTSUP) {
+		MODULE_ERR("zone answer step not found");
+	}
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	if (ctx->shared.refs == 1) {
+		ret = wrr_ctx_init(ctx, self);
+		if (ret != KNOT_EOK) {
+			query_shared_release(&ctx->shared, wrr_ctx_clear);
+			return ret;
+		}
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+	add_tail(&ctx->names, &name->node);
+	pthread_mutex_unlock(&ctx->lock);
+	name->ctx = ctx;
+
+	return KNOT_EOK;
+}
+
+int weighted_rr_load(struct query_plan *plan, struct query_module *self)
+{
+	char *saveptr = NULL;
+	char *owner = strtok_r(self->param, " ", &saveptr);
+	char *variants = strtok_r(NULL, " ", &saveptr);
+	if (owner == NULL || variants == NULL) {
+		return KNOT_EFEWDATA;
+	}
+
+	struct wrr_name *name = mm_alloc(self->mm, sizeof(struct wrr_name));
+	if (name == NULL) {
+		return KNOT_ENOMEM;
+	}
+	memset(name, 0, sizeof(struct wrr_name));
+
+	/* Save in query module, it takes ownership from now on. */
+	self->ctx = name;
+
+	name->owner = knot_dname_from_str_alloc(owner);
+	if (name->owner == NULL) {
+		MODULE_ERR("invalid name '%s'", owner);
+		return KNOT_EMALF;
+	}
+	knot_dname_to_lower(name->owner);
+
+	char *end = NULL;
+	name->variants = strtoul(variants, &end, 10);
+	if (end == variants || *end != '\0' || name->variants == 0 ||
+	    name->variants > WRR_MAX_VARIANTS) {
+		MODULE_ERR("invalid variant count '%s'", variants);
+		return KNOT_EMALF;
+	}
+
+	/* Parse weights. */
+	char *token = NULL;
+	while ((token = strtok_r(NULL, " ", &saveptr)) != NULL) {
+		struct wrr_weight *weights = realloc(name->weights,
+		                                     (name->weight_count + 1) * sizeof(*weights));
+		if (weights == NULL) {
+			return KNOT_ENOMEM;
+		}
+		name->weights = weights;
+		if (weight_parse(token, &weights[name->weight_count]) != KNOT_EOK) {
+			MODULE_ERR("invalid weight '%s'", token);
+			return KNOT_EMALF;
+		}
+		name->weight_count += 1;
+	}
+
+	return wrr_ctx_add(plan, name, self);
+}
+
+int weighted_rr_unload(struct query_module *self)
+{
+	struct wrr_name *name = self->ctx;
+	if (name == NULL) {
+		return KNOT_EOK;
+	}
+
+	/* The context is shared by the modules in the same query plan. */
+	struct wrr_ctx *ctx = name->ctx;
+	if (ctx != NULL) {
+		pthread_mutex_lock(&ctx->lock);
+		rem_node(&name->node);
+		pthread_mutex_unlock(&ctx->lock);
+		query_shared_release(&ctx->shared, wrr_ctx_clear);
+	}
+
+	knot_dname_free(&name->owner, NULL);
+	free(name->weights);
+	mm_free(self->mm, name);
+	return KNOT_EOK;
+}
@@ -0,0 +1,41 @@
+/*!
+ * \file weighted_rr.h
+ *
+ * \brief Weighted and rotated answers module
+ *
+ * Accepted configuration:
+ *  * "<name> <variants> [<address>=<weight> ...]"
+ *
+ * Module reorders the A and AAAA records of the given name in the answer.
+ * For each RR set, the record orders (variants) are precomputed once per
+ * zone version, either as rotations or as weighted random permutations,
+ * and one is picked for each query.
+ *
+ * \addtogroup query_processing
+ * @{
+ */
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "knot/nameserver/query_module.h"
+
+/*! \brief Module interface. */
+int weighted_rr_load(struct query_plan *plan, struct query_module *self);
+int weighted_rr_unload(struct query_module *self);
+
+/*! @} */
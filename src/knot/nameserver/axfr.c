@@ -14,6 +14,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
+
 #include "knot/nameserver/axfr.h"
 #include "knot/nameserver/internet.h"
 #include "knot/nameserver/process_query.h"
@@ -23,12 +25,52 @@
 #include "knot/common/debug.h"
 #include "libknot/descriptor.h"
 #include "libknot/internal/lists.h"
+#include "libknot/internal/macros.h"
+#include "libknot/internal/mempool.h"
+
+/*! \brief Space left in pre-serialized messages for TSIG and OPT [bytes]. */
+#define AXFR_STREAM_RESERVE 1024
+/*! \brief Limit of all pre-serialized messages together [bytes]. */
+#define AXFR_STREAM_MAX (64 * 1024 * 1024)
+
+/*! \brief Pre-serialized AXFR message. */
+struct axfr_msg {
+	size_t offset;    /*!< Offset of the records in the stream data. */
+	uint16_t len;     /*!< Length of the records. */
+	uint16_t ancount; /*!< Number of records. */
+};
+
+/*!
+ * \brief Pre-serialized AXFR messages of a zone version.
+ *
+ * The stream is shared by the transfers running at the same time and freed
+ * when the last of them finishes. A stream that failed to build is kept
+ * with the zone version, so that it's not rebuilt on each transfer.
+ */
+struct axfr_stream {
+	pthread_mutex_t lock; /*!< Held while building. */
+	int ret;              /*!< Result of building. */
+	unsigned refs;        /*!< Transfers using the stream. */
+	uint8_t *data;        /*!< Serialized ANSWER sections. */
+	size_t size;
+	size_t capacity;
+	struct axfr_msg *msgs;
+	unsigned count;
+	unsigned max_count;
+};
+
+/*! \brief Serializes creation and release of streams. */
+static pthread_mutex_t stream_create_lock = PTHREAD_MUTEX_INITIALIZER;
+/*! \brief Size of all pre-serialized messages [bytes]. */
+static size_t stream_total = 0;
 
 /* AXFR context. @note aliasing the generic xfr_proc */
 struct axfr_proc {
 	struct xfr_proc proc;
 	hattrie_iter_t *i;
 	unsigned cur_rrset;
+	struct axfr_stream *stream; /*!< Pre-serialized messages. */
+	unsigned cur_msg;
 };
 
 static int axfr_put_rrsets(knot_pkt_t *pkt, zone_node_t *node,
@@ -91,10 +133,287 @@ static int axfr_process_node_tree(knot_pkt_t *pkt, const void *item,
 	return ret;
 }
 
+/*! \brief Put items of the transfer to packet, SOA around the whole transfer. */
+static int xfr_put_items(knot_pkt_t *pkt, xfr_put_cb process_item,
+                         struct xfr_proc *xfer, const zone_contents_t *zone,
+                         mm_ctx_t *mm)
+{
+	int ret = KNOT_EOK;
+	knot_rrset_t soa_rr = node_rrset(zone->apex, KNOT_RRTYPE_SOA);
+
+	/* Prepend SOA on first packet. */
+	if (xfer->npkts == 0) {
+		ret = knot_pkt_put(pkt, 0, &soa_rr, KNOT_PF_NOTRUNC);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	/* Process all items in the list. */
+	while (!EMPTY_LIST(xfer->nodes)) {
+		ptrnode_t *head = HEAD(xfer->nodes);
+		ret = process_item(pkt, head->d, xfer);
+		if (ret == KNOT_EOK) { /* Finished. */
+			/* Complete change set. */
+			rem_node((node_t *)head);
+			mm_free(mm, head);
+		} else { /* Packet full or other error. */
+			break;
+		}
+	}
+
+	/* Append SOA on last packet. */
+	if (ret == KNOT_EOK) {
+		ret = knot_pkt_put(pkt, 0, &soa_rr, KNOT_PF_NOTRUNC);
+	}
+
+	/* Update counters. */
+	xfer->npkts  += 1;
+	xfer->nbytes += pkt->size;
+
+	return ret;
+}
+
+int xfr_process_list(knot_pkt_t *pkt, xfr_put_cb process_item,
+                     struct query_data *qdata)
+{
+	if (pkt == NULL || qdata == NULL || qdata->ext == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	return xfr_put_items(pkt, process_item, qdata->ext,
+	                     qdata->zone->contents, qdata->mm);
+}
+
+/*! \brief Reserve space for the stream data within the global limit. */
+static bool axfr_stream_reserve(size_t size)
+{
+	if (__sync_add_and_fetch(&stream_total, size) > AXFR_STREAM_MAX) {
+		__sync_sub_and_fetch(&stream_total, size);
+		return false;
+	}
+
+	return true;
+}
+
+/*! \brief Free the stream data, return the reserved space. */
+static void axfr_stream_clear(struct axfr_stream *stream)
+{
+	__sync_sub_and_fetch(&stream_total, stream->capacity);
+	free(stream->data);
+	free(stream->msgs);
+	stream->data = NULL;
+	stream->msgs = NULL;
+	stream->size = stream->capacity = 0;
+	stream->count = stream->max_count = 0;
+}
+
+/*! \brief Append message records to the stream. */
+static int axfr_stream_append(struct axfr_stream *stream, const knot_pkt_t *pkt)
+{
+	size_t start = KNOT_WIRE_HEADER_SIZE + knot_pkt_question_size(pkt);
+	size_t len = pkt->size - start;
+
+	if (stream->size + len > stream->capacity) {
+		size_t new_capacity = MAX(2 * stream->capacity, stream->size + len);
+		if (!axfr_stream_reserve(new_capacity - stream->capacity)) {
+			return KNOT_ELIMIT;
+		}
+		uint8_t *data = realloc(stream->data, new_capacity);
+		if (data == NULL) {
+			__sync_sub_and_fetch(&stream_total,
+			                     new_capacity - stream->capacity);
+			return KNOT_ENOMEM;
+		}
+		stream->data = data;
+		stream->capacity = new_capacity;
+	}
+
+	if (stream->count == stream->max_count) {
+		unsigned new_count = MAX(2 * stream->max_count, 16);
+		struct axfr_msg *msgs = realloc(stream->msgs,
+		                                new_count * sizeof(struct axfr_msg));
+		if (msgs == NULL) {
+			return KNOT_ENOMEM;
+		}
+		stream->msgs = msgs;
+		stream->max_count = new_count;
+	}
+
+	struct axfr_msg *msg = &stream->msgs[stream->count++];
+	msg->offset = stream->size;
+	msg->len = len;
+	msg->ancount = knot_wire_get_ancount(pkt->wire);
+	memcpy(stream->data + stream->size, pkt->wire + start, len);
+	stream->size += len;
+
+	return KNOT_EOK;
+}
+
+/*!
+ * \brief Serialize all AXFR messages of the zone version.
+ *
+ * Messages are written the same way as for a live transfer, after the
+ * question with the zone name, so the name compression stays valid for any
+ * AXFR (or IXFR) query for the zone. Building stops with KNOT_ELIMIT when
+ * the messages of all streams don't fit into AXFR_STREAM_MAX.
+ */
+static int axfr_stream_build(struct axfr_stream *stream, zone_contents_t *zone)
+{
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, MM_DEFAULT_BLKSIZE);
+
+	knot_pkt_t *pkt = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE - AXFR_STREAM_RESERVE,
+	                               &mm);
+	if (pkt == NULL) {
+		mp_delete(mm.ctx);
+		return KNOT_ENOMEM;
+	}
+
+	struct axfr_proc axfr;
+	memset(&axfr, 0, sizeof(axfr));
+	init_list(&axfr.proc.nodes);
+	ptrlist_add(&axfr.proc.nodes, zone->nodes, &mm);
+	if (!zone_tree_is_empty(zone->nsec3_nodes)) {
+		ptrlist_add(&axfr.proc.nodes, zone->nsec3_nodes, &mm);
+	}
+
+	int ret = KNOT_EOK;
+	do {
+		knot_pkt_clear(pkt);
+		knot_pkt_put_question(pkt, zone->apex->owner, KNOT_CLASS_IN,
+		                      KNOT_RRTYPE_AXFR);
+		knot_pkt_begin(pkt, KNOT_ANSWER);
+
+		ret = xfr_put_items(pkt, &axfr_process_node_tree, &axfr.proc,
+		                    zone, &mm);
+		if (ret != KNOT_EOK && ret != KNOT_ESPACE) {
+			break;
+		}
+
+		/* Record not fitting to an empty message. */
+		if (ret == KNOT_ESPACE && pkt->rrset_count == 0) {
+			break;
+		}
+
+		int append_ret = axfr_stream_append(stream, pkt);
+		if (append_ret != KNOT_EOK) {
+			ret = append_ret;
+			break;
+		}
+	} while (ret == KNOT_ESPACE);
+
+	hattrie_iter_free(axfr.i);
+	knot_pkt_free(&pkt);
+	mp_delete(mm.ctx);
+
+	/* Only the failure is remembered. */
+	if (ret != KNOT_EOK) {
+		axfr_stream_clear(stream);
+	}
+
+	return ret;
+}
+
+/*! \brief Release the stream, free it after the last transfer. */
+static void axfr_stream_release(zone_contents_t *zone, struct axfr_stream *stream)
+{
+	pthread_mutex_lock(&stream_create_lock);
+	bool last = --stream->refs == 0 && stream->ret == KNOT_EOK;
+	if (last) {
+		zone->axfr_stream = NULL;
+	}
+	pthread_mutex_unlock(&stream_create_lock);
+
+	if (last) {
+		axfr_stream_free(stream);
+	}
+}
+
+/*! \brief Get built stream of the zone version, build it if not yet done. */
+static struct axfr_stream *axfr_stream_get(zone_contents_t *zone)
+{
+	/* Create the stream, first caller builds it. */
+	pthread_mutex_lock(&stream_create_lock);
+	struct axfr_stream *stream = zone->axfr_stream;
+	bool build = false;
+	if (stream == NULL) {
+		stream = calloc(1, sizeof(struct axfr_stream));
+		if (stream == NULL) {
+			pthread_mutex_unlock(&stream_create_lock);
+			return NULL;
+		}
+		pthread_mutex_init(&stream->lock, NULL);
+		zone->axfr_stream = stream;
+		build = true;
+	}
+	stream->refs += 1;
+	pthread_mutex_lock(&stream->lock);
+	pthread_mutex_unlock(&stream_create_lock);
+
+	/* Others wait until the stream is built. */
+	if (build) {
+		stream->ret = axfr_stream_build(stream, zone);
+	}
+	int ret = stream->ret;
+	pthread_mutex_unlock(&stream->lock);
+
+	if (ret != KNOT_EOK) {
+		axfr_stream_release(zone, stream);
+		return NULL;
+	}
+
+	return stream;
+}
+
+void axfr_stream_free(struct axfr_stream *stream)
+{
+	if (stream == NULL) {
+		return;
+	}
+
+	pthread_mutex_destroy(&stream->lock);
+	axfr_stream_clear(stream);
+	free(stream);
+}
+
+/*! \brief Stop using the pre-serialized messages. */
+static void axfr_stream_drop(struct axfr_proc *axfr)
+{
+	if (axfr->stream != NULL) {
+		axfr_stream_release(axfr->proc.contents, axfr->stream);
+		axfr->stream = NULL;
+	}
+}
+
+/*!
+ * \brief Copy next pre-serialized message to the packet.
+ *
+ * \note Only the wire format is filled, the records are not parsed back into
+ *       the packet (pkt->rr and pkt->rrset_count stay empty). The QPLAN_END
+ *       hooks of query modules see no RRs in the ANSWER of such messages.
+ */
+static int axfr_stream_put(knot_pkt_t *pkt, struct axfr_proc *axfr)
+{
+	const struct axfr_stream *stream = axfr->stream;
+	const struct axfr_msg *msg = &stream->msgs[axfr->cur_msg];
+
+	memcpy(pkt->wire + pkt->size, stream->data + msg->offset, msg->len);
+	pkt->size += msg->len;
+	knot_wire_set_ancount(pkt->wire, msg->ancount);
+
+	axfr->cur_msg += 1;
+	axfr->proc.npkts += 1;
+	axfr->proc.nbytes += pkt->size;
+
+	return axfr->cur_msg < stream->count ? KNOT_ESPACE : KNOT_EOK;
+}
+
 static void axfr_query_cleanup(struct query_data *qdata)
 {
 	struct axfr_proc *axfr = (struct axfr_proc *)qdata->ext;
 
+	axfr_stream_drop(axfr);
 	hattrie_iter_free(axfr->i);
 	ptrlist_free(&axfr->proc.nodes, qdata->mm);
 	mm_free(qdata->mm, axfr);
@@ -107,7 +426,7 @@ static int axfr_query_check(struct query_data *qdata)
 {
 	/* Check valid zone, transaction security and contents. */
 	NS_NEED_ZONE(qdata, KNOT_RCODE_NOTAUTH);
-	NS_NEED_AUTH(&qdata->zone->conf->acl.xfr_out, qdata);
+	NS_NEED_AUTH(qdata->zone->conf->acl_tree.xfr_out, qdata);
 	/* Check expiration. */
 	NS_NEED_ZONE_CONTENTS(qdata, KNOT_RCODE_SERVFAIL);
 
@@ -138,6 +457,7 @@ static int axfr_query_init(struct query_data *qdata)
 	}
 	memset(axfr, 0, sizeof(struct axfr_proc));
 	init_list(&axfr->proc.nodes);
+	axfr->proc.contents = zone;
 
 	/* Put data to process. */
 	gettimeofday(&axfr->proc.tstamp, NULL);
@@ -155,54 +475,10 @@ static int axfr_query_init(struct query_data *qdata)
 	   (unlocked in axfr_answer_cleanup) */
 	rcu_read_lock();
 
-	return KNOT_EOK;
-}
-
-int xfr_process_list(knot_pkt_t *pkt, xfr_put_cb process_item,
-                     struct query_data *qdata)
-{
-	if (pkt == NULL || qdata == NULL || qdata->ext == NULL) {
-		return KNOT_EINVAL;
-	}
-
-	int ret = KNOT_EOK;
-	mm_ctx_t *mm = qdata->mm;
-	struct xfr_proc *xfer = qdata->ext;
-
-	zone_contents_t *zone = qdata->zone->contents;
-	knot_rrset_t soa_rr = node_rrset(zone->apex, KNOT_RRTYPE_SOA);
-
-	/* Prepend SOA on first packet. */
-	if (xfer->npkts == 0) {
-		ret = knot_pkt_put(pkt, 0, &soa_rr, KNOT_PF_NOTRUNC);
-		if (ret != KNOT_EOK) {
-			return ret;
-		}
-	}
-
-	/* Process all items in the list. */
-	while (!EMPTY_LIST(xfer->nodes)) {
-		ptrnode_t *head = HEAD(xfer->nodes);
-		ret = process_item(pkt, head->d, xfer);
-		if (ret == KNOT_EOK) { /* Finished. */
-			/* Complete change set. */
-			rem_node((node_t *)head);
-			mm_free(mm, head);
-		} else { /* Packet full or other error. */
-			break;
-		}
-	}
-
-	/* Append SOA on last packet. */
-	if (ret == KNOT_EOK) {
-		ret = knot_pkt_put(pkt, 0, &soa_rr, KNOT_PF_NOTRUNC);
-	}
-
-	/* Update counters. */
-	xfer->npkts  += 1;
-	xfer->nbytes += pkt->size;
+	/* Messages serialized once are shared by all transfers of the version. */
+	axfr->stream = axfr_stream_get(zone);
 
-	return ret;
+	return KNOT_EOK;
 }
 
 /* AXFR-specific logging (internal, expects 'qdata' variable set). */
@@ -241,9 +517,19 @@ int axfr_query_process(knot_pkt_t *pkt, struct query_data *qdata)
 	/* Reserve space for TSIG. */
 	knot_pkt_reserve(pkt, knot_tsig_wire_maxsize(qdata->sign.tsig_key));
 
-	/* Answer current packet (or continue). */
+	/* Serialize the zone if the pre-serialized messages don't fit. */
 	struct axfr_proc *axfr = (struct axfr_proc *)qdata->ext;
-	ret = xfr_process_list(pkt, &axfr_process_node_tree, qdata);
+	if (axfr->stream != NULL && axfr->proc.npkts == 0 &&
+	    pkt->max_size - pkt->reserved < KNOT_WIRE_MAX_PKTSIZE - AXFR_STREAM_RESERVE) {
+		axfr_stream_drop(axfr);
+	}
+
+	/* Answer current packet (or continue). */
+	if (axfr->stream != NULL) {
+		ret = axfr_stream_put(pkt, axfr);
+	} else {
+		ret = xfr_process_list(pkt, &axfr_process_node_tree, qdata);
+	}
 	switch(ret) {
 	case KNOT_ESPACE: /* Couldn't write more, send packet and continue. */
 		return KNOT_NS_PROC_FULL; /* Check for more. */
@@ -262,13 +548,20 @@ int axfr_query_process(knot_pkt_t *pkt, struct query_data *qdata)
 }
 #undef AXFROUT_LOG
 
+/*! \brief AXFR-in processing context. */
+struct axfrin_proc {
+	struct xfr_proc proc;
+	zbuilder_t builder;
+};
+
 static void axfr_answer_cleanup(struct answer_data *data)
 {
 	assert(data != NULL);
 
-	struct xfr_proc *proc = data->ext;
+	struct axfrin_proc *proc = data->ext;
 	if (proc) {
-		zone_contents_deep_free(&proc->contents);
+		zbuilder_clear(&proc->builder);
+		zone_contents_deep_free(&proc->proc.contents);
 		mm_free(data->mm, proc);
 		data->ext = NULL;
 	}
@@ -280,21 +573,24 @@ static int axfr_answer_init(struct answer_data *data)
 
 	/* Create new zone contents. */
 	zone_t *zone = data->param->zone;
-	zone_contents_t *new_contents = zone_contents_new(zone->name);
+	zone_contents_t *new_contents = zone_contents_new_arena(zone->name);
 	if (new_contents == NULL) {
 		return KNOT_ENOMEM;
 	}
 
 	/* Create new processing context. */
-	struct xfr_proc *proc = mm_alloc(data->mm, sizeof(struct xfr_proc));
+	struct axfrin_proc *proc = mm_alloc(data->mm, sizeof(struct axfrin_proc));
 	if (proc == NULL) {
 		zone_contents_deep_free(&new_contents);
 		return KNOT_ENOMEM;
 	}
 
-	memset(proc, 0, sizeof(struct xfr_proc));
-	proc->contents = new_contents;
-	gettimeofday(&proc->tstamp, NULL);
+	memset(proc, 0, sizeof(struct axfrin_proc));
+	proc->proc.contents = new_contents;
+	gettimeofday(&proc->proc.tstamp, NULL);
+
+	/* Records are streamed into the new zone, it is adjusted at the end. */
+	zbuilder_init(&proc->builder, new_contents, false);
 
 	/* Set up cleanup callback. */
 	data->ext = proc;
@@ -312,12 +608,19 @@ static int axfr_answer_finalize(struct answer_data *adata)
 	struct timeval now;
 	gettimeofday(&now, NULL);
 
+	/* Insert records of the last owner. */
+	struct axfrin_proc *axfr = adata->ext;
+	struct xfr_proc *proc = &axfr->proc;
+	int rc = zbuilder_finish(&axfr->builder);
+	if (rc != KNOT_EOK) {
+		return rc;
+	}
+
 	/*
 	 * Adjust zone so that node count is set properly and nodes are
 	 * marked authoritative / delegation point.
 	 */
-	struct xfr_proc *proc = adata->ext;
-	int rc = zone_contents_adjust_full(proc->contents, NULL, NULL);
+	rc = zone_contents_adjust_full(proc->contents, NULL, NULL);
 	if (rc != KNOT_EOK) {
 		return rc;
 	}
@@ -328,12 +631,17 @@ static int axfr_answer_finalize(struct answer_data *adata)
 	                zone_switch_contents(zone, proc->contents);
 	synchronize_rcu();
 
+	/* Transfer throughput, the interval is at least one millisecond. */
+	double seconds = MAX(time_diff(&proc->tstamp, &now), 1.0) / 1000.0;
+
 	AXFRIN_LOG(LOG_INFO, "finished, "
-	           "serial %u -> %u, %.02f seconds, %u messages, %u bytes",
+	           "serial %u -> %u, %.02f seconds, %u messages, %u bytes, "
+	           "%zu records, %.0f RR/s, %.2f MB/s",
 	           zone_contents_serial(old_contents),
 	           zone_contents_serial(proc->contents),
-	           time_diff(&proc->tstamp, &now) / 1000.0,
-	           proc->npkts, proc->nbytes);
+	           seconds, proc->npkts, proc->nbytes, axfr->builder.rr_count,
+	           axfr->builder.rr_count / seconds,
+	           proc->nbytes / seconds / 1e6);
 
 	/* Do not free new contents with cleanup. */
 	zone_contents_deep_free(&old_contents);
@@ -342,26 +650,22 @@ static int axfr_answer_finalize(struct answer_data *adata)
 	return KNOT_EOK;
 }
 
-static int axfr_answer_packet(knot_pkt_t *pkt, struct xfr_proc *proc)
+static int axfr_answer_packet(knot_pkt_t *pkt, struct axfrin_proc *axfr)
 {
 	assert(pkt != NULL);
-	assert(proc != NULL);
+	assert(axfr != NULL);
 
 	/* Update counters. */
-	proc->npkts  += 1;
-	proc->nbytes += pkt->size;
-
-	/* Init zone creator. */
-	zcreator_t zc = {.z = proc->contents, .master = false, .ret = KNOT_EOK };
+	axfr->proc.npkts  += 1;
+	axfr->proc.nbytes += pkt->size;
 
 	const knot_pktsection_t *answer = knot_pkt_section(pkt, KNOT_ANSWER);
 	for (uint16_t i = 0; i < answer->count; ++i) {
 		const knot_rrset_t *rr = &answer->rr[i];
-		if (rr->type == KNOT_RRTYPE_SOA &&
-		    node_rrtype_exists(zc.z->apex, KNOT_RRTYPE_SOA)) {
+		if (rr->type == KNOT_RRTYPE_SOA && axfr->builder.soa) {
 			return KNOT_NS_PROC_DONE;
 		} else {
-			int ret = zcreator_step(&zc, rr);
+			int ret = zbuilder_add(&axfr->builder, rr);
 			if (ret != KNOT_EOK) {
 				return KNOT_NS_PROC_FAIL;
 			}
@@ -402,7 +706,7 @@ int axfr_answer_process(knot_pkt_t *pkt, struct answer_data *adata)
 	}
 
 	/* Process answer packet. */
-	int ret = axfr_answer_packet(pkt, (struct xfr_proc *)adata->ext);
+	int ret = axfr_answer_packet(pkt, (struct axfrin_proc *)adata->ext);
 	if (ret == KNOT_NS_PROC_DONE) {
 		NS_NEED_TSIG_SIGNED(&adata->param->tsig_ctx, 0);
 		/* This was the last packet, finalize zone and publish it. */
@@ -31,6 +31,7 @@
 
 struct query_data;
 struct answer_data;
+struct axfr_stream;
 
 /*! \brief Generic transfer processing state. */
 struct xfr_proc {
@@ -51,9 +52,18 @@ typedef int (*xfr_put_cb)(knot_pkt_t *pkt, const void *item, struct xfr_proc *xf
  */
 int xfr_process_list(knot_pkt_t *pkt, xfr_put_cb put, struct query_data *qdata);
 
+/*!
+ * \brief Free pre-serialized AXFR messages of a zone version.
+ */
+void axfr_stream_free(struct axfr_stream *stream);
+
 /*!
  * \brief Process an AXFR query message.
  *
+ * Concurrent transfers of the same zone version share the messages
+ * serialized by the first of them. Such messages carry the records only in
+ * the wire format, query module hooks see no RRs in the packet.
+ *
  * \return KNOT_NS_PROC_* processing states
  */
 int axfr_query_process(knot_pkt_t *pkt, struct query_data *qdata);
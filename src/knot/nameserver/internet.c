@@ -119,7 +119,7 @@ static bool dname_cname_cannot_synth(const knot_rrset_t *rrset, const knot_dname
 /*! \brief DNSSEC both requested & available. */
 static bool have_dnssec(struct query_data *qdata)
 {
-	return knot_pkt_has_dnssec(qdata->query) &&
+	return knot_pkt_has_dnssec(qdata->query) && !qdata->unsigned_answer &&
 	       zone_contents_is_signed(qdata->zone->contents);
 }
 
@@ -761,18 +761,21 @@ static int default_answer(knot_pkt_t *response, struct query_data *qdata)
 
 	/* Resolve ANSWER. */
 	dbg_ns("%s: writing %p ANSWER\n", __func__, response);
+	query_timer_start(qdata, QPLAN_ANSWER);
 	knot_pkt_begin(response, KNOT_ANSWER);
 	SOLVE_STEP(solve_answer, state, NULL);
 	SOLVE_STEP(solve_answer_dnssec, state, NULL);
 
 	/* Resolve AUTHORITY. */
 	dbg_ns("%s: writing %p AUTHORITY\n", __func__, response);
+	query_timer_start(qdata, QPLAN_AUTHORITY);
 	knot_pkt_begin(response, KNOT_AUTHORITY);
 	SOLVE_STEP(solve_authority, state, NULL);
 	SOLVE_STEP(solve_authority_dnssec, state, NULL);
 
 	/* Resolve ADDITIONAL. */
 	dbg_ns("%s: writing %p ADDITIONAL\n", __func__, response);
+	query_timer_start(qdata, QPLAN_ADDITIONAL);
 	knot_pkt_begin(response, KNOT_ADDITIONAL);
 	SOLVE_STEP(solve_additional, state, NULL);
 	SOLVE_STEP(solve_additional_dnssec, state, NULL);
@@ -788,6 +791,7 @@ static int planned_answer(struct query_plan *plan, knot_pkt_t *response, struct
 	/* Before query processing code. */
 	int state = BEGIN;
 	struct query_step *step = NULL;
+	query_timer_start(qdata, QPLAN_BEGIN);
 	WALK_LIST(step, plan->stage[QPLAN_BEGIN]) {
 		SOLVE_STEP(step->process, state, step->ctx);
 	}
@@ -796,12 +800,14 @@ static int planned_answer(struct query_plan *plan, knot_pkt_t *response, struct
 	for (int section = KNOT_ANSWER; section <= KNOT_ADDITIONAL; ++section) {
 		dbg_ns("%s: writing section %u\n", __func__, section);
 		knot_pkt_begin(response, section);
+		query_timer_start(qdata, QPLAN_STAGE + section);
 		WALK_LIST(step, plan->stage[QPLAN_STAGE + section]) {
 			SOLVE_STEP(step->process, state, step->ctx);
 		}
 	}
 
 	/* After query processing code. */
+	query_timer_start(qdata, QPLAN_END);
 	WALK_LIST(step, plan->stage[QPLAN_END]) {
 		SOLVE_STEP(step->process, state, step->ctx);
 	}
@@ -827,7 +833,7 @@ int internet_query(knot_pkt_t *response, struct query_data *qdata)
 	/* No applicable ACL, refuse transaction security. */
 	if (knot_pkt_has_tsig(qdata->query)) {
 		/* We have been challenged... */
-		NS_NEED_AUTH(&qdata->zone->conf->acl.xfr_out, qdata);
+		NS_NEED_AUTH(qdata->zone->conf->acl_tree.xfr_out, qdata);
 
 		/* Reserve space for TSIG. */
 		knot_pkt_reserve(response, knot_tsig_wire_maxsize(qdata->sign.tsig_key));
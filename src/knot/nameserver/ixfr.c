@@ -206,7 +206,7 @@ static int ixfr_query_check(struct query_data *qdata)
 	NS_NEED_QNAME(qdata, their_soa->owner, KNOT_RCODE_FORMERR);
 
 	/* Check transcation security and zone contents. */
-	NS_NEED_AUTH(&qdata->zone->conf->acl.xfr_out, qdata);
+	NS_NEED_AUTH(qdata->zone->conf->acl_tree.xfr_out, qdata);
 	NS_NEED_ZONE_CONTENTS(qdata, KNOT_RCODE_SERVFAIL); /* Check expiration. */
 
 	return KNOT_NS_PROC_DONE;
@@ -389,7 +389,6 @@ static int ixfrin_finalize(struct answer_data *adata)
 	if (ret != KNOT_EOK) {
 		IXFRIN_LOG(LOG_WARNING, "failed to write changes to journal (%s)",
 		           knot_strerror(ret));
-		updates_rollback(&ixfr->changesets);
 		update_free_zone(&new_contents);
 		return ret;
 	}
@@ -399,8 +398,6 @@ static int ixfrin_finalize(struct answer_data *adata)
 	synchronize_rcu();
 	update_free_zone(&old_contents);
 
-	updates_cleanup(&ixfr->changesets);
-
 	struct timeval now = {0};
 	gettimeofday(&now, NULL);
 	IXFRIN_LOG(LOG_INFO,
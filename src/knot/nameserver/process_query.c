@@ -11,6 +11,8 @@
 #include "knot/nameserver/notify.h"
 #include "knot/server/server.h"
 #include "knot/server/rrl.h"
+#include "knot/server/stats.h"
+#include "knot/zone/zone-stats.h"
 #include "knot/updates/acl.h"
 #include "knot/conf/conf.h"
 #include "libknot/rrtype/opt.h"
@@ -101,6 +103,11 @@ static int process_query_in(knot_layer_t *ctx, knot_pkt_t *pkt)
 	qdata->query = pkt;
 	qdata->packet_type = knot_pkt_type(pkt);
 
+	/* Only normal queries can do with question, OPT and TSIG. */
+	if (qdata->packet_type != KNOT_QUERY_NORMAL) {
+		(void) knot_pkt_materialize(pkt);
+	}
+
 	/* Declare having response. */
 	return KNOT_NS_PROC_FULL;
 }
@@ -410,7 +417,9 @@ static int ratelimit_apply(int state, knot_pkt_t *pkt, knot_layer_t *ctx)
 	}
 
 	/* Now it is slip or drop. */
-	if (rrl_slip_roll(conf()->rrl_slip)) {
+	bool slip = rrl_slip_roll(conf()->rrl_slip);
+	stats_rrl(stats_thread(&server->stats, qdata->param->thread_id), slip);
+	if (slip) {
 		/* Answer slips. */
 		if (process_query_err(ctx, pkt) != KNOT_EOK) {
 			return KNOT_NS_PROC_FAIL;
@@ -455,12 +464,20 @@ static int process_query_out(knot_layer_t *ctx, knot_pkt_t *pkt)
 	}
 
 	/* Before query processing code. */
+	query_timer_start(qdata, QPLAN_BEGIN);
 	if (plan) {
 		WALK_LIST(step, plan->stage[QPLAN_BEGIN]) {
 			next_state = step->process(next_state, pkt, qdata, step->ctx);
 		}
 	}
 
+	/* Query taken over by a module, it answers on its own. */
+	if (next_state == KNOT_NS_PROC_NOOP) {
+		query_timer_stop(qdata);
+		rcu_read_unlock();
+		return next_state;
+	}
+
 	/* Answer based on qclass. */
 	if (next_state != KNOT_NS_PROC_DONE) {
 		switch (knot_pkt_qclass(pkt)) {
@@ -481,7 +498,7 @@ static int process_query_out(knot_layer_t *ctx, knot_pkt_t *pkt)
 	/*
 	 * Postprocessing.
 	 */
-
+	query_timer_start(qdata, QPLAN_END);
 
 	if (next_state == KNOT_NS_PROC_DONE || next_state == KNOT_NS_PROC_FULL) {
 
@@ -524,18 +541,26 @@ finish:
 		next_state = ratelimit_apply(next_state, pkt, ctx);
 	}
 
+	/* Per-zone statistics. */
+	if (qdata->zone != NULL) {
+		zone_stats_t *stats = zone_stats_get((zone_t *)qdata->zone);
+		zone_stats_query(stats, qdata->param->thread_id, query, qdata->rcode);
+	}
+
 	/* After query processing code. */
+	query_timer_start(qdata, QPLAN_END);
 	if (plan) {
 		WALK_LIST(step, plan->stage[QPLAN_END]) {
 			next_state = step->process(next_state, pkt, qdata, step->ctx);
 		}
 	}
+	query_timer_stop(qdata);
 
 	rcu_read_unlock();
 	return next_state;
 }
 
-bool process_query_acl_check(list_t *acl, struct query_data *qdata)
+bool process_query_acl_check(const acl_tree_t *acl, struct query_data *qdata)
 {
 	knot_pkt_t *query = qdata->query;
 	const struct sockaddr_storage *query_source = qdata->param->remote;
@@ -552,7 +577,7 @@ bool process_query_acl_check(list_t *acl, struct query_data *qdata)
 		key_name = query->tsig_rr->owner;
 		key_alg = knot_tsig_rdata_alg(query->tsig_rr);
 	}
-	conf_iface_t *match = acl_find(acl, query_source, key_name);
+	conf_iface_t *match = acl_tree_find(acl, query_source, key_name);
 
 	/* Did not authenticate, no fitting rule found. */
 	if (match == NULL || (match->key && match->key->algorithm != key_alg)) {
@@ -27,6 +27,7 @@
 #pragma once
 
 #include "libknot/processing/layer.h"
+#include "knot/common/time.h"
 #include "knot/server/server.h"
 #include "knot/updates/acl.h"
 
@@ -80,6 +81,9 @@ struct query_data {
 	const zone_node_t *node, *encloser, *previous;
 	const knot_dname_t *name;
 
+	/* Answer not taken from the zone (e.g. by a module), skip DNSSEC. */
+	bool unsigned_answer;
+
 	/* Original QNAME case. */
 	uint8_t orig_qname[KNOT_DNAME_MAXLEN];
 
@@ -92,11 +96,62 @@ struct query_data {
 	void (*ext_cleanup)(struct query_data*); /*!< Extensions cleanup callback. */
 	knot_sign_context_t sign;            /*!< Signing context. */
 
+#ifdef ENABLE_TIMING
+	/* Query plan stage timing. */
+	unsigned timer_stage;  /*!< Timed stage + 1, 0 if none. */
+	uint64_t timer_start;  /*!< Stage start [ns]. */
+#endif
+
 	/* Everything below should be kept on reset. */
 	struct process_query_param *param; /*!< Module parameters. */
 	mm_ctx_t *mm;                      /*!< Memory context. */
 };
 
+#ifdef ENABLE_TIMING
+/*! \brief Record time spent in the currently timed stage. */
+static inline void query_timer_record(struct query_data *qdata, uint64_t now)
+{
+	if (qdata->timer_stage == 0) {
+		return;
+	}
+
+	server_t *server = qdata->param->server;
+	stats_counters_t *counters = stats_thread(&server->stats, qdata->param->thread_id);
+	if (counters != NULL) {
+		stats_hist_add(&counters->stage[qdata->timer_stage - 1],
+		               now - qdata->timer_start);
+	}
+}
+
+/*!
+ * \brief Start timing given query plan stage, finish the previous one.
+ *
+ * \note Starting the already timed stage has no effect, so the server and
+ *       zone query plans are timed as a single stage.
+ */
+static inline void query_timer_start(struct query_data *qdata, int stage)
+{
+	if (qdata->timer_stage == stage + 1) {
+		return;
+	}
+
+	uint64_t now = time_now_ns();
+	query_timer_record(qdata, now);
+	qdata->timer_stage = stage + 1;
+	qdata->timer_start = now;
+}
+
+/*! \brief Finish timing of the current stage. */
+static inline void query_timer_stop(struct query_data *qdata)
+{
+	query_timer_record(qdata, time_now_ns());
+	qdata->timer_stage = 0;
+}
+#else
+#define query_timer_start(qdata, stage)
+#define query_timer_stop(qdata)
+#endif
+
 /*! \brief Visited wildcard node list. */
 struct wildcard_hit {
 	node_t n;
@@ -114,11 +169,11 @@ struct rrsig_info {
 /*!
  * \brief Check current query against ACL.
  *
- * \param acl
+ * \param acl    Compiled ACL, NULL if empty.
  * \param qdata
  * \return true if accepted, false if denied.
  */
-bool process_query_acl_check(list_t *acl, struct query_data *qdata);
+bool process_query_acl_check(const acl_tree_t *acl, struct query_data *qdata);
 
 /*!
  * \brief Verify current query transaction security and update query data.
@@ -6,6 +6,9 @@
 /* Compiled-in module headers. */
 #include "knot/modules/synth_record.h"
 #include "knot/modules/dnsproxy.h"
+#include "knot/modules/ecs_view.h"
+#include "knot/modules/weighted_rr.h"
+#include "knot/modules/rpz.h"
 #ifdef HAVE_ROSEDB 
 #include "knot/modules/rosedb.h"
 #endif
@@ -18,12 +21,16 @@ struct compiled_module {
 	const char *name;
 	qmodule_load_t load;
 	qmodule_unload_t unload;
+	qmodule_stats_t stats;
 };
 
 /*! \note All modules should be dynamically loaded later on. */
 struct compiled_module MODULES[] = {
         { "synth_record", &synth_record_load, &synth_record_unload },
         { "dnsproxy", &dnsproxy_load, &dnsproxy_unload },
+        { "ecs_view", &ecs_view_load, &ecs_view_unload },
+        { "weighted_rr", &weighted_rr_load, &weighted_rr_unload },
+        { "rpz", &rpz_load, &rpz_unload, &rpz_stats_print },
 #ifdef HAVE_ROSEDB
         { "rosedb", &rosedb_load, &rosedb_unload },
 #endif
@@ -89,6 +96,101 @@ int query_plan_step(struct query_plan *plan, int stage, qmodule_process_t proces
 	return KNOT_EOK;
 }
 
+int query_shared_get(struct query_plan *plan, int stage, enum query_shared_place place,
+                     qmodule_process_t process, size_t size, void **ctx)
+{
+	if (plan == NULL || process == NULL || size < sizeof(struct query_shared) ||
+	    ctx == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	/* A replaced step is the first one, a planned one may be anywhere. */
+	list_t *steps = &plan->stage[stage];
+	struct query_step *step = NULL;
+	if (place == QSHARED_REPLACE) {
+		if (!EMPTY_LIST(*steps) && ((struct query_step *)HEAD(*steps))->process == process) {
+			step = HEAD(*steps);
+		}
+	} else {
+		struct query_step *it = NULL;
+		WALK_LIST(it, *steps) {
+			if (it->process == process) {
+				step = it;
+				break;
+			}
+		}
+	}
+
+	if (step != NULL) {
+		struct query_shared *shared = step->ctx;
+		shared->refs += 1;
+		*ctx = shared;
+		return KNOT_EOK;
+	}
+
+	if (place != QSHARED_APPEND && EMPTY_LIST(*steps)) {
+		return KNOT_ENOTSUP;
+	}
+
+	struct query_shared *shared = mm_alloc(plan->mm, size);
+	if (shared == NULL) {
+		return KNOT_ENOMEM;
+	}
+	memset(shared, 0, size);
+	shared->refs = 1;
+	shared->plan = plan;
+
+	if (place == QSHARED_REPLACE) {
+		step = HEAD(*steps);
+		shared->next = step->process;
+		shared->next_ctx = step->ctx;
+		step->process = process;
+		step->ctx = shared;
+	} else {
+		step = make_step(plan->mm, process, shared);
+		if (step == NULL) {
+			mm_free(plan->mm, shared);
+			return KNOT_ENOMEM;
+		}
+		if (place == QSHARED_FOLLOW) {
+			insert_node(&step->node, HEAD(*steps));
+		} else {
+			add_tail(steps, &step->node);
+		}
+	}
+	shared->step = step;
+
+	*ctx = shared;
+	return KNOT_EOK;
+}
+
+int query_shared_release(struct query_shared *shared, query_shared_clear_t clear)
+{
+	if (shared == NULL) {
+		return 0;
+	}
+
+	if (--shared->refs > 0) {
+		return shared->refs;
+	}
+
+	struct query_plan *plan = shared->plan;
+	if (shared->next != NULL) {
+		shared->step->process = shared->next;
+		shared->step->ctx = shared->next_ctx;
+	} else {
+		rem_node(&shared->step->node);
+		mm_free(plan->mm, shared->step);
+	}
+
+	if (clear != NULL) {
+		clear(shared);
+	}
+	mm_free(plan->mm, shared);
+
+	return 0;
+}
+
 struct query_module *query_module_open(struct conf *config, const char *name,
                                        const char *param, mm_ctx_t *mm)
 {
@@ -117,6 +219,7 @@ struct query_module *query_module_open(struct conf *config, const char *name,
 	module->config = config;
 	module->load = found->load;
 	module->unload = found->unload;
+	module->stats = found->stats;
 	module->param = mm_alloc(mm, buflen);
 	if (module->param == NULL) {
 		mm_free(mm, module);
@@ -67,11 +67,13 @@ struct conf;
 typedef int (*qmodule_load_t)(struct query_plan *plan, struct query_module *self);
 typedef int (*qmodule_unload_t)(struct query_module *self);
 typedef int (*qmodule_process_t)(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx);
+typedef int (*qmodule_stats_t)(const struct query_module *self, char *buf, size_t buflen);
 
 /*!
  * Query module is a dynamically loadable unit that can alter query processing plan.
  * Module requires load and unload callback handlers and is provided with a context
- * and configuration string.
+ * and configuration string. Optional stats callback prints the module counters
+ * on a single line without the line break and returns the printed length.
  */
 struct query_module {
 	node_t node;
@@ -81,6 +83,7 @@ struct query_module {
 	struct conf *config;
 	qmodule_load_t load;
 	qmodule_unload_t unload;
+	qmodule_stats_t stats;
 };
 
 /*! \brief Single processing step in query processing. */
@@ -99,6 +102,29 @@ struct query_plan {
 	list_t stage[QUERY_PLAN_STAGES];
 };
 
+/*! \brief Placement of a shared step in the stage. */
+enum query_shared_place {
+	QSHARED_APPEND,  /*!< After the planned steps. */
+	QSHARED_FOLLOW,  /*!< Right after the first step. */
+	QSHARED_REPLACE  /*!< Instead of the first step, which is kept as the next one. */
+};
+
+/*!
+ * \brief Context of a step shared by the instances of a module in a query plan.
+ *
+ * Embedded at the beginning of the module context.
+ */
+struct query_shared {
+	int refs;
+	struct query_plan *plan;
+	struct query_step *step;
+	qmodule_process_t next;  /*!< Replaced callback, QSHARED_REPLACE only. */
+	void *next_ctx;
+};
+
+/*! \brief Callback clearing the shared context before it's freed. */
+typedef void (*query_shared_clear_t)(void *ctx);
+
 /*! \brief Create an empty query plan. */
 struct query_plan *query_plan_create(mm_ctx_t *mm);
 
@@ -108,6 +134,40 @@ void query_plan_free(struct query_plan *plan);
 /*! \brief Plan another step for given stage. */
 int query_plan_step(struct query_plan *plan, int stage, qmodule_process_t process, void *ctx);
 
+/*!
+ * \brief Get the shared context of the module step in the stage, plan the step if needed.
+ *
+ * The step is identified by its callback. A new context of 'size' bytes is
+ * allocated from the plan memory context and zeroed, only the query_shared
+ * part is set. Each call takes a reference, a new context has one.
+ *
+ * \param plan     Query plan.
+ * \param stage    Processing stage.
+ * \param place    Placement of a new step.
+ * \param process  Step callback.
+ * \param size     Size of the module context.
+ * \param ctx      Output shared context.
+ *
+ * \retval KNOT_EOK if success.
+ * \retval KNOT_ENOTSUP if there's no first step to follow or replace.
+ * \retval KNOT_ENOMEM
+ */
+int query_shared_get(struct query_plan *plan, int stage, enum query_shared_place place,
+                     qmodule_process_t process, size_t size, void **ctx);
+
+/*!
+ * \brief Release the shared context.
+ *
+ * The last reference removes the step or restores the replaced one, clears
+ * and frees the context.
+ *
+ * \param shared  Shared context.
+ * \param clear   Clears the module context, may be NULL.
+ *
+ * \return Number of remaining references.
+ */
+int query_shared_release(struct query_shared *shared, query_shared_clear_t clear);
+
 /*!
  * \brief Open query module identified by name.
  * \note Module 'load' hook is NOT called and left upon a caller to decide.
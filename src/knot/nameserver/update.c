@@ -99,7 +99,6 @@ static int sign_update(zone_t *zone, const zone_contents_t *old_contents,
 	// Merge changesets
 	ret = changeset_merge(ddns_ch, sec_ch);
 	if (ret != KNOT_EOK) {
-		update_cleanup(sec_ch);
 		return ret;
 	}
 
@@ -247,7 +246,6 @@ static int process_normal(zone_t *zone, list_t *requests)
 		ret = sign_update(zone, zone->contents, new_contents, &ddns_ch,
 		                  &sec_ch);
 		if (ret != KNOT_EOK) {
-			update_rollback(&ddns_ch);
 			update_free_zone(&new_contents);
 			changeset_clear(&ddns_ch);
 			set_rcodes(requests, KNOT_RCODE_SERVFAIL);
@@ -258,7 +256,6 @@ static int process_normal(zone_t *zone, list_t *requests)
 	// Write changes to journal if all went well. (DNSSEC merged)
 	ret = zone_change_store(zone, &ddns_ch);
 	if (ret != KNOT_EOK) {
-		update_rollback(&ddns_ch);
 		update_free_zone(&new_contents);
 		changeset_clear(&ddns_ch);
 		if (zone->conf->dnssec_enable) {
@@ -274,14 +271,12 @@ static int process_normal(zone_t *zone, list_t *requests)
 
 	// Clear DNSSEC changes
 	if (zone->conf->dnssec_enable) {
-		update_cleanup(&sec_ch);
 		changeset_clear(&sec_ch);
 	}
 
 	// Clear obsolete zone contents
 	update_free_zone(&old_contents);
 
-	update_cleanup(&ddns_ch);
 	changeset_clear(&ddns_ch);
 
 	/* Sync zonefile immediately if configured. */
@@ -400,7 +395,7 @@ static void forward_requests(zone_t *zone, list_t *requests)
 static bool update_tsig_check(struct query_data *qdata, struct knot_request *req)
 {
 	// Check that ACL is still valid.
-	if (!process_query_acl_check(&qdata->zone->conf->acl.update_in, qdata)) {
+	if (!process_query_acl_check(qdata->zone->conf->acl_tree.update_in, qdata)) {
 		UPDATE_LOG(LOG_WARNING, "ACL check failed");
 		knot_wire_set_rcode(req->resp->wire, qdata->rcode);
 		return false;
@@ -507,7 +502,7 @@ int update_query_process(knot_pkt_t *pkt, struct query_data *qdata)
 
 	/* Need valid transaction security. */
 	zone_t *zone = (zone_t *)qdata->zone;
-	NS_NEED_AUTH(&zone->conf->acl.update_in, qdata);
+	NS_NEED_AUTH(zone->conf->acl_tree.update_in, qdata);
 	/* Check expiration. */
 	NS_NEED_ZONE_CONTENTS(qdata, KNOT_RCODE_SERVFAIL);
 
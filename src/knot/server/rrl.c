@@ -25,7 +25,7 @@
 #include "knot/zone/zone.h"
 #include "libknot/libknot.h"
 #include "libknot/dnssec/random.h"
-#include "libknot/internal/trie/murmurhash3.h"
+#include "libknot/internal/hash.h"
 #include "libknot/internal/errors.h"
 
 /* Hopscotch defines. */
@@ -154,7 +154,7 @@ static int rrl_clsname(char *dst, size_t maxlen, uint8_t cls,
 }
 
 static int rrl_classify(char *dst, size_t maxlen, const struct sockaddr_storage *a,
-                        rrl_req_t *p, const zone_t *z, uint32_t seed)
+                        rrl_req_t *p, const zone_t *z)
 {
 	if (!dst || !p || !a || maxlen == 0) {
 		return KNOT_EINVAL;
@@ -187,12 +187,6 @@ static int rrl_classify(char *dst, size_t maxlen, const struct sockaddr_storage
 	*nlen = len;
 	blklen += len;
 
-	/* Seed. */
-	if (blklen + sizeof(seed) > maxlen) return KNOT_ESPACE;
-	if (memcpy(dst + blklen, (void*)&seed, sizeof(seed)) == 0) {
-		blklen += sizeof(seed);
-	}
-
 	return blklen;
 }
 
@@ -359,12 +353,13 @@ rrl_item_t* rrl_hash(rrl_table_t *t, const struct sockaddr_storage *a, rrl_req_t
                      const zone_t *zone, uint32_t stamp, int *lock)
 {
 	char buf[RRL_CLSBLK_MAXLEN];
-	int len = rrl_classify(buf, sizeof(buf), a, p, zone, t->seed);
+	int len = rrl_classify(buf, sizeof(buf), a, p, zone);
 	if (len < 0) {
 		return NULL;
 	}
 
-	uint32_t id = hash(buf, len) % t->size;
+	/* Keyed hash, as the classified data are controlled by the client. */
+	uint32_t id = hash_keyed(&t->key, buf, len) % t->size;
 
 	/* Lock for lookup. */
 	pthread_mutex_lock(&t->ll);
@@ -374,7 +369,7 @@ rrl_item_t* rrl_hash(rrl_table_t *t, const struct sockaddr_storage *a, rrl_req_t
 	rrl_item_t match = {
 	        0, *((uint64_t*)(buf + 1)), t->rate,    /* hop, netblk, ntok */
 	        buf[0], RRL_BF_NULL,                    /* cls, flags */
-	        hash((char*)(qname + 1), *qname), stamp /* qname, time*/
+	        hash_keyed(&t->key, (char*)(qname + 1), *qname), stamp /* qname, time*/
 	};
 
 	unsigned d = find_match(t, id, &match);
@@ -519,8 +514,8 @@ int rrl_reseed(rrl_table_t *rrl)
 	}
 
 	memset(rrl->arr, 0, rrl->size * sizeof(rrl_item_t));
-	rrl->seed = knot_random_uint32_t();
-	dbg_rrl("%s: reseed to '%u'\n", __func__, rrl->seed);
+	knot_random_buffer(&rrl->key, sizeof(rrl->key));
+	dbg_rrl("%s: reseeded\n", __func__);
 
 	if (rrl->lk_count > 0) {
 		for (unsigned i = 0; i < rrl->lk_count; ++i) {
@@ -28,6 +28,7 @@
 
 #include <stdint.h>
 #include <pthread.h>
+#include "libknot/internal/hash.h"
 #include "libknot/internal/sockaddr.h"
 #include "libknot/packet/pkt.h"
 
@@ -70,7 +71,7 @@ typedef struct rrl_item {
 
 typedef struct rrl_table {
 	uint32_t rate;       /* Configured RRL limit */
-	uint32_t seed;       /* Pseudorandom seed for hashing. */
+	hash_key_t key;      /* Secret key for hashing. */
 	pthread_mutex_t ll;
 	pthread_mutex_t *lk;      /* Table locks. */
 	unsigned lk_count;   /* Table lock count (granularity). */
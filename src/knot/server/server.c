@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <assert.h>
 
+#include "knot/common/conn_pool.h"
 #include "knot/common/debug.h"
 #include "knot/common/trim.h"
 #include "knot/server/server.h"
@@ -29,11 +30,39 @@
 #include "knot/conf/conf.h"
 #include "knot/worker/pool.h"
 #include "knot/zone/timers.h"
+#include "knot/zone/events/notifier.h"
+#include "knot/zone/events/refresh.h"
 #include "knot/zone/zonedb-load.h"
 #include "libknot/libknot.h"
 #include "libknot/dnssec/crypto.h"
 #include "libknot/dnssec/random.h"
 
+/*! \brief Longest wait of the requestor loop [ms]. */
+#define REQUESTOR_WAIT 500
+/*! \brief Longest wait of the NOTIFY dispatcher loop [ms]. */
+#define NOTIFIER_WAIT 100
+
+/*! \brief Write statistics file and plan the next dump. */
+static int stats_dump_event(event_t *event)
+{
+	server_t *server = event->data;
+
+	rcu_read_lock();
+	const char *filename = conf()->stats_file;
+	int interval = conf()->stats_interval;
+	if (filename != NULL) {
+		int ret = stats_dump(&server->stats, filename);
+		if (ret != KNOT_EOK) {
+			log_warning("failed to write statistics file '%s' (%s)",
+			            filename, knot_strerror(ret));
+		}
+		evsched_schedule(event, interval * 1000);
+	}
+	rcu_read_unlock();
+
+	return KNOT_EOK;
+}
+
 /*! \brief Event scheduler loop. */
 static int evsched_run(dthread_t *thread)
 {
@@ -73,6 +102,34 @@ static int evsched_destruct(dthread_t *thread)
 	return KNOT_EOK;
 }
 
+/*! \brief NOTIFY dispatcher loop. */
+static int notifier_run(dthread_t *thread)
+{
+	/* Queued zones are coalesced while waiting. */
+	while (!dt_is_cancelled(thread)) {
+		notifier_exec(NOTIFIER_WAIT);
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Outgoing requests loop. */
+static int requestor_run(dthread_t *thread)
+{
+	struct knot_async_requestor *r = thread->data;
+	if (!r) {
+		return KNOT_EINVAL;
+	}
+
+	/* Wake up periodically to check for cancellation. */
+	while (!dt_is_cancelled(thread)) {
+		knot_async_requestor_exec(r, REQUESTOR_WAIT);
+		conn_pool_expire();
+	}
+
+	return KNOT_EOK;
+}
+
 /*! \brief Unbind and dispose given interface. */
 static void server_remove_iface(iface_t *iface)
 {
@@ -292,13 +349,53 @@ int server_init(server_t *server, int bg_workers)
 		return KNOT_ENOMEM;
 	}
 
+	/* Initialize outgoing requestor. */
+	if (knot_async_requestor_init(&server->requestor) != KNOT_EOK) {
+		dt_delete(&server->iosched);
+		evsched_deinit(&server->sched);
+		return KNOT_ENOMEM;
+	}
+	server->iorequest = dt_create(1, requestor_run, evsched_destruct,
+	                              &server->requestor);
+	if (server->iorequest == NULL) {
+		knot_async_requestor_deinit(&server->requestor);
+		dt_delete(&server->iosched);
+		evsched_deinit(&server->sched);
+		return KNOT_ENOMEM;
+	}
+
+	/* Initialize NOTIFY dispatcher. */
+	if (notifier_init() != KNOT_EOK) {
+		dt_delete(&server->iorequest);
+		knot_async_requestor_deinit(&server->requestor);
+		dt_delete(&server->iosched);
+		evsched_deinit(&server->sched);
+		return KNOT_ENOMEM;
+	}
+	server->ionotify = dt_create(1, notifier_run, evsched_destruct, NULL);
+	if (server->ionotify == NULL) {
+		notifier_deinit();
+		dt_delete(&server->iorequest);
+		knot_async_requestor_deinit(&server->requestor);
+		dt_delete(&server->iosched);
+		evsched_deinit(&server->sched);
+		return KNOT_ENOMEM;
+	}
+
 	server->workers = worker_pool_create(bg_workers);
 	if (server->workers == NULL) {
+		dt_delete(&server->ionotify);
+		notifier_deinit();
+		dt_delete(&server->iorequest);
+		knot_async_requestor_deinit(&server->requestor);
 		dt_delete(&server->iosched);
 		evsched_deinit(&server->sched);
 		return KNOT_ENOMEM;
 	}
 
+	/* Initialize pool of idle connections to remotes. */
+	conn_pool_init();
+
 	return KNOT_EOK;
 }
 
@@ -321,6 +418,13 @@ void server_deinit(server_t *server)
 	/* Free threads and event handlers. */
 	worker_pool_destroy(server->workers);
 	dt_delete(&server->iosched);
+	dt_delete(&server->iorequest);
+	dt_delete(&server->ionotify);
+
+	/* Cancel outstanding requests. */
+	knot_async_requestor_deinit(&server->requestor);
+	notifier_deinit();
+	conn_pool_deinit();
 
 	/* Free rate limits. */
 	rrl_destroy(server->rrl);
@@ -328,9 +432,19 @@ void server_deinit(server_t *server)
 	/* Free zone database. */
 	knot_zonedb_deep_free(&server->zone_db);
 
+	/* Free refresh budgets. */
+	refresh_deinit();
+
 	/* Free remaining events. */
+	if (server->stats_dump != NULL) {
+		evsched_cancel(server->stats_dump);
+		evsched_event_free(server->stats_dump);
+	}
 	evsched_deinit(&server->sched);
 
+	/* Free statistics. */
+	stats_deinit(&server->stats);
+
 	/* Close persistent timers database. */
 	close_timers_db(server->timers_db);
 
@@ -392,12 +506,17 @@ int server_start(server_t *s, bool async)
 		return KNOT_EINVAL;
 	}
 
+	/* Start outgoing requests handlers. */
+	dt_start(s->iorequest);
+	dt_start(s->ionotify);
+
 	/* Start workers. */
 	worker_pool_start(s->workers);
 
 	/* Wait for enqueued events if not asynchronous. */
 	if (!async) {
 		worker_pool_wait(s->workers);
+		knot_async_requestor_wait(&s->requestor);
 	}
 
 	/* Start evsched handler. */
@@ -422,6 +541,8 @@ void server_wait(server_t *s)
 	}
 
 	dt_join(s->iosched);
+	dt_join(s->iorequest);
+	dt_join(s->ionotify);
 	worker_pool_join(s->workers);
 
 	if (s->tu_size == 0) {
@@ -467,6 +588,10 @@ void server_stop(server_t *server)
 	evsched_schedule(term_ev, 0);
 	dt_stop(server->iosched);
 
+	/* Stop outgoing requests handlers. */
+	dt_stop(server->iorequest);
+	dt_stop(server->ionotify);
+
 	/* Interrupt background workers. */
 	worker_pool_stop(server->workers);
 
@@ -488,6 +613,15 @@ static int reconfigure_threads(const struct conf *conf, server_t *server)
 			}
 		}
 
+		/* Counters for each I/O thread, the threads are stopped. */
+		ret = stats_reserve(&server->stats, conf_udp_threads(conf) +
+		                                    conf_tcp_threads(conf));
+		if (ret != KNOT_EOK) {
+			log_error("failed to allocate statistics (%s)",
+			          knot_strerror(ret));
+			return ret;
+		}
+
 		/* Initialize I/O handlers. */
 		ret = server_init_handler(server, IO_UDP, conf_udp_threads(conf),
 		                          &udp_master, &udp_master_destruct);
@@ -519,6 +653,26 @@ static int reconfigure_threads(const struct conf *conf, server_t *server)
 	return ret;
 }
 
+static int reconfigure_stats(const struct conf *conf, server_t *server)
+{
+	if (conf->stats_file == NULL) {
+		if (server->stats_dump != NULL) {
+			evsched_cancel(server->stats_dump);
+		}
+		return KNOT_EOK;
+	}
+
+	if (server->stats_dump == NULL) {
+		server->stats_dump = evsched_event_create(&server->sched,
+		                                          stats_dump_event, server);
+		if (server->stats_dump == NULL) {
+			return KNOT_ENOMEM;
+		}
+	}
+
+	return evsched_schedule(server->stats_dump, conf->stats_interval * 1000);
+}
+
 static int reconfigure_rate_limits(const struct conf *conf, server_t *server)
 {
 	/* Rate limiting. */
@@ -574,6 +728,12 @@ int server_reconfigure(const struct conf *conf, void *data)
 		return ret;
 	}
 
+	/* Reconfigure statistics dump. */
+	if ((ret = reconfigure_stats(conf, server)) < 0) {
+		log_error("failed to reconfigure statistics");
+		return ret;
+	}
+
 	/* Update bound sockets. */
 	if ((ret = reconfigure_sockets(conf, server)) < 0) {
 		log_error("failed to reconfigure server sockets");
@@ -609,6 +769,9 @@ int server_update_zones(const conf_t *conf, void *data)
 	worker_pool_clear(server->workers);
 	worker_pool_wait(server->workers);
 
+	/* Finish outgoing requests of the old zones. */
+	knot_async_requestor_wait(&server->requestor);
+
 	/* Reload zone database and free old zones. */
 	reopen_timers_database(conf, server);
 	int ret = zonedb_reload(conf, server);
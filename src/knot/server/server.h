@@ -36,7 +36,9 @@
 #include "libknot/internal/namedb/namedb.h"
 #include "knot/server/dthreads.h"
 #include "knot/server/rrl.h"
+#include "knot/server/stats.h"
 #include "knot/worker/pool.h"
+#include "libknot/processing/requestor_async.h"
 #include "knot/zone/zonedb.h"
 
 /* Forwad declarations. */
@@ -109,12 +111,23 @@ typedef struct server {
 	dt_unit_t *iosched;
 	evsched_t sched;
 
+	/*! \brief Outgoing requests. */
+	dt_unit_t *iorequest;
+	struct knot_async_requestor requestor;
+
+	/*! \brief NOTIFY dispatcher. */
+	dt_unit_t *ionotify;
+
 	/*! \brief List of interfaces. */
 	ifacelist_t* ifaces;
 
 	/*! \brief Rate limiting. */
 	rrl_table_t *rrl;
 
+	/*! \brief Query statistics and their periodic dump. */
+	server_stats_t stats;
+	event_t *stats_dump;
+
 } server_t;
 
 /*!
@@ -0,0 +1,448 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "knot/server/stats.h"
+#include "libknot/consts.h"
+#include "libknot/descriptor.h"
+#include "libknot/errcode.h"
+#include "libknot/internal/macros.h"
+#include "libknot/internal/utils.h"
+#include "libknot/rrtype/opt.h"
+
+/*! \brief Bucket of a power of two histogram, values over the range are
+ *         counted in the last bucket. */
+static unsigned bucket(uint64_t value, unsigned count)
+{
+	unsigned i = 0;
+	while (value > 0 && i < count - 1) {
+		value >>= 1;
+		i += 1;
+	}
+
+	return i;
+}
+
+int stats_reserve(server_stats_t *stats, unsigned threads)
+{
+	if (stats == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	if (threads <= stats->threads) {
+		return KNOT_EOK;
+	}
+
+	void *mem = NULL;
+	size_t size = threads * sizeof(stats_counters_t);
+	if (posix_memalign(&mem, STATS_CACHELINE, size) != 0) {
+		return KNOT_ENOMEM;
+	}
+
+	memset(mem, 0, size);
+	if (stats->thread != NULL) {
+		memcpy(mem, stats->thread, stats->threads * sizeof(stats_counters_t));
+		free(stats->thread);
+	} else {
+		void *deferred = NULL;
+		if (posix_memalign(&deferred, STATS_CACHELINE,
+		                   sizeof(stats_counters_t)) != 0) {
+			free(mem);
+			return KNOT_ENOMEM;
+		}
+		memset(deferred, 0, sizeof(stats_counters_t));
+		pthread_mutex_init(&stats->lock, NULL);
+		stats->deferred = deferred;
+		stats->since = time(NULL);
+	}
+
+	stats->thread = mem;
+	stats->threads = threads;
+
+	return KNOT_EOK;
+}
+
+uint64_t stats_hist_upper(unsigned bucket)
+{
+	if (bucket < (1 << STATS_HIST_SUB_BITS)) {
+		return bucket;
+	}
+
+	unsigned shift = (bucket >> STATS_HIST_SUB_BITS) - 1;
+	uint64_t sub = bucket & ((1 << STATS_HIST_SUB_BITS) - 1);
+	uint64_t lower = ((1 << STATS_HIST_SUB_BITS) + sub) << shift;
+	return lower + ((uint64_t)1 << shift) - 1;
+}
+
+uint64_t stats_hist_quantile(const stats_hist_t *hist, double quantile)
+{
+	if (hist == NULL) {
+		return 0;
+	}
+
+	uint64_t total = 0;
+	for (unsigned i = 0; i < STATS_HIST_BUCKETS; ++i) {
+		total += hist->count[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	/* Rank of the quantile value rounded up, at least the first one. */
+	double exact = quantile * total;
+	uint64_t rank = exact;
+	if (rank < exact) {
+		rank += 1;
+	}
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < STATS_HIST_BUCKETS; ++i) {
+		seen += hist->count[i];
+		if (seen >= rank) {
+			return stats_hist_upper(i);
+		}
+	}
+
+	return stats_hist_upper(STATS_HIST_BUCKETS - 1);
+}
+
+void stats_deinit(server_stats_t *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+
+	if (stats->deferred != NULL) {
+		pthread_mutex_destroy(&stats->lock);
+		free(stats->deferred);
+	}
+	free(stats->thread);
+	memset(stats, 0, sizeof(server_stats_t));
+}
+
+stats_counters_t *stats_deferred_lock(server_stats_t *stats)
+{
+	if (stats == NULL || stats->deferred == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&stats->lock);
+	return stats->deferred;
+}
+
+void stats_deferred_unlock(server_stats_t *stats)
+{
+	if (stats == NULL || stats->deferred == NULL) {
+		return;
+	}
+
+	pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_query(stats_counters_t *counters, enum stats_proto proto,
+                 const knot_pkt_t *query, const knot_pkt_t *resp,
+                 size_t size, uint64_t usec)
+{
+	if (counters == NULL || query == NULL) {
+		return;
+	}
+
+	counters->queries += 1;
+	counters->proto[proto] += 1;
+
+	if (query->qname_size > 0) {
+		uint16_t qtype = knot_pkt_qtype(query);
+		counters->qtype[MIN(qtype, STATS_QTYPES - 1)] += 1;
+	}
+
+	if (query->opt_rr != NULL) {
+		counters->edns += 1;
+		if (knot_edns_do(query->opt_rr)) {
+			counters->dnssec_ok += 1;
+		}
+	}
+
+	if (resp != NULL && size > 0) {
+		counters->rcode[knot_wire_get_rcode(resp->wire)] += 1;
+		if (knot_wire_get_tc(resp->wire)) {
+			counters->truncated += 1;
+		}
+		counters->size[bucket(size, STATS_SIZES)] += 1;
+	} else {
+		counters->rcode[STATS_RCODES - 1] += 1;
+	}
+
+	counters->latency[bucket(usec, STATS_LATENCIES)] += 1;
+#ifdef ENABLE_TIMING
+	stats_hist_add(&counters->total[proto], usec * 1000);
+#endif
+}
+
+void stats_sum(const server_stats_t *stats, stats_counters_t *sum)
+{
+	if (stats == NULL || sum == NULL) {
+		return;
+	}
+
+	memset(sum, 0, sizeof(stats_counters_t));
+
+	/* Counters are a flat array of uint64_t, the padding is zeroed. */
+	uint64_t *dst = (uint64_t *)sum;
+	const size_t count = sizeof(stats_counters_t) / sizeof(uint64_t);
+	for (unsigned i = 0; i < stats->threads; ++i) {
+		const uint64_t *src = (const uint64_t *)&stats->thread[i];
+		for (size_t j = 0; j < count; ++j) {
+			dst[j] += src[j];
+		}
+	}
+	if (stats->deferred != NULL) {
+		const uint64_t *src = (const uint64_t *)stats->deferred;
+		for (size_t j = 0; j < count; ++j) {
+			dst[j] += src[j];
+		}
+	}
+}
+
+/*! \brief Output buffer. */
+struct outbuf {
+	char *buf;
+	size_t len;
+	size_t maxlen;
+	bool full;
+};
+
+static void out_printf(struct outbuf *out, const char *fmt, ...)
+{
+	if (out->full) {
+		return;
+	}
+
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(out->buf + out->len, out->maxlen - out->len, fmt, ap);
+	va_end(ap);
+
+	if (n < 0 || n >= out->maxlen - out->len) {
+		out->full = true;
+	} else {
+		out->len += n;
+	}
+}
+
+static void print_qtypes(struct outbuf *out, const stats_counters_t *sum)
+{
+	out_printf(out, "qtype:");
+	for (unsigned i = 0; i < STATS_QTYPES; ++i) {
+		if (sum->qtype[i] == 0) {
+			continue;
+		}
+		char name[64] = { '\0' };
+		if (i == STATS_QTYPES - 1) {
+			strcpy(name, "other");
+		} else {
+			knot_rrtype_to_string(i, name, sizeof(name));
+		}
+		out_printf(out, " %s=%"PRIu64, name, sum->qtype[i]);
+	}
+	out_printf(out, "\n");
+}
+
+static void print_rcodes(struct outbuf *out, const stats_counters_t *sum)
+{
+	out_printf(out, "rcode:");
+	for (unsigned i = 0; i < STATS_RCODES; ++i) {
+		if (sum->rcode[i] == 0) {
+			continue;
+		}
+		if (i == STATS_RCODES - 1) {
+			out_printf(out, " none=%"PRIu64, sum->rcode[i]);
+			continue;
+		}
+		lookup_table_t *rcode = lookup_by_id(knot_rcode_names, i);
+		if (rcode != NULL) {
+			out_printf(out, " %s=%"PRIu64, rcode->name, sum->rcode[i]);
+		} else {
+			out_printf(out, " RCODE%u=%"PRIu64, i, sum->rcode[i]);
+		}
+	}
+	out_printf(out, "\n");
+}
+
+static void print_histogram(struct outbuf *out, const char *title,
+                            const char *unit, const uint64_t *hist,
+                            unsigned count)
+{
+	out_printf(out, "%s:", title);
+	for (unsigned i = 0; i < count; ++i) {
+		if (hist[i] == 0) {
+			continue;
+		}
+		if (i == count - 1) {
+			out_printf(out, " >=%"PRIu64"%s=%"PRIu64,
+			           (uint64_t)1 << (i - 1), unit, hist[i]);
+		} else {
+			out_printf(out, " <%"PRIu64"%s=%"PRIu64,
+			           (uint64_t)1 << i, unit, hist[i]);
+		}
+	}
+	out_printf(out, "\n");
+}
+
+int stats_print(const server_stats_t *stats, char *buf, size_t buflen)
+{
+	if (stats == NULL || buf == NULL || buflen == 0) {
+		return KNOT_EINVAL;
+	}
+
+	stats_counters_t sum;
+	stats_sum(stats, &sum);
+
+	struct outbuf out = { buf, 0, buflen, false };
+	out_printf(&out, "uptime=%lld | threads=%u\n",
+	           (long long)(stats->since > 0 ? time(NULL) - stats->since : 0),
+	           stats->threads);
+	out_printf(&out, "queries=%"PRIu64" | udp4=%"PRIu64" udp6=%"PRIu64" "
+	           "tcp4=%"PRIu64" tcp6=%"PRIu64"\n", sum.queries,
+	           sum.proto[STATS_UDP4], sum.proto[STATS_UDP6],
+	           sum.proto[STATS_TCP4], sum.proto[STATS_TCP6]);
+	out_printf(&out, "edns=%"PRIu64" dnssec-ok=%"PRIu64" truncated=%"PRIu64" | "
+	           "rrl slipped=%"PRIu64" dropped=%"PRIu64"\n", sum.edns,
+	           sum.dnssec_ok, sum.truncated, sum.rrl_slipped, sum.rrl_dropped);
+	print_qtypes(&out, &sum);
+	print_rcodes(&out, &sum);
+	print_histogram(&out, "size", "B", sum.size, STATS_SIZES);
+	print_histogram(&out, "latency", "us", sum.latency, STATS_LATENCIES);
+
+	if (out.full) {
+		return KNOT_ESPACE;
+	}
+
+	return out.len;
+}
+
+#ifdef ENABLE_TIMING
+static void print_quantiles(struct outbuf *out, const char *name,
+                            const stats_hist_t *hist)
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+	static const char *labels[] = { "p50", "p90", "p99", "p99.9", "max" };
+
+	uint64_t total = 0;
+	for (unsigned i = 0; i < STATS_HIST_BUCKETS; ++i) {
+		total += hist->count[i];
+	}
+
+	out_printf(out, "%s\tcount=%"PRIu64, name, total);
+	for (unsigned i = 0; total > 0 && i < sizeof(quantiles) / sizeof(*quantiles); ++i) {
+		out_printf(out, " %s=%.3fus", labels[i],
+		           stats_hist_quantile(hist, quantiles[i]) / 1000.0);
+	}
+	out_printf(out, "\n");
+}
+#endif
+
+int stats_print_latency(const server_stats_t *stats, char *buf, size_t buflen)
+{
+	if (stats == NULL || buf == NULL || buflen == 0) {
+		return KNOT_EINVAL;
+	}
+
+#ifdef ENABLE_TIMING
+	static const char *protos[STATS_PROTOS] = { "udp4", "udp6", "tcp4", "tcp6" };
+	static const char *stages[QUERY_PLAN_STAGES] = {
+		"begin", "answer", "authority", "additional", "end"
+	};
+
+	stats_counters_t *sum = malloc(sizeof(stats_counters_t));
+	if (sum == NULL) {
+		return KNOT_ENOMEM;
+	}
+	stats_sum(stats, sum);
+
+	struct outbuf out = { buf, 0, buflen, false };
+	for (unsigned i = 0; i < STATS_PROTOS; ++i) {
+		print_quantiles(&out, protos[i], &sum->total[i]);
+	}
+	for (unsigned i = 0; i < QUERY_PLAN_STAGES; ++i) {
+		print_quantiles(&out, stages[i], &sum->stage[i]);
+	}
+	free(sum);
+
+	if (out.full) {
+		return KNOT_ESPACE;
+	}
+
+	return out.len;
+#else
+	return KNOT_ENOTSUP;
+#endif
+}
+
+int stats_dump(const server_stats_t *stats, const char *filename)
+{
+	if (stats == NULL || filename == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	char buf[8192];
+	int len = stats_print(stats, buf, sizeof(buf));
+	if (len < 0) {
+		return len;
+	}
+
+	/* Write temporary file and replace the old one. */
+	size_t tmplen = strlen(filename) + 5;
+	char *tmp = malloc(tmplen);
+	if (tmp == NULL) {
+		return KNOT_ENOMEM;
+	}
+	snprintf(tmp, tmplen, "%s.tmp", filename);
+
+	int ret = KNOT_EOK;
+	FILE *fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		ret = knot_map_errno(errno);
+		free(tmp);
+		return ret;
+	}
+
+	if (fwrite(buf, 1, len, fp) != len) {
+		ret = KNOT_ERROR;
+	}
+	if (fclose(fp) != 0 && ret == KNOT_EOK) {
+		ret = KNOT_ERROR;
+	}
+
+	if (ret == KNOT_EOK && rename(tmp, filename) != 0) {
+		ret = knot_map_errno(errno);
+	}
+	if (ret != KNOT_EOK) {
+		unlink(tmp);
+	}
+
+	free(tmp);
+	return ret;
+}
@@ -0,0 +1,254 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*!
+ * \file stats.h
+ *
+ * \brief Query processing statistics.
+ *
+ * Each I/O thread owns a block of counters aligned to a cache line, so the
+ * threads never share a line and update their counters without locks or
+ * atomic operations. Blocks are summed up on read, the sum may lag behind
+ * by the queries being processed at the moment.
+ *
+ * With ENABLE_TIMING, processing time is also recorded in log-linear
+ * (HDR-style) histograms per transport and per query plan stage, precise
+ * enough for tail percentiles. Without it, the histograms are left out.
+ *
+ * \addtogroup network
+ * @{
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "knot/nameserver/query_module.h"
+#include "libknot/packet/pkt.h"
+
+/*! \brief Assumed cache line size [B]. */
+#define STATS_CACHELINE 64
+/*! \brief Counted query types, other types share the last bucket. */
+#define STATS_QTYPES 257
+/*! \brief Counted response codes (header RCODE), last bucket for no response. */
+#define STATS_RCODES 17
+/*! \brief Response size buckets, powers of two up to 64 KiB. */
+#define STATS_SIZES 17
+/*! \brief Latency buckets, powers of two from 1 us up to 1 s. */
+#define STATS_LATENCIES 21
+
+/*! \brief Log-linear histogram: sub-buckets per power of two (bits). */
+#define STATS_HIST_SUB_BITS 3
+/*! \brief Log-linear histogram: highest tracked power of two (~17 s in ns). */
+#define STATS_HIST_MAX_EXP 34
+/*! \brief Log-linear histogram: number of buckets. */
+#define STATS_HIST_BUCKETS ((STATS_HIST_MAX_EXP - STATS_HIST_SUB_BITS + 2) << STATS_HIST_SUB_BITS)
+
+/*! \brief Query transport protocol and address family. */
+enum stats_proto {
+	STATS_UDP4 = 0,
+	STATS_UDP6,
+	STATS_TCP4,
+	STATS_TCP6,
+	STATS_PROTOS
+};
+
+/*! \brief Log-linear histogram of nanoseconds. */
+typedef struct stats_hist {
+	uint64_t count[STATS_HIST_BUCKETS];
+} stats_hist_t;
+
+/*! \brief Per-thread counters. */
+typedef struct stats_counters {
+	uint64_t queries;                 /*!< Processed queries. */
+	uint64_t proto[STATS_PROTOS];     /*!< Queries by transport. */
+	uint64_t qtype[STATS_QTYPES];     /*!< Queries by QTYPE. */
+	uint64_t rcode[STATS_RCODES];     /*!< Responses by RCODE. */
+	uint64_t edns;                    /*!< Queries with EDNS. */
+	uint64_t dnssec_ok;               /*!< Queries with DO bit. */
+	uint64_t truncated;               /*!< Truncated responses. */
+	uint64_t rrl_slipped;             /*!< Responses slipped by RRL. */
+	uint64_t rrl_dropped;             /*!< Responses dropped by RRL. */
+	uint64_t size[STATS_SIZES];       /*!< Responses by size. */
+	uint64_t latency[STATS_LATENCIES]; /*!< Queries by processing time. */
+#ifdef ENABLE_TIMING
+	stats_hist_t total[STATS_PROTOS];     /*!< Processing time by transport. */
+	stats_hist_t stage[QUERY_PLAN_STAGES]; /*!< Time spent in plan stages. */
+#endif
+} __attribute__((aligned(STATS_CACHELINE))) stats_counters_t;
+
+/*! \brief Server statistics. */
+typedef struct server_stats {
+	unsigned threads;           /*!< Number of thread blocks. */
+	stats_counters_t *thread;   /*!< Counters for each I/O thread. */
+	stats_counters_t *deferred; /*!< Answers sent outside the I/O threads. */
+	pthread_mutex_t lock;       /*!< Lock for the deferred counters. */
+	time_t since;               /*!< Time of the first block allocation. */
+} server_stats_t;
+
+/*!
+ * \brief Make room for counters of given number of threads.
+ *
+ * \note Existing counters are kept. Must not be called while the threads
+ *       are running if the blocks need to be reallocated.
+ *
+ * \param stats    Server statistics.
+ * \param threads  Number of I/O threads.
+ *
+ * \return KNOT_EOK or error
+ */
+int stats_reserve(server_stats_t *stats, unsigned threads);
+
+/*!
+ * \brief Free the counters.
+ */
+void stats_deinit(server_stats_t *stats);
+
+/*!
+ * \brief Return counters of given thread, NULL if out of range.
+ */
+static inline stats_counters_t *stats_thread(server_stats_t *stats,
+                                             unsigned thread_id)
+{
+	if (stats == NULL || thread_id >= stats->threads) {
+		return NULL;
+	}
+
+	return &stats->thread[thread_id];
+}
+
+/*!
+ * \brief Lock and return counters for answers sent outside the I/O threads.
+ *
+ * Queries taken over by a module are answered later from the module thread,
+ * which must not touch the I/O thread counters. Unlock with
+ * stats_deferred_unlock().
+ *
+ * \return Counters or NULL if not allocated yet.
+ */
+stats_counters_t *stats_deferred_lock(server_stats_t *stats);
+
+/*!
+ * \brief Unlock counters returned by stats_deferred_lock().
+ */
+void stats_deferred_unlock(server_stats_t *stats);
+
+/*!
+ * \brief Count processed query and its response.
+ *
+ * \param counters  Counters of the calling thread (may be NULL).
+ * \param proto     Transport protocol.
+ * \param query     Parsed query.
+ * \param resp      Response or NULL if none was sent.
+ * \param size      Response size (sum of all messages).
+ * \param usec      Processing time [us].
+ */
+void stats_query(stats_counters_t *counters, enum stats_proto proto,
+                 const knot_pkt_t *query, const knot_pkt_t *resp,
+                 size_t size, uint64_t usec);
+
+/*!
+ * \brief Count response limited by RRL.
+ *
+ * \param counters  Counters of the calling thread (may be NULL).
+ * \param slipped   True if slipped, false if dropped.
+ */
+static inline void stats_rrl(stats_counters_t *counters, bool slipped)
+{
+	if (counters == NULL) {
+		return;
+	}
+
+	if (slipped) {
+		counters->rrl_slipped += 1;
+	} else {
+		counters->rrl_dropped += 1;
+	}
+}
+
+/*!
+ * \brief Return histogram bucket for given value.
+ */
+static inline unsigned stats_hist_bucket(uint64_t value)
+{
+	if (value < (1 << STATS_HIST_SUB_BITS)) {
+		return value;
+	}
+
+	unsigned exp = 63 - __builtin_clzll(value);
+	if (exp > STATS_HIST_MAX_EXP) {
+		return STATS_HIST_BUCKETS - 1;
+	}
+
+	unsigned sub = (value >> (exp - STATS_HIST_SUB_BITS)) &
+	               ((1 << STATS_HIST_SUB_BITS) - 1);
+	return ((exp - STATS_HIST_SUB_BITS + 1) << STATS_HIST_SUB_BITS) + sub;
+}
+
+/*!
+ * \brief Return the highest value counted in given bucket.
+ */
+uint64_t stats_hist_upper(unsigned bucket);
+
+/*!
+ * \brief Return value at given quantile (0.0 - 1.0), 0 if empty.
+ */
+uint64_t stats_hist_quantile(const stats_hist_t *hist, double quantile);
+
+/*!
+ * \brief Count value in a histogram.
+ */
+static inline void stats_hist_add(stats_hist_t *hist, uint64_t value)
+{
+	if (hist != NULL) {
+		hist->count[stats_hist_bucket(value)] += 1;
+	}
+}
+
+/*!
+ * \brief Sum counters of all threads.
+ */
+void stats_sum(const server_stats_t *stats, stats_counters_t *sum);
+
+/*!
+ * \brief Print summed counters in a human readable form.
+ *
+ * \param stats   Server statistics.
+ * \param buf     Output buffer.
+ * \param buflen  Output buffer size.
+ *
+ * \return Printed length or KNOT_ESPACE.
+ */
+int stats_print(const server_stats_t *stats, char *buf, size_t buflen);
+
+/*!
+ * \brief Print processing time percentiles per transport and plan stage.
+ *
+ * \return Printed length, KNOT_ENOTSUP if built without ENABLE_TIMING,
+ *         or KNOT_ESPACE.
+ */
+int stats_print_latency(const server_stats_t *stats, char *buf, size_t buflen);
+
+/*!
+ * \brief Write summed counters into a file, replacing it atomically.
+ *
+ * \return KNOT_EOK or error
+ */
+int stats_dump(const server_stats_t *stats, const char *filename);
+
+/*! @} */
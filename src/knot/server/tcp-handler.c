@@ -36,6 +36,7 @@
 #include "knot/common/fdset.h"
 #include "knot/common/time.h"
 #include "knot/nameserver/process_query.h"
+#include "knot/server/stats.h"
 #include "libknot/internal/mempool.h"
 #include "libknot/internal/macros.h"
 #include "libknot/internal/net.h"
@@ -135,6 +136,9 @@ static int tcp_handle(tcp_context_t *tcp, int fd,
 		rx->iov_len = ret;
 	}
 
+	timev_t begin;
+	time_now(&begin);
+
 	/* Create packets. */
 	mm_ctx_t *mm = tcp->overlay.mm;
 	knot_pkt_t *ans = knot_pkt_new(tx->iov_base, tx->iov_len, mm);
@@ -144,11 +148,13 @@ static int tcp_handle(tcp_context_t *tcp, int fd,
 	knot_overlay_init(&tcp->overlay, mm);
 	knot_overlay_add(&tcp->overlay, NS_PROC_QUERY, &param);
 
-	/* Input packet. */
+	/* Input packet, query processing parses the rest of it when needed. */
+	(void) knot_pkt_parse(query, KNOT_PF_LAZY);
 	int state = knot_overlay_in(&tcp->overlay, query);
 
 	/* Resolve until NOOP or finished. */
 	ret = KNOT_EOK;
+	size_t sent = 0;
 	while (state & (KNOT_NS_PROC_FULL|KNOT_NS_PROC_FAIL)) {
 		state = knot_overlay_out(&tcp->overlay, ans);
 
@@ -158,6 +164,7 @@ static int tcp_handle(tcp_context_t *tcp, int fd,
 				ret = KNOT_ECONNREFUSED;
 				break;
 			}
+			sent += ans->size;
 		}
 	}
 
@@ -165,6 +172,10 @@ static int tcp_handle(tcp_context_t *tcp, int fd,
 	knot_overlay_finish(&tcp->overlay);
 	knot_overlay_deinit(&tcp->overlay);
 
+	stats_query(stats_thread(&tcp->server->stats, tcp->thread_id),
+	            ss.ss_family == AF_INET6 ? STATS_TCP6 : STATS_TCP4,
+	            query, ans, sent, time_elapsed_us(&begin));
+
 	/* Cleanup. */
 	knot_pkt_free(&query);
 	knot_pkt_free(&ans);
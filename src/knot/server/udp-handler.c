@@ -36,8 +36,10 @@
 #include <cap-ng.h>
 #endif /* HAVE_CAP_NG_H */
 
+#include "knot/common/time.h"
 #include "knot/server/udp-handler.h"
 #include "knot/server/server.h"
+#include "knot/server/stats.h"
 #include "libknot/internal/sockaddr.h"
 #include "libknot/internal/mempattern.h"
 #include "libknot/internal/mempool.h"
@@ -109,6 +111,9 @@ static inline void udp_pps_sample(unsigned n, unsigned thr_id) {}
 void udp_handle(udp_context_t *udp, int fd, struct sockaddr_storage *ss,
                 struct iovec *rx, struct iovec *tx)
 {
+	timev_t begin;
+	time_now(&begin);
+
 	/* Create query processing parameter. */
 	struct process_query_param param = {0};
 	param.remote = ss;
@@ -133,14 +138,19 @@ void udp_handle(udp_context_t *udp, int fd, struct sockaddr_storage *ss,
 	knot_overlay_init(&udp->overlay, mm);
 	knot_overlay_add(&udp->overlay, NS_PROC_QUERY, &param);
 
-	/* Input packet. */
+	/* Input packet, query processing parses the rest of it when needed. */
+	(void) knot_pkt_parse(query, KNOT_PF_LAZY);
 	int state = knot_overlay_in(&udp->overlay, query);
+	bool accepted = (state != KNOT_NS_PROC_NOOP);
 
 	/* Process answer. */
 	while (state & (KNOT_NS_PROC_FULL|KNOT_NS_PROC_FAIL)) {
 		state = knot_overlay_out(&udp->overlay, ans);
 	}
 
+	/* Query taken over by a module, it is counted when answered. */
+	bool parked = (accepted && state == KNOT_NS_PROC_NOOP);
+
 	/* Send response only if finished successfuly. */
 	if (state == KNOT_NS_PROC_DONE) {
 		tx->iov_len = ans->size;
@@ -152,6 +162,12 @@ void udp_handle(udp_context_t *udp, int fd, struct sockaddr_storage *ss,
 	knot_overlay_finish(&udp->overlay);
 	knot_overlay_deinit(&udp->overlay);
 
+	if (!parked) {
+		stats_query(stats_thread(&udp->server->stats, udp->thread_id),
+		            ss->ss_family == AF_INET6 ? STATS_UDP6 : STATS_UDP4,
+		            query, ans, tx->iov_len, time_elapsed_us(&begin));
+	}
+
 	/* Cleanup. */
 	knot_pkt_free(&query);
 	knot_pkt_free(&ans);
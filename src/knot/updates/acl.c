@@ -26,6 +26,7 @@
 #include "knot/updates/acl.h"
 #include "knot/conf/conf.h"
 #include "libknot/internal/endian.h"
+#include "libknot/internal/macros.h"
 #include "libknot/rrtype/tsig.h"
 
 static inline uint32_t ipv4_chunk(const struct sockaddr_in *ipv4)
@@ -120,6 +121,16 @@ int netblock_match(struct conf_iface *a1, const struct sockaddr_storage *a2)
 	return ret;
 }
 
+/*! \brief Check rule for the TSIG key, NOKEY rules match unsigned queries only. */
+static bool acl_key_match(const conf_iface_t *rule, const knot_dname_t *key_name)
+{
+	if (rule->key == NULL) {
+		return key_name == NULL;
+	}
+
+	return key_name != NULL && knot_dname_is_equal(rule->key->name, key_name);
+}
+
 struct conf_iface* acl_find(list_t *acl, const struct sockaddr_storage *addr,
                               const knot_dname_t *key_name)
 {
@@ -130,24 +141,225 @@ struct conf_iface* acl_find(list_t *acl, const struct sockaddr_storage *addr,
 	conf_remote_t *remote = NULL;
 	WALK_LIST(remote, *acl) {
 		conf_iface_t *cur = remote->remote;
-		if (netblock_match(cur, addr) == 0) {
-			/* NOKEY entry. */
-			if (cur->key == NULL) {
-				if (key_name == NULL) {
-					return cur;
-				}
-				/* NOKEY entry, but key provided. */
-				continue;
-			}
+		if (netblock_match(cur, addr) == 0 && acl_key_match(cur, key_name)) {
+			return cur;
+		}
+	}
+
+	return NULL;
+}
+
+/*! \brief Patricia tree node, the prefix is shared by all the subtree. */
+struct acl_node {
+	uint8_t addr[16];           /*!< Prefix, bits after the length are zero. */
+	uint8_t prefix;             /*!< Prefix length in bits. */
+	struct acl_node *child[2];  /*!< Subtrees by the first bit after prefix. */
+	conf_iface_t **rules;       /*!< Rules with exactly this prefix. */
+	size_t rule_count;
+};
+
+struct acl_tree {
+	struct acl_node *root[2];   /*!< IPv4 and IPv6 tree. */
+	int refs;
+};
+
+/*! \brief Raw address bytes and the address length in bits. */
+static const uint8_t *acl_addr_bytes(const struct sockaddr_storage *ss, unsigned *bits)
+{
+	if (ss->ss_family == AF_INET6) {
+		*bits = IPV6_PREFIXLEN;
+		return (const uint8_t *)&((const struct sockaddr_in6 *)ss)->sin6_addr;
+	} else if (ss->ss_family == AF_INET) {
+		*bits = IPV4_PREFIXLEN;
+		return (const uint8_t *)&((const struct sockaddr_in *)ss)->sin_addr;
+	}
+
+	return NULL;
+}
+
+static int acl_bit(const uint8_t *addr, unsigned pos)
+{
+	return (addr[pos / 8] >> (7 - pos % 8)) & 1;
+}
+
+/*! \brief Length of the common prefix, at most 'bits'. */
+static unsigned acl_common_prefix(const uint8_t *a, const uint8_t *b, unsigned bits)
+{
+	unsigned pos = 0;
+	while (pos + 8 <= bits && a[pos / 8] == b[pos / 8]) {
+		pos += 8;
+	}
+	while (pos < bits && acl_bit(a, pos) == acl_bit(b, pos)) {
+		pos += 1;
+	}
+
+	return pos;
+}
+
+static struct acl_node *acl_node_new(const uint8_t *addr, unsigned prefix)
+{
+	struct acl_node *node = malloc(sizeof(struct acl_node));
+	if (node == NULL) {
+		return NULL;
+	}
+
+	memset(node, 0, sizeof(struct acl_node));
+	node->prefix = prefix;
+	memcpy(node->addr, addr, (prefix + 7) / 8);
+	if (prefix % 8 != 0) {
+		node->addr[prefix / 8] &= 0xff << (8 - prefix % 8);
+	}
+
+	return node;
+}
+
+static int acl_node_add_rule(struct acl_node *node, conf_iface_t *rule)
+{
+	conf_iface_t **rules = realloc(node->rules, (node->rule_count + 1) * sizeof(*rules));
+	if (rules == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	rules[node->rule_count++] = rule;
+	node->rules = rules;
+	return KNOT_EOK;
+}
+
+static void acl_node_free(struct acl_node *node)
+{
+	if (node == NULL) {
+		return;
+	}
+
+	acl_node_free(node->child[0]);
+	acl_node_free(node->child[1]);
+	free(node->rules);
+	free(node);
+}
+
+static int acl_tree_insert(struct acl_node **cur, conf_iface_t *rule)
+{
+	unsigned bits = 0;
+	const uint8_t *addr = acl_addr_bytes(&rule->addr, &bits);
+	unsigned prefix = MIN(rule->prefix, bits);
+
+	while (*cur != NULL) {
+		struct acl_node *node = *cur;
+		unsigned common = acl_common_prefix(node->addr, addr, MIN(node->prefix, prefix));
 
-			/* NOKEY provided, but key required. */
-			if (key_name == NULL) {
-				continue;
+		/* Split the node on the first different bit. */
+		if (common < node->prefix) {
+			struct acl_node *split = acl_node_new(addr, common);
+			if (split == NULL) {
+				return KNOT_ENOMEM;
+			}
+			split->child[acl_bit(node->addr, common)] = node;
+			*cur = split;
+			if (common == prefix) {
+				return acl_node_add_rule(split, rule);
 			}
+			cur = &split->child[acl_bit(addr, common)];
+			break;
+		}
+
+		if (node->prefix == prefix) {
+			return acl_node_add_rule(node, rule);
+		}
+
+		cur = &node->child[acl_bit(addr, node->prefix)];
+	}
+
+	*cur = acl_node_new(addr, prefix);
+	if (*cur == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	return acl_node_add_rule(*cur, rule);
+}
+
+acl_tree_t *acl_tree_build(list_t *acl)
+{
+	if (acl == NULL || EMPTY_LIST(*acl)) {
+		return NULL;
+	}
+
+	acl_tree_t *tree = malloc(sizeof(acl_tree_t));
+	if (tree == NULL) {
+		return NULL;
+	}
+	memset(tree, 0, sizeof(acl_tree_t));
+	tree->refs = 1;
+
+	conf_remote_t *remote = NULL;
+	WALK_LIST(remote, *acl) {
+		conf_iface_t *rule = remote->remote;
+		if (rule->addr.ss_family != AF_INET && rule->addr.ss_family != AF_INET6) {
+			continue;
+		}
+		int family = (rule->addr.ss_family == AF_INET6) ? 1 : 0;
+		if (acl_tree_insert(&tree->root[family], rule) != KNOT_EOK) {
+			acl_tree_free(tree);
+			return NULL;
+		}
+	}
+
+	return tree;
+}
+
+acl_tree_t *acl_tree_ref(acl_tree_t *tree)
+{
+	if (tree != NULL) {
+		__sync_add_and_fetch(&tree->refs, 1);
+	}
+
+	return tree;
+}
+
+void acl_tree_free(acl_tree_t *tree)
+{
+	if (tree == NULL || __sync_sub_and_fetch(&tree->refs, 1) > 0) {
+		return;
+	}
+
+	acl_node_free(tree->root[0]);
+	acl_node_free(tree->root[1]);
+	free(tree);
+}
+
+struct conf_iface* acl_tree_find(const acl_tree_t *tree,
+                                   const struct sockaddr_storage *addr,
+                                   const knot_dname_t *key_name)
+{
+	if (tree == NULL || addr == NULL) {
+		return NULL;
+	}
+
+	unsigned bits = 0;
+	const uint8_t *bytes = acl_addr_bytes(addr, &bits);
+	if (bytes == NULL) {
+		return NULL;
+	}
+
+	/* Collect nodes with rules on the path, the longest prefix last. */
+	const struct acl_node *path[IPV6_PREFIXLEN + 1];
+	int depth = 0;
+	const struct acl_node *node = tree->root[addr->ss_family == AF_INET6 ? 1 : 0];
+	while (node != NULL &&
+	       acl_common_prefix(node->addr, bytes, node->prefix) == node->prefix) {
+		if (node->rule_count > 0) {
+			path[depth++] = node;
+		}
+		if (node->prefix == bits) {
+			break;
+		}
+		node = node->child[acl_bit(bytes, node->prefix)];
+	}
 
-			/* Key name match. */
-			if (knot_dname_is_equal(cur->key->name, key_name)) {
-				return cur;
+	while (depth-- > 0) {
+		node = path[depth];
+		for (size_t i = 0; i < node->rule_count; ++i) {
+			if (acl_key_match(node->rules[i], key_name)) {
+				return node->rules[i];
 			}
 		}
 	}
@@ -23,6 +23,10 @@
  * Simple access control list is implemented as a linked list, sorted by
  * prefix length. This way, longest prefix match is always found first.
  *
+ * For the per-query checks, the list is compiled into a Patricia tree
+ * for each address family, so that the lookup cost depends on the
+ * address length rather than on the number of rules.
+ *
  * \addtogroup common_lib
  * @{
  */
@@ -52,4 +56,39 @@ int netblock_match(struct conf_iface *a1, const struct sockaddr_storage *a2);
 struct conf_iface* acl_find(list_t *acl, const struct sockaddr_storage *addr,
                               const knot_dname_t *key_name);
 
+/*! \brief Compiled ACL, may be shared by more zones. */
+typedef struct acl_tree acl_tree_t;
+
+/*!
+ * \brief Compile ACL into a longest prefix match tree.
+ *
+ * \param acl List of conf_remote_t.
+ *
+ * \return Compiled ACL with a single reference, NULL if empty or on error.
+ */
+acl_tree_t *acl_tree_build(list_t *acl);
+
+/*! \brief Add reference to the compiled ACL. */
+acl_tree_t *acl_tree_ref(acl_tree_t *tree);
+
+/*! \brief Release reference to the compiled ACL, free with the last one. */
+void acl_tree_free(acl_tree_t *tree);
+
+/*!
+ * \brief Match address against compiled ACL.
+ *
+ * Rules with the longest matching prefix are checked first, rules with the
+ * same prefix in the order of the source list.
+ *
+ * \param tree Compiled ACL (may be NULL for an empty ACL).
+ * \param addr IP address.
+ * \param key_name TSIG key name (optional)
+ *
+ * \retval Matching rule instance if found.
+ * \retval NULL if it didn't find a match.
+ */
+struct conf_iface* acl_tree_find(const acl_tree_t *tree,
+                                   const struct sockaddr_storage *addr,
+                                   const knot_dname_t *key_name);
+
 /*! @} */
@@ -35,7 +35,7 @@
 #include "knot/updates/changesets.h"
 
 /*!
- * \brief Applies changesets *with* zone shallow copy.
+ * \brief Applies changesets to a copy of the zone contents.
  *
  * \param zone          Zone to be updated.
  * \param chsets        Changes to be made.
@@ -47,7 +47,7 @@ int apply_changesets(zone_t *zone, list_t *chsets,
                      zone_contents_t **new_contents);
 
 /*!
- * \brief Applies changeset *with* zone shallow copy.
+ * \brief Applies changeset to a copy of the zone contents.
  *
  * \param zone          Zone to be updated.
  * \param ch            Change to be made.
@@ -79,36 +79,8 @@ int apply_changesets_directly(zone_contents_t *contents, list_t *chsets);
 int apply_changeset_directly(zone_contents_t *contents, changeset_t *ch);
 
 /*!
- * \brief Cleanups successful zone updates.
- 
- * \param chgs  Changesets used to create the update.
- */
-void updates_cleanup(list_t *chgs);
-
-/*!
- * \brief Cleanups successful zone update.
- 
- * \param chgs  Changeset used to create the update.
- */
-void update_cleanup(changeset_t *change);
-
-/*!
- * \brief Rollbacks failed zone updates.
- *
- * \param chgs   Changesets used to create the update.
- */
-void updates_rollback(list_t *chgs);
-
-/*!
- * \brief Rollbacks failed zone update.
- *
- * \param chgs   Changeset. used to create the update.
- */
-void update_rollback(changeset_t *change);
-
-/*!
- * \brief Shallow frees zone contents - either shallow copy after failed update
- *        or original zone contents after successful update.
+ * \brief Frees zone contents - either the copy after failed update or original
+ *        zone contents after successful update.
  *
  * \param contents  Contents to free.
  */
@@ -141,10 +141,6 @@ int changeset_init(changeset_t *ch, const knot_dname_t *apex)
 		return KNOT_ENOMEM;
 	}
 
-	// Init change lists
-	init_list(&ch->new_data);
-	init_list(&ch->old_data);
-
 	return KNOT_EOK;
 }
 
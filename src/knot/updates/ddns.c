@@ -270,7 +270,7 @@ static void remove_rr_from_changeset(zone_contents_t *z, const knot_rrset_t *rr)
 		return;
 	}
 
-	knot_rdataset_subtract(rrs, &rr->rrs, NULL);
+	knot_rdataset_subtract(rrs, &rr->rrs, &z->mm);
 	if (rrs->rr_count == 0) {
 		node_remove_rdataset(n, rr->type);
 	}
@@ -286,7 +286,7 @@ static void remove_header_from_changeset(zone_contents_t *z, const knot_rrset_t
 
 	knot_rdataset_t *rrs = node_rdataset(n, rr->type);
 	if (rrs) {
-		knot_rdataset_clear(rrs, NULL);
+		knot_rdataset_clear(rrs, &z->mm);
 		node_remove_rdataset(n, rr->type);
 	}
 }
@@ -295,7 +295,7 @@ static void remove_header_from_changeset(zone_contents_t *z, const knot_rrset_t
 static void remove_owner_from_changeset(zone_contents_t *z, const knot_dname_t *owner)
 {
 	zone_node_t *n = (zone_node_t *)zone_contents_find_node(z, owner);
-	node_free_rrsets(n, NULL);
+	node_free_rrsets(n, &z->mm);
 }
 
 /* --------------------- true/false helper functions ------------------------ */
@@ -447,9 +447,9 @@ static bool singleton_replaced(changeset_t *changeset,
 	}
 
 	// Replace singleton RR.
-	knot_rdataset_clear(rrs, NULL);
+	knot_rdataset_clear(rrs, &changeset->add->mm);
 	node_remove_rdataset(n, rr->type);
-	node_add_rrset(n, rr, NULL);
+	node_add_rrset(n, rr, &changeset->add->mm);
 
 	return true;
 }
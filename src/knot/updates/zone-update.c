@@ -77,42 +77,6 @@ static int apply_changes_to_node(zone_node_t *synth_node, const zone_node_t *add
 	return KNOT_EOK;
 }
 
-static int deep_copy_node_data(zone_node_t *node_copy, const zone_node_t *node,
-                               mm_ctx_t *mm)
-{
-	// Clear space for RRs
-	node_copy->rrs = NULL;
-	node_copy->rrset_count = 0;
-	
-	for (uint16_t i = 0; i < node->rrset_count; ++i) {
-		knot_rrset_t rr = node_rrset_at(node, i);
-		int ret = node_add_rrset(node_copy, &rr, mm);
-		if (ret != KNOT_EOK) {
-			return ret;
-		}
-	}
-
-	return KNOT_EOK;
-}
-
-static zone_node_t *node_deep_copy(const zone_node_t *node, mm_ctx_t *mm)
-{
-	// Shallow copy old node
-	zone_node_t *synth_node = node_shallow_copy(node, mm);
-	if (synth_node == NULL) {
-		return NULL;
-	}
-
-	// Deep copy data inside node copy.
-	int ret = deep_copy_node_data(synth_node, node, mm);
-	if (ret != KNOT_EOK) {
-		node_free(&synth_node, mm);
-		return NULL;
-	}
-
-	return synth_node;
-}
-
 /* ------------------------------- API -------------------------------------- */
 
 void zone_update_init(zone_update_t *update, const zone_contents_t *zone, changeset_t *change)
@@ -153,7 +117,7 @@ const zone_node_t *zone_update_get_node(zone_update_t *update, const knot_dname_
 	}
 
 	// We have to apply changes to node.
-	zone_node_t *synth_node = node_deep_copy(old_node, &update->mm);
+	zone_node_t *synth_node = node_copy(old_node, &update->mm);
 	if (synth_node == NULL) {
 		return NULL;
 	}
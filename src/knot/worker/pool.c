@@ -19,32 +19,174 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "libknot/errcode.h"
 #include "knot/server/dthreads.h"
 #include "knot/worker/pool.h"
 #include "libknot/dnssec/crypto.h"
 
+/*!
+ * \brief Task queues owned by one worker thread.
+ */
+struct worker {
+	pthread_mutex_t lock;
+	worker_queue_t tasks[TASK_PRIO_COUNT];
+};
+
 /*!
  * \brief Worker pool state.
+ *
+ * Tasks are distributed round-robin into per-thread queues, each protected
+ * by its own lock. The pool lock is only used to put idle threads to sleep
+ * and to wake them up. Counters are updated atomically.
  */
 struct worker_pool {
 	dt_unit_t *threads;
+	struct worker *workers;
+	unsigned count;		/*!< Number of worker threads. */
+	unsigned next;		/*!< Next queue for task assignment. */
 
 	pthread_mutex_t lock;
-	pthread_cond_t wake;
+	pthread_cond_t wake;	/*!< Signalled when a task can be taken. */
+	pthread_cond_t done;	/*!< Signalled when the pool becomes idle. */
 
-	bool terminating;	/*!< Is the pool terminating? .*/
-	bool suspended;		/*!< Is execution temporarily suspended? .*/
+	int terminating;	/*!< Is the pool terminating? .*/
+	int suspended;		/*!< Is execution temporarily suspended? .*/
 	int running;		/*!< Number of running threads. */
-	worker_queue_t tasks;
+	int idle;		/*!< Number of sleeping threads. */
+	int running_bulk;	/*!< Number of threads running bulk tasks. */
+	int bulk_limit;		/*!< Maximum number of threads for bulk tasks. */
+	int pending[TASK_PRIO_COUNT]; /*!< Number of enqueued tasks. */
+
+	worker_stats_t stats[WORKER_TASK_TYPES];
 };
 
+/*! \brief Current monotonic time in milliseconds. */
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int atomic_get(int *value)
+{
+	return __sync_add_and_fetch(value, 0);
+}
+
+static worker_stats_t *task_stats(worker_pool_t *pool, const task_t *task)
+{
+	return &pool->stats[task->type % WORKER_TASK_TYPES];
+}
+
+/*!
+ * \brief Check if a sleeping worker could take a task.
+ */
+static bool work_available(worker_pool_t *pool)
+{
+	if (atomic_get(&pool->suspended)) {
+		return false;
+	}
+
+	return atomic_get(&pool->pending[TASK_PRIO_HIGH]) > 0 ||
+	       (atomic_get(&pool->pending[TASK_PRIO_BULK]) > 0 &&
+	        atomic_get(&pool->running_bulk) < pool->bulk_limit);
+}
+
+/*!
+ * \brief Wake up a sleeping worker if there is any.
+ */
+static void wake_worker(worker_pool_t *pool)
+{
+	if (atomic_get(&pool->idle) > 0) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->wake);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+/*!
+ * \brief Take a task of given priority from worker queues.
+ *
+ * The worker's own queue is checked first, then the tasks are stolen
+ * from the other workers.
+ */
+static task_t *take_prio(worker_pool_t *pool, unsigned self, task_prio_t prio)
+{
+	if (atomic_get(&pool->pending[prio]) == 0) {
+		return NULL;
+	}
+
+	for (unsigned i = 0; i < pool->count; ++i) {
+		struct worker *worker = &pool->workers[(self + i) % pool->count];
+		pthread_mutex_lock(&worker->lock);
+		task_t *task = worker_queue_dequeue(&worker->tasks[prio]);
+		pthread_mutex_unlock(&worker->lock);
+		if (task != NULL) {
+			__sync_sub_and_fetch(&pool->pending[prio], 1);
+			return task;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Take next task to be executed by the worker.
+ */
+static task_t *take(worker_pool_t *pool, unsigned self)
+{
+	task_t *task = take_prio(pool, self, TASK_PRIO_HIGH);
+	if (task != NULL) {
+		return task;
+	}
+
+	/* Keep a thread for latency-sensitive tasks. */
+	if (__sync_add_and_fetch(&pool->running_bulk, 1) <= pool->bulk_limit) {
+		task = take_prio(pool, self, TASK_PRIO_BULK);
+		if (task != NULL) {
+			return task;
+		}
+	}
+	__sync_sub_and_fetch(&pool->running_bulk, 1);
+
+	return NULL;
+}
+
+/*!
+ * \brief Run the task and update statistics.
+ */
+static void run(worker_pool_t *pool, task_t *task)
+{
+	assert(task->run);
+
+	worker_stats_t *stats = task_stats(pool, task);
+	uint64_t wait = now_ms() - task->queued_at;
+	__sync_sub_and_fetch(&stats->queued, 1);
+	__sync_add_and_fetch(&stats->executed, 1);
+	__sync_add_and_fetch(&stats->wait_total, wait);
+	uint64_t wait_max = __sync_add_and_fetch(&stats->wait_max, 0);
+	while (wait > wait_max) {
+		wait_max = __sync_val_compare_and_swap(&stats->wait_max, wait_max, wait);
+	}
+
+	/* The task may be reassigned when it's running. */
+	task_prio_t prio = task->prio;
+	task->run(task);
+
+	if (prio == TASK_PRIO_BULK) {
+		__sync_sub_and_fetch(&pool->running_bulk, 1);
+		wake_worker(pool);
+	}
+}
+
 /*!
  * \brief Worker thread.
  *
- * The thread takes a task from the tasks queue and runs it, while checking
- * if the dispatching of new tasks is allowed by the thread pool.
+ * The thread takes a task from its own queues or steals one from the other
+ * workers and runs it, while checking if the dispatching of new tasks is
+ * allowed by the thread pool.
  *
  * An execution of a running thread cannot be enforced.
  *
@@ -54,37 +196,47 @@ static int worker_main(dthread_t *thread)
 	assert(thread);
 
 	worker_pool_t *pool = thread->data;
-
-	pthread_mutex_lock(&pool->lock);
+	unsigned self = dt_get_id(thread);
 
 	for (;;) {
-		if (pool->terminating) {
+		if (atomic_get(&pool->terminating)) {
 			break;
 		}
 
+		/* Count as running before the task is taken from the queue. */
+		__sync_add_and_fetch(&pool->running, 1);
+
 		task_t *task = NULL;
-		if (!pool->suspended) {
-			task = worker_queue_dequeue(&pool->tasks);
+		if (!atomic_get(&pool->suspended)) {
+			task = take(pool, self);
 		}
 
-		if (task == NULL) {
-			pthread_cond_wait(&pool->wake, &pool->lock);
-			continue;
+		if (task != NULL) {
+			run(pool, task);
+		}
+
+		if (__sync_sub_and_fetch(&pool->running, 1) == 0 &&
+		    atomic_get(&pool->pending[TASK_PRIO_HIGH]) == 0 &&
+		    atomic_get(&pool->pending[TASK_PRIO_BULK]) == 0) {
+			pthread_mutex_lock(&pool->lock);
+			pthread_cond_broadcast(&pool->done);
+			pthread_mutex_unlock(&pool->lock);
 		}
 
-		assert(task->run);
-		pool->running += 1;
+		if (task != NULL) {
+			continue;
+		}
 
-		pthread_mutex_unlock(&pool->lock);
-		task->run(task);
+		/* Nothing to do, sleep until woken up. */
 		pthread_mutex_lock(&pool->lock);
-
-		pool->running -= 1;
-		pthread_cond_broadcast(&pool->wake);
+		__sync_add_and_fetch(&pool->idle, 1);
+		if (!atomic_get(&pool->terminating) && !work_available(pool)) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		__sync_sub_and_fetch(&pool->idle, 1);
+		pthread_mutex_unlock(&pool->lock);
 	}
 
-	pthread_mutex_unlock(&pool->lock);
-
 	return KNOT_EOK;
 }
 
@@ -95,16 +247,55 @@ static int worker_cleanup(dthread_t *thread)
 	return KNOT_EOK;
 }
 
+/*!
+ * \brief Remove all enqueued tasks.
+ */
+static void clear_tasks(worker_pool_t *pool)
+{
+	for (unsigned i = 0; i < pool->count; ++i) {
+		struct worker *worker = &pool->workers[i];
+		pthread_mutex_lock(&worker->lock);
+		for (int prio = 0; prio < TASK_PRIO_COUNT; ++prio) {
+			task_t *task = NULL;
+			while ((task = worker_queue_dequeue(&worker->tasks[prio]))) {
+				__sync_sub_and_fetch(&pool->pending[prio], 1);
+				__sync_sub_and_fetch(&task_stats(pool, task)->queued, 1);
+			}
+		}
+		pthread_mutex_unlock(&worker->lock);
+	}
+}
+
 /* -- public API ------------------------------------------------------------ */
 
 worker_pool_t *worker_pool_create(unsigned threads)
 {
+	if (threads == 0) {
+		return NULL;
+	}
+
 	worker_pool_t *pool = malloc(sizeof(worker_pool_t));
 	if (pool == NULL) {
 		return NULL;
 	}
 
 	memset(pool, 0, sizeof(worker_pool_t));
+	pool->count = threads;
+	pool->bulk_limit = threads > 1 ? threads - 1 : 1;
+
+	pool->workers = calloc(threads, sizeof(struct worker));
+	if (pool->workers == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	for (unsigned i = 0; i < threads; ++i) {
+		pthread_mutex_init(&pool->workers[i].lock, NULL);
+		for (int prio = 0; prio < TASK_PRIO_COUNT; ++prio) {
+			worker_queue_init(&pool->workers[i].tasks[prio]);
+		}
+	}
+
 	pool->threads = dt_create(threads, worker_main, worker_cleanup, pool);
 	if (pool->threads == NULL) {
 		goto fail;
@@ -118,12 +309,15 @@ worker_pool_t *worker_pool_create(unsigned threads)
 		goto fail;
 	}
 
-	worker_queue_init(&pool->tasks);
+	if (pthread_cond_init(&pool->done, NULL) != 0) {
+		goto fail;
+	}
 
 	return pool;
 
 fail:
 	dt_delete(&pool->threads);
+	free(pool->workers);
 	free(pool);
 	return NULL;
 }
@@ -138,8 +332,12 @@ void worker_pool_destroy(worker_pool_t *pool)
 
 	pthread_mutex_destroy(&pool->lock);
 	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->done);
 
-	worker_queue_deinit(&pool->tasks);
+	for (unsigned i = 0; i < pool->count; ++i) {
+		pthread_mutex_destroy(&pool->workers[i].lock);
+	}
+	free(pool->workers);
 
 	free(pool);
 }
@@ -160,7 +358,7 @@ void worker_pool_stop(worker_pool_t *pool)
 	}
 
 	pthread_mutex_lock(&pool->lock);
-	pool->terminating = true;
+	__sync_lock_test_and_set(&pool->terminating, 1);
 	pthread_cond_broadcast(&pool->wake);
 	pthread_mutex_unlock(&pool->lock);
 
@@ -174,7 +372,7 @@ void worker_pool_suspend(worker_pool_t *pool)
 	}
 
 	pthread_mutex_lock(&pool->lock);
-	pool->suspended = true;
+	__sync_lock_test_and_set(&pool->suspended, 1);
 	pthread_mutex_unlock(&pool->lock);
 }
 
@@ -185,7 +383,7 @@ void worker_pool_resume(worker_pool_t *pool)
 	}
 
 	pthread_mutex_lock(&pool->lock);
-	pool->suspended = false;
+	__sync_lock_test_and_set(&pool->suspended, 0);
 	pthread_cond_broadcast(&pool->wake);
 	pthread_mutex_unlock(&pool->lock);
 }
@@ -206,8 +404,10 @@ void worker_pool_wait(worker_pool_t *pool)
 	}
 
 	pthread_mutex_lock(&pool->lock);
-	while (!EMPTY_LIST(pool->tasks.list) || pool->running > 0) {
-		pthread_cond_wait(&pool->wake, &pool->lock);
+	while (atomic_get(&pool->pending[TASK_PRIO_HIGH]) > 0 ||
+	       atomic_get(&pool->pending[TASK_PRIO_BULK]) > 0 ||
+	       atomic_get(&pool->running) > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
 	}
 	pthread_mutex_unlock(&pool->lock);
 }
@@ -218,10 +418,20 @@ void worker_pool_assign(worker_pool_t *pool, struct task *task)
 		return;
 	}
 
-	pthread_mutex_lock(&pool->lock);
-	worker_queue_enqueue(&pool->tasks, task);
-	pthread_cond_signal(&pool->wake);
-	pthread_mutex_unlock(&pool->lock);
+	if (task->prio >= TASK_PRIO_COUNT) {
+		task->prio = TASK_PRIO_BULK;
+	}
+	task->queued_at = now_ms();
+	__sync_add_and_fetch(&task_stats(pool, task)->queued, 1);
+
+	unsigned next = __sync_fetch_and_add(&pool->next, 1) % pool->count;
+	struct worker *worker = &pool->workers[next];
+	pthread_mutex_lock(&worker->lock);
+	worker_queue_enqueue(&worker->tasks[task->prio], task);
+	__sync_add_and_fetch(&pool->pending[task->prio], 1);
+	pthread_mutex_unlock(&worker->lock);
+
+	wake_worker(pool);
 }
 
 void worker_pool_clear(worker_pool_t *pool)
@@ -230,8 +440,22 @@ void worker_pool_clear(worker_pool_t *pool)
 		return;
 	}
 
+	clear_tasks(pool);
+
 	pthread_mutex_lock(&pool->lock);
-	worker_queue_deinit(&pool->tasks);
-	worker_queue_init(&pool->tasks);
+	pthread_cond_broadcast(&pool->done);
 	pthread_mutex_unlock(&pool->lock);
 }
+
+void worker_pool_stats(worker_pool_t *pool, unsigned type, worker_stats_t *stats)
+{
+	if (!pool || !stats || type >= WORKER_TASK_TYPES) {
+		return;
+	}
+
+	worker_stats_t *cur = &pool->stats[type];
+	stats->queued = __sync_add_and_fetch(&cur->queued, 0);
+	stats->executed = __sync_add_and_fetch(&cur->executed, 0);
+	stats->wait_total = __sync_add_and_fetch(&cur->wait_total, 0);
+	stats->wait_max = __sync_add_and_fetch(&cur->wait_max, 0);
+}
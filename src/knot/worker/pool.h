@@ -16,14 +16,33 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include "knot/worker/queue.h"
 
+/*! \brief Number of task types with separate statistics. */
+#define WORKER_TASK_TYPES 16
+
 struct worker_pool;
 typedef struct worker_pool worker_pool_t;
 
+/*!
+ * \brief Statistics of one task type.
+ */
+typedef struct worker_stats {
+	uint64_t queued;     /*!< Number of currently enqueued tasks. */
+	uint64_t executed;   /*!< Number of executed tasks. */
+	uint64_t wait_total; /*!< Total time spent in queue (milliseconds). */
+	uint64_t wait_max;   /*!< Maximum time spent in queue (milliseconds). */
+} worker_stats_t;
+
 /*!
  * \brief Initialize worker pool.
  *
+ * Each thread has its own task queues and idle threads steal tasks from
+ * queues of the others. Tasks of TASK_PRIO_HIGH class are always preferred
+ * and bulk tasks never occupy all threads, unless the pool has only one.
+ *
  * \param threads  Number of threads to be created.
  *
  * \return Thread pool or NULL in case of error.
@@ -68,6 +87,8 @@ void worker_pool_wait(worker_pool_t *pool);
 
 /*!
  * \brief Assign a task to be performed by a worker in the pool.
+ *
+ * \note The task must not be assigned again before it starts.
  */
 void worker_pool_assign(worker_pool_t *pool, struct task *task);
 
@@ -75,3 +96,12 @@ void worker_pool_assign(worker_pool_t *pool, struct task *task);
  * \brief Clear all tasks enqueued in pool processing queue.
  */
 void worker_pool_clear(worker_pool_t *pool);
+
+/*!
+ * \brief Get statistics of given task type.
+ *
+ * \param pool   Worker pool.
+ * \param type   Task type (lower than WORKER_TASK_TYPES).
+ * \param stats  Output statistics.
+ */
+void worker_pool_stats(worker_pool_t *pool, unsigned type, worker_stats_t *stats);
@@ -14,6 +14,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+
 #include "knot/worker/queue.h"
 
 void worker_queue_init(worker_queue_t *queue)
@@ -25,12 +27,16 @@ void worker_queue_init(worker_queue_t *queue)
 	memset(queue, 0, sizeof(worker_queue_t));
 
 	init_list(&queue->list);
-	mm_ctx_init(&queue->mm_ctx);
 }
 
 void worker_queue_deinit(worker_queue_t *queue)
 {
-	ptrlist_free(&queue->list, &queue->mm_ctx);
+	if (!queue) {
+		return;
+	}
+
+	/* Tasks are owned by the caller, just unlink them. */
+	init_list(&queue->list);
 }
 
 void worker_queue_enqueue(worker_queue_t *queue, task_t *task)
@@ -39,7 +45,7 @@ void worker_queue_enqueue(worker_queue_t *queue, task_t *task)
 		return;
 	}
 
-	ptrlist_add(&queue->list, task, &queue->mm_ctx);
+	add_tail(&queue->list, &task->n);
 }
 
 task_t *worker_queue_dequeue(worker_queue_t *queue)
@@ -51,10 +57,8 @@ task_t *worker_queue_dequeue(worker_queue_t *queue)
 	task_t *task = NULL;
 
 	if (!EMPTY_LIST(queue->list)) {
-		ptrnode_t *node = HEAD(queue->list);
-		task = (void *)node->d;
-		rem_node(&node->n);
-		queue->mm_ctx.free(&node->n);
+		task = HEAD(queue->list);
+		rem_node(&task->n);
 	}
 
 	return task;
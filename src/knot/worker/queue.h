@@ -16,24 +16,41 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include "libknot/internal/lists.h"
 
 struct task;
 typedef void (*task_cb)(struct task *);
 
+/*!
+ * \brief Task priority class.
+ */
+typedef enum task_prio {
+	TASK_PRIO_HIGH = 0, /*!< Short, latency-sensitive task. */
+	TASK_PRIO_BULK,     /*!< Long-running task. */
+	TASK_PRIO_COUNT
+} task_prio_t;
+
 /*!
  * \brief Task executable by a worker.
+ *
+ * \note The task is linked into the queue directly, so it can be enqueued
+ *       only once at a time.
  */
 typedef struct task {
-	void *ctx;
-	task_cb run;
+	node_t n;            /*!< Queue node. */
+	void *ctx;           /*!< Task context. */
+	task_cb run;         /*!< Task callback. */
+	task_prio_t prio;    /*!< Priority class. */
+	unsigned type;       /*!< Task type for statistics. */
+	uint64_t queued_at;  /*!< Enqueue time (monotonic, milliseconds). */
 } task_t;
 
 /*!
  * \brief Worker queue.
  */
 typedef struct worker_queue {
-	mm_ctx_t mm_ctx;
 	list_t list;
 } worker_queue_t;
 
@@ -17,8 +17,10 @@
 #include <assert.h>
 
 #include "knot/zone/contents.h"
+#include "knot/nameserver/axfr.h"
 #include "knot/common/debug.h"
 #include "libknot/internal/macros.h"
+#include "libknot/internal/mempool.h"
 #include "libknot/rrset.h"
 #include "libknot/internal/base32hex.h"
 #include "libknot/descriptor.h"
@@ -37,6 +39,27 @@
 /* Non-API functions                                                          */
 /*----------------------------------------------------------------------------*/
 
+/*! \brief Size of zone contents arena chunk. */
+#define ZONE_ARENA_CHUNK (64 * 1024)
+/*! \brief Size of RR data arena chunk of the updated zone versions. */
+#define ZONE_DATA_CHUNK (16 * 1024)
+/*! \brief Maximum number of RR data arenas shared by a zone version. */
+#define ZONE_DATA_DEPTH 16
+
+/*!
+ * \brief Arena for the RR data, shared by the zone versions.
+ *
+ * Updated version allocates new RR data from its own arena and keeps the
+ * arena of the version it was copied from, whose RR data it shares.
+ */
+struct zone_data {
+	mm_ctx_t mm;
+	struct zone_data *parent;  /*!< Arena with the shared RR data. */
+	unsigned refs;
+	unsigned depth;            /*!< Number of arenas in the chain. */
+	size_t replaced;           /*!< RR data replaced in this version [B]. */
+};
+
 typedef struct {
 	zone_contents_apply_cb_t func;
 	void *data;
@@ -99,16 +122,16 @@ static int zone_contents_check_node(
  * This function is designed to be used in the tree-iterating functions.
  *
  * \param node Node to destroy RRSets from.
- * \param data Unused parameter.
+ * \param data Memory context of the zone.
  */
 static int zone_contents_destroy_node_rrsets_from_tree(
 	zone_node_t **tnode, void *data)
 {
-	UNUSED(data);
 	assert(tnode != NULL);
 	if (*tnode != NULL) {
-		node_free_rrsets(*tnode, NULL);
-		node_free(tnode, NULL);
+		mm_ctx_t *mm = data;
+		node_free_rrsets(*tnode, mm);
+		node_free(tnode, mm);
 	}
 
 	return KNOT_EOK;
@@ -150,9 +173,9 @@ static int discover_additionals(struct rr_data *rr_data,
 	/* Create new additional nodes. */
 	uint16_t rdcount = rrs->rr_count;
 	if (rr_data->additional) {
-		free(rr_data->additional);
+		mm_free(&zone->mm, rr_data->additional);
 	}
-	rr_data->additional = malloc(rdcount * sizeof(zone_node_t *));
+	rr_data->additional = mm_alloc(&zone->mm, rdcount * sizeof(zone_node_t *));
 	if (rr_data->additional == NULL) {
 		return KNOT_ENOMEM;
 	}
@@ -398,7 +421,105 @@ static int knot_zc_nsec3_parameters_match(const knot_rdataset_t *rrs,
 /* API functions                                                              */
 /*----------------------------------------------------------------------------*/
 
-zone_contents_t *zone_contents_new(const knot_dname_t *apex_name)
+/*! \brief Creates RR data arena sharing the RR data of the parent. */
+static struct zone_data *zone_data_new(size_t chunk_size, struct zone_data *parent)
+{
+	struct zone_data *data = malloc(sizeof(struct zone_data));
+	if (data == NULL) {
+		return NULL;
+	}
+
+	mm_ctx_mempool(&data->mm, chunk_size);
+	if (data->mm.ctx == NULL) {
+		free(data);
+		return NULL;
+	}
+
+	data->parent = parent;
+	data->refs = 1;
+	data->depth = 1;
+	data->replaced = 0;
+	if (parent != NULL) {
+		__sync_add_and_fetch(&parent->refs, 1);
+		data->depth = parent->depth + 1;
+	}
+
+	return data;
+}
+
+/*! \brief Releases the RR data arena and the arenas it shares. */
+static void zone_data_release(struct zone_data *data)
+{
+	while (data != NULL && __sync_sub_and_fetch(&data->refs, 1) == 0) {
+		struct zone_data *parent = data->parent;
+		mp_delete(data->mm.ctx);
+		free(data);
+		data = parent;
+	}
+}
+
+/*! \brief Checks if the RR data can be shared with a new version. */
+static bool zone_data_shareable(const struct zone_data *data)
+{
+	if (data == NULL || data->depth >= ZONE_DATA_DEPTH) {
+		return false;
+	}
+
+	/* Make a full copy if most of the arenas is replaced RR data. */
+	uint64_t total = 0;
+	uint64_t replaced = 0;
+	for (const struct zone_data *it = data; it != NULL; it = it->parent) {
+		total += mp_total_size(it->mm.ctx);
+		replaced += it->replaced;
+	}
+
+	return replaced <= total / 2;
+}
+
+/*!
+ * \brief Initializes memory contexts of the contents, optionally arenas.
+ *
+ * \param contents  Zone contents.
+ * \param arena     Use arenas instead of the system allocator.
+ * \param share     RR data arena to share, NULL for a new one.
+ */
+static int contents_init_mm(zone_contents_t *contents, bool arena,
+                            struct zone_data *share)
+{
+	if (!arena) {
+		mm_ctx_init(&contents->mm);
+		return KNOT_EOK;
+	}
+
+	mm_ctx_mempool(&contents->mm, ZONE_ARENA_CHUNK);
+	if (contents->mm.ctx == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	size_t chunk_size = (share != NULL) ? ZONE_DATA_CHUNK : ZONE_ARENA_CHUNK;
+	contents->data = zone_data_new(chunk_size, share);
+	if (contents->data == NULL) {
+		mp_delete(contents->mm.ctx);
+		contents->mm.ctx = NULL;
+		return KNOT_ENOMEM;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Releases the contents arenas, if any. */
+static void contents_free_mm(zone_contents_t *contents)
+{
+	if (contents->mm.ctx != NULL) {
+		mp_delete(contents->mm.ctx);
+		contents->mm.ctx = NULL;
+	}
+
+	zone_data_release(contents->data);
+	contents->data = NULL;
+}
+
+static zone_contents_t *contents_new(const knot_dname_t *apex_name, bool arena)
 {
 	dbg_zone("%s(%p)\n", __func__, apex_name);
 	if (apex_name == NULL) {
@@ -411,7 +532,12 @@ zone_contents_t *zone_contents_new(const knot_dname_t *apex_name)
 	}
 
 	memset(contents, 0, sizeof(zone_contents_t));
-	contents->apex = node_new(apex_name, NULL);
+	if (contents_init_mm(contents, arena, NULL) != KNOT_EOK) {
+		free(contents);
+		return NULL;
+	}
+
+	contents->apex = node_new(apex_name, &contents->mm);
 	if (contents->apex == NULL) {
 		goto cleanup;
 	}
@@ -429,12 +555,53 @@ zone_contents_t *zone_contents_new(const knot_dname_t *apex_name)
 
 cleanup:
 	dbg_zone("%s: failure to initialize contents %p\n", __func__, contents);
-	free(contents->nodes);
-	free(contents->nsec3_nodes);
+	zone_tree_free(&contents->nodes);
+	node_free(&contents->apex, &contents->mm);
+	contents_free_mm(contents);
 	free(contents);
 	return NULL;
 }
 
+zone_contents_t *zone_contents_new(const knot_dname_t *apex_name)
+{
+	return contents_new(apex_name, false);
+}
+
+zone_contents_t *zone_contents_new_arena(const knot_dname_t *apex_name)
+{
+	return contents_new(apex_name, true);
+}
+
+mm_ctx_t *zone_contents_data_mm(zone_contents_t *contents)
+{
+	return (contents->data != NULL) ? &contents->data->mm : &contents->mm;
+}
+
+int zone_contents_unshare_rdataset(zone_contents_t *contents, zone_node_t *node,
+                                   uint16_t type)
+{
+	if (contents == NULL || node == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	/* Without the arena, the contents are never shared. */
+	knot_rdataset_t *rrs = node_rdataset(node, type);
+	if (rrs == NULL || contents->data == NULL) {
+		return KNOT_EOK;
+	}
+
+	knot_rdataset_t copy;
+	int ret = knot_rdataset_copy(&copy, rrs, &contents->data->mm);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	contents->data->replaced += knot_rdataset_size(rrs);
+	*rrs = copy;
+
+	return KNOT_EOK;
+}
+
 /*----------------------------------------------------------------------------*/
 
 static zone_node_t *zone_contents_get_node(const zone_contents_t *zone,
@@ -502,7 +669,7 @@ static int zone_contents_add_node(zone_contents_t *zone, zone_node_t *node,
 
 			/* Create a new node. */
 			dbg_zone_detail("Creating new node.\n");
-			next_node = node_new(parent, NULL);
+			next_node = node_new(parent, &zone->mm);
 			if (next_node == NULL) {
 				return KNOT_ENOMEM;
 			}
@@ -511,7 +678,7 @@ static int zone_contents_add_node(zone_contents_t *zone, zone_node_t *node,
 			dbg_zone_detail("Inserting new node to zone tree.\n");
 			ret = zone_tree_insert(zone->nodes, next_node);
 			if (ret != KNOT_EOK) {
-				node_free(&next_node, NULL);
+				node_free(&next_node, &zone->mm);
 				return ret;
 			}
 
@@ -614,22 +781,46 @@ static int insert_rr(zone_contents_t *z,
 		             zone_contents_get_node(z, rr->owner);
 		if (*n == NULL) {
 			// Create new, insert
-			*n = node_new(rr->owner, NULL);
+			*n = node_new(rr->owner, &z->mm);
 			if (*n == NULL) {
 				return KNOT_ENOMEM;
 			}
 			ret = nsec3 ? zone_contents_add_nsec3_node(z, *n) :
 			              zone_contents_add_node(z, *n, true);
 			if (ret != KNOT_EOK) {
-				node_free(n, NULL);
+				node_free(n, &z->mm);
 			}
 		}
 	}
 
-	return node_add_rrset(*n, rr, NULL);
+	return node_add_rrset_data(*n, rr, &z->mm, zone_contents_data_mm(z));
 }
 
-static int recreate_normal_tree(const zone_contents_t *z, zone_contents_t *out)
+/*! \brief Copies the node into the new version, shares or copies its RR data. */
+static zone_node_t *node_version_copy(const zone_node_t *src, zone_contents_t *out,
+                                      bool share)
+{
+	zone_node_t *dst = node_shallow_copy(src, &out->mm);
+	if (dst == NULL || share) {
+		return dst;
+	}
+
+	for (uint16_t i = 0; i < src->rrset_count; ++i) {
+		int ret = knot_rdataset_copy(&dst->rrs[i].rrs, &src->rrs[i].rrs,
+		                             zone_contents_data_mm(out));
+		if (ret != KNOT_EOK) {
+			dst->rrset_count = i;
+			node_free_rrsets(dst, zone_contents_data_mm(out));
+			node_free(&dst, &out->mm);
+			return NULL;
+		}
+	}
+
+	return dst;
+}
+
+static int recreate_normal_tree(const zone_contents_t *z, zone_contents_t *out,
+                                bool share)
 {
 	out->nodes = hattrie_dup(z->nodes, NULL);
 	if (out->nodes == NULL) {
@@ -637,7 +828,7 @@ static int recreate_normal_tree(const zone_contents_t *z, zone_contents_t *out)
 	}
 
 	// Insert APEX first.
-	zone_node_t *apex_cpy = node_shallow_copy(z->apex, NULL);
+	zone_node_t *apex_cpy = node_version_copy(z->apex, out, share);
 	if (apex_cpy == NULL) {
 		return KNOT_ENOMEM;
 	}
@@ -645,7 +836,7 @@ static int recreate_normal_tree(const zone_contents_t *z, zone_contents_t *out)
 	// Normal additions need apex ... so we need to insert directly.
 	int ret = zone_tree_insert(out->nodes, apex_cpy);
 	if (ret != KNOT_EOK) {
-		node_free(&apex_cpy, NULL);
+		node_free(&apex_cpy, &out->mm);
 		return ret;
 	}
 
@@ -662,7 +853,7 @@ static int recreate_normal_tree(const zone_contents_t *z, zone_contents_t *out)
 			hattrie_iter_next(itt);
 			continue;
 		}
-		zone_node_t *to_add = node_shallow_copy(to_cpy, NULL);
+		zone_node_t *to_add = node_version_copy(to_cpy, out, share);
 		if (to_add == NULL) {
 			hattrie_iter_free(itt);
 			return KNOT_ENOMEM;
@@ -670,7 +861,7 @@ static int recreate_normal_tree(const zone_contents_t *z, zone_contents_t *out)
 
 		int ret = zone_contents_add_node(out, to_add, true);
 		if (ret != KNOT_EOK) {
-			node_free(&to_add, NULL);
+			node_free(&to_add, &out->mm);
 			hattrie_iter_free(itt);
 			return ret;
 		}
@@ -683,7 +874,8 @@ static int recreate_normal_tree(const zone_contents_t *z, zone_contents_t *out)
 	return KNOT_EOK;
 }
 
-static int recreate_nsec3_tree(const zone_contents_t *z, zone_contents_t *out)
+static int recreate_nsec3_tree(const zone_contents_t *z, zone_contents_t *out,
+                               bool share)
 {
 	out->nsec3_nodes = hattrie_dup(z->nsec3_nodes, NULL);
 	if (out->nsec3_nodes == NULL) {
@@ -696,7 +888,7 @@ static int recreate_nsec3_tree(const zone_contents_t *z, zone_contents_t *out)
 	}
 	while (!hattrie_iter_finished(itt)) {
 		const zone_node_t *to_cpy = (zone_node_t *)*hattrie_iter_val(itt);
-		zone_node_t *to_add = node_shallow_copy(to_cpy, NULL);
+		zone_node_t *to_add = node_version_copy(to_cpy, out, share);
 		if (to_add == NULL) {
 			hattrie_iter_free(itt);
 			return KNOT_ENOMEM;
@@ -704,7 +896,7 @@ static int recreate_nsec3_tree(const zone_contents_t *z, zone_contents_t *out)
 		int ret = zone_contents_add_nsec3_node(out, to_add);
 		if (ret != KNOT_EOK) {
 			hattrie_iter_free(itt);
-			node_free(&to_add, NULL);
+			node_free(&to_add, &out->mm);
 			return ret;
 		}
 		hattrie_iter_next(itt);
@@ -1242,7 +1434,7 @@ int zone_contents_nsec3_apply_inorder(zone_contents_t *zone,
 
 /*----------------------------------------------------------------------------*/
 
-int zone_contents_shallow_copy(const zone_contents_t *from, zone_contents_t **to)
+int zone_contents_copy(const zone_contents_t *from, zone_contents_t **to)
 {
 	if (from == NULL || to == NULL) {
 		return KNOT_EINVAL;
@@ -1258,23 +1450,22 @@ int zone_contents_shallow_copy(const zone_contents_t *from, zone_contents_t **to
 		return KNOT_ENOMEM;
 	}
 
-	int ret = recreate_normal_tree(from, contents);
+	/* Share the RR data, unless a full copy is due. */
+	bool share = zone_data_shareable(from->data);
+	int ret = contents_init_mm(contents, true, share ? from->data : NULL);
 	if (ret != KNOT_EOK) {
-		zone_tree_free(&contents->nodes);
 		free(contents);
 		return ret;
 	}
 
-	if (from->nsec3_nodes) {
-		ret = recreate_nsec3_tree(from, contents);
-		if (ret != KNOT_EOK) {
-			zone_tree_free(&contents->nodes);
-			zone_tree_free(&contents->nsec3_nodes);
-			free(contents);
-			return ret;
-		}
-	} else {
-		contents->nsec3_nodes = NULL;
+	ret = recreate_normal_tree(from, contents, share);
+	if (ret == KNOT_EOK && from->nsec3_nodes) {
+		ret = recreate_nsec3_tree(from, contents, share);
+	}
+
+	if (ret != KNOT_EOK) {
+		zone_contents_free(&contents);
+		return ret;
 	}
 
 	*to = contents;
@@ -1297,6 +1488,11 @@ void zone_contents_free(zone_contents_t **contents)
 
 	knot_nsec3param_free(&(*contents)->nsec3_params);
 
+	axfr_stream_free((*contents)->axfr_stream);
+
+	// release nodes allocated in the arena
+	contents_free_mm(*contents);
+
 	free(*contents);
 	*contents = NULL;
 }
@@ -1309,18 +1505,21 @@ void zone_contents_deep_free(zone_contents_t **contents)
 		return;
 	}
 
-	if ((*contents) != NULL) {
+	// Nodes in the arena are released with it, no need to walk them.
+	if ((*contents)->mm.ctx == NULL) {
+		mm_ctx_t *mm = &(*contents)->mm;
+
 		// Delete NSEC3 tree
 		zone_tree_apply(
 			(*contents)->nsec3_nodes,
 			zone_contents_destroy_node_rrsets_from_tree,
-			(void*)1);
+			mm);
 
 		// Delete normal tree
 		zone_tree_apply(
 			(*contents)->nodes,
 			zone_contents_destroy_node_rrsets_from_tree,
-			(void*)1);
+			mm);
 	}
 
 	zone_contents_free(contents);
@@ -1401,14 +1600,14 @@ zone_node_t *zone_contents_get_node_for_rr(zone_contents_t *zone, const knot_rrs
 
 	if (node == NULL) {
 		int ret = KNOT_EOK;
-		node = node_new(rrset->owner, NULL);
+		node = node_new(rrset->owner, &zone->mm);
 		if (!nsec3) {
 			ret = zone_contents_add_node(zone, node, 1);
 		} else {
 			ret = zone_contents_add_nsec3_node(zone, node);
 		}
 		if (ret != KNOT_EOK) {
-			node_free(&node, NULL);
+			node_free(&node, &zone->mm);
 			return NULL;
 		}
 
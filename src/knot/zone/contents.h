@@ -27,11 +27,13 @@
 #pragma once
 
 #include "libknot/internal/lists.h"
+#include "libknot/internal/mempattern.h"
 #include "libknot/rrtype/nsec3param.h"
 #include "knot/zone/node.h"
 #include "knot/zone/zone-tree.h"
 
 struct zone;
+struct zone_data;
 
 enum zone_contents_find_dname_result {
 	ZONE_NAME_FOUND = 1,
@@ -47,6 +49,12 @@ typedef struct zone_contents {
 	zone_tree_t *nsec3_nodes;
 
 	knot_nsec3_params_t nsec3_params;
+
+	/*! \brief Pre-serialized AXFR messages of running transfers. */
+	struct axfr_stream *axfr_stream;
+
+	mm_ctx_t mm;             /*!< Memory context for nodes of this version. */
+	struct zone_data *data;  /*!< RR data arena, shared with other versions. */
 } zone_contents_t;
 
 /*!
@@ -56,8 +64,42 @@ typedef int (*zone_contents_apply_cb_t)(zone_node_t *node, void *data);
 
 /*----------------------------------------------------------------------------*/
 
+/*!
+ * \brief Creates empty zone contents, nodes and RR data use system allocator.
+ *
+ * Suitable for small contents, e.g. changesets.
+ */
 zone_contents_t *zone_contents_new(const knot_dname_t *apex_name);
 
+/*!
+ * \brief Creates empty zone contents with its own memory arenas.
+ *
+ * Nodes and owners are allocated from the arena of the contents, RR data from
+ * a separate arena that is shared with the copies of the contents. Both are
+ * released at once when the contents are freed. Suitable for complete zones.
+ */
+zone_contents_t *zone_contents_new_arena(const knot_dname_t *apex_name);
+
+/*!
+ * \brief Returns memory context for the RR data of the contents.
+ */
+mm_ctx_t *zone_contents_data_mm(zone_contents_t *contents);
+
+/*!
+ * \brief Makes the RR data of the given type private to the contents.
+ *
+ * Contents created by zone_contents_copy() share the RR data with the
+ * original, the RR data must be made private before they are modified.
+ *
+ * \param contents  Zone contents.
+ * \param node      Node of the contents.
+ * \param type      RR type.
+ *
+ * \return KNOT_EOK, KNOT_EINVAL or KNOT_ENOMEM.
+ */
+int zone_contents_unshare_rdataset(zone_contents_t *contents, zone_node_t *node,
+                                   uint16_t type);
+
 int zone_contents_add_rr(zone_contents_t *z, const knot_rrset_t *rr, zone_node_t **n);
 
 int zone_contents_remove_node(zone_contents_t *contents, const knot_dname_t *owner);
@@ -240,13 +282,12 @@ int zone_contents_nsec3_apply_inorder(zone_contents_t *zone,
                                       zone_contents_apply_cb_t function, void *data);
 
 /*!
- * \brief Creates a shallow copy of the zone (no stored data are copied).
+ * \brief Creates a copy of the zone for copy-on-write update.
  *
- * This function creates a new zone structure in \a to, creates new trees for
- * regular nodes and for NSEC3 nodes, creates new hash table and a new domain
- * table. It also fills these structures with the exact same data as the
- * original zone is - no copying of stored data is done, just pointers are
- * copied.
+ * The nodes are copied into the arena of the copy, the RR data are shared with
+ * the original, which can be freed independently of the copy. The RR data are
+ * copied as well if the chain of shared RR data arenas grows too long or too
+ * much of the shared RR data was replaced in the previous versions.
  *
  * \param from Original zone.
  * \param to Copy of the zone.
@@ -255,10 +296,18 @@ int zone_contents_nsec3_apply_inorder(zone_contents_t *zone,
  * \retval KNOT_EINVAL
  * \retval KNOT_ENOMEM
  */
-int zone_contents_shallow_copy(const zone_contents_t *from, zone_contents_t **to);
+int zone_contents_copy(const zone_contents_t *from, zone_contents_t **to);
 
+/*!
+ * \brief Frees the zone trees, keeps the nodes unless allocated in the arena.
+ */
 void zone_contents_free(zone_contents_t **contents);
 
+/*!
+ * \brief Frees the zone contents including all nodes and RR data.
+ *
+ * Contents with an arena are released at once without walking the nodes.
+ */
 void zone_contents_deep_free(zone_contents_t **contents);
 
 /*! \brief Return zone SOA rdataset. */
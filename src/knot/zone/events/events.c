@@ -39,17 +39,18 @@ typedef struct event_info {
 	zone_event_type_t type;
 	const zone_event_cb callback;
 	const char *name;
+	task_prio_t prio;
 } event_info_t;
 
 static const event_info_t EVENT_INFO[] = {
-        { ZONE_EVENT_RELOAD,  event_reload,  "reload" },
-        { ZONE_EVENT_REFRESH, event_refresh, "refresh" },
-        { ZONE_EVENT_XFER,    event_xfer,    "transfer" },
-        { ZONE_EVENT_UPDATE,  event_update,  "update" },
-        { ZONE_EVENT_EXPIRE,  event_expire,  "expiration" },
-        { ZONE_EVENT_FLUSH,   event_flush,   "journal flush" },
-        { ZONE_EVENT_NOTIFY,  event_notify,  "notify" },
-        { ZONE_EVENT_DNSSEC,  event_dnssec,  "DNSSEC resign" },
+        { ZONE_EVENT_RELOAD,  event_reload,  "reload",        TASK_PRIO_BULK },
+        { ZONE_EVENT_REFRESH, event_refresh, "refresh",       TASK_PRIO_HIGH },
+        { ZONE_EVENT_XFER,    event_xfer,    "transfer",      TASK_PRIO_BULK },
+        { ZONE_EVENT_UPDATE,  event_update,  "update",        TASK_PRIO_HIGH },
+        { ZONE_EVENT_EXPIRE,  event_expire,  "expiration",    TASK_PRIO_HIGH },
+        { ZONE_EVENT_FLUSH,   event_flush,   "journal flush", TASK_PRIO_BULK },
+        { ZONE_EVENT_NOTIFY,  event_notify,  "notify",        TASK_PRIO_HIGH },
+        { ZONE_EVENT_DNSSEC,  event_dnssec,  "DNSSEC resign", TASK_PRIO_BULK },
         { 0 }
 };
 
@@ -155,6 +156,23 @@ static void reschedule(zone_events_t *events)
 	evsched_schedule(events->event, diff * 1000);
 }
 
+/*!
+ * \brief Assign the events task to the worker pool.
+ *
+ * The task is classified by the event type which is going to be executed.
+ * The events mutex must be locked when calling this function.
+ */
+static void assign_task(zone_events_t *events, zone_event_type_t type)
+{
+	assert(events);
+	assert(valid_event(type));
+
+	events->running = true;
+	events->task.type = type;
+	events->task.prio = get_event_info(type)->prio;
+	worker_pool_assign(events->pool, &events->task);
+}
+
 /* -- callbacks control ----------------------------------------------------- */
 
 /*!
@@ -181,6 +199,7 @@ static void event_wrap(task_t *task)
 		return;
 	}
 	event_set_time(events, type, 0);
+	events->refs = 1;
 	pthread_mutex_unlock(&events->mx);
 
 	const event_info_t *info = get_event_info(type);
@@ -190,10 +209,7 @@ static void event_wrap(task_t *task)
 		               knot_strerror(result));
 	}
 
-	pthread_mutex_lock(&events->mx);
-	events->running = false;
-	reschedule(events);
-	pthread_mutex_unlock(&events->mx);
+	zone_events_done(zone);
 }
 
 /*!
@@ -207,9 +223,9 @@ static int event_dispatch(event_t *event)
 	zone_events_t *events = event->data;
 
 	pthread_mutex_lock(&events->mx);
-	if (!events->running && !events->frozen) {
-		events->running = true;
-		worker_pool_assign(events->pool, &events->task);
+	zone_event_type_t type = get_next_event(events);
+	if (!events->running && !events->frozen && valid_event(type)) {
+		assign_task(events, type);
 	}
 	pthread_mutex_unlock(&events->mx);
 
@@ -235,7 +251,9 @@ int zone_events_init(zone_t *zone)
 }
 
 int zone_events_setup(struct zone *zone, worker_pool_t *workers,
-                      evsched_t *scheduler, namedb_t *timers_db)
+                      evsched_t *scheduler,
+                      struct knot_async_requestor *requestor,
+                      namedb_t *timers_db)
 {
 	if (!zone || !workers || !scheduler) {
 		return KNOT_EINVAL;
@@ -249,6 +267,7 @@ int zone_events_setup(struct zone *zone, worker_pool_t *workers,
 
 	zone->events.event = event;
 	zone->events.pool = workers;
+	zone->events.requestor = requestor;
 	zone->events.timers_db = timers_db;
 
 	return KNOT_EOK;
@@ -299,9 +318,8 @@ void zone_events_enqueue(zone_t *zone, zone_event_type_t type)
 
 	/* Bypass scheduler if no event is running. */
 	if (!events->running && !events->frozen) {
-		events->running = true;
 		event_set_time(events, type, ZONE_EVENT_IMMEDIATE);
-		worker_pool_assign(events->pool, &events->task);
+		assign_task(events, type);
 		pthread_mutex_unlock(&events->mx);
 		return;
 	}
@@ -323,6 +341,39 @@ void zone_events_cancel(zone_t *zone, zone_event_type_t type)
 	zone_events_schedule_at(zone, type, 0);
 }
 
+void zone_events_hold(zone_t *zone)
+{
+	if (!zone) {
+		return;
+	}
+
+	zone_events_t *events = &zone->events;
+
+	pthread_mutex_lock(&events->mx);
+	assert(events->running && events->refs > 0);
+	events->refs += 1;
+	pthread_mutex_unlock(&events->mx);
+}
+
+void zone_events_done(zone_t *zone)
+{
+	if (!zone) {
+		return;
+	}
+
+	zone_events_t *events = &zone->events;
+
+	/* Last reference finishes the running event. */
+	pthread_mutex_lock(&events->mx);
+	assert(events->refs > 0);
+	events->refs -= 1;
+	if (events->refs == 0) {
+		events->running = false;
+		reschedule(events);
+	}
+	pthread_mutex_unlock(&events->mx);
+}
+
 void zone_events_freeze(zone_t *zone)
 {
 	if (!zone) {
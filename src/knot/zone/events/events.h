@@ -20,6 +20,7 @@
 #include <stdbool.h>
 
 #include "knot/common/evsched.h"
+#include "libknot/processing/requestor_async.h"
 #include "libknot/internal/namedb/namedb.h"
 #include "knot/worker/pool.h"
 
@@ -48,10 +49,12 @@ typedef enum zone_event_type {
 typedef struct zone_events {
 	pthread_mutex_t mx;		//!< Mutex protecting the struct.
 	bool running;			//!< Some zone event is being run.
+	unsigned refs;			//!< References to the running event.
 	bool frozen;			//!< Terminated, don't schedule new events.
 
 	event_t *event;			//!< Scheduler event.
 	worker_pool_t *pool;		//!< Server worker pool.
+	struct knot_async_requestor *requestor; //!< Outgoing requests.
 	namedb_t *timers_db;		//!< Persistent zone timers database.
 
 	task_t task;			//!< Event execution context.
@@ -76,12 +79,15 @@ int zone_events_init(struct zone *zone);
  * \param zone       Zone to setup.
  * \param workers    Worker thread pool.
  * \param scheduler  Event scheduler.
+ * \param requestor  Asynchronous requestor. Can be NULL.
  * \param timers_db  Persistent timers database. Can be NULL.
  *
  * \return KNOT_E*
  */
 int zone_events_setup(struct zone *zone, worker_pool_t *workers,
-                      evsched_t *scheduler, namedb_t *timers_db);
+                      evsched_t *scheduler,
+                      struct knot_async_requestor *requestor,
+                      namedb_t *timers_db);
 
 /*!
  * \brief Deinitialize zone events.
@@ -135,6 +141,23 @@ bool zone_events_is_scheduled(struct zone *zone, zone_event_type_t type);
  */
 void zone_events_cancel(struct zone *zone, zone_event_type_t type);
 
+/*!
+ * \brief Keep the running event in progress after its handler returns.
+ *
+ * Used by handlers waiting for asynchronous requests. No other zone event is
+ * executed until each hold is released with zone_events_done().
+ *
+ * \param zone  Zone with running event.
+ */
+void zone_events_hold(struct zone *zone);
+
+/*!
+ * \brief Release one hold of the running event.
+ *
+ * \param zone  Zone with running event.
+ */
+void zone_events_done(struct zone *zone);
+
 /*!
  * \brief Freeze all zone events and prevent new events from running.
  *
@@ -14,10 +14,14 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <unistd.h>
+
 #include "libknot/rrtype/soa.h"
 #include "libknot/dnssec/random.h"
 #include "libknot/processing/requestor.h"
+#include "libknot/processing/requestor_async.h"
 
+#include "knot/common/conn_pool.h"
 #include "knot/common/trim.h"
 #include "libknot/internal/mempool.h"
 #include "libknot/internal/macros.h"
@@ -31,6 +35,8 @@
 #include "knot/zone/zonefile.h"
 #include "knot/zone/events/events.h"
 #include "knot/zone/events/handlers.h"
+#include "knot/zone/events/notifier.h"
+#include "knot/zone/events/refresh.h"
 #include "knot/updates/apply.h"
 #include "knot/nameserver/internet.h"
 #include "knot/nameserver/update.h"
@@ -84,6 +90,13 @@ static knot_pkt_t *zone_query(const zone_t *zone, uint16_t pkt_type, mm_ctx_t *m
 	return pkt;
 }
 
+/*! \brief Take idle connection to the remote, -1 if none. */
+static int zone_query_reuse(const conf_iface_t *remote)
+{
+	int fd = conn_pool_get(&remote->via, &remote->addr);
+	return fd >= 0 ? fd : -1;
+}
+
 /*!
  * \brief Create a zone event query, send it, wait for the response and process it.
  *
@@ -121,20 +134,28 @@ static int zone_query_execute(zone_t *zone, uint16_t pkt_type, const conf_iface_
 		goto fail;
 	}
 
-	/* Create a request. */
+	/* Create a request, reuse idle connection to the remote if any. */
 	const struct sockaddr *dst = (const struct sockaddr *)&remote->addr;
 	const struct sockaddr *src = (const struct sockaddr *)&remote->via;
-	struct knot_request *req = knot_request_make(re.mm, dst, src, query, 0);
+	struct knot_request *req = knot_request_make(re.mm, dst, src, query,
+	                                             KNOT_RQ_KEEP);
 	if (req == NULL) {
 		ret = KNOT_ENOMEM;
 		goto fail;
 	}
+	req->fd = zone_query_reuse(remote);
 
 	/* Send the queries and process responses. */
 	ret = knot_requestor_enqueue(&re, req);
 	if (ret == KNOT_EOK) {
+		int fd = req->fd;
 		struct timeval tv = { conf()->max_conn_reply, 0 };
 		ret = knot_requestor_exec(&re, &tv);
+		if (ret == KNOT_EOK) {
+			conn_pool_put(&remote->via, &remote->addr, fd);
+		}
+	} else if (req->fd >= 0) {
+		close(req->fd);
 	}
 
 fail:
@@ -146,6 +167,117 @@ fail:
 	return ret;
 }
 
+/*! \brief Asynchronous zone query completion callback. */
+typedef void (*zone_query_cb)(zone_t *zone, const conf_iface_t *remote, int ret);
+
+/*! \brief Asynchronous zone query context. */
+struct zone_query_ctx {
+	mm_ctx_t mm;
+	zone_t *zone;
+	conf_iface_t remote;
+	zone_query_cb done;
+	struct process_answer_param param;
+};
+
+static void zone_query_done(struct knot_async_request *request, int ret)
+{
+	struct zone_query_ctx *ctx = request->data;
+	zone_t *zone = ctx->zone;
+
+	/* Park the connection for next query. */
+	if (ret == KNOT_EOK && request->req.fd >= 0) {
+		conn_pool_put(&ctx->remote.via, &ctx->remote.addr, request->req.fd);
+		request->req.fd = -1;
+	}
+
+	ctx->done(zone, &ctx->remote, ret);
+
+	/* Cleanup, the context lives in its own memory pool. */
+	tsig_cleanup(&ctx->param.tsig_ctx);
+	mp_delete(ctx->mm.ctx);
+
+	/* Let the zone run other events. */
+	zone_events_done(zone);
+}
+
+/*!
+ * \brief Create a zone event query and send it without waiting for the response.
+ *
+ * The running zone event is held until the response is processed and the
+ * completion callback is called from the requestor thread. Falls back to
+ * synchronous processing if the zone has no requestor.
+ */
+static int zone_query_async(zone_t *zone, uint16_t pkt_type,
+                            const conf_iface_t *remote, zone_query_cb done)
+{
+	struct knot_async_requestor *requestor = zone->events.requestor;
+	if (requestor == NULL) {
+		done(zone, remote, zone_query_execute(zone, pkt_type, remote));
+		return KNOT_EOK;
+	}
+
+	/* Create a memory pool for this task. */
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, MM_DEFAULT_BLKSIZE);
+
+	struct zone_query_ctx *ctx = mm_alloc(&mm, sizeof(struct zone_query_ctx));
+	knot_pkt_t *query = zone_query(zone, pkt_type, &mm);
+	if (ctx == NULL || query == NULL) {
+		mp_delete(mm.ctx);
+		return KNOT_ENOMEM;
+	}
+
+	/* Remote is copied, configuration may change before completion. */
+	memset(ctx, 0, sizeof(struct zone_query_ctx));
+	ctx->mm = mm;
+	ctx->zone = zone;
+	ctx->remote = *remote;
+	ctx->done = done;
+
+	/* Answer processing parameters. */
+	ctx->param.zone = zone;
+	ctx->param.query = query;
+	ctx->param.remote = &ctx->remote.addr;
+	tsig_init(&ctx->param.tsig_ctx, remote->key);
+
+	int ret = tsig_sign_packet(&ctx->param.tsig_ctx, query);
+	if (ret != KNOT_EOK) {
+		goto fail;
+	}
+
+	/* Create a request. */
+	const struct sockaddr *dst = (const struct sockaddr *)&ctx->remote.addr;
+	const struct sockaddr *src = (const struct sockaddr *)&ctx->remote.via;
+	struct knot_async_request *req = knot_async_request_make(&ctx->mm, dst,
+	                                                         src, query,
+	                                                         KNOT_RQ_KEEP);
+	if (req == NULL) {
+		ret = KNOT_ENOMEM;
+		goto fail;
+	}
+	req->req.fd = zone_query_reuse(remote);
+
+	knot_async_request_overlay(req, KNOT_NS_PROC_ANSWER, &ctx->param);
+
+	/* Hold the event until completion. */
+	zone_events_hold(zone);
+	ret = knot_async_requestor_enqueue(requestor, req,
+	                                   conf()->max_conn_reply * 1000,
+	                                   zone_query_done, ctx);
+	if (ret != KNOT_EOK) {
+		zone_events_done(zone);
+		knot_async_request_free(&ctx->mm, req);
+		goto fail;
+	}
+
+	return KNOT_EOK;
+
+fail:
+	tsig_cleanup(&ctx->param.tsig_ctx);
+	mp_delete(ctx->mm.ctx);
+	return ret;
+}
+
 /* @note Module specific, expects some variables set. */
 #define ZONE_XFER_LOG(severity, pkt_type, msg...) \
 	if (pkt_type == KNOT_QUERY_AXFR) { \
@@ -280,7 +412,7 @@ int event_reload(zone_t *zone)
 
 	/* Schedule notify and refresh after load. */
 	if (zone_master(zone)) {
-		zone_events_schedule(zone, ZONE_EVENT_REFRESH, ZONE_EVENT_NOW);
+		zone_events_schedule(zone, ZONE_EVENT_REFRESH, refresh_spread());
 	}
 	if (!zone_contents_is_empty(contents)) {
 		zone_events_schedule(zone, ZONE_EVENT_NOTIFY, ZONE_EVENT_NOW);
@@ -306,6 +438,35 @@ fail:
 	return result;
 }
 
+/*! \brief SOA query completion, reschedule refresh timer. */
+static void refresh_done(zone_t *zone, const conf_iface_t *master, int ret)
+{
+	refresh_release(master, REFRESH_QUERY);
+
+	const knot_rdataset_t *soa = zone_soa(zone);
+	if (ret != KNOT_EOK) {
+		/* Log connection errors. */
+		ZONE_QUERY_LOG(LOG_WARNING, zone, master, "SOA query, outgoing",
+		               "failed (%s)", knot_strerror(ret));
+		/* Rotate masters if current failed. */
+		zone_master_rotate(zone);
+		/* Schedule next retry. */
+		zone_events_schedule(zone, ZONE_EVENT_REFRESH,
+		                     refresh_jitter(knot_soa_retry(soa)));
+		start_expire_timer(zone, soa);
+	} else {
+		/* SOA query answered, reschedule refresh timer. */
+		zone_events_schedule(zone, ZONE_EVENT_REFRESH,
+		                     refresh_jitter(knot_soa_refresh(soa)));
+	}
+
+	ret = zone_events_write_persistent(zone);
+	if (ret != KNOT_EOK) {
+		log_zone_error(zone->name, "failed to write zone timers (%s)",
+		               knot_strerror(ret));
+	}
+}
+
 int event_refresh(zone_t *zone)
 {
 	assert(zone);
@@ -322,23 +483,20 @@ int event_refresh(zone_t *zone)
 		return KNOT_EOK;
 	}
 
-	int ret = zone_query_execute(zone, KNOT_QUERY_NORMAL, master);
-	const knot_rdataset_t *soa = zone_soa(zone);
+	/* Postpone the query if the master is over budget. */
+	uint32_t delay = 0;
+	int ret = refresh_acquire(zone, master, REFRESH_QUERY, &delay);
 	if (ret != KNOT_EOK) {
-		/* Log connection errors. */
-		ZONE_QUERY_LOG(LOG_WARNING, zone, master, "SOA query, outgoing",
-		               "failed (%s)", knot_strerror(ret));
-		/* Rotate masters if current failed. */
-		zone_master_rotate(zone);
-		/* Schedule next retry. */
-		zone_events_schedule(zone, ZONE_EVENT_REFRESH, knot_soa_retry(soa));
-		start_expire_timer(zone, soa);
-	} else {
-		/* SOA query answered, reschedule refresh timer. */
-		zone_events_schedule(zone, ZONE_EVENT_REFRESH, knot_soa_refresh(soa));
+		zone_events_schedule(zone, ZONE_EVENT_REFRESH, delay);
+		return KNOT_EOK;
 	}
 
-	return zone_events_write_persistent(zone);
+	ret = zone_query_async(zone, KNOT_QUERY_NORMAL, master, refresh_done);
+	if (ret != KNOT_EOK) {
+		refresh_done(zone, master, ret);
+	}
+
+	return KNOT_EOK;
 }
 
 int event_xfer(zone_t *zone)
@@ -358,8 +516,17 @@ int event_xfer(zone_t *zone)
 		pkt_type = KNOT_QUERY_AXFR;
 	}
 
+	/* Postpone the transfer if the master is over budget. */
+	uint32_t delay = 0;
+	int ret = refresh_acquire(zone, master, REFRESH_XFER, &delay);
+	if (ret != KNOT_EOK) {
+		zone_events_schedule(zone, ZONE_EVENT_XFER, delay);
+		return KNOT_EOK;
+	}
+
 	/* Execute zone transfer and reschedule timers. */
-	int ret = zone_query_transfer(zone, master, pkt_type);
+	ret = zone_query_transfer(zone, master, pkt_type);
+	refresh_release(master, REFRESH_XFER);
 
 	/* Handle failure during transfer. */
 	if (ret != KNOT_EOK) {
@@ -368,7 +535,8 @@ int event_xfer(zone_t *zone)
 			zone_events_schedule(zone, ZONE_EVENT_XFER, zone->bootstrap_retry);
 		} else {
 			const knot_rdataset_t *soa = zone_soa(zone);
-			zone_events_schedule(zone, ZONE_EVENT_XFER, knot_soa_retry(soa));
+			zone_events_schedule(zone, ZONE_EVENT_XFER,
+			                     refresh_jitter(knot_soa_retry(soa)));
 			start_expire_timer(zone, soa);
 		}
 
@@ -379,7 +547,8 @@ int event_xfer(zone_t *zone)
 	const knot_rdataset_t *soa = zone_soa(zone);
 
 	/* Rechedule events. */
-	zone_events_schedule(zone, ZONE_EVENT_REFRESH, knot_soa_refresh(soa));
+	zone_events_schedule(zone, ZONE_EVENT_REFRESH,
+	                     refresh_jitter(knot_soa_refresh(soa)));
 	zone_events_schedule(zone, ZONE_EVENT_NOTIFY,  ZONE_EVENT_NOW);
 	zone_events_cancel(zone, ZONE_EVENT_EXPIRE);
 	if (zone->conf->dbsync_timeout == 0) {
@@ -463,28 +632,43 @@ int event_flush(zone_t *zone)
 	return zone_flush_journal(zone);
 }
 
+/*! \brief NOTIFY completion. */
+static void notify_done(zone_t *zone, const conf_iface_t *remote, int ret)
+{
+	if (ret == KNOT_EOK) {
+		ZONE_QUERY_LOG(LOG_INFO, zone, remote, "NOTIFY, outgoing",
+		               "serial %u", zone_contents_serial(zone->contents));
+	} else {
+		ZONE_QUERY_LOG(LOG_WARNING, zone, remote, "NOTIFY, outgoing",
+		               "failed (%s)", knot_strerror(ret));
+	}
+}
+
 int event_notify(zone_t *zone)
 {
 	assert(zone);
 
 	/* Check zone contents. */
-	if (zone_contents_is_empty(zone->contents)) {
+	if (zone_contents_is_empty(zone->contents) ||
+	    EMPTY_LIST(zone->conf->acl.notify_out)) {
 		return KNOT_EOK;
 	}
 
+	/* Pass to the dispatcher, notifications are coalesced and batched. */
+	int ret = notifier_enqueue(zone);
+	if (ret != KNOT_ENOTRUNNING) {
+		return ret;
+	}
+
 	/* Walk through configured remotes and send messages. */
 	conf_remote_t *remote = 0;
 	WALK_LIST(remote, zone->conf->acl.notify_out) {
 		conf_iface_t *iface = remote->remote;
 
-		int ret = zone_query_execute(zone, KNOT_QUERY_NOTIFY, iface);
-		if (ret == KNOT_EOK) {
-			ZONE_QUERY_LOG(LOG_INFO, zone, iface, "NOTIFY, outgoing",
-			               "serial %u",
-			               zone_contents_serial(zone->contents));
-		} else {
-			ZONE_QUERY_LOG(LOG_WARNING, zone, iface, "NOTIFY, outgoing",
-			               "failed (%s)", knot_strerror(ret));
+		/* Remotes are notified concurrently. */
+		ret = zone_query_async(zone, KNOT_QUERY_NOTIFY, iface, notify_done);
+		if (ret != KNOT_EOK) {
+			notify_done(zone, iface, ret);
 		}
 	}
 
@@ -534,7 +718,6 @@ int event_dnssec(zone_t *zone)
 		if (ret != KNOT_EOK) {
 			log_zone_error(zone->name, "DNSSEC, failed to sign zone (%s)",
 				       knot_strerror(ret));
-			update_rollback(&ch);
 			update_free_zone(&new_contents);
 			goto done;
 		}
@@ -543,8 +726,6 @@ int event_dnssec(zone_t *zone)
 		zone_contents_t *old_contents = zone_switch_contents(zone, new_contents);
 		synchronize_rcu();
 		update_free_zone(&old_contents);
-
-		update_cleanup(&ch);
 	}
 
 	// Schedule dependent events.
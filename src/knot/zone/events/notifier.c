@@ -0,0 +1,677 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <urcu.h>
+
+#include "libknot/errcode.h"
+#include "libknot/descriptor.h"
+#include "libknot/dnssec/random.h"
+#include "libknot/internal/lists.h"
+#include "libknot/internal/net.h"
+#include "knot/common/time.h"
+#include "knot/nameserver/process_query.h"
+#include "knot/nameserver/tsig_ctx.h"
+#include "knot/zone/events/notifier.h"
+
+/*! \brief Maximum size of outgoing NOTIFY message. */
+#define NOTIFIER_PKTSIZE 1024
+/*! \brief Maximum size of accepted response. */
+#define NOTIFIER_RXSIZE 4096
+
+/*! \brief NOTIFY logging. */
+#define NOTIFIER_LOG(severity, t, msg...) \
+	NS_PROC_LOG(severity, &(t)->addr, (t)->zone, "NOTIFY, outgoing", msg)
+
+/*! \brief Source socket for outgoing messages. */
+struct source {
+	node_t n;
+	struct sockaddr_storage addr; /*!< Bound address or family only. */
+	int fd;
+};
+
+/*! \brief NOTIFY message to one remote. */
+struct target {
+	node_t n;
+	knot_dname_t *zone;           /*!< Zone name. */
+	struct sockaddr_storage addr; /*!< Remote address. */
+	struct source *src;           /*!< Source socket. */
+	knot_tsig_key_t key;          /*!< Copy of remote TSIG key. */
+	tsig_ctx_t tsig;
+	uint32_t serial;
+	uint64_t timeout;             /*!< Time of retransmission [ms]. */
+	unsigned attempt;
+	uint16_t id;
+	uint16_t len;
+	uint8_t wire[NOTIFIER_PKTSIZE];
+};
+
+/*! \brief Buffers for batched I/O. */
+struct batch {
+	struct mmsghdr msgs[NOTIFIER_BATCH];
+	struct iovec iov[NOTIFIER_BATCH];
+	struct sockaddr_storage addr[NOTIFIER_BATCH];
+	uint8_t buf[NOTIFIER_BATCH][NOTIFIER_RXSIZE];
+};
+
+/*! \brief Global dispatcher state. */
+static struct {
+	pthread_mutex_t lock;
+	bool running;
+	list_t queue;             /*!< Zones waiting for dispatch. */
+	unsigned queued;
+	list_t inflight;          /*!< Unanswered messages ordered by timeout. */
+	unsigned count;
+	list_t sources;
+	unsigned nsources;
+	struct target **ids;      /*!< Unanswered messages by message ID. */
+	struct batch *batch;
+	notifier_stats_t stats;
+} notifier = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*! \brief Find or open socket for given remote. */
+static struct source *source_get(const conf_iface_t *remote)
+{
+	struct sockaddr_storage addr;
+	memset(&addr, 0, sizeof(addr));
+	if (remote->via.ss_family != AF_UNSPEC) {
+		memcpy(&addr, &remote->via, sizeof(addr));
+	} else {
+		addr.ss_family = remote->addr.ss_family;
+	}
+
+	struct source *src = NULL;
+	WALK_LIST(src, notifier.sources) {
+		if (memcmp(&src->addr, &addr, sizeof(addr)) == 0) {
+			return src;
+		}
+	}
+
+	src = malloc(sizeof(struct source));
+	if (src == NULL) {
+		return NULL;
+	}
+
+	memcpy(&src->addr, &addr, sizeof(addr));
+	if (remote->via.ss_family != AF_UNSPEC) {
+		src->fd = net_bound_socket(SOCK_DGRAM, &addr);
+	} else {
+		src->fd = net_unbound_socket(SOCK_DGRAM, &addr);
+	}
+	if (src->fd < 0) {
+		free(src);
+		return NULL;
+	}
+
+	add_tail(&notifier.sources, &src->n);
+	notifier.nsources += 1;
+	return src;
+}
+
+/*! \brief Write NOTIFY message with current SOA, without message ID. */
+static int notify_template(const zone_t *zone, const zone_contents_t *contents,
+                           uint8_t *wire, uint16_t *len)
+{
+	knot_pkt_t *pkt = knot_pkt_new(wire, NOTIFIER_PKTSIZE, NULL);
+	if (pkt == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	/* RFC1996, SOA in ANSWER. */
+	knot_pkt_clear(pkt);
+	knot_wire_set_aa(pkt->wire);
+	knot_wire_set_opcode(pkt->wire, KNOT_OPCODE_NOTIFY);
+	int ret = knot_pkt_put_question(pkt, zone->name, KNOT_CLASS_IN,
+	                                KNOT_RRTYPE_SOA);
+	if (ret == KNOT_EOK) {
+		knot_pkt_begin(pkt, KNOT_ANSWER);
+		knot_rrset_t soa_rr = node_rrset(contents->apex, KNOT_RRTYPE_SOA);
+		ret = knot_pkt_put(pkt, KNOT_COMPR_HINT_QNAME, &soa_rr, 0);
+	}
+
+	*len = pkt->size;
+	knot_pkt_free(&pkt);
+
+	return ret;
+}
+
+static void target_free(struct target *t)
+{
+	if (notifier.ids[t->id] == t) {
+		notifier.ids[t->id] = NULL;
+	}
+
+	tsig_cleanup(&t->tsig);
+	knot_tsig_key_free(&t->key);
+	knot_dname_free(&t->zone, NULL);
+	free(t);
+}
+
+/*! \brief Assign unused message ID, sign the message. */
+static int target_sign(struct target *t)
+{
+	do {
+		t->id = knot_random_uint16_t();
+	} while (notifier.ids[t->id] != NULL);
+	knot_wire_set_id(t->wire, t->id);
+
+	if (t->tsig.key == NULL) {
+		return KNOT_EOK;
+	}
+
+	knot_pkt_t *pkt = knot_pkt_new(t->wire, NOTIFIER_PKTSIZE, NULL);
+	if (pkt == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	pkt->size = t->len;
+	int ret = tsig_sign_packet(&t->tsig, pkt);
+	t->len = pkt->size;
+	knot_pkt_free(&pkt);
+
+	return ret;
+}
+
+static struct target *target_new(const zone_t *zone, const conf_iface_t *remote,
+                                 const uint8_t *wire, uint16_t len,
+                                 uint32_t serial)
+{
+	struct target *t = malloc(sizeof(struct target));
+	if (t == NULL) {
+		return NULL;
+	}
+
+	memset(t, 0, sizeof(struct target));
+	t->zone = knot_dname_copy(zone->name, NULL);
+	memcpy(&t->addr, &remote->addr, sizeof(t->addr));
+	t->src = source_get(remote);
+	t->serial = serial;
+	t->len = len;
+	memcpy(t->wire, wire, len);
+
+	/* Remote configuration may change before the message is answered. */
+	int ret = KNOT_EOK;
+	if (remote->key != NULL) {
+		t->key.name = knot_dname_copy(remote->key->name, NULL);
+		t->key.algorithm = remote->key->algorithm;
+		ret = knot_binary_dup(&remote->key->secret, &t->key.secret);
+		tsig_init(&t->tsig, &t->key);
+	}
+
+	if (t->zone == NULL || t->src == NULL || ret != KNOT_EOK ||
+	    (remote->key != NULL && t->key.name == NULL) ||
+	    target_sign(t) != KNOT_EOK) {
+		target_free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+/*! \brief Log the result and free the message. */
+static void target_finish(struct target *t, int ret)
+{
+	if (ret == KNOT_EOK) {
+		NOTIFIER_LOG(LOG_INFO, t, "serial %u", t->serial);
+		__sync_add_and_fetch(&notifier.stats.answered, 1);
+	} else {
+		NOTIFIER_LOG(LOG_WARNING, t, "failed (%s)", knot_strerror(ret));
+		__sync_add_and_fetch(&notifier.stats.failed, 1);
+	}
+
+	rem_node(&t->n);
+	notifier.count -= 1;
+	target_free(t);
+}
+
+/*! \brief Insert message into the list ordered by timeout. */
+static void target_schedule(struct target *t)
+{
+	struct target *it = NULL;
+	WALK_LIST_BACKWARDS(it, notifier.inflight) {
+		if (it->timeout <= t->timeout) {
+			insert_node(&t->n, &it->n);
+			return;
+		}
+	}
+
+	add_head(&notifier.inflight, &t->n);
+}
+
+/*! \brief Drop unanswered messages for older serial of the same zone. */
+static void supersede(const knot_dname_t *zone, const struct sockaddr_storage *addr)
+{
+	struct target *t = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(t, next, notifier.inflight) {
+		if (sockaddr_cmp(&t->addr, addr) == 0 &&
+		    knot_dname_is_equal(t->zone, zone)) {
+			rem_node(&t->n);
+			notifier.count -= 1;
+			target_free(t);
+			__sync_add_and_fetch(&notifier.stats.coalesced, 1);
+		}
+	}
+}
+
+/*! \brief Create messages for all remotes of the zone. */
+static void zone_targets(zone_t *zone, list_t *out)
+{
+	uint8_t wire[NOTIFIER_PKTSIZE];
+	uint16_t len = 0;
+
+	rcu_read_lock();
+	const zone_contents_t *contents = zone->contents;
+	if (zone_contents_is_empty(contents)) {
+		rcu_read_unlock();
+		return;
+	}
+	uint32_t serial = zone_contents_serial(contents);
+	int ret = notify_template(zone, contents, wire, &len);
+	rcu_read_unlock();
+
+	if (ret != KNOT_EOK) {
+		log_zone_error(zone->name, "NOTIFY, failed to create message (%s)",
+		               knot_strerror(ret));
+		return;
+	}
+
+	conf_remote_t *remote = NULL;
+	WALK_LIST(remote, zone->conf->acl.notify_out) {
+		const conf_iface_t *iface = remote->remote;
+		supersede(zone->name, &iface->addr);
+
+		struct target *t = target_new(zone, iface, wire, len, serial);
+		if (t == NULL) {
+			NS_PROC_LOG(LOG_WARNING, &iface->addr, zone->name,
+			            "NOTIFY, outgoing", "failed (%s)",
+			            knot_strerror(KNOT_ENOMEM));
+			__sync_add_and_fetch(&notifier.stats.failed, 1);
+			continue;
+		}
+
+		notifier.ids[t->id] = t;
+		notifier.count += 1;
+		add_tail(out, &t->n);
+		__sync_add_and_fetch(&notifier.stats.sent, 1);
+	}
+}
+
+/*! \brief Take queued zones while there is room in the window. */
+static void dispatch(list_t *out)
+{
+	pthread_mutex_lock(&notifier.lock);
+
+	/* Zones with many remotes may overshoot the window slightly. */
+	while (!EMPTY_LIST(notifier.queue) && notifier.count < NOTIFIER_WINDOW) {
+		node_t *n = HEAD(notifier.queue);
+		zone_t *zone = (zone_t *)((char *)n - offsetof(zone_t, notify_node));
+		rem_node(n);
+		notifier.queued -= 1;
+
+		/* Zone can't be freed while it's locked in the queue. */
+		zone_targets(zone, out);
+	}
+
+	pthread_mutex_unlock(&notifier.lock);
+}
+
+/*! \brief Send multiple messages, sendmmsg() if available. */
+static int batch_send(int fd, struct mmsghdr *msgs, unsigned count)
+{
+#ifdef HAVE_SENDMMSG
+	return sendmmsg(fd, msgs, count, MSG_DONTWAIT);
+#else
+	unsigned sent = 0;
+	for (; sent < count; ++sent) {
+		if (sendmsg(fd, &msgs[sent].msg_hdr, MSG_DONTWAIT) < 0) {
+			break;
+		}
+	}
+
+	return sent;
+#endif
+}
+
+/*! \brief Receive multiple messages, recvmmsg() if available. */
+static int batch_recv(int fd, struct mmsghdr *msgs, unsigned count)
+{
+#ifdef HAVE_RECVMMSG
+	return recvmmsg(fd, msgs, count, MSG_DONTWAIT, NULL);
+#else
+	unsigned received = 0;
+	for (; received < count; ++received) {
+		int ret = recvmsg(fd, &msgs[received].msg_hdr, MSG_DONTWAIT);
+		if (ret < 0) {
+			break;
+		}
+		msgs[received].msg_len = ret;
+	}
+
+	return received;
+#endif
+}
+
+/*! \brief Send messages from the list in batches, move them to in-flight list. */
+static void send_all(list_t *out, uint64_t now)
+{
+	struct batch *b = notifier.batch;
+
+	while (!EMPTY_LIST(*out)) {
+		/* Collect messages sharing the socket of the first one. */
+		struct target *first = HEAD(*out);
+		struct source *src = first->src;
+		unsigned count = 0;
+		struct target *t = NULL, *next = NULL;
+		WALK_LIST_DELSAFE(t, next, *out) {
+			if (t->src != src) {
+				continue;
+			}
+
+			memset(&b->msgs[count], 0, sizeof(struct mmsghdr));
+			b->iov[count].iov_base = t->wire;
+			b->iov[count].iov_len = t->len;
+			b->msgs[count].msg_hdr.msg_name = &t->addr;
+			b->msgs[count].msg_hdr.msg_namelen = sockaddr_len((struct sockaddr *)&t->addr);
+			b->msgs[count].msg_hdr.msg_iov = &b->iov[count];
+			b->msgs[count].msg_hdr.msg_iovlen = 1;
+
+			/* Unsent messages are retransmitted on timeout. */
+			rem_node(&t->n);
+			t->timeout = now + ((uint64_t)NOTIFIER_TIMEOUT << t->attempt);
+			target_schedule(t);
+			if (++count == NOTIFIER_BATCH) {
+				break;
+			}
+		}
+
+		batch_send(src->fd, b->msgs, count);
+	}
+}
+
+/*! \brief Retransmit or fail unanswered messages over timeout. */
+static int expire(list_t *out, uint64_t now)
+{
+	int finished = 0;
+
+	struct target *t = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(t, next, notifier.inflight) {
+		if (t->timeout > now) {
+			break;
+		}
+
+		if (t->attempt >= NOTIFIER_RETRIES) {
+			target_finish(t, KNOT_ETIMEOUT);
+			finished += 1;
+			continue;
+		}
+
+		t->attempt += 1;
+		rem_node(&t->n);
+		add_tail(out, &t->n);
+		__sync_add_and_fetch(&notifier.stats.retries, 1);
+	}
+
+	return finished;
+}
+
+/*! \brief Match the response, return true if it finished the message. */
+static bool process_response(uint8_t *wire, size_t len,
+                             const struct sockaddr_storage *from)
+{
+	if (len < KNOT_WIRE_HEADER_SIZE) {
+		return false;
+	}
+
+	struct target *t = notifier.ids[knot_wire_get_id(wire)];
+	if (t == NULL || sockaddr_cmp(&t->addr, from) != 0 ||
+	    !knot_wire_get_qr(wire) ||
+	    knot_wire_get_opcode(wire) != KNOT_OPCODE_NOTIFY) {
+		return false;
+	}
+
+	knot_pkt_t *pkt = knot_pkt_new(wire, len, NULL);
+	if (pkt == NULL) {
+		return false;
+	}
+
+	/* Ignore malformed or forged responses, wait for retransmission. */
+	int ret = knot_pkt_parse(pkt, 0);
+	if (ret != KNOT_EOK || !knot_dname_is_equal(knot_pkt_qname(pkt), t->zone) ||
+	    (t->tsig.key != NULL && (pkt->tsig_rr == NULL ||
+	                             tsig_verify_packet(&t->tsig, pkt) != KNOT_EOK))) {
+		knot_pkt_free(&pkt);
+		return false;
+	}
+
+	uint8_t rcode = knot_wire_get_rcode(wire);
+	knot_pkt_free(&pkt);
+
+	target_finish(t, rcode == KNOT_RCODE_NOERROR ? KNOT_EOK : KNOT_EDENIED);
+	return true;
+}
+
+/*! \brief Receive available responses on the socket. */
+static int receive(int fd)
+{
+	struct batch *b = notifier.batch;
+	for (unsigned i = 0; i < NOTIFIER_BATCH; ++i) {
+		memset(&b->msgs[i], 0, sizeof(struct mmsghdr));
+		b->iov[i].iov_base = b->buf[i];
+		b->iov[i].iov_len = NOTIFIER_RXSIZE;
+		b->msgs[i].msg_hdr.msg_name = &b->addr[i];
+		b->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int finished = 0;
+	int ret = batch_recv(fd, b->msgs, NOTIFIER_BATCH);
+	for (int i = 0; i < ret; ++i) {
+		if (process_response(b->buf[i], b->msgs[i].msg_len, &b->addr[i])) {
+			finished += 1;
+		}
+	}
+
+	return finished;
+}
+
+/*! \brief Wait for responses on all sockets. */
+static int wait_responses(int timeout)
+{
+	struct pollfd fds[notifier.nsources + 1];
+	unsigned nfds = 0;
+
+	struct source *src = NULL;
+	WALK_LIST(src, notifier.sources) {
+		fds[nfds].fd = src->fd;
+		fds[nfds].events = POLLIN;
+		fds[nfds].revents = 0;
+		nfds += 1;
+	}
+
+	if (nfds == 0) {
+		poll(NULL, 0, timeout);
+		return 0;
+	}
+
+	int finished = 0;
+	if (poll(fds, nfds, timeout) > 0) {
+		for (unsigned i = 0; i < nfds; ++i) {
+			if (fds[i].revents & POLLIN) {
+				finished += receive(fds[i].fd);
+			}
+		}
+	}
+
+	return finished;
+}
+
+int notifier_init(void)
+{
+	pthread_mutex_lock(&notifier.lock);
+
+	if (notifier.running) {
+		pthread_mutex_unlock(&notifier.lock);
+		return KNOT_EOK;
+	}
+
+	notifier.ids = calloc(UINT16_MAX + 1, sizeof(struct target *));
+	notifier.batch = malloc(sizeof(struct batch));
+	if (notifier.ids == NULL || notifier.batch == NULL) {
+		free(notifier.ids);
+		free(notifier.batch);
+		pthread_mutex_unlock(&notifier.lock);
+		return KNOT_ENOMEM;
+	}
+
+	init_list(&notifier.queue);
+	init_list(&notifier.inflight);
+	init_list(&notifier.sources);
+	notifier.queued = 0;
+	notifier.count = 0;
+	notifier.nsources = 0;
+	memset(&notifier.stats, 0, sizeof(notifier_stats_t));
+	notifier.running = true;
+
+	pthread_mutex_unlock(&notifier.lock);
+
+	return KNOT_EOK;
+}
+
+void notifier_deinit(void)
+{
+	pthread_mutex_lock(&notifier.lock);
+
+	if (!notifier.running) {
+		pthread_mutex_unlock(&notifier.lock);
+		return;
+	}
+
+	node_t *n = NULL, *nxt = NULL;
+	WALK_LIST_DELSAFE(n, nxt, notifier.queue) {
+		rem_node(n);
+	}
+
+	struct target *t = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(t, next, notifier.inflight) {
+		target_free(t);
+	}
+
+	struct source *src = NULL, *src_next = NULL;
+	WALK_LIST_DELSAFE(src, src_next, notifier.sources) {
+		close(src->fd);
+		free(src);
+	}
+
+	free(notifier.ids);
+	free(notifier.batch);
+	notifier.ids = NULL;
+	notifier.batch = NULL;
+	notifier.queued = 0;
+	notifier.count = 0;
+	notifier.nsources = 0;
+	notifier.running = false;
+
+	pthread_mutex_unlock(&notifier.lock);
+}
+
+int notifier_enqueue(zone_t *zone)
+{
+	if (zone == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	int ret = KNOT_EOK;
+
+	pthread_mutex_lock(&notifier.lock);
+	if (!notifier.running) {
+		ret = KNOT_ENOTRUNNING;
+	} else if (zone->notify_node.next != NULL) {
+		/* Already queued, the current serial is sent on dispatch. */
+		notifier.stats.coalesced += 1;
+	} else {
+		add_tail(&notifier.queue, &zone->notify_node);
+		notifier.queued += 1;
+	}
+	pthread_mutex_unlock(&notifier.lock);
+
+	return ret;
+}
+
+void notifier_cancel(zone_t *zone)
+{
+	if (zone == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&notifier.lock);
+	if (zone->notify_node.next != NULL) {
+		rem_node(&zone->notify_node);
+		notifier.queued -= 1;
+	}
+	pthread_mutex_unlock(&notifier.lock);
+}
+
+int notifier_exec(int max_wait)
+{
+	if (!notifier.running) {
+		return KNOT_ENOTRUNNING;
+	}
+
+	list_t out;
+	init_list(&out);
+
+	/* Expire unanswered messages, collect retransmissions. */
+	uint64_t now = time_now_ms();
+	int finished = expire(&out, now);
+
+	/* Take queued zones. */
+	dispatch(&out);
+
+	/* Send all messages in batches. */
+	send_all(&out, now);
+
+	/* Wait until the closest retransmission at most. */
+	int timeout = max_wait;
+	if (!EMPTY_LIST(notifier.inflight)) {
+		struct target *t = HEAD(notifier.inflight);
+		uint64_t next = t->timeout > now ? t->timeout - now : 0;
+		if (next < timeout) {
+			timeout = next;
+		}
+	}
+
+	return finished + wait_responses(timeout);
+}
+
+void notifier_stats(notifier_stats_t *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&notifier.lock);
+	*stats = notifier.stats;
+	stats->queued = notifier.queued;
+	stats->inflight = notifier.count;
+	pthread_mutex_unlock(&notifier.lock);
+}
@@ -0,0 +1,105 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*!
+ * \file notifier.h
+ *
+ * \brief Batched dispatcher of outgoing NOTIFY messages.
+ *
+ * Zones are queued for notification and coalesced, a zone queued again
+ * before its NOTIFY is sent is sent only once with the current serial, and
+ * a newer serial supersedes unanswered messages for the older one. The
+ * dispatcher sends messages to all remotes in batches over shared UDP
+ * sockets, matches the responses by message ID and retransmits unanswered
+ * messages with an exponential backoff.
+ *
+ * \addtogroup server
+ * @{
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "knot/zone/zone.h"
+
+/*! \brief Maximum number of messages sent or received at once. */
+#define NOTIFIER_BATCH 64
+/*! \brief Maximum number of unanswered messages. */
+#define NOTIFIER_WINDOW 1024
+/*! \brief Initial retransmission timeout, doubled on each retry [ms]. */
+#define NOTIFIER_TIMEOUT 1000
+/*! \brief Maximum number of retransmissions. */
+#define NOTIFIER_RETRIES 4
+
+/*! \brief Notification dispatcher statistics. */
+typedef struct notifier_stats {
+	unsigned queued;      /*!< Zones waiting for dispatch. */
+	unsigned inflight;    /*!< Unanswered messages. */
+	uint64_t sent;        /*!< Total messages sent (without retries). */
+	uint64_t retries;     /*!< Total retransmissions. */
+	uint64_t answered;    /*!< Total answered messages. */
+	uint64_t failed;      /*!< Total failed or timed out messages. */
+	uint64_t coalesced;   /*!< Total coalesced or superseded notifications. */
+} notifier_stats_t;
+
+/*!
+ * \brief Initialize the dispatcher.
+ *
+ * \return KNOT_EOK or error
+ */
+int notifier_init(void);
+
+/*!
+ * \brief Drop all queued zones and unanswered messages, close sockets.
+ */
+void notifier_deinit(void);
+
+/*!
+ * \brief Queue zone for notification of its remotes.
+ *
+ * \param zone  Zone to be notified.
+ *
+ * \retval KNOT_EOK if queued or coalesced with a queued notification.
+ * \retval KNOT_ENOTRUNNING if the dispatcher is not initialized.
+ */
+int notifier_enqueue(zone_t *zone);
+
+/*!
+ * \brief Remove zone from the queue.
+ *
+ * \note Must be called before the zone is freed.
+ */
+void notifier_cancel(zone_t *zone);
+
+/*!
+ * \brief Run one iteration of the dispatcher.
+ *
+ * Sends messages for the queued zones and retransmissions, waits for the
+ * responses up to \a max_wait and expires unanswered messages. Queued zones
+ * are coalesced in the meantime. Must be called from one thread only.
+ *
+ * \param max_wait  Maximum time to wait for responses [ms].
+ *
+ * \return Number of finished messages or error.
+ */
+int notifier_exec(int max_wait);
+
+/*!
+ * \brief Read dispatcher statistics.
+ */
+void notifier_stats(notifier_stats_t *stats);
+
+/*! @} */
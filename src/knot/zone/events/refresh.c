@@ -0,0 +1,478 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libknot/errcode.h"
+#include "libknot/dnssec/random.h"
+#include "libknot/internal/lists.h"
+#include "libknot/internal/macros.h"
+#include "knot/common/time.h"
+#include "knot/zone/events/events.h"
+#include "knot/zone/events/refresh.h"
+
+/*! \brief Budget of a single master. */
+struct master {
+	node_t n;
+	struct sockaddr_storage addr;
+	double tokens;      /*!< Available SOA queries. */
+	uint64_t updated;   /*!< Last token refill [ms]. */
+	time_t backlog_at;  /*!< Second the postponed queries are planned to. */
+	unsigned backlog;   /*!< Queries postponed to 'backlog_at'. */
+	unsigned inflight[REFRESH_OPS];
+	list_t queue;       /*!< Transfers waiting for a slot (FIFO). */
+	list_t woken;       /*!< Woken transfers with a reserved slot. */
+	unsigned reserved;  /*!< Number of woken transfers. */
+};
+
+/*! \brief Transfer waiting for a slot. */
+struct refresh_wait {
+	node_t n;
+	zone_t *zone;
+	struct master *master;
+	time_t woken;  /*!< Slot reserved at, 0 if queued. */
+};
+
+/*! \brief Global refresh scheduler state. */
+static struct {
+	pthread_mutex_t lock;
+	pthread_mutex_t wake_lock; /*!< Held while waking zones outside 'lock'. */
+	list_t masters;
+	unsigned count;
+	unsigned pending;
+	unsigned queued;
+	unsigned reserved;
+	unsigned inflight[REFRESH_OPS];
+	uint64_t deferred[REFRESH_OPS];
+} refresh = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/*! \brief Find tracked master budget. */
+static struct master *master_find(const struct sockaddr_storage *addr)
+{
+	if (refresh.masters.head == NULL) {
+		init_list(&refresh.masters);
+	}
+
+	struct master *master = NULL;
+	WALK_LIST(master, refresh.masters) {
+		if (sockaddr_cmp(&master->addr, addr) == 0) {
+			return master;
+		}
+	}
+
+	return NULL;
+}
+
+/*! \brief Find master budget, create a new one if not tracked. */
+static struct master *master_get(const struct sockaddr_storage *addr,
+                                 unsigned rate)
+{
+	struct master *master = master_find(addr);
+	if (master != NULL) {
+		return master;
+	}
+
+	master = malloc(sizeof(struct master));
+	if (master == NULL) {
+		return NULL;
+	}
+
+	memset(master, 0, sizeof(struct master));
+	memcpy(&master->addr, addr, sizeof(struct sockaddr_storage));
+	init_list(&master->queue);
+	init_list(&master->woken);
+	master->tokens = rate;
+	master->updated = time_now_ms();
+	add_tail(&refresh.masters, &master->n);
+	refresh.count += 1;
+
+	return master;
+}
+
+/*! \brief Take a token for SOA query, plan a slot for it if none available. */
+static bool query_budget(struct master *master, unsigned rate, uint32_t *delay)
+{
+	if (rate > 0) {
+		uint64_t now = time_now_ms();
+		master->tokens += (double)(now - master->updated) * rate / 1000;
+		master->tokens = MIN(master->tokens, rate);
+		master->updated = now;
+	}
+
+	if (rate == 0 || master->tokens >= 1.0) {
+		if (rate > 0) {
+			master->tokens -= 1.0;
+		}
+		return true;
+	}
+
+	/* Spread postponed queries over the next seconds at given rate. */
+	time_t now = time(NULL);
+	if (master->backlog_at <= now) {
+		master->backlog_at = now + 1;
+		master->backlog = 0;
+	}
+	*delay = master->backlog_at - now;
+	if (++master->backlog >= MAX(rate, 1)) {
+		master->backlog_at += 1;
+		master->backlog = 0;
+	}
+
+	return false;
+}
+
+/*! \brief Number of transfers in progress and reserved slots. */
+static unsigned busy_slots(void)
+{
+	return refresh.inflight[REFRESH_XFER] + refresh.reserved;
+}
+
+/*! \brief Remove waiting transfer of a zone. */
+static void wait_drop(zone_t *zone)
+{
+	struct refresh_wait *wait = zone->refresh_wait;
+	if (wait == NULL) {
+		return;
+	}
+
+	rem_node(&wait->n);
+	if (wait->woken != 0) {
+		wait->master->reserved -= 1;
+		refresh.reserved -= 1;
+	} else {
+		refresh.queued -= 1;
+	}
+
+	zone->refresh_wait = NULL;
+	free(wait);
+}
+
+/*! \brief Return woken transfer to the head of the queue, free its slot. */
+static void wait_requeue(struct refresh_wait *wait)
+{
+	rem_node(&wait->n);
+	add_head(&wait->master->queue, &wait->n);
+	wait->woken = 0;
+	wait->master->reserved -= 1;
+	refresh.reserved -= 1;
+	refresh.queued += 1;
+}
+
+/*! \brief Requeue woken transfers which didn't claim the slot in time. */
+static void master_expire(struct master *master, time_t now)
+{
+	struct refresh_wait *wait = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(wait, next, master->woken) {
+		if (wait->woken + REFRESH_XFER_DELAY <= now) {
+			wait_requeue(wait);
+		}
+	}
+}
+
+/*!
+ * \brief Wake queued transfers while there are free slots.
+ *
+ * Masters take turns, the master served last is moved to the end of the list.
+ * Woken transfers have their slot reserved until they claim it. The zones
+ * are returned in 'woken' to be scheduled once the state lock is released.
+ *
+ * \return Number of woken zones.
+ */
+static unsigned wake_queued(unsigned limit, unsigned total, zone_t ***woken)
+{
+	time_t now = time(NULL);
+	struct master *m = NULL;
+	WALK_LIST(m, refresh.masters) {
+		master_expire(m, now);
+	}
+
+	*woken = NULL;
+	if (refresh.queued == 0 || busy_slots() >= total) {
+		return 0;
+	}
+
+	/* Transfers are left queued if the wake up can't be recorded. */
+	unsigned max = MIN(refresh.queued, total - busy_slots());
+	*woken = malloc(max * sizeof(zone_t *));
+	if (*woken == NULL) {
+		return 0;
+	}
+
+	unsigned count = 0;
+	while (count < max && busy_slots() < total) {
+		struct master *found = NULL;
+		WALK_LIST(m, refresh.masters) {
+			if (!EMPTY_LIST(m->queue) &&
+			    m->inflight[REFRESH_XFER] + m->reserved < limit) {
+				found = m;
+				break;
+			}
+		}
+		if (found == NULL) {
+			break;
+		}
+
+		struct refresh_wait *wait = HEAD(found->queue);
+		rem_node(&wait->n);
+		add_tail(&found->woken, &wait->n);
+		wait->woken = now;
+		found->reserved += 1;
+		refresh.reserved += 1;
+		refresh.queued -= 1;
+
+		rem_node(&found->n);
+		add_tail(&refresh.masters, &found->n);
+
+		(*woken)[count++] = wait->zone;
+	}
+
+	return count;
+}
+
+/*!
+ * \brief Check concurrent transfers, queue the zone if over budget.
+ *
+ * Transfers to a master are admitted in the order of arrival, a zone may
+ * proceed only if no other zone is queued before it.
+ */
+static bool xfer_budget(zone_t *zone, struct master *master, unsigned limit,
+                        unsigned total, uint32_t *delay)
+{
+	master_expire(master, time(NULL));
+
+	/* Zone master has changed, start over. */
+	struct refresh_wait *wait = zone->refresh_wait;
+	if (wait != NULL && wait->master != master) {
+		wait_drop(zone);
+		wait = NULL;
+	}
+
+	bool woken = wait != NULL && wait->woken != 0;
+	bool first = woken || EMPTY_LIST(master->queue) ||
+	             (wait != NULL && HEAD(master->queue) == (void *)wait);
+	unsigned own = woken ? 1 : 0;
+
+	if (first && busy_slots() - own < total &&
+	    master->inflight[REFRESH_XFER] + master->reserved - own < limit) {
+		wait_drop(zone);
+		return true;
+	}
+
+	if (wait == NULL) {
+		wait = malloc(sizeof(struct refresh_wait));
+		if (wait != NULL) {
+			memset(wait, 0, sizeof(struct refresh_wait));
+			wait->zone = zone;
+			wait->master = master;
+			add_tail(&master->queue, &wait->n);
+			refresh.queued += 1;
+			zone->refresh_wait = wait;
+		}
+	} else if (woken) {
+		wait_requeue(wait);
+	}
+
+	/* Fallback if the wake up is missed. */
+	*delay = REFRESH_XFER_DELAY + knot_random_uint32_t() % REFRESH_XFER_DELAY;
+	return false;
+}
+
+uint32_t refresh_jitter(uint32_t interval)
+{
+	uint32_t range = interval / REFRESH_JITTER_DIV;
+	if (range == 0) {
+		return interval;
+	}
+
+	return interval - knot_random_uint32_t() % (range + 1);
+}
+
+uint32_t refresh_spread(void)
+{
+	return knot_random_uint32_t() % (REFRESH_SPREAD + 1);
+}
+
+time_t refresh_restore(time_t at)
+{
+	time_t now = time(NULL);
+	if (at <= now) {
+		return now + refresh_spread();
+	}
+
+	return now + refresh_jitter(at - now);
+}
+
+int refresh_acquire(zone_t *zone, const conf_iface_t *master, refresh_op_t op,
+                    uint32_t *delay)
+{
+	if (zone == NULL || master == NULL || op >= REFRESH_OPS || delay == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	const unsigned rate = conf()->refresh_rate;
+	const unsigned limit = conf()->master_xfers;
+	const unsigned total = conf()->xfers;
+
+	pthread_mutex_lock(&refresh.lock);
+
+	struct master *m = master_get(&master->addr, rate);
+	if (m == NULL) {
+		pthread_mutex_unlock(&refresh.lock);
+		*delay = REFRESH_XFER_DELAY;
+		return KNOT_ENOMEM;
+	}
+
+	bool granted = false;
+	if (op == REFRESH_QUERY) {
+		granted = query_budget(m, rate, delay);
+	} else {
+		granted = xfer_budget(zone, m, limit, total, delay);
+	}
+
+	if (granted) {
+		m->inflight[op] += 1;
+		refresh.inflight[op] += 1;
+		if (zone->flags & ZONE_REFRESH_WAIT) {
+			zone->flags &= ~ZONE_REFRESH_WAIT;
+			refresh.pending -= 1;
+		}
+	} else {
+		refresh.deferred[op] += 1;
+		if (!(zone->flags & ZONE_REFRESH_WAIT)) {
+			zone->flags |= ZONE_REFRESH_WAIT;
+			refresh.pending += 1;
+		}
+	}
+
+	pthread_mutex_unlock(&refresh.lock);
+
+	return granted ? KNOT_EOK : KNOT_ELIMIT;
+}
+
+void refresh_release(const conf_iface_t *master, refresh_op_t op)
+{
+	if (master == NULL || op >= REFRESH_OPS) {
+		return;
+	}
+
+	pthread_mutex_lock(&refresh.lock);
+
+	struct master *m = master_find(&master->addr);
+	if (m != NULL && m->inflight[op] > 0) {
+		m->inflight[op] -= 1;
+		refresh.inflight[op] -= 1;
+	}
+
+	/* Hand the free slot over to a queued transfer. */
+	zone_t **woken = NULL;
+	unsigned count = wake_queued(conf()->master_xfers, conf()->xfers, &woken);
+
+	/* Taken before the state lock is released, so that refresh_cancel()
+	 * waits until the woken zones are scheduled. */
+	pthread_mutex_lock(&refresh.wake_lock);
+	pthread_mutex_unlock(&refresh.lock);
+
+	for (unsigned i = 0; i < count; ++i) {
+		zone_events_schedule(woken[i], ZONE_EVENT_XFER, ZONE_EVENT_NOW);
+	}
+
+	pthread_mutex_unlock(&refresh.wake_lock);
+	free(woken);
+}
+
+void refresh_cancel(zone_t *zone)
+{
+	if (zone == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&refresh.lock);
+	if (zone->flags & ZONE_REFRESH_WAIT) {
+		zone->flags &= ~ZONE_REFRESH_WAIT;
+		refresh.pending -= 1;
+	}
+	wait_drop(zone);
+	pthread_mutex_unlock(&refresh.lock);
+
+	/* The zone may have been woken just before, wait until it's scheduled. */
+	pthread_mutex_lock(&refresh.wake_lock);
+	pthread_mutex_unlock(&refresh.wake_lock);
+}
+
+void refresh_stats(refresh_stats_t *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&refresh.lock);
+	stats->pending = refresh.pending;
+	stats->queued = refresh.queued;
+	stats->masters = refresh.count;
+	for (int op = 0; op < REFRESH_OPS; ++op) {
+		stats->inflight[op] = refresh.inflight[op];
+		stats->deferred[op] = refresh.deferred[op];
+	}
+	pthread_mutex_unlock(&refresh.lock);
+}
+
+int refresh_walk(refresh_master_cb cb, void *ctx)
+{
+	if (cb == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	int ret = KNOT_EOK;
+
+	pthread_mutex_lock(&refresh.lock);
+	if (refresh.masters.head != NULL) {
+		struct master *m = NULL;
+		WALK_LIST(m, refresh.masters) {
+			ret = cb(&m->addr, m->inflight, ctx);
+			if (ret != KNOT_EOK) {
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&refresh.lock);
+
+	return ret;
+}
+
+void refresh_deinit(void)
+{
+	pthread_mutex_lock(&refresh.lock);
+	if (refresh.masters.head != NULL) {
+		struct master *m = NULL, *next = NULL;
+		WALK_LIST_DELSAFE(m, next, refresh.masters) {
+			while (!EMPTY_LIST(m->queue)) {
+				wait_drop(((struct refresh_wait *)HEAD(m->queue))->zone);
+			}
+			while (!EMPTY_LIST(m->woken)) {
+				wait_drop(((struct refresh_wait *)HEAD(m->woken))->zone);
+			}
+			free(m);
+		}
+		init_list(&refresh.masters);
+	}
+	refresh.count = 0;
+	pthread_mutex_unlock(&refresh.lock);
+}
@@ -0,0 +1,139 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*!
+ * \file refresh.h
+ *
+ * \brief Rate control of outgoing SOA queries and zone transfers.
+ *
+ * Slave zones ask for a budget before contacting their master. Each master
+ * has a token bucket limiting the SOA queries per second and a cap on the
+ * concurrently running transfers, the transfers are also capped by the global
+ * 'transfers' limit. SOA queries are cheap and asynchronous, they are not
+ * counted against the global limit, so that the refreshes aren't starved by
+ * long running transfers. Operations over budget are postponed, the
+ * postponed SOA queries are spread over the following seconds at the
+ * configured rate. Postponed transfers wait in a FIFO queue of their master
+ * and are woken as soon as a slot is released, masters take turns in
+ * getting the free slots.
+ *
+ * SOA queries are not batched, each is a separate request. Consecutive
+ * queries to the same master reuse the pooled connections (see conn_pool.h).
+ *
+ * \addtogroup server
+ * @{
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include "knot/conf/conf.h"
+#include "knot/zone/zone.h"
+
+/*! \brief Window for spreading refreshes planned on zone load [s]. */
+#define REFRESH_SPREAD 60
+/*! \brief Refresh interval may be shortened by up to 1/REFRESH_JITTER_DIV. */
+#define REFRESH_JITTER_DIV 10
+/*! \brief Base delay of a transfer postponed due to full budget, also the
+ *         time a woken transfer has to claim its slot [s]. */
+#define REFRESH_XFER_DELAY 5
+
+/*! \brief Rate-controlled operation types. */
+typedef enum refresh_op {
+	REFRESH_QUERY = 0, /*!< SOA query. */
+	REFRESH_XFER,      /*!< Zone transfer. */
+	REFRESH_OPS
+} refresh_op_t;
+
+/*! \brief Refresh scheduler statistics. */
+typedef struct refresh_stats {
+	unsigned pending;              /*!< Zones postponed, waiting for budget. */
+	unsigned queued;               /*!< Transfers queued for a free slot. */
+	unsigned inflight[REFRESH_OPS]; /*!< Operations in progress. */
+	uint64_t deferred[REFRESH_OPS]; /*!< Total number of postponements. */
+	unsigned masters;              /*!< Number of tracked masters. */
+} refresh_stats_t;
+
+/*! \brief Callback for walking tracked masters. */
+typedef int (*refresh_master_cb)(const struct sockaddr_storage *addr,
+                                 const unsigned *inflight, void *ctx);
+
+/*!
+ * \brief Randomly shorten the refresh or retry interval.
+ *
+ * \param interval  Interval from the SOA record [s].
+ *
+ * \return Interval shortened by up to 1/REFRESH_JITTER_DIV.
+ */
+uint32_t refresh_jitter(uint32_t interval);
+
+/*!
+ * \brief Return random delay for a refresh planned on zone load.
+ */
+uint32_t refresh_spread(void);
+
+/*!
+ * \brief Spread a refresh time read from the persistent timers.
+ *
+ * Timers already expired are spread over REFRESH_SPREAD from now, timers in
+ * the future are jittered like the SOA intervals.
+ */
+time_t refresh_restore(time_t at);
+
+/*!
+ * \brief Ask for a budget to contact zone master.
+ *
+ * \param zone    Zone to be refreshed.
+ * \param master  Zone master.
+ * \param op      Requested operation.
+ * \param delay   Suggested delay of the operation if over budget [s].
+ *
+ * \retval KNOT_EOK if the operation may proceed, release it when finished.
+ * \retval KNOT_ELIMIT if the operation must be postponed by \a delay. A queued
+ *         transfer is scheduled earlier when its slot is free.
+ */
+int refresh_acquire(zone_t *zone, const conf_iface_t *master, refresh_op_t op,
+                    uint32_t *delay);
+
+/*!
+ * \brief Return a budget acquired with refresh_acquire().
+ */
+void refresh_release(const conf_iface_t *master, refresh_op_t op);
+
+/*!
+ * \brief Forget postponed operation and queued transfer of a zone being freed.
+ */
+void refresh_cancel(zone_t *zone);
+
+/*!
+ * \brief Get refresh scheduler statistics.
+ */
+void refresh_stats(refresh_stats_t *stats);
+
+/*!
+ * \brief Walk tracked masters with their operations in progress.
+ *
+ * \return Error code of the callback, KNOT_EOK if all masters were visited.
+ */
+int refresh_walk(refresh_master_cb cb, void *ctx);
+
+/*!
+ * \brief Free tracked masters.
+ */
+void refresh_deinit(void);
+
+/*! @} */
@@ -18,6 +18,7 @@
 
 #include "knot/zone/events/replan.h"
 #include "knot/zone/events/handlers.h"
+#include "knot/zone/events/refresh.h"
 #include "knot/zone/zone.h"
 #include "libknot/internal/macros.h"
 
@@ -50,7 +51,8 @@ static void replan_soa_events(zone_t *zone, const zone_t *old_zone)
 			const knot_rdataset_t *soa = node_rdataset(zone->contents->apex,
 			                                           KNOT_RRTYPE_SOA);
 			assert(soa);
-			zone_events_schedule(zone, ZONE_EVENT_REFRESH, knot_soa_refresh(soa));
+			zone_events_schedule(zone, ZONE_EVENT_REFRESH,
+			                     refresh_jitter(knot_soa_refresh(soa)));
 		}
 	}
 }
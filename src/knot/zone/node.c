@@ -29,7 +29,7 @@
 static void rr_data_clear(struct rr_data *data, mm_ctx_t *mm)
 {
 	knot_rdataset_clear(&data->rrs, mm);
-	free(data->additional);
+	mm_free(mm, data->additional);
 }
 
 /*! \brief Clears allocated data in RRSet entry. */
@@ -47,7 +47,7 @@ static int rr_data_from(const knot_rrset_t *rrset, struct rr_data *data, mm_ctx_
 
 /*! \brief Adds RRSet to node directly. */
 static int add_rrset_no_merge(zone_node_t *node, const knot_rrset_t *rrset,
-                              mm_ctx_t *mm)
+                              mm_ctx_t *mm, mm_ctx_t *data_mm)
 {
 	if (node == NULL) {
 		return KNOT_EINVAL;
@@ -60,7 +60,7 @@ static int add_rrset_no_merge(zone_node_t *node, const knot_rrset_t *rrset,
 		return KNOT_ENOMEM;
 	}
 	node->rrs = p;
-	int ret = rr_data_from(rrset, node->rrs + node->rrset_count, mm);
+	int ret = rr_data_from(rrset, node->rrs + node->rrset_count, data_mm);
 	if (ret != KNOT_EOK) {
 		return ret;
 	}
@@ -113,7 +113,7 @@ void node_free_rrsets(zone_node_t *node, mm_ctx_t *mm)
 	}
 
 	for (uint16_t i = 0; i < node->rrset_count; ++i) {
-		rr_data_clear(&node->rrs[i], NULL);
+		rr_data_clear(&node->rrs[i], mm);
 	}
 
 	node->rrset_count = 0;
@@ -167,7 +167,34 @@ zone_node_t *node_shallow_copy(const zone_node_t *src, mm_ctx_t *mm)
 	return dst;
 }
 
+zone_node_t *node_copy(const zone_node_t *src, mm_ctx_t *mm)
+{
+	zone_node_t *dst = node_shallow_copy(src, mm);
+	if (dst == NULL) {
+		return NULL;
+	}
+
+	// copy RR data
+	for (uint16_t i = 0; i < src->rrset_count; ++i) {
+		int ret = knot_rdataset_copy(&dst->rrs[i].rrs, &src->rrs[i].rrs, mm);
+		if (ret != KNOT_EOK) {
+			dst->rrset_count = i;
+			node_free_rrsets(dst, mm);
+			node_free(&dst, mm);
+			return NULL;
+		}
+	}
+
+	return dst;
+}
+
 int node_add_rrset(zone_node_t *node, const knot_rrset_t *rrset, mm_ctx_t *mm)
+{
+	return node_add_rrset_data(node, rrset, mm, mm);
+}
+
+int node_add_rrset_data(zone_node_t *node, const knot_rrset_t *rrset,
+                        mm_ctx_t *mm, mm_ctx_t *data_mm)
 {
 	if (node == NULL || rrset == NULL) {
 		return KNOT_EINVAL;
@@ -178,7 +205,7 @@ int node_add_rrset(zone_node_t *node, const knot_rrset_t *rrset, mm_ctx_t *mm)
 			struct rr_data *node_data = &node->rrs[i];
 			const bool ttl_err = ttl_error(node_data, rrset);
 			int ret = knot_rdataset_merge(&node_data->rrs,
-			                              &rrset->rrs, mm);
+			                              &rrset->rrs, data_mm);
 			if (ret != KNOT_EOK) {
 				return ret;
 			} else {
@@ -188,7 +215,7 @@ int node_add_rrset(zone_node_t *node, const knot_rrset_t *rrset, mm_ctx_t *mm)
 	}
 
 	// New RRSet (with one RR)
-	return add_rrset_no_merge(node, rrset, mm);
+	return add_rrset_no_merge(node, rrset, mm, data_mm);
 }
 
 void node_remove_rdataset(zone_node_t *node, uint16_t type)
@@ -122,6 +122,16 @@ void node_free(zone_node_t **node, mm_ctx_t *mm);
  */
 zone_node_t *node_shallow_copy(const zone_node_t *src, mm_ctx_t *mm);
 
+/*!
+ * \brief Creates a copy of node structure including the RR data.
+ *
+ * \param src  Source of the copy.
+ * \param mm   Memory context to use.
+ *
+ * \return Copied node if success, NULL otherwise.
+ */
+zone_node_t *node_copy(const zone_node_t *src, mm_ctx_t *mm);
+
 /* ----------------------- Data addition/removal -----------------------------*/
 
 /*!
@@ -135,6 +145,19 @@ zone_node_t *node_shallow_copy(const zone_node_t *src, mm_ctx_t *mm);
  */
 int node_add_rrset(zone_node_t *node, const knot_rrset_t *rrset, mm_ctx_t *mm);
 
+/*!
+ * \brief Adds an RRSet to the node, the RR data are allocated separately.
+ *
+ * \param node     Node to add the RRSet to.
+ * \param rrset    RRSet to add.
+ * \param mm       Memory context for the node structures.
+ * \param data_mm  Memory context for the RR data.
+ *
+ * \return KNOT_E*
+ */
+int node_add_rrset_data(zone_node_t *node, const knot_rrset_t *rrset,
+                        mm_ctx_t *mm, mm_ctx_t *data_mm);
+
 /*!
  * \brief Removes data for given RR type from node.
  *
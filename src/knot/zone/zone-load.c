@@ -118,7 +118,6 @@ int zone_load_journal(zone_t *zone, zone_contents_t *contents)
 	              serial, zone_contents_serial(contents),
 	              knot_strerror(ret));
 
-	updates_cleanup(&chgs);
 	changesets_free(&chgs);
 	return ret;
 }
@@ -150,7 +149,6 @@ int zone_load_post(zone_contents_t *contents, zone_t *zone, uint32_t *dnssec_ref
 		/* Apply DNSSEC changes. */
 		if (!changeset_empty(&change)) {
 			ret = apply_changeset_directly(contents, &change);
-			update_cleanup(&change);
 			if (ret != KNOT_EOK) {
 				changeset_clear(&change);
 				return ret;
@@ -0,0 +1,288 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "knot/zone/zone-stats.h"
+#include "knot/zone/zone.h"
+#include "libknot/descriptor.h"
+#include "libknot/dname.h"
+#include "libknot/errcode.h"
+
+const uint16_t zone_stats_qtypes[ZONE_STATS_QTYPES - 1] = {
+	KNOT_RRTYPE_A,
+	KNOT_RRTYPE_AAAA,
+	KNOT_RRTYPE_NS,
+	KNOT_RRTYPE_CNAME,
+	KNOT_RRTYPE_SOA,
+	KNOT_RRTYPE_PTR,
+	KNOT_RRTYPE_MX,
+	KNOT_RRTYPE_TXT,
+	KNOT_RRTYPE_SRV,
+	KNOT_RRTYPE_DS,
+	KNOT_RRTYPE_DNSKEY,
+	KNOT_RRTYPE_ANY
+};
+
+static const char *rcode_names[ZONE_STATS_RCODES] = {
+	"NOERROR", "NXDOMAIN", "REFUSED", "SERVFAIL", "other"
+};
+
+static unsigned qtype_index(uint16_t qtype)
+{
+	for (unsigned i = 0; i < ZONE_STATS_QTYPES - 1; ++i) {
+		if (zone_stats_qtypes[i] == qtype) {
+			return i;
+		}
+	}
+
+	return ZONE_STATS_QTYPES - 1;
+}
+
+static unsigned rcode_index(uint16_t rcode)
+{
+	switch (rcode) {
+	case KNOT_RCODE_NOERROR:  return ZONE_STATS_NOERROR;
+	case KNOT_RCODE_NXDOMAIN: return ZONE_STATS_NXDOMAIN;
+	case KNOT_RCODE_REFUSED:  return ZONE_STATS_REFUSED;
+	case KNOT_RCODE_SERVFAIL: return ZONE_STATS_SERVFAIL;
+	default:                  return ZONE_STATS_RCODE_OTHER;
+	}
+}
+
+zone_stats_t *zone_stats_get(zone_t *zone)
+{
+	if (zone == NULL) {
+		return NULL;
+	}
+
+	zone_stats_t *stats = zone->stats;
+	if (stats != NULL) {
+		return stats;
+	}
+
+	void *mem = NULL;
+	if (posix_memalign(&mem, 64, sizeof(zone_stats_t)) != 0) {
+		return NULL;
+	}
+
+	stats = mem;
+	memset(stats, 0, sizeof(zone_stats_t));
+	stats->since = time(NULL);
+	pthread_mutex_init(&stats->top_lock, NULL);
+
+	/* Another thread may have been faster. */
+	if (!__sync_bool_compare_and_swap(&zone->stats, NULL, stats)) {
+		zone_stats_free(stats);
+		stats = zone->stats;
+	}
+
+	return stats;
+}
+
+void zone_stats_free(zone_stats_t *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+
+	pthread_mutex_destroy(&stats->top_lock);
+	free(stats);
+}
+
+/*! \brief Count sampled QNAME using the space-saving algorithm. */
+static void top_sample(zone_stats_t *stats, const knot_dname_t *qname)
+{
+	uint8_t name[KNOT_DNAME_MAXLEN];
+	if (knot_dname_to_wire(name, qname, sizeof(name)) < 0) {
+		return;
+	}
+	knot_dname_to_lower(name);
+
+	/* Skip the sample rather than wait for another thread. */
+	if (pthread_mutex_trylock(&stats->top_lock) != 0) {
+		return;
+	}
+
+	zone_stats_name_t *min = &stats->top[0];
+	for (unsigned i = 0; i < ZONE_STATS_TOPK; ++i) {
+		zone_stats_name_t *entry = &stats->top[i];
+		if (entry->count > 0 && knot_dname_is_equal(entry->name, name)) {
+			entry->count += 1;
+			pthread_mutex_unlock(&stats->top_lock);
+			return;
+		}
+		if (entry->count < min->count) {
+			min = entry;
+		}
+	}
+
+	/* Replace the least frequent name, inherit its count as the error. */
+	memcpy(min->name, name, knot_dname_size(name));
+	min->error = min->count;
+	min->count += 1;
+
+	pthread_mutex_unlock(&stats->top_lock);
+}
+
+void zone_stats_query(zone_stats_t *stats, unsigned thread_id,
+                      const knot_pkt_t *query, uint16_t rcode)
+{
+	if (stats == NULL || query == NULL) {
+		return;
+	}
+
+	zone_stats_shard_t *shard = &stats->shard[thread_id % ZONE_STATS_SHARDS];
+	uint64_t queries = __sync_add_and_fetch(&shard->queries, 1);
+	__sync_fetch_and_add(&shard->rcode[rcode_index(rcode)], 1);
+
+	const knot_dname_t *qname = knot_pkt_qname(query);
+	if (qname == NULL) {
+		return;
+	}
+
+	__sync_fetch_and_add(&shard->qtype[qtype_index(knot_pkt_qtype(query))], 1);
+
+	if (queries % ZONE_STATS_SAMPLE == 0) {
+		top_sample(stats, qname);
+	}
+}
+
+void zone_stats_sum(const zone_stats_t *stats, zone_stats_shard_t *sum)
+{
+	if (stats == NULL || sum == NULL) {
+		return;
+	}
+
+	memset(sum, 0, sizeof(zone_stats_shard_t));
+	for (unsigned i = 0; i < ZONE_STATS_SHARDS; ++i) {
+		const zone_stats_shard_t *shard = &stats->shard[i];
+		sum->queries += shard->queries;
+		for (unsigned j = 0; j < ZONE_STATS_RCODES; ++j) {
+			sum->rcode[j] += shard->rcode[j];
+		}
+		for (unsigned j = 0; j < ZONE_STATS_QTYPES; ++j) {
+			sum->qtype[j] += shard->qtype[j];
+		}
+	}
+}
+
+/*! \brief Output buffer. */
+struct outbuf {
+	char *buf;
+	size_t len;
+	size_t maxlen;
+	bool full;
+};
+
+static void out_printf(struct outbuf *out, const char *fmt, ...)
+{
+	if (out->full) {
+		return;
+	}
+
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(out->buf + out->len, out->maxlen - out->len, fmt, ap);
+	va_end(ap);
+
+	if (n < 0 || n >= out->maxlen - out->len) {
+		out->full = true;
+	} else {
+		out->len += n;
+	}
+}
+
+static int top_cmp(const void *a, const void *b)
+{
+	const zone_stats_name_t *x = a, *y = b;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+static void print_top(struct outbuf *out, zone_stats_t *stats)
+{
+	zone_stats_name_t top[ZONE_STATS_TOPK];
+	pthread_mutex_lock(&stats->top_lock);
+	memcpy(top, stats->top, sizeof(top));
+	pthread_mutex_unlock(&stats->top_lock);
+
+	qsort(top, ZONE_STATS_TOPK, sizeof(zone_stats_name_t), top_cmp);
+
+	out_printf(out, " | top:");
+	for (unsigned i = 0; i < ZONE_STATS_TOPK && top[i].count > 0; ++i) {
+		char name[KNOT_DNAME_MAXLEN] = { '\0' };
+		knot_dname_to_str(name, top[i].name, sizeof(name));
+		out_printf(out, " %s~%"PRIu64, name,
+		           (uint64_t)top[i].count * ZONE_STATS_SAMPLE);
+	}
+}
+
+int zone_stats_print(const zone_t *zone, char *buf, size_t buflen)
+{
+	if (zone == NULL || buf == NULL || buflen == 0) {
+		return KNOT_EINVAL;
+	}
+
+	zone_stats_t *stats = zone->stats;
+	if (stats == NULL) {
+		return 0;
+	}
+
+	zone_stats_shard_t sum;
+	zone_stats_sum(stats, &sum);
+
+	time_t elapsed = time(NULL) - stats->since;
+	if (elapsed < 1) {
+		elapsed = 1;
+	}
+
+	char zname[KNOT_DNAME_MAXLEN] = { '\0' };
+	knot_dname_to_str(zname, zone->name, sizeof(zname));
+
+	struct outbuf out = { buf, 0, buflen, false };
+	out_printf(&out, "%s\tqueries=%"PRIu64" qps=%.1f |", zname, sum.queries,
+	           (double)sum.queries / elapsed);
+	for (unsigned i = 0; i < ZONE_STATS_RCODES; ++i) {
+		if (sum.rcode[i] > 0) {
+			out_printf(&out, " %s=%"PRIu64, rcode_names[i], sum.rcode[i]);
+		}
+	}
+	out_printf(&out, " nxdomain-rate=%.1f%% | qtype:", sum.queries > 0 ?
+	           100.0 * sum.rcode[ZONE_STATS_NXDOMAIN] / sum.queries : 0.0);
+	for (unsigned i = 0; i < ZONE_STATS_QTYPES; ++i) {
+		if (sum.qtype[i] == 0) {
+			continue;
+		}
+		char type[16] = "other";
+		if (i < ZONE_STATS_QTYPES - 1) {
+			knot_rrtype_to_string(zone_stats_qtypes[i], type, sizeof(type));
+		}
+		out_printf(&out, " %s=%"PRIu64, type, sum.qtype[i]);
+	}
+	print_top(&out, stats);
+	out_printf(&out, "\n");
+
+	if (out.full) {
+		return KNOT_ESPACE;
+	}
+
+	return out.len;
+}
@@ -0,0 +1,128 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*!
+ * \file zone-stats.h
+ *
+ * \brief Per-zone query statistics.
+ *
+ * The counters are allocated on the first query to the zone, so that idle
+ * zones cost only a pointer. Threads are spread over a few cache-line
+ * aligned shards to avoid bouncing a single line between all of them.
+ * The most frequent QNAMEs are estimated from sampled queries with the
+ * space-saving algorithm.
+ *
+ * \addtogroup libknot
+ * @{
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libknot/consts.h"
+#include "libknot/packet/pkt.h"
+
+struct zone;
+
+/*! \brief Number of counter shards per zone. */
+#define ZONE_STATS_SHARDS 4
+/*! \brief One of this many queries is sampled for the top QNAMEs. */
+#define ZONE_STATS_SAMPLE 16
+/*! \brief Number of tracked top QNAMEs. */
+#define ZONE_STATS_TOPK 8
+
+/*! \brief Tracked response codes. */
+enum zone_stats_rcode {
+	ZONE_STATS_NOERROR = 0,
+	ZONE_STATS_NXDOMAIN,
+	ZONE_STATS_REFUSED,
+	ZONE_STATS_SERVFAIL,
+	ZONE_STATS_RCODE_OTHER,
+	ZONE_STATS_RCODES
+};
+
+/*! \brief Tracked query types, see zone_stats_qtypes. */
+#define ZONE_STATS_QTYPES 13
+
+/*! \brief Query types counted separately, the rest is counted as other. */
+extern const uint16_t zone_stats_qtypes[ZONE_STATS_QTYPES - 1];
+
+/*! \brief Counters shard. */
+typedef struct zone_stats_shard {
+	uint64_t queries;
+	uint64_t rcode[ZONE_STATS_RCODES];
+	uint64_t qtype[ZONE_STATS_QTYPES];
+} __attribute__((aligned(64))) zone_stats_shard_t;
+
+/*! \brief Sampled QNAME. */
+typedef struct zone_stats_name {
+	uint8_t name[KNOT_DNAME_MAXLEN]; /*!< Lowercased QNAME. */
+	uint32_t count;                  /*!< Sampled occurences (upper bound). */
+	uint32_t error;                  /*!< Maximum overestimation. */
+} zone_stats_name_t;
+
+/*! \brief Zone statistics. */
+typedef struct zone_stats {
+	zone_stats_shard_t shard[ZONE_STATS_SHARDS];
+	time_t since;                       /*!< Time of the first query. */
+	pthread_mutex_t top_lock;
+	zone_stats_name_t top[ZONE_STATS_TOPK];
+} zone_stats_t;
+
+/*!
+ * \brief Return zone statistics, allocate them on first use.
+ *
+ * \return Zone statistics or NULL if out of memory.
+ */
+zone_stats_t *zone_stats_get(struct zone *zone);
+
+/*!
+ * \brief Free zone statistics.
+ */
+void zone_stats_free(zone_stats_t *stats);
+
+/*!
+ * \brief Count query answered from the zone.
+ *
+ * \param stats      Zone statistics.
+ * \param thread_id  Calling thread identifier (shard selector).
+ * \param query      Processed query.
+ * \param rcode      Response code.
+ */
+void zone_stats_query(zone_stats_t *stats, unsigned thread_id,
+                      const knot_pkt_t *query, uint16_t rcode);
+
+/*!
+ * \brief Sum counters of all shards.
+ */
+void zone_stats_sum(const zone_stats_t *stats, zone_stats_shard_t *sum);
+
+/*!
+ * \brief Print zone statistics as a single line.
+ *
+ * \param zone    Zone.
+ * \param buf     Output buffer.
+ * \param buflen  Output buffer size.
+ *
+ * \retval Printed length.
+ * \retval 0 if the zone wasn't queried.
+ * \retval KNOT_ESPACE if the buffer is too small.
+ */
+int zone_stats_print(const struct zone *zone, char *buf, size_t buflen);
+
+/*! @} */
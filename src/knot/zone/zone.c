@@ -26,7 +26,10 @@
 #include "knot/zone/node.h"
 #include "knot/zone/zone.h"
 #include "knot/zone/zonefile.h"
+#include "knot/zone/zone-stats.h"
 #include "knot/zone/contents.h"
+#include "knot/zone/events/notifier.h"
+#include "knot/zone/events/refresh.h"
 #include "knot/updates/apply.h"
 #include "libknot/processing/requestor.h"
 #include "knot/nameserver/process_query.h"
@@ -92,6 +95,9 @@ void zone_free(zone_t **zone_ptr)
 
 	zone_t *zone = *zone_ptr;
 
+	/* Woken refreshes and notifications schedule the zone events. */
+	refresh_cancel(zone);
+	notifier_cancel(zone);
 	zone_events_deinit(zone);
 
 	knot_dname_free(&zone->name, NULL);
@@ -106,6 +112,8 @@ void zone_free(zone_t **zone_ptr)
 	/* Free zone contents. */
 	zone_contents_deep_free(&zone->contents);
 
+	zone_stats_free(zone->stats);
+
 	free(zone);
 	*zone_ptr = NULL;
 }
@@ -157,6 +165,73 @@ int zone_changes_store(zone_t *zone, list_t *chgs)
 	return ret;
 }
 
+/*! \brief Registered zone hook. */
+struct zone_hook_entry {
+	struct zone_hook_entry *next;
+	zone_hook_t hook;
+	void *data;
+};
+
+/*! \brief Zone hooks, the lock is held for reading while they run. */
+static struct zone_hook_entry *zone_hooks = NULL;
+static pthread_rwlock_t zone_hooks_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+int zone_hook_add(zone_hook_t hook, void *data)
+{
+	if (hook == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	struct zone_hook_entry *entry = malloc(sizeof(struct zone_hook_entry));
+	if (entry == NULL) {
+		return KNOT_ENOMEM;
+	}
+	entry->hook = hook;
+	entry->data = data;
+
+	pthread_rwlock_wrlock(&zone_hooks_lock);
+	entry->next = zone_hooks;
+	zone_hooks = entry;
+	pthread_rwlock_unlock(&zone_hooks_lock);
+
+	return KNOT_EOK;
+}
+
+void zone_hook_remove(zone_hook_t hook, void *data)
+{
+	pthread_rwlock_wrlock(&zone_hooks_lock);
+	struct zone_hook_entry **pos = &zone_hooks;
+	while (*pos != NULL) {
+		struct zone_hook_entry *entry = *pos;
+		if (entry->hook == hook && entry->data == data) {
+			*pos = entry->next;
+			free(entry);
+			break;
+		}
+		pos = &entry->next;
+	}
+	pthread_rwlock_unlock(&zone_hooks_lock);
+}
+
+static void zone_hooks_call(zone_t *zone, const zone_contents_t *contents)
+{
+	pthread_rwlock_rdlock(&zone_hooks_lock);
+	for (struct zone_hook_entry *entry = zone_hooks; entry != NULL;
+	     entry = entry->next) {
+		entry->hook(zone, contents, entry->data);
+	}
+	pthread_rwlock_unlock(&zone_hooks_lock);
+}
+
+void zone_hooks_run(zone_t *zone)
+{
+	if (zone == NULL) {
+		return;
+	}
+
+	zone_hooks_call(zone, zone->contents);
+}
+
 zone_contents_t *zone_switch_contents(zone_t *zone, zone_contents_t *new_contents)
 {
 	if (zone == NULL) {
@@ -167,6 +242,8 @@ zone_contents_t *zone_switch_contents(zone_t *zone, zone_contents_t *new_content
 	zone_contents_t **current_contents = &zone->contents;
 	old_contents = rcu_xchg_pointer(current_contents, new_contents);
 
+	zone_hooks_call(zone, new_contents);
+
 	return old_contents;
 }
 
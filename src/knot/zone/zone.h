@@ -38,13 +38,16 @@
 #include "libknot/dname.h"
 
 struct process_query_param;
+struct refresh_wait;
+struct zone_stats;
 
 /*!
  * \brief Zone flags.
  */
 typedef enum zone_flag_t {
 	ZONE_FORCE_AXFR   = 1 << 0, /* Force AXFR as next transfer. */
-	ZONE_FORCE_RESIGN = 1 << 1  /* Force zone resign. */
+	ZONE_FORCE_RESIGN = 1 << 1, /* Force zone resign. */
+	ZONE_REFRESH_WAIT = 1 << 2  /* Refresh postponed, waiting for budget. */
 } zone_flag_t;
 
 /*!
@@ -71,6 +74,15 @@ typedef struct zone
 	time_t zonefile_mtime;
 	uint32_t zonefile_serial;
 
+	/*! \brief Node in the NOTIFY dispatcher queue. */
+	node_t notify_node;
+
+	/*! \brief Place in the transfer queue of its master. */
+	struct refresh_wait *refresh_wait;
+
+	/*! \brief Query statistics, allocated on the first query. */
+	struct zone_stats *stats;
+
 } zone_t;
 
 /*----------------------------------------------------------------------------*/
@@ -102,10 +114,31 @@ int zone_changes_store(zone_t *zone, list_t *chgs);
 int zone_change_store(zone_t *zone, changeset_t *change);
 /*!
  * \brief Atomically switch the content of the zone.
+ *
+ * \note Runs the zone hooks with the new contents.
  */
 zone_contents_t *zone_switch_contents(zone_t *zone,
 					   zone_contents_t *new_contents);
 
+/*!
+ * \brief Zone hook prototype, called when the zone gets new contents.
+ *
+ * Hooks run in the thread that published the contents (zone events,
+ * transfers, zone database reload), never in the query processing threads,
+ * so they may do expensive work. Contents is NULL if the zone expired.
+ */
+typedef void (*zone_hook_t)(zone_t *zone, const zone_contents_t *contents,
+                            void *data);
+
+/*! \brief Register zone hook. */
+int zone_hook_add(zone_hook_t hook, void *data);
+
+/*! \brief Unregister zone hook, waits for the running hooks to finish. */
+void zone_hook_remove(zone_hook_t hook, void *data);
+
+/*! \brief Run the zone hooks for the current contents of the zone. */
+void zone_hooks_run(zone_t *zone);
+
 /*! \brief Return zone master remote. */
 const conf_iface_t *zone_master(const zone_t *zone);
 
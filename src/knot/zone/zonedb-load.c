@@ -25,6 +25,7 @@
 #include "knot/zone/zonefile.h"
 #include "knot/zone/zonedb.h"
 #include "knot/zone/timers.h"
+#include "knot/zone/events/refresh.h"
 #include "knot/server/server.h"
 #include "libknot/dname.h"
 
@@ -121,7 +122,7 @@ static zone_t *create_zone_from(conf_zone_t *zone_conf, server_t *server)
 	}
 
 	int result = zone_events_setup(zone, server->workers, &server->sched,
-	                               server->timers_db);
+	                               &server->requestor, server->timers_db);
 	if (result != KNOT_EOK) {
 		zone->conf = NULL;
 		zone_free(&zone);
@@ -139,6 +140,7 @@ static zone_t *create_zone_reload(conf_zone_t *zone_conf, server_t *server,
 		return NULL;
 	}
 	zone->contents = old_zone->contents;
+	zone->stats = old_zone->stats;
 	
 	const zone_status_t zstatus = zone_file_status(old_zone, zone_conf);
 	
@@ -180,6 +182,11 @@ static void reuse_events(zone_t *zone, const time_t *timers)
 			// Slave-only event.
 			continue;
 		}
+		if (event == ZONE_EVENT_REFRESH) {
+			// Don't let restored refreshes fire at once.
+			zone_events_schedule_at(zone, event, refresh_restore(timers[event]));
+			continue;
+		}
 		
 		zone_events_schedule_at(zone, event, timers[event]);
 	}
@@ -224,8 +231,8 @@ static zone_t *create_zone_new(conf_zone_t *zone_conf, server_t *server)
 		break;
 	case ZONE_STATUS_BOOSTRAP:
 		if (timers[ZONE_EVENT_REFRESH] == 0) {
-			// Plan immediate refresh if not already planned.
-			zone_events_schedule(zone, ZONE_EVENT_REFRESH, ZONE_EVENT_NOW);
+			// Plan refresh soon if not already planned.
+			zone_events_schedule(zone, ZONE_EVENT_REFRESH, refresh_spread());
 		}
 		break;
 	case ZONE_STATUS_NOT_FOUND:
@@ -310,8 +317,8 @@ static knot_zonedb_t *create_zonedb(const conf_t *conf, server_t *server)
 /*!
  * \brief Schedule deletion of old zones, and free the zone db structure.
  *
- * \note Zone content may be preserved in the new zone database, in this case
- *       new and old zone share the contents. Shared content is not freed.
+ * \note Zone content and statistics may be preserved in the new zone database,
+ *       in this case new and old zone share them. Shared data are not freed.
  *
  * \param db_new New zone database.
  * \param db_old Old zone database.
@@ -331,6 +338,7 @@ static int remove_old_zonedb(const knot_zonedb_t *db_new, knot_zonedb_t *db_old)
 
 		if (old_zone) {
 			old_zone->contents = NULL;
+			old_zone->stats = NULL;
 		}
 
 		knot_zonedb_iter_next(&it);
@@ -373,6 +381,9 @@ int zonedb_reload(const conf_t *conf, struct server *server)
 	/* Sweep the timer database. */
 	sweep_timer_db(server->timers_db, db_new);
 
+	/* Zones keeping their contents are published again. */
+	knot_zonedb_foreach(db_new, zone_hooks_run);
+
 	/*
 	 * Remove all zones present in the new DB from the old DB.
 	 * No new thread can access these zones in the old DB, as the
@@ -37,6 +37,7 @@
 #include "libknot/rdata.h"
 #include "knot/zone/zone-dump.h"
 #include "libknot/rrtype/naptr.h"
+#include "libknot/rrtype/rrsig.h"
 
 #define ERROR(zone, fmt...) log_zone_error(zone, "zone loader, " fmt)
 #define WARNING(zone, fmt...) log_zone_warning(zone, "zone loader, " fmt)
@@ -144,6 +145,229 @@ int zcreator_step(zcreator_t *zc, const knot_rrset_t *rr)
 	return sem_fatal_error ? KNOT_ESEMCHECK : KNOT_EOK;
 }
 
+/*! \brief Checks node semantics after insertion of records. */
+static int zbuilder_check_node(zbuilder_t *zb, const zone_node_t *node)
+{
+	if (node == NULL) {
+		return KNOT_EOK;
+	}
+
+	err_handler_t err_handler;
+	err_handler_init(&err_handler);
+	bool sem_fatal_error = false;
+
+	int ret = sem_check_node_plain(zb->zc.z, node, &err_handler, true,
+	                               &sem_fatal_error);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return sem_fatal_error ? KNOT_ESEMCHECK : KNOT_EOK;
+}
+
+/*! \brief Inserts pending RRSets of the current owner into the zone. */
+static int zbuilder_flush(zbuilder_t *zb)
+{
+	zcreator_t *zc = &zb->zc;
+	zone_node_t *node = NULL;
+	zone_node_t *nsec3_node = NULL;
+
+	for (uint16_t i = 0; i < zb->count; ++i) {
+		struct zbuilder_rrset *pending = &zb->rrsets[i];
+		if (pending->rr_count == 0) {
+			continue;
+		}
+
+		knot_rrset_t rr;
+		knot_rrset_init(&rr, zb->owner, pending->type, zb->rclass);
+		rr.rrs.rr_count = pending->rr_count;
+		rr.rrs.data = pending->data;
+
+		/* NSEC3-related records live in a separate tree. */
+		bool nsec3 = pending->type == KNOT_RRTYPE_NSEC3 ||
+		             (pending->type == KNOT_RRTYPE_RRSIG &&
+		              knot_rrsig_type_covered(&rr.rrs, 0) == KNOT_RRTYPE_NSEC3);
+		zone_node_t **n = nsec3 ? &nsec3_node : &node;
+
+		int ret = zone_contents_add_rr(zc->z, &rr, n);
+		if (ret == KNOT_EOK && pending->ttl_err) {
+			ret = KNOT_ETTL;
+		}
+		pending->rr_count = 0;
+		pending->size = 0;
+		pending->ttl_err = false;
+		if (ret != KNOT_EOK) {
+			if (!handle_err(zc, *n, &rr, ret, zc->master)) {
+				zb->count = 0;
+				return ret;
+			}
+		}
+	}
+	zb->count = 0;
+
+	int ret = zbuilder_check_node(zb, node);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	return zbuilder_check_node(zb, nsec3_node);
+}
+
+/*! \brief Returns pending RRSet of given type, creates empty one if needed. */
+static struct zbuilder_rrset *zbuilder_rrset(zbuilder_t *zb, uint16_t type)
+{
+	for (uint16_t i = 0; i < zb->count; ++i) {
+		if (zb->rrsets[i].type == type) {
+			return &zb->rrsets[i];
+		}
+	}
+
+	if (zb->count == zb->max) {
+		uint16_t max = zb->max > 0 ? 2 * zb->max : 8;
+		struct zbuilder_rrset *rrsets = realloc(zb->rrsets,
+		                                        max * sizeof(*rrsets));
+		if (rrsets == NULL) {
+			return NULL;
+		}
+		memset(rrsets + zb->max, 0, (max - zb->max) * sizeof(*rrsets));
+		zb->rrsets = rrsets;
+		zb->max = max;
+	}
+
+	/* Buffers of the reused slot are kept. */
+	struct zbuilder_rrset *pending = &zb->rrsets[zb->count++];
+	pending->type = type;
+	return pending;
+}
+
+/*! \brief Inserts RDATA into pending RRSet, keeps the canonical order. */
+static int zbuilder_rrset_add(struct zbuilder_rrset *pending,
+                              const knot_rdata_t *rr)
+{
+	const size_t rr_size = knot_rdata_array_size(knot_rdata_rdlen(rr));
+	if (pending->size + rr_size > pending->capacity) {
+		size_t capacity = MAX(2 * pending->capacity, pending->size + rr_size);
+		uint8_t *data = realloc(pending->data, capacity);
+		if (data == NULL) {
+			return KNOT_ENOMEM;
+		}
+		pending->data = data;
+		pending->capacity = capacity;
+	}
+
+	/* Records are usually sorted, so try to append first. */
+	size_t pos = pending->size;
+	if (pending->rr_count > 0) {
+		int cmp = knot_rdata_cmp(pending->data + pending->last, rr);
+		if (cmp == 0) {
+			return KNOT_EOK;
+		} else if (cmp > 0) {
+			for (pos = 0; pos < pending->size; ) {
+				const knot_rdata_t *cur = pending->data + pos;
+				cmp = knot_rdata_cmp(cur, rr);
+				if (cmp == 0) {
+					return KNOT_EOK;
+				} else if (cmp > 0) {
+					break;
+				}
+				pos += knot_rdata_array_size(knot_rdata_rdlen(cur));
+			}
+			memmove(pending->data + pos + rr_size, pending->data + pos,
+			        pending->size - pos);
+			pending->last += rr_size;
+		}
+	}
+
+	memcpy(pending->data + pos, rr, rr_size);
+	if (pos == pending->size) {
+		pending->last = pos;
+	}
+	pending->size += rr_size;
+	pending->rr_count += 1;
+
+	return KNOT_EOK;
+}
+
+void zbuilder_init(zbuilder_t *zb, zone_contents_t *z, bool master)
+{
+	memset(zb, 0, sizeof(*zb));
+	zb->zc.z = z;
+	zb->zc.master = master;
+	zb->zc.ret = KNOT_EOK;
+}
+
+int zbuilder_add(zbuilder_t *zb, const knot_rrset_t *rr)
+{
+	if (zb == NULL || knot_rrset_empty(rr)) {
+		return KNOT_EINVAL;
+	}
+
+	if (rr->type == KNOT_RRTYPE_SOA && zb->soa) {
+		// Ignore extra SOA
+		return KNOT_EOK;
+	}
+
+	/* Owner changed, insert records of the previous one. */
+	if (zb->count > 0 && !knot_dname_is_equal(zb->owner, rr->owner)) {
+		int ret = zbuilder_flush(zb);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+	if (zb->count == 0) {
+		knot_dname_to_wire(zb->owner, rr->owner, sizeof(zb->owner));
+		zb->rclass = rr->rclass;
+	}
+
+	struct zbuilder_rrset *pending = zbuilder_rrset(zb, rr->type);
+	if (pending == NULL) {
+		return KNOT_ENOMEM;
+	}
+
+	for (uint16_t i = 0; i < rr->rrs.rr_count; ++i) {
+		const knot_rdata_t *rdata = knot_rdataset_at(&rr->rrs, i);
+		if (pending->rr_count > 0 && rr->type != KNOT_RRTYPE_RRSIG &&
+		    knot_rdata_ttl(rdata) != knot_rdata_ttl(pending->data)) {
+			pending->ttl_err = true;
+		}
+		int ret = zbuilder_rrset_add(pending, rdata);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	if (rr->type == KNOT_RRTYPE_SOA &&
+	    knot_dname_is_equal(rr->owner, zb->zc.z->apex->owner)) {
+		zb->soa = true;
+	}
+	zb->rr_count += rr->rrs.rr_count;
+
+	return KNOT_EOK;
+}
+
+int zbuilder_finish(zbuilder_t *zb)
+{
+	if (zb == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	return zbuilder_flush(zb);
+}
+
+void zbuilder_clear(zbuilder_t *zb)
+{
+	if (zb == NULL) {
+		return;
+	}
+
+	for (uint16_t i = 0; i < zb->max; ++i) {
+		free(zb->rrsets[i].data);
+	}
+	free(zb->rrsets);
+	zb->rrsets = NULL;
+	zb->count = zb->max = 0;
+}
+
 /*! \brief Creates RR from parser input, passes it to handling function. */
 static void scanner_process(zs_scanner_t *scanner)
 {
@@ -196,7 +420,7 @@ static zone_contents_t *create_zone_from_name(const char *origin)
 		return NULL;
 	}
 	knot_dname_to_lower(owner);
-	zone_contents_t *z = zone_contents_new(owner);
+	zone_contents_t *z = zone_contents_new_arena(owner);
 	knot_dname_free(&owner, NULL);
 	return z;
 }
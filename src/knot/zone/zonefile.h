@@ -42,6 +42,38 @@ typedef struct zcreator {
 	int ret;                  /*!< Return value. */
 } zcreator_t;
 
+/*!
+ * \brief Pending RRSet of the bulk zone builder.
+ */
+struct zbuilder_rrset {
+	uint16_t type;      /*!< RR type. */
+	uint16_t rr_count;  /*!< Number of RRs in the buffer. */
+	size_t size;        /*!< Used size of the RDATA buffer. */
+	size_t capacity;    /*!< Allocated size of the RDATA buffer. */
+	size_t last;        /*!< Offset of the last (largest) RDATA. */
+	uint8_t *data;      /*!< Sorted RDATA in rdataset format. */
+	bool ttl_err;       /*!< TTL mismatch within the RRSet. */
+};
+
+/*!
+ * \brief Bulk zone builder.
+ *
+ * Accumulates records of one owner in sorted buffers and inserts each
+ * RRSet into the zone with a single copy once the owner changes.
+ * Buffers are reused for all owners, so a transfer in canonical order
+ * needs no intermediate allocations.
+ */
+typedef struct zbuilder {
+	zcreator_t zc;                   /*!< Zone creator context. */
+	knot_dname_t owner[KNOT_DNAME_MAXLEN]; /*!< Owner of pending records. */
+	uint16_t rclass;                 /*!< Class of pending records. */
+	struct zbuilder_rrset *rrsets;   /*!< Pending RRSets. */
+	uint16_t count;                  /*!< Number of pending RRSets. */
+	uint16_t max;                    /*!< Number of allocated RRSets. */
+	bool soa;                        /*!< Zone SOA record was added. */
+	size_t rr_count;                 /*!< Number of added records. */
+} zbuilder_t;
+
 /*!
  * \brief Zone loader structure.
  */
@@ -104,6 +136,46 @@ void zonefile_close(zloader_t *loader);
  */
 int zcreator_step(zcreator_t *zl, const knot_rrset_t *rr);
 
+/*!
+ * \brief Initializes bulk zone builder.
+ *
+ * \param zb      Zone builder.
+ * \param z       Zone contents to fill.
+ * \param master  Master flag (TTL mismatch is fatal).
+ */
+void zbuilder_init(zbuilder_t *zb, zone_contents_t *z, bool master);
+
+/*!
+ * \brief Adds RRs into the builder.
+ *
+ * Records are inserted into the zone when a record with different owner
+ * is added or on zbuilder_finish(). Extra SOA records are ignored.
+ *
+ * \param zb  Zone builder.
+ * \param rr  RRSet to add.
+ *
+ * \return KNOT_E*
+ */
+int zbuilder_add(zbuilder_t *zb, const knot_rrset_t *rr);
+
+/*!
+ * \brief Inserts pending records into the zone.
+ *
+ * \note The zone is not adjusted, this is left to the caller.
+ *
+ * \param zb  Zone builder.
+ *
+ * \return KNOT_E*
+ */
+int zbuilder_finish(zbuilder_t *zb);
+
+/*!
+ * \brief Frees builder buffers.
+ *
+ * \param zb  Zone builder.
+ */
+void zbuilder_clear(zbuilder_t *zb);
+
 /*!
  * \brief Scanner error processing function.
  * \param scanner  Scanner to use.
@@ -19,6 +19,11 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_CPU_DISPATCH
+#include <tmmintrin.h>
+#endif
 
 /*! \brief Maximal length of binary input to Base32hex encoding. */
 #define MAX_BIN_DATA_LEN	((INT32_MAX / 8) * 5)
@@ -80,6 +85,115 @@ const uint8_t base32hex_dec[256] = {
 	[ 42] = KO, ['U'] = 30, [128] = KO, [171] = KO, [214] = KO,
 };
 
+#ifdef HAVE_CPU_DISPATCH
+
+/*! \brief Maps 5-bit values to Base32hex alphabet. */
+__attribute__((target("ssse3")))
+static inline __m128i base32hex_enc_ssse3(__m128i idx)
+{
+	__m128i letter = _mm_cmpgt_epi8(idx, _mm_set1_epi8(9));
+	idx = _mm_add_epi8(idx, _mm_set1_epi8('0'));
+	return _mm_add_epi8(idx, _mm_and_si128(letter, _mm_set1_epi8('A' - '9' - 1)));
+}
+
+/*!
+ * \brief Encodes 10-byte blocks using SSSE3 (at least 16 bytes must remain
+ *        readable for each block).
+ *
+ * \return Number of input bytes processed.
+ */
+__attribute__((target("ssse3")))
+static uint32_t base32hex_encode_ssse3(const uint8_t *in, uint32_t in_len,
+                                       uint8_t *out)
+{
+	// Big-endian 16-bit lanes containing each 5-bit value of a 5-byte group.
+	const __m128i split1 = _mm_setr_epi8(1, 0, 1, 0, 2, 1, 2, 1,
+	                                     3, 2, 4, 3, 4, 3, 5, 4);
+	const __m128i split2 = _mm_setr_epi8(6, 5, 6, 5, 7, 6, 7, 6,
+	                                     8, 7, 9, 8, 9, 8, 10, 9);
+	// Right shifts of the lanes (11, 6, 9, 4, 7, 10, 5, 8) as multipliers.
+	const __m128i shift = _mm_setr_epi16(1 << 5, 1 << 10, 1 << 7, 1 << 12,
+	                                     1 << 9, 1 << 6, 1 << 11, 1 << 8);
+	const __m128i mask = _mm_set1_epi16(0x1F);
+
+	uint32_t pos = 0;
+	while (in_len - pos >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)(in + pos));
+
+		__m128i idx1 = _mm_shuffle_epi8(block, split1);
+		idx1 = _mm_and_si128(_mm_mulhi_epu16(idx1, shift), mask);
+		__m128i idx2 = _mm_shuffle_epi8(block, split2);
+		idx2 = _mm_and_si128(_mm_mulhi_epu16(idx2, shift), mask);
+
+		__m128i text = base32hex_enc_ssse3(_mm_packus_epi16(idx1, idx2));
+		_mm_storeu_si128((__m128i *)out, text);
+		out += 16;
+		pos += 10;
+	}
+
+	return pos;
+}
+
+/*! \brief Checks if signed characters are in a given range. */
+__attribute__((target("ssse3")))
+static inline __m128i base32hex_in_range(__m128i text, char lo, char hi)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(text, _mm_set1_epi8(lo - 1)),
+	                     _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), text));
+}
+
+/*!
+ * \brief Decodes 16-character blocks using SSSE3, stops at first block
+ *        with a character out of alphabet (including padding).
+ *
+ * \note The last 8 characters are always left to the caller.
+ *
+ * \return Number of input characters processed.
+ */
+__attribute__((target("ssse3")))
+static uint32_t base32hex_decode_ssse3(const uint8_t *in, uint32_t in_len,
+                                       uint8_t *out)
+{
+	const __m128i join = _mm_setr_epi8(4, 3, 2, 1, 0, 12, 11, 10, 9, 8,
+	                                   -1, -1, -1, -1, -1, -1);
+
+	uint32_t pos = 0;
+	while (in_len - pos > 16) {
+		__m128i text = _mm_loadu_si128((const __m128i *)(in + pos));
+
+		// Check all characters are in the alphabet.
+		__m128i digit = base32hex_in_range(text, '0', '9');
+		__m128i upper = base32hex_in_range(text, 'A', 'V');
+		__m128i lower = base32hex_in_range(text, 'a', 'v');
+		__m128i valid = _mm_or_si128(digit, _mm_or_si128(upper, lower));
+		if (_mm_movemask_epi8(valid) != 0xFFFF) {
+			break;
+		}
+
+		// Translate characters to 5-bit values.
+		__m128i val = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+		val = _mm_sub_epi8(val, _mm_and_si128(upper, _mm_set1_epi8('A' - '9' - 1)));
+		val = _mm_sub_epi8(val, _mm_and_si128(lower, _mm_set1_epi8('a' - '9' - 1)));
+
+		// Join each 8 values into 40-bit numbers.
+		val = _mm_maddubs_epi16(val, _mm_set1_epi16(0x0120));
+		val = _mm_madd_epi16(val, _mm_set1_epi32(0x00010400));
+		__m128i hi = _mm_and_si128(val, _mm_set1_epi64x(0xFFFFFFFF));
+		val = _mm_or_si128(_mm_slli_epi64(hi, 20), _mm_srli_epi64(val, 32));
+		val = _mm_shuffle_epi8(val, join);
+
+		uint8_t bin[16];
+		_mm_storeu_si128((__m128i *)bin, val);
+		memcpy(out, bin, 10);
+		out += 10;
+		pos += 16;
+	}
+
+	return pos;
+}
+
+#endif /* HAVE_CPU_DISPATCH */
+
 int32_t base32hex_encode(const uint8_t  *in,
                          const uint32_t in_len,
                          uint8_t        *out,
@@ -97,6 +211,15 @@ int32_t base32hex_encode(const uint8_t  *in,
 	const uint8_t	*stop = in + in_len - rest_len;
 	uint8_t		*text = out;
 
+#ifdef HAVE_CPU_DISPATCH
+	// Vectorized encoding of the bulk, if supported.
+	if (__builtin_cpu_supports("ssse3")) {
+		uint32_t done = base32hex_encode_ssse3(in, in_len, text);
+		text += (done / 5) * 8;
+		in += done;
+	}
+#endif
+
 	// Encoding loop takes 5 bytes and creates 8 characters.
 	while (in < stop) {
 		text[0] = base32hex_enc[in[0] >> 3];
@@ -213,6 +336,15 @@ int32_t base32hex_decode(const uint8_t  *in,
 	uint8_t		pad_len = 0;
 	uint8_t		c1, c2, c3, c4, c5, c6, c7, c8;
 
+#ifdef HAVE_CPU_DISPATCH
+	// Vectorized decoding of the bulk, the rest is decoded and checked below.
+	if (__builtin_cpu_supports("ssse3")) {
+		uint32_t done = base32hex_decode_ssse3(in, in_len, bin);
+		bin += (done / 8) * 5;
+		in += done;
+	}
+#endif
+
 	// Decoding loop takes 8 characters and creates 5 bytes.
 	while (in < stop) {
 		// Filling and transforming 8 Base32hex chars.
@@ -19,6 +19,11 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_CPU_DISPATCH
+#include <tmmintrin.h>
+#endif
 
 /*! \brief Maximal length of binary input to Base64 encoding. */
 #define MAX_BIN_DATA_LEN	((INT32_MAX / 4) * 3)
@@ -81,6 +86,118 @@ const uint8_t base64_dec[256] = {
 	[ 42] = KO, ['U'] = 20, [128] = KO, [171] = KO, [214] = KO,
 };
 
+#ifdef HAVE_CPU_DISPATCH
+
+/*!
+ * \brief Encodes 12-byte blocks using SSSE3 (at least 16 bytes must remain
+ *        readable for each block).
+ *
+ * \return Number of input bytes processed.
+ */
+__attribute__((target("ssse3")))
+static uint32_t base64_encode_ssse3(const uint8_t *in, uint32_t in_len,
+                                    uint8_t *out)
+{
+	// Alphabet offsets indexed by reduced 6-bit value, see below.
+	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+	                                      '0' - 52, '0' - 52, '0' - 52,
+	                                      '0' - 52, '0' - 52, '0' - 52,
+	                                      '0' - 52, '0' - 52, '+' - 62,
+	                                      '/' - 63, 'A', 0, 0);
+	const __m128i split = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+	                                    7, 6, 8, 7, 10, 9, 11, 10);
+
+	uint32_t pos = 0;
+	while (in_len - pos >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)(in + pos));
+
+		// Spread each 3 bytes into 4 lanes of 6 bits.
+		block = _mm_shuffle_epi8(block, split);
+		__m128i hi = _mm_and_si128(block, _mm_set1_epi32(0x0FC0FC00));
+		hi = _mm_mulhi_epu16(hi, _mm_set1_epi32(0x04000040));
+		__m128i lo = _mm_and_si128(block, _mm_set1_epi32(0x003F03F0));
+		lo = _mm_mullo_epi16(lo, _mm_set1_epi32(0x01000010));
+		__m128i idx = _mm_or_si128(hi, lo);
+
+		// Reduce values to 0 ('A'-'Z'), 13 ('a'-'z'), 1-10 (digits),
+		// 11 ('+') and 12 ('/') and add corresponding offsets.
+		__m128i red = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+		__m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+		red = _mm_or_si128(red, _mm_and_si128(upper, _mm_set1_epi8(13)));
+		__m128i text = _mm_add_epi8(idx, _mm_shuffle_epi8(offsets, red));
+
+		_mm_storeu_si128((__m128i *)out, text);
+		out += 16;
+		pos += 12;
+	}
+
+	return pos;
+}
+
+/*!
+ * \brief Decodes 16-character blocks using SSSE3, stops at first block
+ *        with a character out of alphabet (including padding).
+ *
+ * \note The last 4 characters are always left to the caller.
+ *
+ * \return Number of input characters processed.
+ */
+__attribute__((target("ssse3")))
+static uint32_t base64_decode_ssse3(const uint8_t *in, uint32_t in_len,
+                                    uint8_t *out)
+{
+	// Value offsets indexed by upper nibble, '/' is fixed up separately.
+	const __m128i offsets = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71,
+	                                      0, 0, 0, 0, 0, 0, 0, 0);
+	// Bitmaps of valid upper nibbles indexed by lower nibble.
+	const __m128i valid_hi = _mm_setr_epi8(0xA8, 0xF8, 0xF8, 0xF8,
+	                                       0xF8, 0xF8, 0xF8, 0xF8,
+	                                       0xF8, 0xF8, 0xF0, 0x54,
+	                                       0x50, 0x50, 0x50, 0x54);
+	const __m128i hi_bit = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08,
+	                                     0x10, 0x20, 0x40, 0x80,
+	                                     0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i join = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+	                                   8, 14, 13, 12, -1, -1, -1, -1);
+
+	uint32_t pos = 0;
+	while (in_len - pos > 16) {
+		__m128i text = _mm_loadu_si128((const __m128i *)(in + pos));
+		__m128i hi = _mm_and_si128(_mm_srli_epi32(text, 4),
+		                           _mm_set1_epi8(0x0F));
+		__m128i lo = _mm_and_si128(text, _mm_set1_epi8(0x0F));
+
+		// Check all characters are in the alphabet.
+		__m128i valid = _mm_and_si128(_mm_shuffle_epi8(valid_hi, lo),
+		                              _mm_shuffle_epi8(hi_bit, hi));
+		valid = _mm_cmpeq_epi8(valid, _mm_setzero_si128());
+		if (_mm_movemask_epi8(valid) != 0) {
+			break;
+		}
+
+		// Translate characters to 6-bit values.
+		__m128i slash = _mm_cmpeq_epi8(text, _mm_set1_epi8('/'));
+		__m128i shift = _mm_add_epi8(_mm_shuffle_epi8(offsets, hi),
+		                             _mm_and_si128(slash, _mm_set1_epi8(-3)));
+		__m128i val = _mm_add_epi8(text, shift);
+
+		// Join each 4 values into 3 bytes.
+		val = _mm_maddubs_epi16(val, _mm_set1_epi32(0x01400140));
+		val = _mm_madd_epi16(val, _mm_set1_epi32(0x00011000));
+		val = _mm_shuffle_epi8(val, join);
+
+		uint8_t bin[16];
+		_mm_storeu_si128((__m128i *)bin, val);
+		memcpy(out, bin, 12);
+		out += 12;
+		pos += 16;
+	}
+
+	return pos;
+}
+
+#endif /* HAVE_CPU_DISPATCH */
+
 int32_t base64_encode(const uint8_t  *in,
                       const uint32_t in_len,
                       uint8_t        *out,
@@ -98,6 +215,15 @@ int32_t base64_encode(const uint8_t  *in,
 	const uint8_t	*stop = in + in_len - rest_len;
 	uint8_t		*text = out;
 
+#ifdef HAVE_CPU_DISPATCH
+	// Vectorized encoding of the bulk, if supported.
+	if (__builtin_cpu_supports("ssse3")) {
+		uint32_t done = base64_encode_ssse3(in, in_len, text);
+		text += (done / 3) * 4;
+		in += done;
+	}
+#endif
+
 	// Encoding loop takes 3 bytes and creates 4 characters.
 	while (in < stop) {
 		text[0] = base64_enc[in[0] >> 2];
@@ -180,6 +306,15 @@ int32_t base64_decode(const uint8_t  *in,
 	uint8_t		pad_len = 0;
 	uint8_t		c1, c2, c3, c4;
 
+#ifdef HAVE_CPU_DISPATCH
+	// Vectorized decoding of the bulk, the rest is decoded and checked below.
+	if (__builtin_cpu_supports("ssse3")) {
+		uint32_t done = base64_decode_ssse3(in, in_len, bin);
+		bin += (done / 4) * 3;
+		in += done;
+	}
+#endif
+
 	// Decoding loop takes 4 characters and creates 3 bytes.
 	while (in < stop) {
 		// Filling and transforming 4 Base64 chars.
@@ -0,0 +1,127 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "libknot/internal/hash.h"
+#include "libknot/internal/trie/murmurhash3.h"
+
+#ifdef HAVE_CPU_DISPATCH
+#include <nmmintrin.h>
+
+/*! \brief CRC32C using SSE4.2 instructions. */
+__attribute__((target("sse4.2")))
+static uint32_t hash_crc32c_sse42(const char *data, size_t len)
+{
+	const char *end = data + len;
+#ifdef __x86_64__
+	uint64_t crc64 = 0xFFFFFFFF;
+	for (; end - data >= 8; data += 8) {
+		uint64_t block;
+		memcpy(&block, data, sizeof(block));
+		crc64 = _mm_crc32_u64(crc64, block);
+	}
+	uint32_t crc = crc64;
+#else
+	uint32_t crc = 0xFFFFFFFF;
+#endif
+	for (; end - data >= 4; data += 4) {
+		uint32_t block;
+		memcpy(&block, data, sizeof(block));
+		crc = _mm_crc32_u32(crc, block);
+	}
+	for (; data < end; ++data) {
+		crc = _mm_crc32_u8(crc, *data);
+	}
+
+	return ~crc;
+}
+#endif /* HAVE_CPU_DISPATCH */
+
+uint32_t hash_fast(const char *data, size_t len)
+{
+#ifdef HAVE_CPU_DISPATCH
+	if (__builtin_cpu_supports("sse4.2")) {
+		return hash_crc32c_sse42(data, len);
+	}
+#endif
+	return hash(data, len);
+}
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND \
+	do { \
+		v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+		v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+	} while (0)
+
+/*! \brief Read 64-bit little-endian word. */
+static inline uint64_t read_u64_le(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; --i) {
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+uint64_t hash_keyed(const hash_key_t *key, const char *data, size_t len)
+{
+	uint64_t v0 = key->k0 ^ 0x736f6d6570736575ULL;
+	uint64_t v1 = key->k1 ^ 0x646f72616e646f6dULL;
+	uint64_t v2 = key->k0 ^ 0x6c7967656e657261ULL;
+	uint64_t v3 = key->k1 ^ 0x7465646279746573ULL;
+
+	const uint8_t *in = (const uint8_t *)data;
+	const uint8_t *end = in + len - (len % 8);
+
+	// Compression of whole words.
+	for (; in != end; in += 8) {
+		uint64_t m = read_u64_le(in);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	// Last word with the length in the most significant byte.
+	uint64_t b = ((uint64_t)len) << 56;
+	switch (len % 8) {
+	case 7: b |= ((uint64_t)in[6]) << 48;
+	case 6: b |= ((uint64_t)in[5]) << 40;
+	case 5: b |= ((uint64_t)in[4]) << 32;
+	case 4: b |= ((uint64_t)in[3]) << 24;
+	case 3: b |= ((uint64_t)in[2]) << 16;
+	case 2: b |= ((uint64_t)in[1]) << 8;
+	case 1: b |= ((uint64_t)in[0]);
+	}
+	v3 ^= b;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= b;
+
+	// Finalization.
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
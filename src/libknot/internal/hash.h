@@ -0,0 +1,63 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ * \file hash.h
+ *
+ * \brief Hash functions for hash tables.
+ *
+ * Use hash_fast() for keys not controlled by a remote party (zone contents),
+ * hash_keyed() for keys derived from the network traffic.
+ *
+ * \addtogroup common_lib
+ * @{
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*! \brief Secret key for keyed hashing. */
+typedef struct hash_key {
+	uint64_t k0;
+	uint64_t k1;
+} hash_key_t;
+
+/*!
+ * \brief Fast non-cryptographic hash.
+ *
+ * \note CRC32C is used if the CPU supports SSE4.2, MurmurHash3 otherwise.
+ *       The result is stable only within a running process.
+ *
+ * \param data  Input data.
+ * \param len   Length of input data.
+ *
+ * \return Hash value.
+ */
+uint32_t hash_fast(const char *data, size_t len);
+
+/*!
+ * \brief Keyed hash resistant to hash flooding (SipHash-2-4).
+ *
+ * \param key   Secret key.
+ * \param data  Input data.
+ * \param len   Length of input data.
+ *
+ * \return Hash value.
+ */
+uint64_t hash_keyed(const hash_key_t *key, const char *data, size_t len);
+
+/*! @} */
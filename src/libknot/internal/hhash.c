@@ -4,7 +4,7 @@
 
 #include "libknot/internal/hhash.h"
 #include "libknot/internal/binsearch.h"
-#include "libknot/internal/trie/murmurhash3.h"
+#include "libknot/internal/hash.h"
 #include "libknot/errcode.h"
 
 /* UCW array sorting defines. */
@@ -282,7 +282,7 @@ value_t *hhash_map(hhash_t* tbl, const char* key, uint16_t len, uint16_t mode)
 	}
 
 	/* Find an exact match in <id, id + HOP_LEN). */
-	uint32_t id = hash(key, len) % tbl->size;
+	uint32_t id = hash_fast(key, len) % tbl->size;
 	int dist = find_match(tbl, id, key, len);
 	if (dist <= HOP_LEN) {
 		/* Found exact match, return value. */
@@ -355,7 +355,7 @@ int hhash_del(hhash_t* tbl, const char* key, uint16_t len)
 		return KNOT_EINVAL;
 	}
 
-	uint32_t idx = hash(key, len) % tbl->size;
+	uint32_t idx = hash_fast(key, len) % tbl->size;
 	unsigned dist = find_match(tbl, idx, key, len);
 	if (dist > HOP_LEN) {
 		return KNOT_ENOENT;
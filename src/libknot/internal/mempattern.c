@@ -14,6 +14,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "libknot/internal/mempattern.h"
@@ -40,9 +41,22 @@ void *mm_alloc(mm_ctx_t *mm, size_t size)
 }
 
 
+/*! \brief Check if the block is the most recent allocation from the pool. */
+static bool mp_is_last(struct mempool *pool, void *what, size_t size)
+{
+	unsigned idx = mp_idx(pool, what);
+	uint8_t *end = (uint8_t *)pool->state.last[idx] - pool->state.free[idx];
+	return (uint8_t *)what + size == end;
+}
+
 void *mm_realloc(mm_ctx_t *mm, void *what, size_t size, size_t prev_size)
 {
 	if (mm) {
+		/* Grow or shrink the last block of a memory pool in place. */
+		if (mm->alloc == (mm_alloc_t)mp_alloc && what != NULL && size > 0 &&
+		    mp_is_last(mm->ctx, what, prev_size)) {
+			return mp_realloc(mm->ctx, what, size);
+		}
 		void *p = mm->alloc(mm->ctx, size);
 		if (p == NULL) {
 			return NULL;
@@ -63,6 +63,9 @@ static void pkt_free_data(knot_pkt_t *pkt)
 	/* Reset special types. */
 	pkt->opt_rr = NULL;
 	pkt->tsig_rr = NULL;
+
+	/* Nothing is left to materialize. */
+	pkt->flags &= ~KNOT_PF_LAZY;
 }
 
 /*! \brief Allocate new wireformat of given length. */
@@ -537,6 +540,111 @@ const knot_pktsection_t *knot_pkt_section(const knot_pkt_t *pkt,
 	return &pkt->sections[section_id];
 }
 
+/*! \brief Skip RR on the wire without parsing it, return its type. */
+static int pkt_skip_rr(const knot_pkt_t *pkt, size_t *pos, uint16_t *type)
+{
+	const uint8_t *wire_end = pkt->wire + pkt->size;
+	int owner_len = knot_dname_wire_check(pkt->wire + *pos, wire_end, pkt->wire);
+	if (owner_len <= 0) {
+		return KNOT_EMALF;
+	}
+
+	/* TYPE, CLASS, TTL and RDLENGTH. */
+	size_t rdata_pos = *pos + owner_len + 3 * sizeof(uint16_t) + sizeof(uint32_t);
+	if (rdata_pos > pkt->size) {
+		return KNOT_EMALF;
+	}
+
+	uint16_t rdlen = wire_read_u16(pkt->wire + rdata_pos - sizeof(uint16_t));
+	if (rdata_pos + rdlen > pkt->size) {
+		return KNOT_EMALF;
+	}
+
+	*type = wire_read_u16(pkt->wire + *pos + owner_len);
+	*pos = rdata_pos + rdlen;
+	return KNOT_EOK;
+}
+
+/*! \brief Parse payload RR at given position. */
+static int pkt_parse_rr_at(knot_pkt_t *pkt, size_t pos, unsigned flags)
+{
+	size_t end = pkt->parsed;
+	pkt->parsed = pos;
+
+	int ret = knot_pkt_parse_rr(pkt, flags);
+	if (ret != KNOT_EOK) {
+		return ret;
+	}
+
+	/* Stripped TSIG RR leaves the end of the wire at its position. */
+	pkt->parsed = MIN(end, pkt->size);
+	return KNOT_EOK;
+}
+
+/*!
+ * \brief Check framing of the packet payload and parse OPT and TSIG only.
+ *
+ * Other RRs are merely skipped, constraints on special RRs are the same
+ * as with the full parsing.
+ */
+static int pkt_parse_payload_lazy(knot_pkt_t *pkt, unsigned flags)
+{
+	size_t opt_pos = 0;
+	size_t tsig_pos = 0;
+	size_t pos = pkt->parsed;
+
+	for (knot_section_t i = KNOT_ANSWER; i <= KNOT_ADDITIONAL; ++i) {
+		uint16_t rr_count = pkt_rr_wirecount(pkt, i);
+		for (uint16_t rr_parsed = 0; rr_parsed < rr_count; ++rr_parsed) {
+			/* Nothing may follow TSIG RR. */
+			if (tsig_pos > 0 || pos >= pkt->size) {
+				return KNOT_EMALF;
+			}
+
+			size_t rr_pos = pos;
+			uint16_t type = 0;
+			int ret = pkt_skip_rr(pkt, &pos, &type);
+			if (ret != KNOT_EOK) {
+				return ret;
+			}
+
+			if (type != KNOT_RRTYPE_OPT && type != KNOT_RRTYPE_TSIG) {
+				continue;
+			}
+
+			/* Special RRs are unique and only in ADDITIONAL. */
+			size_t *special_pos = (type == KNOT_RRTYPE_OPT) ? &opt_pos : &tsig_pos;
+			if (i != KNOT_ADDITIONAL || *special_pos > 0) {
+				return KNOT_EMALF;
+			}
+			*special_pos = rr_pos;
+		}
+	}
+
+	/* Check for trailing garbage. */
+	pkt->parsed = pos;
+	if (pkt->parsed < pkt->size) {
+		return KNOT_EMALF;
+	}
+
+	/* Materialize only special RRs. */
+	knot_pkt_begin(pkt, KNOT_AUTHORITY);
+	knot_pkt_begin(pkt, KNOT_ADDITIONAL);
+
+	if (opt_pos > 0) {
+		int ret = pkt_parse_rr_at(pkt, opt_pos, flags);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	if (tsig_pos > 0) {
+		return pkt_parse_rr_at(pkt, tsig_pos, flags);
+	}
+
+	return KNOT_EOK;
+}
+
 _public_
 int knot_pkt_parse(knot_pkt_t *pkt, unsigned flags)
 {
@@ -548,11 +656,67 @@ int knot_pkt_parse(knot_pkt_t *pkt, unsigned flags)
 	pkt_reset_sections(pkt);
 
 	int ret = knot_pkt_parse_question(pkt);
-	if (ret == KNOT_EOK) {
-		ret = knot_pkt_parse_payload(pkt, flags);
+	if (ret != KNOT_EOK) {
+		return ret;
 	}
 
-	return ret;
+	if (flags & KNOT_PF_LAZY) {
+		pkt->flags |= KNOT_PF_LAZY;
+		return pkt_parse_payload_lazy(pkt, flags & ~KNOT_PF_LAZY);
+	}
+
+	return knot_pkt_parse_payload(pkt, flags);
+}
+
+_public_
+int knot_pkt_materialize(knot_pkt_t *pkt)
+{
+	if (pkt == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	if (!(pkt->flags & KNOT_PF_LAZY)) {
+		return KNOT_EOK;
+	}
+
+	/* Stripped TSIG RR is past the wire end, it can't be parsed again. */
+	knot_rrset_t tsig_rr;
+	knot_rrset_init_empty(&tsig_rr);
+	unsigned flags = 0;
+	if (pkt->tsig_rr != NULL) {
+		knot_rrinfo_t *info = &pkt->rr_info[pkt->tsig_rr - pkt->rr];
+		if (info->pos >= pkt->size) {
+			tsig_rr = *pkt->tsig_rr;
+			info->flags &= ~KNOT_PF_FREE;
+		} else {
+			flags = KNOT_PF_KEEPWIRE;
+		}
+	}
+
+	/* Drop special RRs, they'll be parsed in place. */
+	pkt_free_data(pkt);
+	pkt_reset_sections(pkt);
+	pkt->parsed = KNOT_WIRE_HEADER_SIZE + knot_pkt_question_size(pkt);
+
+	int ret = knot_pkt_parse_payload(pkt, flags);
+	if (ret != KNOT_EOK) {
+		knot_rrset_clear(&tsig_rr, &pkt->mm);
+		return ret;
+	}
+
+	/* Put back stripped TSIG RR as the last RR. */
+	if (!knot_rrset_empty(&tsig_rr)) {
+		knot_rrinfo_t *info = &pkt->rr_info[pkt->rrset_count];
+		memset(info, 0, sizeof(knot_rrinfo_t));
+		info->pos = pkt->size;
+		info->flags = KNOT_PF_FREE;
+		pkt->rr[pkt->rrset_count] = tsig_rr;
+		pkt->tsig_rr = &pkt->rr[pkt->rrset_count];
+		++pkt->rrset_count;
+		++pkt->sections[KNOT_ADDITIONAL].count;
+	}
+
+	return KNOT_EOK;
 }
 
 _public_
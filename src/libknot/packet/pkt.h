@@ -71,7 +71,8 @@ enum {
 	KNOT_PF_FREE      = 1 << 1, /*!< Free with packet. */
 	KNOT_PF_NOTRUNC   = 1 << 2, /*!< Don't truncate. */
 	KNOT_PF_CHECKDUP  = 1 << 3, /*!< Check for duplicates. */
-	KNOT_PF_KEEPWIRE  = 1 << 4  /*!< Keep wireformat untouched when parsing. */
+	KNOT_PF_KEEPWIRE  = 1 << 4, /*!< Keep wireformat untouched when parsing. */
+	KNOT_PF_LAZY      = 1 << 5  /*!< Parse only question, OPT and TSIG RRs. */
 };
 
 /*!
@@ -255,13 +256,26 @@ const knot_pktsection_t *knot_pkt_section(const knot_pkt_t *pkt,
  * includes semantic checks over specific RRs (TSIG, OPT).
  *
  * \note For KNOT_PF_KEEPWIRE see note for \fn knot_pkt_parse_rr
+ * \note With KNOT_PF_LAZY, the payload is only checked for framing and only
+ *       the OPT and TSIG RRs are parsed, packet sections contain just those.
+ *       Use \fn knot_pkt_materialize to parse the rest when needed.
  *
  * \param pkt Given packet.
- * \param flags Parsing flags (allowed KNOT_PF_KEEPWIRE)
+ * \param flags Parsing flags (allowed KNOT_PF_KEEPWIRE, KNOT_PF_LAZY)
  * \return KNOT_EOK, KNOT_EMALF and other errors
  */
 int knot_pkt_parse(knot_pkt_t *pkt, unsigned flags);
 
+/*!
+ * \brief Parse all RRs skipped by a lazy packet parsing.
+ *
+ * \note Does nothing if the packet wasn't parsed with KNOT_PF_LAZY.
+ *
+ * \param pkt Given packet.
+ * \return KNOT_EOK, KNOT_EMALF and other errors
+ */
+int knot_pkt_materialize(knot_pkt_t *pkt);
+
 /*!
  * \brief Parse packet header and a QUESTION section.
  */
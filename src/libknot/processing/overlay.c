@@ -89,7 +89,10 @@ int knot_overlay_in(struct knot_overlay *overlay, knot_pkt_t *pkt)
 		return overlay->state;
 	}
 
-	knot_pkt_parse(pkt, 0);
+	/* Lazily parsed packet is left to the layers to materialize. */
+	if (!(pkt->flags & KNOT_PF_LAZY)) {
+		knot_pkt_parse(pkt, 0);
+	}
 
 	ITERATE_LAYERS(overlay, knot_layer_in, pkt);
 }
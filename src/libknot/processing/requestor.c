@@ -154,7 +154,9 @@ struct knot_request *knot_request_make(mm_ctx_t *mm,
 _public_
 int knot_request_free(mm_ctx_t *mm, struct knot_request *request)
 {
-	close(request->fd);
+	if (!(request->flags & KNOT_RQ_KEEP)) {
+		close(request->fd);
+	}
 	knot_pkt_free(&request->query);
 	knot_pkt_free(&request->resp);
 
@@ -210,11 +212,13 @@ int knot_requestor_enqueue(struct knot_requestor *requestor,
 		sock_type = SOCK_STREAM;
 	}
 
-	/* Fetch a bound socket. */
-	request->fd = net_connected_socket(sock_type, &request->remote,
-	                                   &request->origin, O_NONBLOCK);
+	/* Fetch a bound socket unless reusing a connection. */
 	if (request->fd < 0) {
-		return KNOT_ECONN;
+		request->fd = net_connected_socket(sock_type, &request->remote,
+		                                   &request->origin, O_NONBLOCK);
+		if (request->fd < 0) {
+			return KNOT_ECONN;
+		}
 	}
 
 	/* Prepare response buffers. */
@@ -282,8 +286,7 @@ static int exec_request(struct knot_requestor *req, struct knot_request *last,
 	while (req->overlay.state & (KNOT_NS_PROC_FULL|KNOT_NS_PROC_MORE)) {
 		ret = request_io(req, last, timeout);
 		if (ret != KNOT_EOK) {
-			knot_overlay_reset(&req->overlay);
-			return ret;
+			break;
 		}
 	}
 
@@ -295,6 +298,12 @@ static int exec_request(struct knot_requestor *req, struct knot_request *last,
 	/* Finish current query processing. */
 	knot_overlay_reset(&req->overlay);
 
+	/* Connection in unknown state is not kept. */
+	if (ret != KNOT_EOK && (last->flags & KNOT_RQ_KEEP)) {
+		close(last->fd);
+		last->fd = -1;
+	}
+
 	return ret;
 }
 
@@ -27,7 +27,8 @@ struct knot_request;
 
 /* Requestor flags. */
 enum {
-	KNOT_RQ_UDP = 1 << 0  /* Use UDP for requests. */
+	KNOT_RQ_UDP  = 1 << 0, /* Use UDP for requests. */
+	KNOT_RQ_KEEP = 1 << 1  /* Keep the connection open after success. */
 };
 
 /*! \brief Requestor structure.
@@ -114,7 +115,11 @@ int knot_requestor_overlay(struct knot_requestor *requestor,
  * \brief Enqueue a query for processing.
  *
  * \note This function asynchronously creates a new connection to remote, but
- *       it does not send any data until requestor_exec().
+ *       it does not send any data until requestor_exec(). A request with
+ *       an open socket reuses the existing connection instead.
+ *
+ * \note With KNOT_RQ_KEEP, the socket is left open after a successful
+ *       request and the caller takes over it, it is closed on failure.
  *
  * \param requestor Requestor instance.
  * \param request   Prepared request.
@@ -0,0 +1,691 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
+
+#include "libknot/processing/requestor_async.h"
+#include "libknot/errcode.h"
+#include "libknot/internal/macros.h"
+#include "libknot/internal/net.h"
+
+/*! \brief Maximum number of ready requests processed in one iteration. */
+#define ASYNC_BATCH 256
+
+/* Awaited socket events. */
+enum {
+	EV_READ  = 1 << 0,
+	EV_WRITE = 1 << 1
+};
+
+static uint64_t time_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool use_tcp(struct knot_async_request *request)
+{
+	return !(request->req.flags & KNOT_RQ_UDP);
+}
+
+/*! \brief Socket events awaited in given processing state. */
+static unsigned state_events(int state)
+{
+	switch (state) {
+	case KNOT_NS_PROC_FULL: return EV_WRITE;
+	case KNOT_NS_PROC_MORE: return EV_READ;
+	default:                return 0;
+	}
+}
+
+/* -- event polling backend ------------------------------------------------- */
+
+#ifdef HAVE_EPOLL_CREATE1
+
+static int poller_create(void)
+{
+	int fd = epoll_create1(EPOLL_CLOEXEC);
+	if (fd < 0) {
+		return knot_map_errno(EMFILE, ENFILE, ENOMEM);
+	}
+
+	return fd;
+}
+
+static int poller_ctl(struct knot_async_requestor *requestor,
+                      struct knot_async_request *request, int op)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = (request->events & EV_READ  ? EPOLLIN  : 0) |
+	            (request->events & EV_WRITE ? EPOLLOUT : 0);
+	ev.data.ptr = request;
+
+	if (epoll_ctl(requestor->fd, op, request->req.fd, &ev) != 0) {
+		return knot_map_errno(ENOMEM, ENOSPC, EBADF);
+	}
+
+	return KNOT_EOK;
+}
+
+static int poller_add(struct knot_async_requestor *requestor,
+                      struct knot_async_request *request)
+{
+	return poller_ctl(requestor, request, EPOLL_CTL_ADD);
+}
+
+static int poller_mod(struct knot_async_requestor *requestor,
+                      struct knot_async_request *request)
+{
+	return poller_ctl(requestor, request, EPOLL_CTL_MOD);
+}
+
+static void poller_del(struct knot_async_requestor *requestor,
+                       struct knot_async_request *request)
+{
+	(void) poller_ctl(requestor, request, EPOLL_CTL_DEL);
+}
+
+static int poller_wait(struct knot_async_requestor *requestor,
+                       struct knot_async_request **ready, unsigned *revents,
+                       int timeout)
+{
+	struct epoll_event ev[ASYNC_BATCH];
+	int n = epoll_wait(requestor->fd, ev, ASYNC_BATCH, timeout);
+	if (n < 0) {
+		return errno == EINTR ? 0 : KNOT_ERROR;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		ready[i] = ev[i].data.ptr;
+		revents[i] = 0;
+		if (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+			revents[i] |= EV_READ;
+		}
+		if (ev[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+			revents[i] |= EV_WRITE;
+		}
+	}
+
+	return n;
+}
+
+#else /* Portable poll() backend, descriptors are collected on each wait. */
+
+static int poller_create(void)
+{
+	return 0;
+}
+
+static int poller_add(struct knot_async_requestor *requestor,
+                      struct knot_async_request *request)
+{
+	return KNOT_EOK;
+}
+
+static int poller_mod(struct knot_async_requestor *requestor,
+                      struct knot_async_request *request)
+{
+	return KNOT_EOK;
+}
+
+static void poller_del(struct knot_async_requestor *requestor,
+                       struct knot_async_request *request)
+{
+}
+
+static int poller_wait(struct knot_async_requestor *requestor,
+                       struct knot_async_request **ready, unsigned *revents,
+                       int timeout)
+{
+	/* Only the loop thread removes requests, snapshot is safe to use. */
+	pthread_mutex_lock(&requestor->lock);
+	unsigned count = requestor->count;
+	struct pollfd *fds = malloc(MAX(count, 1) * sizeof(struct pollfd));
+	struct knot_async_request **reqs = malloc(MAX(count, 1) * sizeof(*reqs));
+	if (fds == NULL || reqs == NULL) {
+		pthread_mutex_unlock(&requestor->lock);
+		free(fds);
+		free(reqs);
+		return KNOT_ENOMEM;
+	}
+
+	unsigned nfds = 0;
+	struct knot_async_request *request = NULL;
+	WALK_LIST(request, requestor->pending) {
+		if (nfds == count) {
+			break;
+		}
+		fds[nfds].fd = request->req.fd;
+		fds[nfds].events = (request->events & EV_READ  ? POLLIN  : 0) |
+		                   (request->events & EV_WRITE ? POLLOUT : 0);
+		fds[nfds].revents = 0;
+		reqs[nfds++] = request;
+	}
+	pthread_mutex_unlock(&requestor->lock);
+
+	int n = poll(fds, nfds, timeout);
+	if (n < 0) {
+		n = (errno == EINTR) ? 0 : KNOT_ERROR;
+	}
+
+	int found = 0;
+	for (unsigned i = 0; i < nfds && n > 0 && found < ASYNC_BATCH; ++i) {
+		if (fds[i].revents == 0) {
+			continue;
+		}
+		ready[found] = reqs[i];
+		revents[found] = 0;
+		if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+			revents[found] |= EV_READ;
+		}
+		if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+			revents[found] |= EV_WRITE;
+		}
+		found += 1;
+	}
+
+	free(fds);
+	free(reqs);
+
+	return n < 0 ? n : found;
+}
+
+#endif /* HAVE_EPOLL_CREATE1 */
+
+/* -- pending requests ------------------------------------------------------ */
+
+/*! \brief Insert request to the pending list ordered by deadline. */
+static void pending_insert(struct knot_async_requestor *requestor,
+                           struct knot_async_request *request)
+{
+	/* Timeouts are mostly uniform, the position is usually at the tail. */
+	struct knot_async_request *it = NULL;
+	WALK_LIST_BACKWARDS(it, requestor->pending) {
+		if (it->deadline <= request->deadline) {
+			insert_node(&request->req.node, &it->req.node);
+			return;
+		}
+	}
+
+	add_head(&requestor->pending, &request->req.node);
+}
+
+/*! \brief Postpone request deadline after progress. */
+static void pending_touch(struct knot_async_requestor *requestor,
+                          struct knot_async_request *request)
+{
+	pthread_mutex_lock(&requestor->lock);
+	rem_node(&request->req.node);
+	request->deadline = time_now_ms() + request->timeout;
+	pending_insert(requestor, request);
+	pthread_mutex_unlock(&requestor->lock);
+}
+
+/*! \brief Remove request from processing and close its socket. */
+static void request_close(struct knot_async_requestor *requestor,
+                          struct knot_async_request *request, int ret)
+{
+	poller_del(requestor, request);
+
+	/* Connection of a successful request may be kept for reuse. */
+	if (ret != KNOT_EOK || !(request->req.flags & KNOT_RQ_KEEP)) {
+		close(request->req.fd);
+		request->req.fd = -1;
+	}
+
+	knot_overlay_finish(&request->overlay);
+	knot_overlay_deinit(&request->overlay);
+	init_list(&request->overlay.layers);
+}
+
+/*! \brief Call completion callback of a finished request. */
+static void request_done(struct knot_async_requestor *requestor,
+                         struct knot_async_request *request, int ret)
+{
+	request->done(request, ret);
+
+	/* Callback has finished, the request is no longer outstanding. */
+	pthread_mutex_lock(&requestor->lock);
+	requestor->count -= 1;
+	if (requestor->count == 0) {
+		pthread_cond_broadcast(&requestor->idle);
+	}
+	pthread_mutex_unlock(&requestor->lock);
+}
+
+/* -- request I/O ----------------------------------------------------------- */
+
+static int request_send(struct knot_async_request *request)
+{
+	/* Check socket error (i.e. failed connection). */
+	int err = 0;
+	socklen_t len = sizeof(int);
+	getsockopt(request->req.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+	if (err != 0) {
+		return KNOT_ECONNREFUSED;
+	}
+
+	knot_pkt_t *query = request->req.query;
+	knot_overlay_out(&request->overlay, query);
+
+	int ret = 0;
+	if (use_tcp(request)) {
+		ret = tcp_send_msg(request->req.fd, query->wire, query->size);
+	} else {
+		ret = udp_send_msg(request->req.fd, query->wire, query->size,
+		                   (const struct sockaddr *)&request->req.remote);
+	}
+	if (ret != query->size) {
+		return KNOT_ECONN;
+	}
+
+	request->rx = 0;
+	return KNOT_EOK;
+}
+
+/*! \brief Receive (a part of) TCP message, KNOT_EAGAIN if incomplete. */
+static int request_recv_tcp(struct knot_async_request *request)
+{
+	knot_pkt_t *resp = request->req.resp;
+	const size_t prefix = sizeof(uint16_t);
+
+	if (request->rx == 0) {
+		knot_pkt_clear(resp);
+	}
+
+	while (request->rx < prefix || request->rx - prefix < ntohs(request->rx_len)) {
+		uint8_t *dst = NULL;
+		size_t want = 0;
+		if (request->rx < prefix) {
+			dst = (uint8_t *)&request->rx_len + request->rx;
+			want = prefix - request->rx;
+		} else {
+			size_t msg_len = ntohs(request->rx_len);
+			if (msg_len > resp->max_size) {
+				return KNOT_ESPACE;
+			}
+			dst = resp->wire + request->rx - prefix;
+			want = msg_len - (request->rx - prefix);
+		}
+
+		ssize_t n = recv(request->req.fd, dst, want, 0);
+		if (n == 0) {
+			return KNOT_ECONN;
+		}
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return KNOT_EAGAIN;
+			}
+			return KNOT_ECONN;
+		}
+
+		request->rx += n;
+	}
+
+	resp->size = ntohs(request->rx_len);
+	request->rx = 0;
+	return KNOT_EOK;
+}
+
+static int request_recv(struct knot_async_request *request)
+{
+	if (use_tcp(request)) {
+		return request_recv_tcp(request);
+	}
+
+	knot_pkt_t *resp = request->req.resp;
+	knot_pkt_clear(resp);
+
+	int ret = udp_recv_msg(request->req.fd, resp->wire, resp->max_size,
+	                       (struct sockaddr *)&request->req.remote);
+	if (ret < 0) {
+		resp->size = 0;
+		return ret;
+	}
+
+	resp->size = ret;
+	return KNOT_EOK;
+}
+
+/*!
+ * \brief Perform I/O on a ready request.
+ *
+ * \retval KNOT_EAGAIN if the request is not finished yet.
+ * \retval KNOT_EOK if the request was processed successfully.
+ * \retval error code if the request failed.
+ */
+static int request_io(struct knot_async_request *request, unsigned revents)
+{
+	struct knot_overlay *overlay = &request->overlay;
+
+	if ((revents & EV_WRITE) && overlay->state == KNOT_NS_PROC_FULL) {
+		int ret = request_send(request);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	} else if ((revents & EV_READ) && overlay->state == KNOT_NS_PROC_MORE) {
+		int ret = request_recv(request);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+		knot_overlay_in(overlay, request->req.resp);
+	}
+
+	/* Continue until the processing is satisfied or fails. */
+	switch (overlay->state) {
+	case KNOT_NS_PROC_FULL:
+	case KNOT_NS_PROC_MORE: return KNOT_EAGAIN;
+	case KNOT_NS_PROC_FAIL: return KNOT_ERROR;
+	default:                return KNOT_EOK;
+	}
+}
+
+/* -- public API ------------------------------------------------------------ */
+
+_public_
+struct knot_async_request *knot_async_request_make(mm_ctx_t *mm,
+                                                   const struct sockaddr *dst,
+                                                   const struct sockaddr *src,
+                                                   knot_pkt_t *query,
+                                                   unsigned flags)
+{
+	if (dst == NULL || query == NULL) {
+		return NULL;
+	}
+
+	struct knot_async_request *request =
+	                mm_alloc(mm, sizeof(struct knot_async_request));
+	if (request == NULL) {
+		return NULL;
+	}
+
+	memset(request, 0, sizeof(struct knot_async_request));
+	memcpy(&request->req.remote, dst, sockaddr_len(dst));
+	if (src) {
+		memcpy(&request->req.origin, src, sockaddr_len(src));
+	}
+
+	request->req.fd = -1;
+	request->req.query = query;
+	request->req.flags = flags;
+
+	request->req.resp = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, mm);
+	if (request->req.resp == NULL) {
+		mm_free(mm, request);
+		return NULL;
+	}
+
+	knot_overlay_init(&request->overlay, mm);
+
+	return request;
+}
+
+_public_
+int knot_async_request_overlay(struct knot_async_request *request,
+                               const knot_layer_api_t *proc, void *param)
+{
+	if (request == NULL || proc == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	return knot_overlay_add(&request->overlay, proc, param);
+}
+
+_public_
+void knot_async_request_free(mm_ctx_t *mm, struct knot_async_request *request)
+{
+	if (request == NULL) {
+		return;
+	}
+
+	if (request->req.fd >= 0) {
+		close(request->req.fd);
+	}
+
+	knot_overlay_deinit(&request->overlay);
+	knot_pkt_free(&request->req.query);
+	knot_pkt_free(&request->req.resp);
+	mm_free(mm, request);
+}
+
+_public_
+int knot_async_requestor_init(struct knot_async_requestor *requestor)
+{
+	if (requestor == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	memset(requestor, 0, sizeof(struct knot_async_requestor));
+
+	requestor->fd = poller_create();
+	if (requestor->fd < 0) {
+		return requestor->fd;
+	}
+
+	pthread_mutex_init(&requestor->lock, NULL);
+	pthread_cond_init(&requestor->idle, NULL);
+	init_list(&requestor->pending);
+
+	return KNOT_EOK;
+}
+
+_public_
+void knot_async_requestor_deinit(struct knot_async_requestor *requestor)
+{
+	if (requestor == NULL) {
+		return;
+	}
+
+	/* Cancel outstanding requests. */
+	list_t cancelled;
+	init_list(&cancelled);
+	pthread_mutex_lock(&requestor->lock);
+	add_tail_list(&cancelled, &requestor->pending);
+	init_list(&requestor->pending);
+	pthread_mutex_unlock(&requestor->lock);
+
+	struct knot_async_request *request = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(request, next, cancelled) {
+		rem_node(&request->req.node);
+		request_close(requestor, request, KNOT_ENOTRUNNING);
+		request_done(requestor, request, KNOT_ENOTRUNNING);
+	}
+
+#ifdef HAVE_EPOLL_CREATE1
+	close(requestor->fd);
+#endif
+	pthread_cond_destroy(&requestor->idle);
+	pthread_mutex_destroy(&requestor->lock);
+	memset(requestor, 0, sizeof(struct knot_async_requestor));
+}
+
+_public_
+int knot_async_requestor_enqueue(struct knot_async_requestor *requestor,
+                                 struct knot_async_request *request,
+                                 unsigned timeout, knot_async_cb done,
+                                 void *data)
+{
+	if (requestor == NULL || request == NULL || done == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	request->events = state_events(request->overlay.state);
+	if (request->events == 0) {
+		return KNOT_EINVAL;
+	}
+
+	/* Start connecting unless reusing a connection. */
+	if (request->req.fd < 0) {
+		int sock_type = use_tcp(request) ? SOCK_STREAM : SOCK_DGRAM;
+		request->req.fd = net_connected_socket(sock_type, &request->req.remote,
+		                                       &request->req.origin, O_NONBLOCK);
+		if (request->req.fd < 0) {
+			request->req.fd = -1;
+			return KNOT_ECONN;
+		}
+	}
+
+	request->done = done;
+	request->data = data;
+	request->timeout = timeout;
+	request->deadline = time_now_ms() + timeout;
+	request->rx = 0;
+
+	/* Insert before polling, the loop may pick the request up at once. */
+	pthread_mutex_lock(&requestor->lock);
+	pending_insert(requestor, request);
+	requestor->count += 1;
+	pthread_mutex_unlock(&requestor->lock);
+
+	int ret = poller_add(requestor, request);
+	if (ret != KNOT_EOK) {
+		pthread_mutex_lock(&requestor->lock);
+		rem_node(&request->req.node);
+		requestor->count -= 1;
+		if (requestor->count == 0) {
+			pthread_cond_broadcast(&requestor->idle);
+		}
+		pthread_mutex_unlock(&requestor->lock);
+		close(request->req.fd);
+		request->req.fd = -1;
+	}
+
+	return ret;
+}
+
+_public_
+int knot_async_requestor_exec(struct knot_async_requestor *requestor,
+                              int max_wait)
+{
+	if (requestor == NULL) {
+		return KNOT_EINVAL;
+	}
+
+	/* Don't sleep past the nearest deadline. */
+	int timeout = max_wait;
+	pthread_mutex_lock(&requestor->lock);
+	if (!EMPTY_LIST(requestor->pending)) {
+		struct knot_async_request *first = HEAD(requestor->pending);
+		uint64_t now = time_now_ms();
+		int until = first->deadline > now ? first->deadline - now : 0;
+		if (timeout < 0 || until < timeout) {
+			timeout = until;
+		}
+	}
+	pthread_mutex_unlock(&requestor->lock);
+
+	struct knot_async_request *ready[ASYNC_BATCH];
+	unsigned revents[ASYNC_BATCH];
+	int n = poller_wait(requestor, ready, revents, timeout);
+	if (n < 0) {
+		return n;
+	}
+
+	int finished = 0;
+
+	/* Process ready requests. */
+	for (int i = 0; i < n; ++i) {
+		struct knot_async_request *request = ready[i];
+		int ret = request_io(request, revents[i]);
+		if (ret == KNOT_EAGAIN) {
+			unsigned events = state_events(request->overlay.state);
+			if (events != request->events) {
+				request->events = events;
+				int mod = poller_mod(requestor, request);
+				if (mod != KNOT_EOK) {
+					ret = mod;
+				}
+			}
+		}
+		if (ret == KNOT_EAGAIN) {
+			pending_touch(requestor, request);
+			continue;
+		}
+
+		pthread_mutex_lock(&requestor->lock);
+		rem_node(&request->req.node);
+		pthread_mutex_unlock(&requestor->lock);
+
+		request_close(requestor, request, ret);
+		request_done(requestor, request, ret);
+		finished += 1;
+	}
+
+	/* Expire requests over deadline. */
+	list_t expired;
+	init_list(&expired);
+	uint64_t now = time_now_ms();
+	pthread_mutex_lock(&requestor->lock);
+	struct knot_async_request *request = NULL, *next = NULL;
+	WALK_LIST_DELSAFE(request, next, requestor->pending) {
+		if (request->deadline > now) {
+			break;
+		}
+		rem_node(&request->req.node);
+		add_tail(&expired, &request->req.node);
+	}
+	pthread_mutex_unlock(&requestor->lock);
+
+	WALK_LIST_DELSAFE(request, next, expired) {
+		rem_node(&request->req.node);
+		request_close(requestor, request, KNOT_ETIMEOUT);
+		request_done(requestor, request, KNOT_ETIMEOUT);
+		finished += 1;
+	}
+
+	return finished;
+}
+
+_public_
+unsigned knot_async_requestor_pending(struct knot_async_requestor *requestor)
+{
+	if (requestor == NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&requestor->lock);
+	unsigned count = requestor->count;
+	pthread_mutex_unlock(&requestor->lock);
+
+	return count;
+}
+
+_public_
+void knot_async_requestor_wait(struct knot_async_requestor *requestor)
+{
+	if (requestor == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&requestor->lock);
+	while (requestor->count > 0) {
+		pthread_cond_wait(&requestor->idle, &requestor->lock);
+	}
+	pthread_mutex_unlock(&requestor->lock);
+}
@@ -0,0 +1,170 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*!
+ * \file requestor_async.h
+ *
+ * \brief Asynchronous requestor.
+ *
+ * Unlike the synchronous requestor, requests don't block the caller. Each
+ * request carries its own processing overlay, requests may be enqueued from
+ * any thread and a single thread runs the event loop, which multiplexes all
+ * outstanding requests (epoll or poll based) and reports their completion
+ * by a callback.
+ *
+ * \addtogroup query_processing
+ * @{
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "libknot/processing/requestor.h"
+
+struct knot_async_request;
+
+/*!
+ * \brief Request completion callback.
+ *
+ * Called from the event loop thread when the request is finished, the socket
+ * is already closed and the overlay finished. The callback owns the request.
+ * With KNOT_RQ_KEEP, the socket of a successful request is left open, the
+ * callback may take it over or it is closed with the request.
+ *
+ * \param request  Finished request.
+ * \param ret      KNOT_EOK, KNOT_ETIMEOUT or other error code.
+ */
+typedef void (*knot_async_cb)(struct knot_async_request *request, int ret);
+
+/*! \brief Asynchronous request. */
+struct knot_async_request {
+	struct knot_request req;      /*!< Socket, endpoints and messages. */
+	struct knot_overlay overlay;  /*!< Response processing overlay. */
+	knot_async_cb done;           /*!< Completion callback. */
+	void *data;                   /*!< Callback data. */
+	uint64_t deadline;            /*!< Time of expiration [ms]. */
+	unsigned timeout;             /*!< Inactivity timeout [ms]. */
+	unsigned events;              /*!< Awaited socket events. */
+	uint16_t rx_len;              /*!< Expected TCP message length. */
+	size_t rx;                    /*!< Received part of TCP message. */
+};
+
+/*! \brief Asynchronous requestor. */
+struct knot_async_requestor {
+	pthread_mutex_t lock;  /*!< Lock protecting the pending list. */
+	pthread_cond_t idle;   /*!< Signalled when no request is pending. */
+	list_t pending;        /*!< Outstanding requests ordered by deadline. */
+	unsigned count;        /*!< Number of outstanding requests. */
+	int fd;                /*!< Event polling descriptor (epoll). */
+};
+
+/*!
+ * \brief Make asynchronous request out of endpoints and query.
+ *
+ * \param mm     Memory context for the request, overlay and response.
+ * \param dst    Remote endpoint address.
+ * \param src    Source address (or NULL).
+ * \param query  Query message.
+ * \param flags  Request flags.
+ *
+ * \return Prepared request or NULL in case of error.
+ */
+struct knot_async_request *knot_async_request_make(mm_ctx_t *mm,
+                                                   const struct sockaddr *dst,
+                                                   const struct sockaddr *src,
+                                                   knot_pkt_t *query,
+                                                   unsigned flags);
+
+/*!
+ * \brief Add a processing layer to the request.
+ *
+ * \param request  Request.
+ * \param proc     Response processing module.
+ * \param param    Processing module parameters.
+ */
+int knot_async_request_overlay(struct knot_async_request *request,
+                               const knot_layer_api_t *proc, void *param);
+
+/*!
+ * \brief Free request and associated data.
+ */
+void knot_async_request_free(mm_ctx_t *mm, struct knot_async_request *request);
+
+/*!
+ * \brief Initialize asynchronous requestor.
+ *
+ * \return KNOT_EOK or error
+ */
+int knot_async_requestor_init(struct knot_async_requestor *requestor);
+
+/*!
+ * \brief Cancel outstanding requests and free the requestor.
+ *
+ * \note Completion callbacks of the cancelled requests are called with
+ *       KNOT_ENOTRUNNING from the calling thread.
+ */
+void knot_async_requestor_deinit(struct knot_async_requestor *requestor);
+
+/*!
+ * \brief Connect to remote and start the request.
+ *
+ * A request with an open socket reuses the existing connection.
+ *
+ * \note Thread-safe, may be called from any thread. The completion callback
+ *       is called only if KNOT_EOK is returned.
+ *
+ * \param requestor  Requestor instance.
+ * \param request    Prepared request with processing layers.
+ * \param timeout    Inactivity timeout [ms].
+ * \param done       Completion callback.
+ * \param data       Callback data.
+ *
+ * \return KNOT_EOK or error
+ */
+int knot_async_requestor_enqueue(struct knot_async_requestor *requestor,
+                                 struct knot_async_request *request,
+                                 unsigned timeout, knot_async_cb done,
+                                 void *data);
+
+/*!
+ * \brief Run one iteration of the event loop.
+ *
+ * Waits for socket events up to \a max_wait, performs I/O on all ready
+ * requests, expires requests over deadline and calls completion callbacks.
+ * Must be called from one thread only.
+ *
+ * \param requestor  Requestor instance.
+ * \param max_wait   Maximum time to wait for events [ms].
+ *
+ * \return Number of finished requests or error.
+ */
+int knot_async_requestor_exec(struct knot_async_requestor *requestor,
+                              int max_wait);
+
+/*!
+ * \brief Return number of outstanding requests.
+ */
+unsigned knot_async_requestor_pending(struct knot_async_requestor *requestor);
+
+/*!
+ * \brief Wait until there are no outstanding requests.
+ *
+ * \note The event loop must run in another thread.
+ */
+void knot_async_requestor_wait(struct knot_async_requestor *requestor);
+
+/*! @} */
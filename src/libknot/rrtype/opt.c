@@ -276,6 +276,18 @@ bool knot_edns_has_option(const knot_rrset_t *opt_rr, uint16_t code)
 	return pos != NULL;
 }
 
+/*----------------------------------------------------------------------------*/
+_public_
+uint8_t *knot_edns_get_option(const knot_rrset_t *opt_rr, uint16_t code)
+{
+	assert(opt_rr != NULL);
+
+	knot_rdata_t *rdata = knot_rdataset_at(&opt_rr->rrs, 0);
+	assert(rdata != NULL);
+
+	return find_option(rdata, code);
+}
+
 /*----------------------------------------------------------------------------*/
 _public_
 bool knot_edns_has_nsid(const knot_rrset_t *opt_rr)
@@ -261,6 +261,31 @@ int knot_edns_add_option(knot_rrset_t *opt_rr, uint16_t code,
  */
 bool knot_edns_has_option(const knot_rrset_t *opt_rr, uint16_t code);
 
+/*!
+ * \brief Returns the first Option with the specified code in the OPT RR.
+ *
+ * \warning The Option length is not checked against the RDATA, use only on
+ *          records which passed knot_edns_check_record() (as in a parsed packet).
+ *
+ * \param opt_rr OPT RR structure to search for the Option in.
+ * \param code Option code to search for.
+ *
+ * \return Pointer to the Option in the RDATA wire, or NULL if not found.
+ */
+uint8_t *knot_edns_get_option(const knot_rrset_t *opt_rr, uint16_t code);
+
+/*! \brief Returns the data length of the Option returned by knot_edns_get_option(). */
+static inline uint16_t knot_edns_opt_get_length(const uint8_t *opt)
+{
+	return wire_read_u16(opt + sizeof(uint16_t));
+}
+
+/*! \brief Returns the data of the Option returned by knot_edns_get_option(). */
+static inline const uint8_t *knot_edns_opt_get_data(const uint8_t *opt)
+{
+	return opt + KNOT_EDNS_OPTION_HDRLEN;
+}
+
 /*! \brief Return true if RRSet has NSID option. */
 bool knot_edns_has_nsid(const knot_rrset_t *opt_rr);
 
@@ -0,0 +1,570 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils/common/strtonum.h"
+#include "libknot/libknot.h"
+#include "libknot/internal/utils.h"
+#include "dnstap/convert.h"
+#include "dnstap/decoder.h"
+#include "dnstap/mmap_reader.h"
+
+#define PROGRAM_NAME "kreplay"
+
+/*! \brief Messages sent or received with a single system call. */
+#define BATCH 64
+/*! \brief Received message buffer, only the header is needed. */
+#define RECV_BUFSIZE 512
+/*! \brief Longest sleep between two checks of the schedule [ns]. */
+#define MAX_SLEEP 100000000
+
+#define NS_PER_S 1000000000ULL
+
+/*! \brief Query from the capture. */
+typedef struct {
+	const uint8_t *wire;   /*!< Query, points to the capture or to 'owned'. */
+	uint8_t *owned;        /*!< Query rebuilt from a logged response. */
+	uint16_t len;
+	uint64_t time;         /*!< Capture timestamp [ns]. */
+} query_t;
+
+/*! \brief Replay state shared by the sender and the receiver. */
+typedef struct {
+	int fd;
+	query_t *queries;
+	size_t count;
+
+	/* Schedule. */
+	double speed;          /*!< Original timing divided by this, 0 for no delays. */
+	uint32_t rate;         /*!< Fixed rate [qps], overrides speed. */
+	int timeout;           /*!< Wait for responses after the last query [s]. */
+
+	/* Send time of the outstanding queries by message ID, 0 if answered. */
+	uint64_t sent_at[UINT16_MAX + 1];
+
+	/* Results, written by the receiver only. */
+	volatile bool stop;
+	size_t sent;
+	size_t received;
+	size_t rcodes[16];
+	uint32_t *latency;     /*!< Response latencies [us]. */
+} replay_t;
+
+static void usage(FILE *stream)
+{
+	fprintf(stream, "usage: " PROGRAM_NAME " [options] <capture.tap>\n"
+	       "\n"
+	       "Replays queries from a dnstap capture to a server over UDP.\n"
+	       "\n"
+	       "options:\n"
+	       "  -s, --server <address>  Target server (default 127.0.0.1).\n"
+	       "  -p, --port <port>       Target port (default 53).\n"
+	       "  -x, --speed <factor>    Replay faster (>1) or slower (<1) than captured,\n"
+	       "                          0 sends as fast as possible (default 1).\n"
+	       "  -r, --rate <qps>        Send at a fixed rate instead.\n"
+	       "  -n, --count <number>    Replay at most this many queries.\n"
+	       "  -t, --timeout <seconds> Wait for responses after the last query (default 2).\n"
+	       "  -h, --help              Print help.\n"
+	       "  -V, --version           Print program version.\n");
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+/*! \brief Rebuild the query from the header and question of a response. */
+static uint8_t *query_from_response(const uint8_t *wire, size_t len, uint16_t *qlen)
+{
+	if (len <= KNOT_WIRE_HEADER_SIZE || knot_wire_get_qdcount(wire) != 1) {
+		return NULL;
+	}
+
+	int name_len = knot_dname_wire_check(wire + KNOT_WIRE_HEADER_SIZE,
+	                                     wire + len, NULL);
+	if (name_len <= 0 || KNOT_WIRE_HEADER_SIZE + name_len + 4 > len) {
+		return NULL;
+	}
+	*qlen = KNOT_WIRE_HEADER_SIZE + name_len + 4;
+
+	uint8_t *query = malloc(*qlen);
+	if (query == NULL) {
+		return NULL;
+	}
+	memcpy(query, wire, *qlen);
+	knot_wire_clear_qr(query);
+	knot_wire_clear_aa(query);
+	knot_wire_clear_tc(query);
+	knot_wire_clear_ra(query);
+	knot_wire_set_rcode(query, KNOT_RCODE_NOERROR);
+	knot_wire_set_ancount(query, 0);
+	knot_wire_set_nscount(query, 0);
+	knot_wire_set_arcount(query, 0);
+
+	return query;
+}
+
+static int query_cmp(const void *a, const void *b)
+{
+	const query_t *x = a, *y = b;
+	if (x->time != y->time) {
+		return x->time < y->time ? -1 : 1;
+	}
+	return x->wire < y->wire ? -1 : (x->wire > y->wire);
+}
+
+/*!
+ * \brief Collect queries from the capture.
+ *
+ * Logged queries are used as they are. If the capture contains only the
+ * responses, the queries are rebuilt from them.
+ */
+static int load_queries(dt_mmap_reader_t *reader, replay_t *r, size_t limit)
+{
+	size_t capacity = 0;
+	bool has_queries = false;
+
+	for (int pass = 0; pass < 2 && r->count == 0; ++pass) {
+		dt_mmap_reader_rewind(reader);
+
+		const uint8_t *frame = NULL;
+		size_t frame_len = 0;
+		int ret = KNOT_EOK;
+		while (r->count < limit &&
+		       (ret = dt_mmap_reader_next(reader, &frame, &frame_len)) == KNOT_EOK) {
+			dt_message_t msg;
+			if (dt_decode_message(frame, frame_len, &msg) != KNOT_EOK) {
+				continue;
+			}
+
+			query_t q = { NULL };
+			if (pass == 0 && msg.query_message != NULL) {
+				if (msg.query_message_len < KNOT_WIRE_HEADER_SIZE ||
+				    msg.query_message_len > UINT16_MAX) {
+					continue;
+				}
+				has_queries = true;
+				q.wire = msg.query_message;
+				q.len = msg.query_message_len;
+			} else if (pass == 1 && msg.response_message != NULL) {
+				q.owned = query_from_response(msg.response_message,
+				                              msg.response_message_len,
+				                              &q.len);
+				if (q.owned == NULL) {
+					continue;
+				}
+				q.wire = q.owned;
+			} else {
+				continue;
+			}
+
+			const struct timespec *ts = msg.has_query_time ?
+			                            &msg.query_time : &msg.response_time;
+			q.time = ts->tv_sec * NS_PER_S + ts->tv_nsec;
+
+			if (r->count == capacity) {
+				capacity = capacity ? 2 * capacity : 1024;
+				query_t *queries = realloc(r->queries, capacity * sizeof(query_t));
+				if (queries == NULL) {
+					free(q.owned);
+					return KNOT_ENOMEM;
+				}
+				r->queries = queries;
+			}
+			r->queries[r->count++] = q;
+		}
+
+		if (ret != KNOT_EOK && ret != KNOT_EOF) {
+			return ret;
+		}
+
+		/* Rebuild queries from responses only if there are none. */
+		if (has_queries) {
+			break;
+		}
+	}
+
+	/* Frames from different server threads may be interleaved. */
+	qsort(r->queries, r->count, sizeof(query_t), query_cmp);
+
+	return KNOT_EOK;
+}
+
+/*! \brief Receive responses and match them with the sent queries. */
+static void *receiver(void *arg)
+{
+	replay_t *r = arg;
+
+	static uint8_t bufs[BATCH][RECV_BUFSIZE];
+	struct mmsghdr msgs[BATCH];
+	struct iovec iov[BATCH];
+	memset(msgs, 0, sizeof(msgs));
+	for (unsigned i = 0; i < BATCH; ++i) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = RECV_BUFSIZE;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	struct pollfd pfd = { r->fd, POLLIN, 0 };
+	while (!r->stop) {
+		if (poll(&pfd, 1, 100) <= 0) {
+			continue;
+		}
+
+		int n = recvmmsg(r->fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+		uint64_t now = now_ns();
+		for (int i = 0; i < n; ++i) {
+			if (msgs[i].msg_len < KNOT_WIRE_HEADER_SIZE ||
+			    !knot_wire_get_qr(bufs[i])) {
+				continue;
+			}
+
+			/* Claim the query, it may be resent with the same ID. */
+			uint16_t id = knot_wire_get_id(bufs[i]);
+			uint64_t sent = __sync_lock_test_and_set(&r->sent_at[id], 0);
+			if (sent == 0) {
+				continue;
+			}
+
+			r->latency[r->received++] = (now - sent) / 1000;
+			r->rcodes[knot_wire_get_rcode(bufs[i])] += 1;
+		}
+	}
+
+	return NULL;
+}
+
+/*! \brief Time when the query should be sent, relative to the start [ns]. */
+static uint64_t schedule(const replay_t *r, size_t i)
+{
+	if (r->rate > 0) {
+		return i * NS_PER_S / r->rate;
+	}
+	if (r->speed <= 0) {
+		return 0;
+	}
+
+	return (r->queries[i].time - r->queries[0].time) / r->speed;
+}
+
+/*! \brief Send the queries on schedule in batches. */
+static int sender(replay_t *r)
+{
+	struct mmsghdr msgs[BATCH];
+	struct iovec iov[BATCH][2];
+	uint8_t ids[BATCH][2];
+	memset(msgs, 0, sizeof(msgs));
+
+	uint64_t start = now_ns();
+	size_t next = 0;
+	while (next < r->count) {
+		/* Wait for the next query. */
+		uint64_t elapsed = now_ns() - start;
+		uint64_t due = schedule(r, next);
+		if (due > elapsed) {
+			uint64_t wait = due - elapsed;
+			struct timespec ts = { 0, wait > MAX_SLEEP ? MAX_SLEEP : wait };
+			nanosleep(&ts, NULL);
+			continue;
+		}
+
+		/* Send all queries due, each with its own ID. */
+		unsigned batch = 0;
+		while (batch < BATCH && next + batch < r->count &&
+		       schedule(r, next + batch) <= elapsed) {
+			const query_t *q = &r->queries[next + batch];
+			uint16_t id = (next + batch) & UINT16_MAX;
+			wire_write_u16(ids[batch], id);
+			iov[batch][0].iov_base = ids[batch];
+			iov[batch][0].iov_len = sizeof(ids[batch]);
+			iov[batch][1].iov_base = (uint8_t *)q->wire + sizeof(ids[batch]);
+			iov[batch][1].iov_len = q->len - sizeof(ids[batch]);
+			msgs[batch].msg_hdr.msg_iov = iov[batch];
+			msgs[batch].msg_hdr.msg_iovlen = 2;
+			batch += 1;
+		}
+
+		uint64_t now = now_ns();
+		for (unsigned i = 0; i < batch; ++i) {
+			r->sent_at[(next + i) & UINT16_MAX] = now;
+		}
+
+		int ret = sendmmsg(r->fd, msgs, batch, 0);
+		if (ret < 0) {
+			if (errno == EINTR || errno == ENOBUFS || errno == EAGAIN) {
+				ret = 0;
+			} else {
+				fprintf(stderr, "Cannot send queries (%s)\n", strerror(errno));
+				return KNOT_ECONN;
+			}
+		}
+
+		/* Queries not accepted by the kernel are resent. */
+		for (unsigned i = ret; i < batch; ++i) {
+			r->sent_at[(next + i) & UINT16_MAX] = 0;
+		}
+		next += ret;
+		r->sent += ret;
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Wait for the outstanding responses. */
+static void wait_responses(replay_t *r)
+{
+	uint64_t deadline = now_ns() + r->timeout * NS_PER_S;
+	while (now_ns() < deadline && __sync_fetch_and_add(&r->received, 0) < r->sent) {
+		struct timespec ts = { 0, 10000000 };
+		nanosleep(&ts, NULL);
+	}
+}
+
+static int latency_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void print_results(replay_t *r, double duration)
+{
+	printf("Sent:      %zu queries in %.2f s (%.0f qps)\n", r->sent, duration,
+	       duration > 0 ? r->sent / duration : 0.0);
+	printf("Received:  %zu responses (%.2f%%)\n", r->received,
+	       r->sent > 0 ? 100.0 * r->received / r->sent : 0.0);
+
+	if (r->received == 0) {
+		return;
+	}
+
+	printf("Rcodes:   ");
+	for (unsigned i = 0; i < 16; ++i) {
+		if (r->rcodes[i] == 0) {
+			continue;
+		}
+		lookup_table_t *rcode = lookup_by_id(knot_rcode_names, i);
+		if (rcode != NULL) {
+			printf(" %s=%zu", rcode->name, r->rcodes[i]);
+		} else {
+			printf(" RCODE%u=%zu", i, r->rcodes[i]);
+		}
+	}
+	printf("\n");
+
+	qsort(r->latency, r->received, sizeof(uint32_t), latency_cmp);
+	const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	printf("Latency:   min=%.3f", r->latency[0] / 1000.0);
+	for (unsigned i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+		size_t idx = quantiles[i] * (r->received - 1);
+		printf(" p%g=%.3f", quantiles[i] * 100, r->latency[idx] / 1000.0);
+	}
+	printf(" max=%.3f ms\n", r->latency[r->received - 1] / 1000.0);
+}
+
+/*! \brief Open UDP socket connected to the target. */
+static int connect_target(const char *server, const char *port)
+{
+	struct addrinfo hints = { 0 };
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo *res = NULL;
+	int ret = getaddrinfo(server, port, &hints, &res);
+	if (ret != 0) {
+		fprintf(stderr, "Cannot resolve '%s' (%s)\n", server, gai_strerror(ret));
+		return -1;
+	}
+
+	int fd = socket(res->ai_family, SOCK_DGRAM, 0);
+	if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+		fprintf(stderr, "Cannot connect to '%s' (%s)\n", server, strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+		}
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	/* Bursts of responses must not be dropped locally. */
+	int bufsize = 8 * 1024 * 1024;
+	if (fd >= 0) {
+		(void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+		(void)setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	}
+
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *server = "127.0.0.1";
+	const char *port = "53";
+	int limit = 0;
+
+	replay_t *r = calloc(1, sizeof(replay_t));
+	if (r == NULL) {
+		return 1;
+	}
+	r->fd = -1;
+	r->speed = 1.0;
+	r->timeout = 2;
+
+	struct option options[] = {
+		{ "server",  required_argument, 0, 's' },
+		{ "port",    required_argument, 0, 'p' },
+		{ "speed",   required_argument, 0, 'x' },
+		{ "rate",    required_argument, 0, 'r' },
+		{ "count",   required_argument, 0, 'n' },
+		{ "timeout", required_argument, 0, 't' },
+		{ "version", no_argument,       0, 'V' },
+		{ "help",    no_argument,       0, 'h' },
+		{ NULL }
+	};
+
+	int opt = 0;
+	int li = 0;
+	char *end = NULL;
+	int rate = 0;
+	while ((opt = getopt_long(argc, argv, "s:p:x:r:n:t:hV", options, &li)) != -1) {
+		switch (opt) {
+		case 's':
+			server = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 'x':
+			r->speed = strtod(optarg, &end);
+			if (*end != '\0' || r->speed < 0) {
+				fprintf(stderr, "Invalid speed '%s'\n", optarg);
+				free(r);
+				return 1;
+			}
+			break;
+		case 'r':
+			if (knot_str2int(optarg, &rate) != KNOT_EOK || rate <= 0) {
+				fprintf(stderr, "Invalid rate '%s'\n", optarg);
+				free(r);
+				return 1;
+			}
+			r->rate = rate;
+			break;
+		case 'n':
+			if (knot_str2int(optarg, &limit) != KNOT_EOK || limit <= 0) {
+				fprintf(stderr, "Invalid count '%s'\n", optarg);
+				free(r);
+				return 1;
+			}
+			break;
+		case 't':
+			if (knot_str2int(optarg, &r->timeout) != KNOT_EOK || r->timeout < 0) {
+				fprintf(stderr, "Invalid timeout '%s'\n", optarg);
+				free(r);
+				return 1;
+			}
+			break;
+		case 'V':
+			printf("%s, version %s\n", PROGRAM_NAME, PACKAGE_VERSION);
+			free(r);
+			return 0;
+		case 'h':
+			usage(stdout);
+			free(r);
+			return 0;
+		default:
+			usage(stderr);
+			free(r);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(stderr);
+		free(r);
+		return 1;
+	}
+
+	int exit_code = 1;
+	dt_mmap_reader_t reader;
+	int ret = dt_mmap_reader_open(&reader, argv[optind]);
+	if (ret != KNOT_EOK) {
+		fprintf(stderr, "Cannot open capture '%s' (%s)\n", argv[optind],
+		        knot_strerror(ret));
+		free(r);
+		return 1;
+	}
+
+	ret = load_queries(&reader, r, limit > 0 ? limit : SIZE_MAX);
+	if (ret != KNOT_EOK) {
+		fprintf(stderr, "Cannot read capture '%s' (%s)\n", argv[optind],
+		        knot_strerror(ret));
+		goto fail;
+	}
+	if (r->count == 0) {
+		fprintf(stderr, "No queries in the capture '%s'\n", argv[optind]);
+		goto fail;
+	}
+
+	r->latency = malloc(r->count * sizeof(uint32_t));
+	r->fd = connect_target(server, port);
+	if (r->latency == NULL || r->fd < 0) {
+		goto fail;
+	}
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, receiver, r) != 0) {
+		fprintf(stderr, "Cannot start the receiver\n");
+		goto fail;
+	}
+
+	uint64_t start = now_ns();
+	ret = sender(r);
+	double duration = (now_ns() - start) / (double)NS_PER_S;
+	wait_responses(r);
+	r->stop = true;
+	pthread_join(thread, NULL);
+
+	print_results(r, duration);
+	exit_code = (ret == KNOT_EOK) ? 0 : 1;
+
+fail:
+	if (r->fd >= 0) {
+		close(r->fd);
+	}
+	for (size_t i = 0; i < r->count; ++i) {
+		free(r->queries[i].owned);
+	}
+	free(r->queries);
+	free(r->latency);
+	free(r);
+	dt_mmap_reader_close(&reader);
+
+	return exit_code;
+}
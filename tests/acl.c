@@ -46,9 +46,10 @@ static int acl_insert(list_t *acl, const struct sockaddr_storage *addr,
 
 int main(int argc, char *argv[])
 {
-	plan(15);
+	plan(22);
 
 	conf_iface_t *match = NULL;
+	conf_remote_t *remote = NULL, *next = NULL;
 	list_t acl;
 	init_list(&acl);
 
@@ -133,12 +134,61 @@ int main(int argc, char *argv[])
 	knot_tsig_create_key("tsig-bad", KNOT_TSIG_ALG_HMAC_MD5, "Wg==", &badkey);
 	match = acl_find(&acl, &test_pf6, badkey.name);
 	ok(match == NULL, "acl: searching v6 address with bad TSIG key");
+
+	// Compiled ACL gives the same results
+	acl_tree_t *tree = acl_tree_build(&acl);
+	ok(tree != NULL, "acl: compiled");
+	ok(acl_tree_find(tree, &unmatch_v4, NULL) == NULL &&
+	   acl_tree_find(tree, &unmatch_v6, NULL) == NULL,
+	   "acl: compiled, matching non-existing address");
+	ok(acl_tree_find(tree, &test_v4, NULL) != NULL &&
+	   acl_tree_find(tree, &test_v6, NULL) != NULL,
+	   "acl: compiled, matching existing address");
+	sockaddr_set(&test_pf4, AF_INET, "192.168.1.20", 0);
+	ok(acl_tree_find(tree, &test_pf4, NULL) != NULL &&
+	   acl_tree_find(tree, &test_pf6, NULL) != NULL,
+	   "acl: compiled, searching address in matching prefix");
+	match = acl_tree_find(tree, &test_pf6, key_b.name);
+	ok(match != NULL && match->key == &key_b &&
+	   acl_tree_find(tree, &test_pf6, badkey.name) == NULL,
+	   "acl: compiled, searching v6 address with TSIG key");
+	acl_tree_free(tree);
+	ok(acl_tree_find(NULL, &test_v4, NULL) == NULL, "acl: compiled empty");
 	knot_tsig_key_free(&badkey);
 
+	// Random rules, compiled ACL must agree with the list
+	list_t random_acl;
+	init_list(&random_acl);
+	for (int i = 0; i < 500; ++i) {
+		struct sockaddr_storage rule;
+		char addr_str[32];
+		snprintf(addr_str, sizeof(addr_str), "10.%d.%d.%d",
+		         rand() % 4, rand() % 256, rand() % 256);
+		sockaddr_set(&rule, AF_INET, addr_str, 0);
+		acl_insert(&random_acl, &rule, 8 + rand() % 25, NULL);
+	}
+	tree = acl_tree_build(&random_acl);
+	int mismatch = 0;
+	for (int i = 0; i < 10000; ++i) {
+		struct sockaddr_storage query;
+		char addr_str[32];
+		snprintf(addr_str, sizeof(addr_str), "%d.%d.%d.%d", 9 + rand() % 3,
+		         rand() % 5, rand() % 256, rand() % 256);
+		sockaddr_set(&query, AF_INET, addr_str, 0);
+		bool list_match = acl_find(&random_acl, &query, NULL) != NULL;
+		bool tree_match = acl_tree_find(tree, &query, NULL) != NULL;
+		mismatch += (list_match != tree_match);
+	}
+	ok(mismatch == 0, "acl: compiled, random rules");
+	acl_tree_free(tree);
+	WALK_LIST_DELSAFE(remote, next, random_acl) {
+		free(remote->remote);
+		free(remote);
+	}
+
 	knot_tsig_key_free(&key_a);
 	knot_tsig_key_free(&key_b);
 
-	conf_remote_t *remote = NULL, *next = NULL;
 	WALK_LIST_DELSAFE(remote, next, acl) {
 		free(remote->remote);
 		free(remote);
@@ -0,0 +1,183 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <tap/basic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libknot/descriptor.h"
+#include "libknot/internal/mempool.h"
+#include "libknot/packet/wire.h"
+#include "knot/nameserver/process_query.h"
+#include "knot/updates/acl.h"
+#include "fake_server.h"
+
+/* Enough records for several messages. */
+#define RECORD_COUNT 8000
+/* Maximum number of messages of a transfer. */
+#define MSG_MAX 64
+
+/*! \brief Outgoing transfer, messages are kept for comparison. */
+struct transfer {
+	knot_layer_t proc;
+	mm_ctx_t mm;
+	knot_pkt_t *msgs[MSG_MAX];
+	unsigned count;
+	unsigned records;
+	int state;
+};
+
+static void transfer_begin(struct transfer *xfr, struct process_query_param *param,
+                           knot_pkt_t *query)
+{
+	memset(xfr, 0, sizeof(*xfr));
+	mm_ctx_mempool(&xfr->mm, MM_DEFAULT_BLKSIZE);
+	xfr->proc.mm = &xfr->mm;
+	knot_layer_begin(&xfr->proc, NS_PROC_QUERY, param);
+	xfr->state = knot_layer_in(&xfr->proc, query);
+}
+
+/*! \brief Produce next message of the transfer. */
+static void transfer_next(struct transfer *xfr)
+{
+	if (xfr->state != KNOT_NS_PROC_FULL || xfr->count == MSG_MAX) {
+		xfr->state = KNOT_NS_PROC_FAIL;
+		return;
+	}
+
+	knot_pkt_t *msg = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	xfr->state = knot_layer_out(&xfr->proc, msg);
+	xfr->msgs[xfr->count++] = msg;
+
+	knot_pkt_t *parsed = knot_pkt_new(msg->wire, msg->size, NULL);
+	if (knot_pkt_parse(parsed, 0) == KNOT_EOK) {
+		xfr->records += knot_pkt_section(parsed, KNOT_ANSWER)->count;
+	}
+	knot_pkt_free(&parsed);
+}
+
+static void transfer_end(struct transfer *xfr)
+{
+	knot_layer_finish(&xfr->proc);
+	for (unsigned i = 0; i < xfr->count; ++i) {
+		knot_pkt_free(&xfr->msgs[i]);
+	}
+	mp_delete(xfr->mm.ctx);
+}
+
+static bool transfer_same(const struct transfer *a, const struct transfer *b)
+{
+	if (a->count != b->count) {
+		return false;
+	}
+
+	for (unsigned i = 0; i < a->count; ++i) {
+		if (a->msgs[i]->size != b->msgs[i]->size ||
+		    memcmp(a->msgs[i]->wire, b->msgs[i]->wire, a->msgs[i]->size) != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	server_t server;
+	create_fake_server(&server, NULL);
+
+	/* Zone with many records. */
+	zone_contents_t *contents = create_fake_contents(EXAMPLE_DNAME, 1);
+	for (int i = 0; i < RECORD_COUNT; ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "host%d.example.", i);
+		knot_dname_t *owner = knot_dname_from_str_alloc(name);
+		uint8_t addr[4] = { 10, 0, i / 256, i % 256 };
+		add_fake_rr(contents, owner, KNOT_RRTYPE_A, addr, sizeof(addr));
+		knot_dname_free(&owner, NULL);
+	}
+	adjust_fake_contents(contents);
+	zone_t *zone = create_fake_zone("example.", contents);
+
+	knot_zonedb_free(&server.zone_db);
+	server.zone_db = knot_zonedb_new(1);
+	knot_zonedb_insert(server.zone_db, zone);
+	knot_zonedb_build_index(server.zone_db);
+
+	/* Allow transfers from the localhost. */
+	static conf_iface_t localhost;
+	sockaddr_set(&localhost.addr, AF_INET, "127.0.0.1", 0);
+	localhost.prefix = 32;
+	conf_remote_t *rule = malloc(sizeof(conf_remote_t));
+	rule->remote = &localhost;
+	add_tail(&zone->conf->acl.xfr_out, &rule->n);
+	zone->conf->acl_tree.xfr_out = acl_tree_build(&zone->conf->acl.xfr_out);
+
+	struct sockaddr_storage ss;
+	sockaddr_set(&ss, AF_INET, "127.0.0.1", 53);
+	struct process_query_param param = { 0 };
+	param.remote = &ss;
+	param.server = &server;
+
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_put_question(query, EXAMPLE_DNAME, KNOT_CLASS_IN, KNOT_RRTYPE_AXFR);
+	knot_pkt_parse(query, 0);
+
+	/* Concurrent transfers share the messages. */
+	struct transfer first, second;
+	transfer_begin(&first, &param, query);
+	transfer_begin(&second, &param, query);
+	transfer_next(&first);
+	transfer_next(&second);
+	ok(contents->axfr_stream != NULL, "axfr: messages shared by the transfers");
+	while (first.state == KNOT_NS_PROC_FULL || second.state == KNOT_NS_PROC_FULL) {
+		if (first.state == KNOT_NS_PROC_FULL) {
+			transfer_next(&first);
+		}
+		if (second.state == KNOT_NS_PROC_FULL) {
+			transfer_next(&second);
+		}
+	}
+	ok(first.state == KNOT_NS_PROC_DONE && second.state == KNOT_NS_PROC_DONE,
+	   "axfr: transfers finished");
+	ok(first.count > 1, "axfr: transfer split into %u messages", first.count);
+	is_int(RECORD_COUNT + 2, first.records, "axfr: all records transferred");
+	ok(transfer_same(&first, &second), "axfr: transfers identical");
+
+	transfer_end(&first);
+	ok(contents->axfr_stream != NULL, "axfr: messages kept for running transfer");
+	transfer_end(&second);
+	ok(contents->axfr_stream == NULL, "axfr: messages released after the transfers");
+
+	/* Next transfer serializes the messages again. */
+	struct transfer third;
+	transfer_begin(&third, &param, query);
+	transfer_next(&third);
+	while (third.state == KNOT_NS_PROC_FULL) {
+		transfer_next(&third);
+	}
+	is_int(RECORD_COUNT + 2, third.records, "axfr: later transfer complete");
+	transfer_end(&third);
+	ok(contents->axfr_stream == NULL, "axfr: messages of later transfer released");
+
+	knot_pkt_free(&query);
+	server_deinit(&server);
+	conf_free(conf());
+
+	return 0;
+}
@@ -28,7 +28,7 @@
 
 int main(int argc, char *argv[])
 {
-	plan(67);
+	plan(70);
 
 	int32_t  ret;
 	uint8_t  in[BUF_LEN], ref[BUF_LEN], out[BUF_LEN], out2[BUF_LEN], *out3;
@@ -263,5 +263,17 @@ int main(int argc, char *argv[])
 	ret = base32hex_decode((uint8_t *)"$AAAAAAA", 8, out, BUF_LEN);
 	ok(ret == KNOT_BASE32HEX_ECHAR, "Bad data character dollar on position 1");
 
+	// Long data (processed in blocks)
+	for (in_len = 0; in_len < 100; in_len++) {
+		in[in_len] = in_len * 73;
+	}
+	ret = base32hex_encode(in, in_len, out, BUF_LEN);
+	ok(ret == 160, "Long data - ENC output length");
+	ret = base32hex_decode(out, 160, out2, BUF_LEN);
+	ok(ret == in_len && memcmp(out2, in, in_len) == 0, "Long data - DEC output");
+	out[40] = 'W';
+	ret = base32hex_decode(out, 160, out2, BUF_LEN);
+	ok(ret == KNOT_BASE32HEX_ECHAR, "Long data - bad character in the middle");
+
 	return 0;
 }
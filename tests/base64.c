@@ -28,7 +28,7 @@
 
 int main(int argc, char *argv[])
 {
-	plan(52);
+	plan(55);
 
 	int32_t  ret;
 	uint8_t  in[BUF_LEN], ref[BUF_LEN], out[BUF_LEN], out2[BUF_LEN], *out3;
@@ -233,5 +233,17 @@ int main(int argc, char *argv[])
 	ret = base64_decode((uint8_t *)"AAA ", 4, out, BUF_LEN);
 	ok(ret == KNOT_BASE64_ECHAR, "Bad data character space");
 
+	// Long data (processed in blocks)
+	for (in_len = 0; in_len < 150; in_len++) {
+		in[in_len] = in_len * 73;
+	}
+	ret = base64_encode(in, in_len, out, BUF_LEN);
+	ok(ret == 200, "Long data - ENC output length");
+	ret = base64_decode(out, 200, out2, BUF_LEN);
+	ok(ret == in_len && memcmp(out2, in, in_len) == 0, "Long data - DEC output");
+	out[20] = '=';
+	ret = base64_decode(out, 200, out2, BUF_LEN);
+	ok(ret == KNOT_BASE64_ECHAR, "Long data - bad padding in the middle");
+
 	return 0;
 }
@@ -0,0 +1,80 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libknot/internal/base32hex.h"
+#include "libknot/internal/base64.h"
+
+/*! \brief Size of binary data in one codec call (typical RRSIG signature). */
+#define CHUNK_LEN	256
+/*! \brief Total amount of binary data processed per measurement. */
+#define TOTAL_LEN	(256 * 1024 * 1024)
+
+typedef int32_t (*codec_t)(const uint8_t *, const uint32_t, uint8_t *,
+                           const uint32_t);
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*! \brief Run codec over the input and print binary data throughput. */
+static void measure(const char *name, codec_t codec, const uint8_t *in,
+                    uint32_t in_len, uint32_t bin_len)
+{
+	uint8_t out[2 * CHUNK_LEN];
+	unsigned rounds = TOTAL_LEN / bin_len;
+
+	double begin = now();
+	for (unsigned i = 0; i < rounds; ++i) {
+		if (codec(in, in_len, out, sizeof(out)) < 0) {
+			printf("%-18s failed\n", name);
+			return;
+		}
+	}
+	double elapsed = now() - begin;
+
+	printf("%-18s %8.1f MB/s\n", name, (double)TOTAL_LEN / elapsed / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t bin[CHUNK_LEN], b64[2 * CHUNK_LEN], b32[2 * CHUNK_LEN];
+
+	srand(time(NULL));
+	for (unsigned i = 0; i < CHUNK_LEN; ++i) {
+		bin[i] = rand();
+	}
+
+	int32_t b64_len = base64_encode(bin, CHUNK_LEN, b64, sizeof(b64));
+	int32_t b32_len = base32hex_encode(bin, CHUNK_LEN, b32, sizeof(b32));
+	if (b64_len < 0 || b32_len < 0) {
+		return EXIT_FAILURE;
+	}
+
+	measure("base64_encode", base64_encode, bin, CHUNK_LEN, CHUNK_LEN);
+	measure("base64_decode", base64_decode, b64, b64_len, CHUNK_LEN);
+	measure("base32hex_encode", base32hex_encode, bin, CHUNK_LEN, CHUNK_LEN);
+	measure("base32hex_decode", base32hex_decode, b32, b32_len, CHUNK_LEN);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libknot/errcode.h"
+#include "knot/common/evsched.h"
+
+/*! \brief Number of scheduled events (one per zone timer). */
+#define EVENT_COUNT	(1024 * 1024)
+/*! \brief Number of concurrently scheduling threads. */
+#define THREADS		4
+/*! \brief Maximum timeout of long-term events (one day, milliseconds). */
+#define LONG_DT		(24 * 3600 * 1000)
+/*! \brief Maximum timeout of events waited for (milliseconds). */
+#define SHORT_DT	2000
+
+struct bench {
+	event_t **events;
+	unsigned begin;
+	unsigned end;
+	uint32_t max_dt;
+	unsigned seed;
+};
+
+static unsigned fired = 0;
+static int64_t early = 0;
+static int64_t late = 0;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*! \brief Count fired events and their deviation from the scheduled time. */
+static int count_cb(event_t *ev)
+{
+	int64_t diff = (int64_t)(now() * 1000) - (int64_t)ev->time;
+	if (diff < early) {
+		early = diff;
+	}
+	if (diff > late) {
+		late = diff;
+	}
+
+	fired += 1;
+	return KNOT_EOK;
+}
+
+static void *schedule_range(void *arg)
+{
+	struct bench *b = arg;
+	for (unsigned i = b->begin; i < b->end; ++i) {
+		evsched_schedule(b->events[i], rand_r(&b->seed) % b->max_dt);
+	}
+
+	return NULL;
+}
+
+/*! \brief Schedule all events from several threads and print the rate. */
+static void measure_schedule(const char *name, event_t **events,
+                             unsigned threads, uint32_t max_dt)
+{
+	pthread_t thr[THREADS];
+	struct bench b[THREADS];
+	unsigned chunk = EVENT_COUNT / threads;
+
+	double begin = now();
+	for (unsigned i = 0; i < threads; ++i) {
+		b[i] = (struct bench) { events, i * chunk, (i + 1) * chunk, max_dt,
+		                        rand() };
+		pthread_create(&thr[i], NULL, schedule_range, &b[i]);
+	}
+	for (unsigned i = 0; i < threads; ++i) {
+		pthread_join(thr[i], NULL);
+	}
+	double elapsed = now() - begin;
+
+	printf("%-24s %8.2f Mevents/s\n", name, EVENT_COUNT / elapsed / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	evsched_t sched;
+	if (evsched_init(&sched, NULL) != KNOT_EOK) {
+		return EXIT_FAILURE;
+	}
+
+	event_t **events = malloc(EVENT_COUNT * sizeof(event_t *));
+	if (events == NULL) {
+		return EXIT_FAILURE;
+	}
+	for (unsigned i = 0; i < EVENT_COUNT; ++i) {
+		events[i] = evsched_event_create(&sched, count_cb, NULL);
+		if (events[i] == NULL) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	srand(time(NULL));
+
+	/* Long-term timers, like zone refresh or expiration. */
+	measure_schedule("schedule", events, 1, LONG_DT);
+	measure_schedule("reschedule", events, 1, LONG_DT);
+	measure_schedule("reschedule (4 threads)", events, THREADS, LONG_DT);
+
+	double begin = now();
+	for (unsigned i = 0; i < EVENT_COUNT; ++i) {
+		evsched_cancel(events[i]);
+	}
+	double elapsed = now() - begin;
+	printf("%-24s %8.2f Mevents/s\n", "cancel", EVENT_COUNT / elapsed / 1e6);
+
+	/* Wait for short-term timers to expire. */
+	measure_schedule("schedule short", events, 1, SHORT_DT);
+	begin = now();
+	while (fired < EVENT_COUNT) {
+		event_t *ev = evsched_begin_process(&sched);
+		ev->cb(ev);
+		evsched_end_process(&sched);
+	}
+	elapsed = now() - begin;
+	printf("%-24s %8.2f seconds (%.2f s expected)\n", "expire all", elapsed,
+	       SHORT_DT / 1000.0);
+	printf("%-24s %8lld ms early, %lld ms late\n", "max deviation",
+	       (long long)-early, (long long)late);
+
+	for (unsigned i = 0; i < EVENT_COUNT; ++i) {
+		evsched_event_free(events[i]);
+	}
+	free(events);
+	evsched_deinit(&sched);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "libknot/errcode.h"
+#include "libknot/internal/hash.h"
+#include "libknot/internal/hhash.h"
+#include "libknot/internal/trie/murmurhash3.h"
+
+/*! \brief Number of generated names. */
+#define NAME_COUNT	(1024 * 1024)
+/*! \brief Maximum generated name length. */
+#define NAME_MAXLEN	64
+/*! \brief Lookup rounds over all names. */
+#define ROUNDS		8
+
+struct name {
+	uint16_t len;
+	char wire[NAME_MAXLEN];
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*! \brief Generate name in wire format like 'www<N>.<label>.<tld>'. */
+static void name_generate(struct name *name, unsigned i)
+{
+	static const char *tlds[] = { "\x03" "com", "\x03" "net", "\x03" "org",
+	                              "\x02" "cz", "\x02" "de", "\x04" "info" };
+	char label[NAME_MAXLEN];
+
+	/* Host label. */
+	int len = snprintf(label, sizeof(label), "www%u", i);
+	name->wire[0] = len;
+	memcpy(name->wire + 1, label, len);
+	name->len = 1 + len;
+
+	/* Domain label with varying length. */
+	len = 3 + rand() % 20;
+	name->wire[name->len++] = len;
+	for (int j = 0; j < len; ++j) {
+		name->wire[name->len++] = 'a' + rand() % 26;
+	}
+
+	/* TLD and root label. */
+	const char *tld = tlds[rand() % (sizeof(tlds) / sizeof(tlds[0]))];
+	memcpy(name->wire + name->len, tld, tld[0] + 1);
+	name->len += tld[0] + 1;
+	name->wire[name->len++] = '\0';
+}
+
+typedef uint32_t (*hash_fn_t)(const char *, size_t);
+
+static uint32_t keyed(const char *data, size_t len)
+{
+	static const hash_key_t key = { 0x0706050403020100, 0x0f0e0d0c0b0a0908 };
+	return hash_keyed(&key, data, len);
+}
+
+/*! \brief Hash all names repeatedly and print key throughput. */
+static void measure_hash(const char *name, hash_fn_t fn, const struct name *names)
+{
+	uint32_t sink = 0;
+
+	double begin = now();
+	for (unsigned r = 0; r < ROUNDS; ++r) {
+		for (unsigned i = 0; i < NAME_COUNT; ++i) {
+			sink += fn(names[i].wire, names[i].len);
+		}
+	}
+	double elapsed = now() - begin;
+
+	printf("%-16s %8.2f Mkeys/s (%x)\n", name,
+	       ROUNDS * NAME_COUNT / elapsed / 1e6, sink);
+}
+
+int main(int argc, char *argv[])
+{
+	struct name *names = malloc(NAME_COUNT * sizeof(struct name));
+	hhash_t *tbl = hhash_create(2 * NAME_COUNT);
+	if (names == NULL || tbl == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	srand(time(NULL));
+	for (unsigned i = 0; i < NAME_COUNT; ++i) {
+		name_generate(&names[i], i);
+	}
+
+	/* Raw hash functions. */
+	measure_hash("murmurhash3", hash, names);
+	measure_hash("hash_fast", hash_fast, names);
+	measure_hash("hash_keyed", keyed, names);
+
+	/* Hash table insertion and lookup. */
+	double begin = now();
+	for (unsigned i = 0; i < NAME_COUNT; ++i) {
+		if (hhash_insert(tbl, names[i].wire, names[i].len, &names[i]) != KNOT_EOK) {
+			printf("hhash_insert failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	double elapsed = now() - begin;
+	printf("%-16s %8.2f Mkeys/s\n", "hhash_insert", NAME_COUNT / elapsed / 1e6);
+
+	unsigned found = 0;
+	begin = now();
+	for (unsigned r = 0; r < ROUNDS; ++r) {
+		for (unsigned i = 0; i < NAME_COUNT; ++i) {
+			unsigned k = (i * 7919) % NAME_COUNT;
+			found += hhash_find(tbl, names[k].wire, names[k].len) != NULL;
+		}
+	}
+	elapsed = now() - begin;
+	printf("%-16s %8.2f Mkeys/s (%u found)\n", "hhash_find",
+	       ROUNDS * NAME_COUNT / elapsed / 1e6, found);
+
+	hhash_free(tbl);
+	free(names);
+	return EXIT_SUCCESS;
+}
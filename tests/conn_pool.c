@@ -0,0 +1,97 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <tap/basic.h>
+
+#include "libknot/errcode.h"
+#include "libknot/internal/net.h"
+#include "knot/common/conn_pool.h"
+
+/*! \brief Connect to the listening socket, return both ends. */
+static int connect_pair(int listener, const struct sockaddr_storage *addr,
+                        int *accepted)
+{
+	struct sockaddr_storage any;
+	memset(&any, 0, sizeof(any));
+	int fd = net_connected_socket(SOCK_STREAM, addr, &any, 0);
+	assert(fd >= 0);
+	*accepted = accept(listener, NULL, NULL);
+	assert(*accepted >= 0);
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	struct sockaddr_storage any, remote, other;
+	memset(&any, 0, sizeof(any));
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 0);
+	sockaddr_set(&other, AF_INET, "127.0.0.1", 1);
+	int listener = net_bound_socket(SOCK_STREAM, &remote);
+	assert(listener >= 0);
+	socklen_t len = sizeof(remote);
+	getsockname(listener, (struct sockaddr *)&remote, &len);
+	listen(listener, 8);
+
+	/* Disabled pool doesn't keep connections. */
+	int peer = -1;
+	int fd = connect_pair(listener, &remote, &peer);
+	conn_pool_put(&any, &remote, fd);
+	is_int(KNOT_ENOENT, conn_pool_get(&any, &remote), "conn_pool: disabled");
+	close(peer);
+
+	is_int(KNOT_EOK, conn_pool_init(), "conn_pool: init");
+
+	/* Parked connection is reused for the same endpoints only. */
+	fd = connect_pair(listener, &remote, &peer);
+	conn_pool_put(&any, &remote, fd);
+	is_int(KNOT_ENOENT, conn_pool_get(&any, &other), "conn_pool: other remote");
+	is_int(fd, conn_pool_get(&any, &remote), "conn_pool: connection reused");
+	is_int(KNOT_ENOENT, conn_pool_get(&any, &remote), "conn_pool: taken once");
+
+	/* Connection closed by the remote is discarded. */
+	conn_pool_put(&any, &remote, fd);
+	close(peer);
+	usleep(10000);
+	is_int(KNOT_ENOENT, conn_pool_get(&any, &remote), "conn_pool: closed discarded");
+
+	/* Full pool evicts the oldest connection. */
+	int peers[CONN_POOL_CAPACITY + 1];
+	for (int i = 0; i <= CONN_POOL_CAPACITY; ++i) {
+		fd = connect_pair(listener, &remote, &peers[i]);
+		conn_pool_put(&any, &remote, fd);
+	}
+	conn_pool_stats_t stats = { 0 };
+	conn_pool_stats(&stats);
+	ok(stats.idle == CONN_POOL_CAPACITY && stats.reused == 1 && stats.expired == 2,
+	   "conn_pool: capacity limited");
+
+	/* Deinit closes idle connections. */
+	conn_pool_deinit();
+	conn_pool_stats(&stats);
+	is_int(0, stats.idle, "conn_pool: deinit");
+
+	for (int i = 0; i <= CONN_POOL_CAPACITY; ++i) {
+		close(peers[i]);
+	}
+	close(listener);
+
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <tap/basic.h>
+
+#include "libknot/descriptor.h"
+#include "libknot/rdata.h"
+#include "knot/updates/apply.h"
+#include "knot/updates/changesets.h"
+#include "knot/zone/contents.h"
+#include "fake_server.h"
+
+#define UPDATE_COUNT 40
+
+static const uint8_t EXAMPLE[] = "\x07""example";
+static const uint8_t WWW[] = "\x03""www""\x07""example";
+static const uint8_t MAIL[] = "\x04""mail""\x07""example";
+
+static const knot_rdata_t *rdata_at(const zone_contents_t *contents,
+                                    const knot_dname_t *owner, uint16_t pos)
+{
+	const zone_node_t *node = zone_contents_find_node(contents, owner);
+	const knot_rdataset_t *rrs = node_rdataset(node, KNOT_RRTYPE_A);
+	if (rrs == NULL || pos >= rrs->rr_count) {
+		return NULL;
+	}
+
+	return knot_rdataset_at(rrs, pos);
+}
+
+static uint16_t rr_count(const zone_contents_t *contents, const knot_dname_t *owner)
+{
+	const zone_node_t *node = zone_contents_find_node(contents, owner);
+	const knot_rdataset_t *rrs = node_rdataset(node, KNOT_RRTYPE_A);
+	return rrs ? rrs->rr_count : 0;
+}
+
+/*! \brief Update the zone, replace the lower WWW address with a new one. */
+static int update_zone(zone_t *zone, uint32_t serial)
+{
+	changeset_t ch;
+	changeset_init(&ch, zone->name);
+	ch.soa_from = create_fake_soa(zone->name, serial);
+	ch.soa_to = create_fake_soa(zone->name, serial + 1);
+
+	uint8_t addr[4] = { 192, 0, 2, serial };
+	knot_rrset_t *rr = knot_rrset_new(WWW, KNOT_RRTYPE_A, KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(rr, addr, sizeof(addr), 3600, NULL);
+	changeset_rem_rrset(&ch, rr);
+	knot_rrset_free(&rr, NULL);
+	addr[3] = serial + 2;
+	rr = knot_rrset_new(WWW, KNOT_RRTYPE_A, KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(rr, addr, sizeof(addr), 3600, NULL);
+	changeset_add_rrset(&ch, rr);
+	knot_rrset_free(&rr, NULL);
+
+	zone_contents_t *contents = NULL;
+	int ret = apply_changeset(zone, &ch, &contents);
+	if (ret == KNOT_EOK) {
+		zone_contents_t *old = zone_switch_contents(zone, contents);
+		zone_contents_deep_free(&old);
+	}
+
+	changeset_clear(&ch);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	/* Zone with its own arenas, as loaded from the zone file. */
+	zone_contents_t *contents = zone_contents_new_arena(EXAMPLE);
+	knot_rrset_t *soa = create_fake_soa(EXAMPLE, 1);
+	zone_node_t *node = NULL;
+	zone_contents_add_rr(contents, soa, &node);
+	knot_rrset_free(&soa, NULL);
+	const uint8_t addr_www[] = { 192, 0, 2, 1 };
+	const uint8_t addr_mail[] = { 192, 0, 2, 25 };
+	add_fake_rr(contents, WWW, KNOT_RRTYPE_A, addr_www, sizeof(addr_www));
+	add_fake_rr(contents, MAIL, KNOT_RRTYPE_A, addr_mail, sizeof(addr_mail));
+	zone_contents_adjust_full(contents, NULL, NULL);
+	zone_t *zone = create_fake_zone("example.", contents);
+
+	/* The copy shares the RR data until they are modified. */
+	zone_contents_t *copy = NULL;
+	ok(zone_contents_copy(contents, &copy) == KNOT_EOK &&
+	   rdata_at(copy, MAIL, 0) == rdata_at(contents, MAIL, 0) &&
+	   rdata_at(copy, WWW, 0) == rdata_at(contents, WWW, 0) &&
+	   copy->apex != contents->apex,
+	   "contents: copy shares RR data, not nodes");
+
+	node = (zone_node_t *)zone_contents_find_node(copy, WWW);
+	const uint8_t addr_new[] = { 192, 0, 2, 2 };
+	knot_rrset_t *rr = knot_rrset_new(WWW, KNOT_RRTYPE_A, KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(rr, addr_new, sizeof(addr_new), 3600, NULL);
+	int ret = zone_contents_unshare_rdataset(copy, node, KNOT_RRTYPE_A);
+	if (ret == KNOT_EOK) {
+		ret = node_add_rrset_data(node, rr, &copy->mm, zone_contents_data_mm(copy));
+	}
+	knot_rrset_free(&rr, NULL);
+	ok(ret == KNOT_EOK && rr_count(copy, WWW) == 2 && rr_count(contents, WWW) == 1 &&
+	   rdata_at(copy, MAIL, 0) == rdata_at(contents, MAIL, 0),
+	   "contents: modified RR data copied on write");
+
+	/* Shared RR data outlive the original. */
+	zone_contents_deep_free(&contents);
+	zone->contents = copy;
+	const knot_rdata_t *mail = rdata_at(copy, MAIL, 0);
+	ok(mail && memcmp(knot_rdata_data(mail), addr_mail, sizeof(addr_mail)) == 0,
+	   "contents: shared RR data kept after the original is freed");
+
+	/* Updates share the unchanged RR data, until the arena chain is too long. */
+	const knot_rdata_t *first = rdata_at(zone->contents, MAIL, 0);
+	bool valid = true;
+	int shared = 0;
+	for (int i = 1; i <= UPDATE_COUNT && valid; ++i) {
+		valid = update_zone(zone, i) == KNOT_EOK &&
+		        rr_count(zone->contents, WWW) == 2 &&
+		        knot_rdata_data(rdata_at(zone->contents, WWW, 1))[3] == i + 2;
+		if (rdata_at(zone->contents, MAIL, 0) == first) {
+			shared += 1;
+		}
+	}
+	mail = rdata_at(zone->contents, MAIL, 0);
+	ok(valid, "contents: updates applied");
+	ok(shared > 1 && shared < UPDATE_COUNT, "contents: RR data copied after a chain of updates");
+	ok(mail && memcmp(knot_rdata_data(mail), addr_mail, sizeof(addr_mail)) == 0,
+	   "contents: RR data kept across the updates");
+
+	zone_free(&zone);
+
+	return 0;
+}
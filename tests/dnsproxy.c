@@ -0,0 +1,286 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <tap/basic.h>
+
+#include "libknot/descriptor.h"
+#include "libknot/errcode.h"
+#include "libknot/internal/net.h"
+#include "libknot/internal/sockaddr.h"
+#include "libknot/internal/utils.h"
+#include "knot/conf/conf.h"
+#include "knot/modules/dnsproxy.h"
+#include "knot/nameserver/process_query.h"
+#include "knot/server/server.h"
+
+/*! \brief Bind UDP socket to a random local port. */
+static int local_socket(struct sockaddr_storage *addr)
+{
+	sockaddr_set(addr, AF_INET, "127.0.0.1", 0);
+	int fd = net_bound_socket(SOCK_DGRAM, addr);
+	socklen_t len = sizeof(*addr);
+	getsockname(fd, (struct sockaddr *)addr, &len);
+	return fd;
+}
+
+static knot_pkt_t *make_query(const char *qname, uint16_t id)
+{
+	knot_dname_t *name = knot_dname_from_str_alloc(qname);
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_wire_set_id(query->wire, id);
+	knot_pkt_put_question(query, name, KNOT_CLASS_IN, KNOT_RRTYPE_A);
+	knot_dname_free(&name, NULL);
+	knot_pkt_parse(query, 0);
+	return query;
+}
+
+static ssize_t recv_wait(int fd, uint8_t *buf, size_t len, int timeout)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	if (poll(&pfd, 1, timeout) <= 0) {
+		return -1;
+	}
+	return recv(fd, buf, len, 0);
+}
+
+/*! \brief Receive the forwarded query. */
+static ssize_t upstream_recv(int fd, uint8_t *buf, struct sockaddr_storage *from)
+{
+	socklen_t fromlen = sizeof(*from);
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	if (poll(&pfd, 1, 2000) <= 0) {
+		return -1;
+	}
+	return recvfrom(fd, buf, KNOT_WIRE_MAX_PKTSIZE, 0, (struct sockaddr *)from,
+	                &fromlen);
+}
+
+/*! \brief Answer the forwarded query with a single A record (1.2.3.<last>). */
+static bool upstream_send(int fd, const uint8_t *query, size_t len,
+                          const struct sockaddr_storage *to, uint8_t last)
+{
+	if (len < KNOT_WIRE_HEADER_SIZE) {
+		return false;
+	}
+
+	uint8_t buf[KNOT_WIRE_MAX_PKTSIZE];
+	const uint8_t rr[] = { 0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01,
+	                       0x00, 0x00, 0x01, 0x2c, 0x00, 0x04, 1, 2, 3, last };
+	memcpy(buf, query, len);
+	memcpy(buf + len, rr, sizeof(rr));
+	knot_wire_set_qr(buf);
+	knot_wire_set_ancount(buf, 1);
+	return sendto(fd, buf, len + sizeof(rr), 0, (const struct sockaddr *)to,
+	              sockaddr_len((const struct sockaddr *)to)) > 0;
+}
+
+/*! \brief Answer the forwarded query with a single A record. */
+static bool upstream_answer(int fd)
+{
+	uint8_t buf[KNOT_WIRE_MAX_PKTSIZE];
+	struct sockaddr_storage from;
+	ssize_t len = upstream_recv(fd, buf, &from);
+	return upstream_send(fd, buf, len, &from, 4);
+}
+
+/*! \brief Check that the QNAME is the expected one in a different case. */
+static bool qname_case_differs(const uint8_t *wire, const char *lower)
+{
+	const uint8_t *qname = wire + KNOT_WIRE_HEADER_SIZE;
+	bool differs = false;
+	for (size_t i = 0; lower[i] != '\0'; ++i) {
+		if (tolower(qname[i]) != lower[i]) {
+			return false;
+		}
+		differs = differs || qname[i] != lower[i];
+	}
+
+	return differs;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	struct sockaddr_storage upstream_addr, server_addr, client_addr;
+	int upstream = local_socket(&upstream_addr);
+	int server = local_socket(&server_addr);
+	int client = local_socket(&client_addr);
+
+	/* Load into the server query plan with a small cache. */
+	struct conf config;
+	memset(&config, 0, sizeof(config));
+	config.max_conn_hs = 1;
+	config.query_plan = query_plan_create(NULL);
+
+	char param[64];
+	snprintf(param, sizeof(param), "127.0.0.1@%d 16", sockaddr_port(&upstream_addr));
+	struct query_module module;
+	memset(&module, 0, sizeof(module));
+	module.param = param;
+	module.config = &config;
+	is_int(KNOT_EOK, dnsproxy_load(config.query_plan, &module), "dnsproxy: load");
+	struct query_step *step = HEAD(config.query_plan->stage[QPLAN_BEGIN]);
+
+	/* Parked answers are counted in the deferred counters. */
+	server_t srv;
+	memset(&srv, 0, sizeof(srv));
+	stats_reserve(&srv.stats, 1);
+
+	struct process_query_param qparam = { 0 };
+	qparam.server = &srv;
+	qparam.socket = server;
+	qparam.remote = &client_addr;
+	struct query_data qdata;
+	memset(&qdata, 0, sizeof(qdata));
+	qdata.param = &qparam;
+	knot_pkt_t *ans = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+
+	/* UDP query is parked and answered from the upstream thread. */
+	qdata.query = make_query("example.com.", 0x1234);
+	int state = step->process(KNOT_NS_PROC_FULL, ans, &qdata, step->ctx);
+	is_int(KNOT_NS_PROC_NOOP, state, "dnsproxy: query parked");
+	ok(upstream_answer(upstream), "dnsproxy: query forwarded");
+	uint8_t buf[KNOT_WIRE_MAX_PKTSIZE];
+	ssize_t len = recv_wait(client, buf, sizeof(buf), 2000);
+	ok(len > KNOT_WIRE_HEADER_SIZE && knot_wire_get_id(buf) == 0x1234 &&
+	   knot_wire_get_qr(buf) && knot_wire_get_ancount(buf) == 1,
+	   "dnsproxy: answer relayed with original ID");
+	ok(srv.stats.deferred->queries == 1 &&
+	   srv.stats.deferred->rcode[KNOT_RCODE_NOERROR] == 1 &&
+	   srv.stats.deferred->qtype[KNOT_RRTYPE_A] == 1 &&
+	   srv.stats.thread[0].queries == 0,
+	   "dnsproxy: relayed answer counted");
+	knot_pkt_free(&qdata.query);
+
+	/* Same question is answered from the cache, keeping the query case. */
+	qdata.query = make_query("EXAMPLE.com.", 0x4321);
+	state = step->process(KNOT_NS_PROC_FULL, ans, &qdata, step->ctx);
+	ok(state == KNOT_NS_PROC_DONE && knot_wire_get_id(ans->wire) == 0x4321 &&
+	   knot_wire_get_ancount(ans->wire) == 1 &&
+	   memcmp(ans->wire + KNOT_WIRE_HEADER_SIZE, "\x07" "EXAMPLE", 8) == 0,
+	   "dnsproxy: cached answer");
+	ok(wire_read_u32(ans->wire + ans->size - 10) <= 300, "dnsproxy: cached TTL");
+	knot_pkt_free(&qdata.query);
+
+	/* Unanswered query times out with SERVFAIL. */
+	qdata.query = make_query("lost.example.com.", 0x5678);
+	state = step->process(KNOT_NS_PROC_FULL, ans, &qdata, step->ctx);
+	is_int(KNOT_NS_PROC_NOOP, state, "dnsproxy: second query parked");
+	len = recv_wait(client, buf, sizeof(buf), 4000);
+	ok(len > KNOT_WIRE_HEADER_SIZE && knot_wire_get_id(buf) == 0x5678 &&
+	   knot_wire_get_rcode(buf) == KNOT_RCODE_SERVFAIL,
+	   "dnsproxy: timeout answered with SERVFAIL");
+	ok(srv.stats.deferred->queries == 2 &&
+	   srv.stats.deferred->rcode[KNOT_RCODE_SERVFAIL] == 1,
+	   "dnsproxy: SERVFAIL counted");
+	knot_pkt_free(&qdata.query);
+	struct sockaddr_storage from, other;
+	(void)upstream_recv(upstream, buf, &from);
+
+	/* Queries go out from many source ports with QNAME in random case. */
+	const char *long_name = "abcdefghijklmnopqrstuvwxyzabcdefghij.example.com.";
+	const char long_wire[] = "\x24" "abcdefghijklmnopqrstuvwxyzabcdefghij"
+	                         "\x07" "example" "\x03" "com";
+	uint16_t ports[32];
+	bool randomized = true;
+	bool answered = true;
+	for (int i = 0; i < 32; ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "q%d.%s", i, long_name);
+		qdata.query = make_query(name, 0x100 + i);
+		state = step->process(KNOT_NS_PROC_FULL, ans, &qdata, step->ctx);
+		len = upstream_recv(upstream, buf, &from);
+		ports[i] = sockaddr_port(&from);
+		randomized = randomized && len > KNOT_WIRE_HEADER_SIZE &&
+		             qname_case_differs(buf + 1 + buf[KNOT_WIRE_HEADER_SIZE], long_wire);
+		answered = answered && state == KNOT_NS_PROC_NOOP &&
+		           upstream_send(upstream, buf, len, &from, 4) &&
+		           recv_wait(client, buf, sizeof(buf), 2000) > KNOT_WIRE_HEADER_SIZE &&
+		           knot_wire_get_id(buf) == 0x100 + i &&
+		           memcmp(buf + KNOT_WIRE_HEADER_SIZE + 1 + buf[KNOT_WIRE_HEADER_SIZE],
+		                  long_wire, sizeof(long_wire)) == 0;
+		knot_pkt_free(&qdata.query);
+	}
+	int distinct = 0;
+	for (int i = 0; i < 32; ++i) {
+		bool seen = false;
+		for (int j = 0; j < i; ++j) {
+			seen = seen || ports[j] == ports[i];
+		}
+		distinct += seen ? 0 : 1;
+	}
+	ok(answered, "dnsproxy: answers relayed with the original QNAME case");
+	ok(randomized, "dnsproxy: QNAME case randomized");
+	ok(distinct > 16, "dnsproxy: source ports randomized");
+
+	/* Reply to another upstream socket is ignored. */
+	qdata.query = make_query(long_name, 0x2468);
+	state = step->process(KNOT_NS_PROC_FULL, ans, &qdata, step->ctx);
+	len = upstream_recv(upstream, buf, &from);
+	memcpy(&other, &from, sizeof(other));
+	for (int i = 0; i < 32; ++i) {
+		if (ports[i] != sockaddr_port(&from)) {
+			sockaddr_port_set(&other, ports[i]);
+			break;
+		}
+	}
+	bool sent = state == KNOT_NS_PROC_NOOP &&
+	            upstream_send(upstream, buf, len, &other, 66);
+	usleep(100000);
+	ok(sent && upstream_send(upstream, buf, len, &from, 4),
+	   "dnsproxy: reply to another socket sent first");
+	ssize_t ans_len = recv_wait(client, buf, sizeof(buf), 2000);
+	ok(ans_len > KNOT_WIRE_HEADER_SIZE && knot_wire_get_id(buf) == 0x2468 &&
+	   buf[ans_len - 1] == 4, "dnsproxy: reply from the query socket accepted");
+	knot_pkt_free(&qdata.query);
+
+	/* Answer not echoing the QNAME case is relayed, but not cached. */
+	const char *lower_name = "lower.abcdefghijklmnopqrstuvwxyz.example.com.";
+	bool relayed = true;
+	for (int i = 0; i < 2; ++i) {
+		qdata.query = make_query(lower_name, 0x3000 + i);
+		state = step->process(KNOT_NS_PROC_FULL, ans, &qdata, step->ctx);
+		len = upstream_recv(upstream, buf, &from);
+		if (len > KNOT_WIRE_HEADER_SIZE) {
+			knot_dname_to_lower(buf + KNOT_WIRE_HEADER_SIZE);
+		}
+		relayed = relayed && state == KNOT_NS_PROC_NOOP &&
+		          upstream_send(upstream, buf, len, &from, 4) &&
+		          recv_wait(client, buf, sizeof(buf), 2000) > KNOT_WIRE_HEADER_SIZE &&
+		          knot_wire_get_id(buf) == 0x3000 + i &&
+		          knot_wire_get_ancount(buf) == 1;
+		knot_pkt_free(&qdata.query);
+	}
+	ok(relayed, "dnsproxy: answer with QNAME case changed not cached");
+
+	is_int(KNOT_EOK, dnsproxy_unload(&module), "dnsproxy: unload");
+
+	knot_pkt_free(&ans);
+	stats_deinit(&srv.stats);
+	query_plan_free(config.query_plan);
+	close(upstream);
+	close(server);
+	close(client);
+
+	return 0;
+}
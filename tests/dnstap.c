@@ -0,0 +1,172 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <tap/basic.h>
+
+#include "libknot/errcode.h"
+#include "libknot/internal/utils.h"
+#include "dnstap/decoder.h"
+#include "dnstap/dnstap.h"
+#include "dnstap/encoder.h"
+#include "dnstap/mmap_reader.h"
+
+/*! \brief Query for '.' IN A from 192.0.2.1#53000, as packed by protobuf. */
+static const uint8_t query_frame[] = {
+	0x72, 0x2e, 0x08, 0x01, 0x10, 0x01, 0x18, 0x01, 0x22, 0x04, 0xc0, 0x00,
+	0x02, 0x01, 0x30, 0x88, 0x9e, 0x03, 0x40, 0x80, 0x9c, 0x92, 0xa5, 0x05,
+	0x4d, 0x15, 0xcd, 0x5b, 0x07, 0x52, 0x11, 0xab, 0xcd, 0x01, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
+	0x78, 0x01
+};
+
+static void write_u32(FILE *fp, uint32_t value)
+{
+	uint8_t buf[4];
+	wire_write_u32(buf, value);
+	fwrite(buf, 1, sizeof(buf), fp);
+}
+
+/*! \brief Write a Frame Streams file with the given data frames. */
+static void write_capture(const char *path, const uint8_t *frame, size_t len,
+                          unsigned count, bool stop)
+{
+	FILE *fp = fopen(path, "w");
+	const size_t type_len = strlen(DNSTAP_CONTENT_TYPE);
+	write_u32(fp, 0);
+	write_u32(fp, 12 + type_len);
+	write_u32(fp, 2); /* START */
+	write_u32(fp, 1); /* Content type. */
+	write_u32(fp, type_len);
+	fwrite(DNSTAP_CONTENT_TYPE, 1, type_len, fp);
+	for (unsigned i = 0; i < count; ++i) {
+		write_u32(fp, len);
+		fwrite(frame, 1, len, fp);
+	}
+	if (stop) {
+		write_u32(fp, 0);
+		write_u32(fp, 4);
+		write_u32(fp, 3); /* STOP */
+	}
+	fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	struct sockaddr_in sa = { 0 };
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(53000);
+	inet_pton(AF_INET, "192.0.2.1", &sa.sin_addr);
+	struct timespec qtime = { 1420070400, 123456789 };
+	const uint8_t wire[] = { 0xab, 0xcd, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
+	                         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+	                         0x01 };
+
+	uint8_t buf[512];
+	int len = dt_encode_message(buf, sizeof(buf), DNSTAP__MESSAGE__TYPE__AUTH_QUERY,
+	                            (struct sockaddr *)&sa, NULL, IPPROTO_UDP,
+	                            wire, sizeof(wire), &qtime, NULL);
+	ok(len == sizeof(query_frame) && memcmp(buf, query_frame, len) == 0,
+	   "dnstap: encode query");
+
+	len = dt_encode_message(buf, sizeof(query_frame) - 1,
+	                        DNSTAP__MESSAGE__TYPE__AUTH_QUERY,
+	                        (struct sockaddr *)&sa, NULL, IPPROTO_UDP,
+	                        wire, sizeof(wire), &qtime, NULL);
+	is_int(KNOT_ESPACE, len, "dnstap: encode into short buffer");
+
+	/* Response over IPv6, the message length needs a two byte varint. */
+	struct sockaddr_in6 sa6 = { 0 };
+	sa6.sin6_family = AF_INET6;
+	sa6.sin6_port = htons(5353);
+	inet_pton(AF_INET6, "2001:db8::1", &sa6.sin6_addr);
+	struct timespec rtime = { 3, 4 };
+	uint8_t large[300];
+	memset(large, 0xaa, sizeof(large));
+	len = dt_encode_message(buf, sizeof(buf), DNSTAP__MESSAGE__TYPE__AUTH_RESPONSE,
+	                        (struct sockaddr *)&sa6, NULL, IPPROTO_TCP,
+	                        large, sizeof(large), &qtime, &rtime);
+	size_t msg_len = (buf[1] & 0x7f) | (buf[2] << 7);
+	ok(buf[0] == 0x72 && (buf[1] & 0x80) && len == 3 + msg_len + 2 &&
+	   buf[len - 2] == 0x78 && buf[len - 1] == 0x01, "dnstap: encode envelope");
+	ok(len <= DT_ENCODE_OVERHEAD + sizeof(large) &&
+	   memcmp(buf + len - 2 - sizeof(large), large, sizeof(large)) == 0 &&
+	   buf[len - 5 - sizeof(large)] == 0x72, "dnstap: encode response message");
+
+	/* Decoding points into the frame. */
+	dt_message_t msg;
+	is_int(KNOT_EOK, dt_decode_message(buf, len, &msg), "dnstap: decode");
+	ok(msg.type == DNSTAP__MESSAGE__TYPE__AUTH_RESPONSE &&
+	   msg.socket_family == AF_INET6 && msg.socket_protocol == IPPROTO_TCP &&
+	   msg.query_address_len == 16 &&
+	   memcmp(msg.query_address, &sa6.sin6_addr, 16) == 0 &&
+	   msg.query_port == 5353 && msg.response_address == NULL,
+	   "dnstap: decode addresses");
+	ok(msg.has_query_time && msg.query_time.tv_sec == qtime.tv_sec &&
+	   msg.query_time.tv_nsec == qtime.tv_nsec && msg.has_response_time &&
+	   msg.response_time.tv_sec == 3 && msg.response_time.tv_nsec == 4,
+	   "dnstap: decode times");
+	ok(msg.query_message == NULL && msg.response_message_len == sizeof(large) &&
+	   msg.response_message >= buf && msg.response_message < buf + len,
+	   "dnstap: decode message in place");
+	is_int(KNOT_EMALF, dt_decode_message(buf, len - 10, &msg),
+	       "dnstap: decode truncated");
+
+	/* Read the frames from a mapped capture. */
+	char path[] = "/tmp/knot-dnstap.XXXXXX";
+	close(mkstemp(path));
+	write_capture(path, query_frame, sizeof(query_frame), 3, true);
+	dt_mmap_reader_t reader;
+	is_int(KNOT_EOK, dt_mmap_reader_open(&reader, path), "dnstap: map capture");
+	const uint8_t *frame = NULL;
+	size_t frame_len = 0;
+	unsigned frames = 0;
+	int ret = KNOT_EOK;
+	while ((ret = dt_mmap_reader_next(&reader, &frame, &frame_len)) == KNOT_EOK) {
+		frames += (frame_len == sizeof(query_frame) &&
+		           memcmp(frame, query_frame, frame_len) == 0);
+	}
+	ok(ret == KNOT_EOF && frames == 3, "dnstap: read mapped frames");
+	dt_mmap_reader_rewind(&reader);
+	ok(dt_mmap_reader_next(&reader, &frame, &frame_len) == KNOT_EOK &&
+	   dt_decode_message(frame, frame_len, &msg) == KNOT_EOK &&
+	   msg.type == DNSTAP__MESSAGE__TYPE__AUTH_QUERY &&
+	   msg.query_message_len == sizeof(wire), "dnstap: rewind");
+	dt_mmap_reader_close(&reader);
+
+	/* Capture of a killed writer ends with a partial frame. */
+	write_capture(path, query_frame, sizeof(query_frame), 2, false);
+	FILE *fp = fopen(path, "a");
+	write_u32(fp, 100);
+	fclose(fp);
+	dt_mmap_reader_open(&reader, path);
+	frames = 0;
+	while ((ret = dt_mmap_reader_next(&reader, &frame, &frame_len)) == KNOT_EOK) {
+		frames += 1;
+	}
+	ok(ret == KNOT_EMALF && frames == 2, "dnstap: truncated capture");
+	dt_mmap_reader_close(&reader);
+	unlink(path);
+
+	return 0;
+}
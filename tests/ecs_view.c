@@ -0,0 +1,232 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <arpa/inet.h>
+#include <tap/basic.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "libknot/internal/mempool.h"
+#include "libknot/descriptor.h"
+#include "libknot/rrtype/opt.h"
+#include "knot/modules/ecs_view.h"
+#include "knot/nameserver/internet.h"
+#include "knot/nameserver/process_query.h"
+#include "fake_server.h"
+
+/*! \brief Create zone with the SOA and an A record for 'www'. */
+static zone_t *create_zone(const char *name, const char *addr, bool sign)
+{
+	knot_dname_t *apex = knot_dname_from_str_alloc(name);
+	zone_contents_t *contents = create_fake_contents(apex, 1);
+
+	uint8_t owner[KNOT_DNAME_MAXLEN] = "\x03""www";
+	memcpy(owner + 4, apex, knot_dname_size(apex));
+	uint8_t rdata[4];
+	inet_pton(AF_INET, addr, rdata);
+	add_fake_rr(contents, owner, KNOT_RRTYPE_A, rdata, sizeof(rdata));
+	if (sign) {
+		add_fake_soa_rrsig(contents);
+	}
+	adjust_fake_contents(contents);
+	knot_dname_free(&apex, NULL);
+
+	return create_fake_zone(name, contents);
+}
+
+/*! \brief Create query for 'www.example.' with optional client subnet and DO bit. */
+static void make_query(knot_pkt_t *query, uint16_t qtype, const uint8_t *ecs,
+                       uint16_t ecs_len, bool dnssec)
+{
+	knot_pkt_clear(query);
+	knot_pkt_put_question(query, (const uint8_t *)"\x03""www""\x07""example",
+	                      KNOT_CLASS_IN, qtype);
+	if (ecs != NULL) {
+		knot_rrset_t opt;
+		knot_edns_init(&opt, 4096, 0, KNOT_EDNS_VERSION, &query->mm);
+		knot_edns_add_option(&opt, KNOT_EDNS_OPTION_CLIENT_SUBNET, ecs_len,
+		                     ecs, &query->mm);
+		if (dnssec) {
+			knot_edns_set_do(&opt);
+		}
+		knot_pkt_begin(query, KNOT_ADDITIONAL);
+		knot_pkt_put(query, KNOT_COMPR_HINT_NONE, &opt, KNOT_PF_FREE);
+	}
+	knot_pkt_parse(query, 0);
+}
+
+/*! \brief Resolve the query, return answer address and the ECS scope (-1 if none). */
+static int exec_query(knot_layer_t *proc, knot_pkt_t *query, knot_pkt_t *answer,
+                      char *addr, int *scope)
+{
+	addr[0] = '\0';
+	*scope = -1;
+	knot_pkt_t *parsed = exec_fake_query(proc, query, answer);
+	if (parsed == NULL) {
+		return -1;
+	}
+
+	const knot_pktsection_t *an = knot_pkt_section(parsed, KNOT_ANSWER);
+	if (an->count == 1) {
+		const knot_rrset_t *rr = &an->rr[0];
+		if (rr->type == KNOT_RRTYPE_A &&
+		    knot_dname_is_equal(rr->owner, knot_pkt_qname(query))) {
+			const uint8_t *ip = knot_rdata_data(knot_rdataset_at(&rr->rrs, 0));
+			sprintf(addr, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+		}
+	}
+
+	const uint8_t *opt = NULL;
+	if (parsed->opt_rr != NULL) {
+		opt = knot_edns_get_option(parsed->opt_rr, KNOT_EDNS_OPTION_CLIENT_SUBNET);
+	}
+	if (opt != NULL) {
+		*scope = knot_edns_opt_get_data(opt)[3];
+	}
+
+	int rcode = knot_wire_get_rcode(answer->wire);
+	knot_pkt_free(&parsed);
+	return rcode;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, sizeof(knot_pkt_t));
+
+	knot_layer_t proc;
+	memset(&proc, 0, sizeof(knot_layer_t));
+	proc.mm = &mm;
+
+	server_t server;
+	int ret = create_fake_server(&server, proc.mm);
+	ok(ret == KNOT_EOK, "ecs_view: fake server initialization");
+
+	/* Zone with two views, the views are zones as well. */
+	zone_t *zone = create_zone("example.", "192.0.2.1", true);
+	knot_zonedb_free(&server.zone_db);
+	server.zone_db = knot_zonedb_new(3);
+	knot_zonedb_insert(server.zone_db, zone);
+	knot_zonedb_insert(server.zone_db, create_zone("eu.view.", "198.51.100.1", false));
+	knot_zonedb_insert(server.zone_db, create_zone("us.view.", "203.0.113.1", false));
+	knot_zonedb_build_index(server.zone_db);
+
+	struct query_plan *plan = query_plan_create(NULL);
+	internet_query_plan(plan);
+	zone->conf->query_plan = plan;
+	char param_eu[] = "10.0.0.0/8 eu.view.";
+	char param_us[] = "10.1.0.0/16 us.view.";
+	struct query_module module_eu = { .param = param_eu };
+	struct query_module module_us = { .param = param_us };
+	ok(ecs_view_load(plan, &module_eu) == KNOT_EOK &&
+	   ecs_view_load(plan, &module_us) == KNOT_EOK, "ecs_view: load");
+
+	struct sockaddr_storage remote;
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 53);
+	struct process_query_param param = { 0 };
+	param.remote = &remote;
+	param.server = &server;
+	knot_layer_begin(&proc, NS_PROC_QUERY, &param);
+
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_t *answer = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	char addr[32];
+	int scope = 0;
+
+	/* Source address outside the views, answer from the zone. */
+	make_query(query, KNOT_RRTYPE_A, NULL, 0, false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "192.0.2.1") == 0 && scope == -1,
+	   "ecs_view: source address without view");
+
+	/* Source address in a view. */
+	sockaddr_set(&remote, AF_INET, "10.1.2.3", 53);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "203.0.113.1") == 0 && scope == -1,
+	   "ecs_view: source address in view");
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 53);
+
+	/* 10.2.0.0/16 differs from 10.1.0.0/16 in the 15th bit. */
+	const uint8_t ecs_short[] = { 0x00, 0x01, 16, 0, 10, 2 };
+	make_query(query, KNOT_RRTYPE_A, ecs_short, sizeof(ecs_short), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "198.51.100.1") == 0 && scope == 15,
+	   "ecs_view: client subnet in shorter prefix");
+
+	const uint8_t ecs_long[] = { 0x00, 0x01, 24, 0, 10, 1, 2 };
+	make_query(query, KNOT_RRTYPE_A, ecs_long, sizeof(ecs_long), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "203.0.113.1") == 0 && scope == 16,
+	   "ecs_view: client subnet in longer prefix");
+
+	const uint8_t ecs_wide[] = { 0x00, 0x01, 8, 0, 10 };
+	make_query(query, KNOT_RRTYPE_A, ecs_wide, sizeof(ecs_wide), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "198.51.100.1") == 0 && scope == 8,
+	   "ecs_view: scope limited by source prefix");
+
+	const uint8_t ecs_none[] = { 0x00, 0x01, 24, 0, 192, 0, 2 };
+	make_query(query, KNOT_RRTYPE_A, ecs_none, sizeof(ecs_none), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "192.0.2.1") == 0 && scope == 1,
+	   "ecs_view: client subnet without view");
+
+	/* View data in a signed zone is served without DNSSEC records. */
+	make_query(query, KNOT_RRTYPE_A, ecs_long, sizeof(ecs_long), true);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "203.0.113.1") == 0 &&
+	   knot_wire_get_ancount(answer->wire) == 1 &&
+	   knot_wire_get_nscount(answer->wire) == 0 && scope == 16,
+	   "ecs_view: unsigned view answer with DO bit");
+
+	/* Types missing in the view are answered from the zone. */
+	make_query(query, KNOT_RRTYPE_AAAA, ecs_long, sizeof(ecs_long), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && knot_wire_get_ancount(answer->wire) == 0 &&
+	   knot_wire_get_nscount(answer->wire) == 1 && scope == 16,
+	   "ecs_view: type missing in view");
+
+	/* Address longer than the source prefix. */
+	const uint8_t ecs_bad[] = { 0x00, 0x01, 8, 0, 10, 1 };
+	make_query(query, KNOT_RRTYPE_A, ecs_bad, sizeof(ecs_bad), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	is_int(KNOT_RCODE_FORMERR, ret, "ecs_view: malformed client subnet");
+
+	/* Bits set after the source prefix. */
+	const uint8_t ecs_bits[] = { 0x00, 0x01, 7, 0, 11 };
+	make_query(query, KNOT_RRTYPE_A, ecs_bits, sizeof(ecs_bits), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	is_int(KNOT_RCODE_FORMERR, ret, "ecs_view: client subnet with trailing bits");
+
+	/* Unloading restores the zone answer step. */
+	ecs_view_unload(&module_us);
+	ecs_view_unload(&module_eu);
+	make_query(query, KNOT_RRTYPE_A, ecs_long, sizeof(ecs_long), false);
+	ret = exec_query(&proc, query, answer, addr, &scope);
+	ok(ret == KNOT_RCODE_NOERROR && strcmp(addr, "192.0.2.1") == 0 && scope == -1,
+	   "ecs_view: unload");
+
+	knot_layer_finish(&proc);
+	knot_pkt_free(&query);
+	knot_pkt_free(&answer);
+	mp_delete((struct mempool *)mm.ctx);
+	server_deinit(&server);
+	conf_free(conf());
+
+	return 0;
+}
@@ -246,6 +246,19 @@ static bool test_getters(knot_rrset_t *opt_rr, int *done)
 	success &= check;
 	(*done)++;
 
+	/* OPTION data */
+	const uint8_t *opt = knot_edns_get_option(opt_rr, KNOT_EDNS_OPTION_NSID);
+	check = opt != NULL && knot_edns_opt_get_length(opt) == E_NSID_LEN &&
+	        memcmp(knot_edns_opt_get_data(opt), E_NSID_STR, E_NSID_LEN) == 0;
+	ok(check, "OPT RR getters: NSID data");
+	success &= check;
+	(*done)++;
+
+	check = knot_edns_get_option(opt_rr, KNOT_EDNS_OPTION_CLIENT_SUBNET) == NULL;
+	ok(check, "OPT RR getters: missing option");
+	success &= check;
+	(*done)++;
+
 	return success;
 }
 
@@ -444,7 +457,7 @@ static void test_client_subnet()
            "EDNS-client-subnet: parse (cmp addr)");
 }
 
-#define TEST_COUNT 68
+#define TEST_COUNT 70
 
 static inline int remaining(int done) {
 	return TEST_COUNT - done;
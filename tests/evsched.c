@@ -0,0 +1,133 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <tap/basic.h>
+#include <stdlib.h>
+
+#include "libknot/errcode.h"
+#include "knot/common/evsched.h"
+
+#define EVENT_COUNT 1000
+
+static int event_cb(event_t *ev)
+{
+	return KNOT_EOK;
+}
+
+/*! \brief Count expired events, check they are due and free them. */
+static int take_expired(struct evsched_wheel *w, uint64_t now, bool *due)
+{
+	int count = 0;
+	while (!EMPTY_LIST(w->expired)) {
+		event_t *ev = HEAD(w->expired);
+		evsched_wheel_remove(w, ev);
+		*due = *due && ev->time == now;
+		evsched_event_free(ev);
+		count += 1;
+	}
+
+	return count;
+}
+
+static int time_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*! \brief Insert events in random distances from the start time, check each
+ *         expires exactly at its time. */
+static void check_wheel(evsched_t *sched, uint64_t start, const char *msg)
+{
+	struct evsched_wheel w;
+	evsched_wheel_init(&w, start);
+
+	uint64_t times[EVENT_COUNT];
+	for (int i = 0; i < EVENT_COUNT; ++i) {
+		/* Short, medium and the longest possible distances. */
+		uint64_t dt = 0;
+		switch (i % 4) {
+		case 0: dt = 1 + rand() % 1000; break;
+		case 1: dt = 1 + rand() % 100000000; break;
+		case 2: dt = UINT32_MAX - rand() % 1000; break;
+		default: dt = ((uint64_t)rand() << 16 ^ rand()) % UINT32_MAX + 1; break;
+		}
+		event_t *ev = evsched_event_create(sched, event_cb, NULL);
+		ev->time = start + dt;
+		evsched_wheel_insert(&w, ev);
+		times[i] = ev->time;
+	}
+	qsort(times, EVENT_COUNT, sizeof(uint64_t), time_cmp);
+
+	bool valid = true;
+	int expired = 0;
+	for (int i = 0; i < EVENT_COUNT && valid; ++i) {
+		if (i > 0 && times[i] == times[i - 1]) {
+			continue;
+		}
+		valid = evsched_wheel_next(&w) <= times[i];
+		evsched_wheel_advance(&w, times[i] - 1);
+		valid = valid && EMPTY_LIST(w.expired);
+		evsched_wheel_advance(&w, times[i]);
+		expired += take_expired(&w, times[i], &valid);
+	}
+	ok(valid && expired == EVENT_COUNT, "evsched: %s", msg);
+
+	evsched_wheel_deinit(&w);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	evsched_t sched;
+	ok(evsched_init(&sched, NULL) == KNOT_EOK, "evsched: init");
+
+	/* Event crossing the 2^32 ms boundary (uptime of ~49.7 days). */
+	uint64_t wrap = 1ULL << 32;
+	struct evsched_wheel w;
+	evsched_wheel_init(&w, wrap - 1000);
+	event_t *ev = evsched_event_create(&sched, event_cb, NULL);
+	ev->time = wrap + 4000;
+	evsched_wheel_insert(&w, ev);
+	ok(evsched_wheel_next(&w) <= wrap, "evsched: wake up at the top level wrap");
+	evsched_wheel_advance(&w, wrap + 3999);
+	ok(EMPTY_LIST(w.expired), "evsched: event beyond the wrap not early");
+	evsched_wheel_advance(&w, wrap + 4000);
+	bool due = true;
+	ok(take_expired(&w, wrap + 4000, &due) == 1 && due,
+	   "evsched: event beyond the wrap on time");
+	evsched_wheel_deinit(&w);
+
+	/* Random events around the level boundaries. */
+	srand(42);
+	check_wheel(&sched, 0, "events from zero");
+	check_wheel(&sched, (1ULL << 24) - 7, "events across the third level");
+	check_wheel(&sched, wrap - 5000, "events across the top level wrap");
+	check_wheel(&sched, 5 * wrap - 1, "events across a later wrap");
+
+	/* Scheduler with the real clock. */
+	ev = evsched_event_create(&sched, event_cb, NULL);
+	ok(evsched_schedule(ev, 10) == KNOT_EOK, "evsched: schedule");
+	ok(evsched_begin_process(&sched) == ev, "evsched: process event");
+	ok(evsched_end_process(&sched) == KNOT_EOK, "evsched: end processing");
+	ok(evsched_cancel(ev) == KNOT_EOK, "evsched: cancel");
+	evsched_event_free(ev);
+
+	evsched_deinit(&sched);
+
+	return 0;
+}
@@ -2,6 +2,8 @@
 
 #include "knot/server/server.h"
 #include "libknot/internal/mempattern.h"
+#include "libknot/internal/utils.h"
+#include "libknot/processing/layer.h"
 
 /* Some domain names. */
 #define ROOT_DNAME ((const uint8_t *)"")
@@ -66,3 +68,106 @@ static inline int create_fake_server(server_t *server, mm_ctx_t *mm)
 
 	return KNOT_EOK;
 }
+
+/* Create SOA of a test zone. */
+static inline knot_rrset_t *create_fake_soa(const knot_dname_t *apex, uint32_t serial)
+{
+	static const uint8_t ZONE_SOA_RDATA[] = {
+	        0x02, 'n', 's', 0x00,          /* ns. */
+	        0x04, 'm', 'a', 'i', 'l', 0x00,/* mail. */
+	        0x00, 0x00, 0x00, 0x00,        /* serial */
+	        0x00, 0x00, 0x0e, 0x10,        /* refresh */
+	        0x00, 0x00, 0x0e, 0x10,        /* retry */
+	        0x00, 0x0a, 0x8c, 0x00,        /* expire */
+	        0x00, 0x00, 0x0e, 0x10         /* min ttl */
+	};
+
+	uint8_t rdata[sizeof(ZONE_SOA_RDATA)];
+	memcpy(rdata, ZONE_SOA_RDATA, sizeof(rdata));
+	wire_write_u32(rdata + 10, serial);
+
+	knot_rrset_t *soa = knot_rrset_new(apex, KNOT_RRTYPE_SOA, KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(soa, rdata, sizeof(rdata), 3600, NULL);
+	return soa;
+}
+
+/* Add a record to test zone contents. */
+static inline void add_fake_rr(zone_contents_t *contents, const knot_dname_t *owner,
+                               uint16_t type, const uint8_t *rdata, uint16_t size)
+{
+	knot_rrset_t *rr = knot_rrset_new(owner, type, KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(rr, rdata, size, 3600, NULL);
+	zone_node_t *node = NULL;
+	zone_contents_add_rr(contents, rr, &node);
+	knot_rrset_free(&rr, NULL);
+}
+
+/* Create test zone contents with the SOA only. */
+static inline zone_contents_t *create_fake_contents(const knot_dname_t *apex,
+                                                    uint32_t serial)
+{
+	zone_contents_t *contents = zone_contents_new(apex);
+
+	knot_rrset_t *soa = create_fake_soa(apex, serial);
+	zone_node_t *node = NULL;
+	zone_contents_add_rr(contents, soa, &node);
+	knot_rrset_free(&soa, NULL);
+
+	return contents;
+}
+
+/* Make test zone contents look signed, add bogus RRSIG covering the SOA. */
+static inline void add_fake_soa_rrsig(zone_contents_t *contents)
+{
+	const knot_dname_t *apex = contents->apex->owner;
+	uint8_t rdata[18 + KNOT_DNAME_MAXLEN + 4] = { 0 };
+	wire_write_u16(rdata, KNOT_RRTYPE_SOA);
+	rdata[2] = 8;                              /* algorithm */
+	rdata[3] = knot_dname_labels(apex, NULL);  /* labels */
+	wire_write_u32(rdata + 4, 3600);           /* original TTL */
+	wire_write_u32(rdata + 8, UINT32_MAX);     /* expiration */
+	int len = knot_dname_to_wire(rdata + 18, apex, KNOT_DNAME_MAXLEN);
+
+	/* Zeroed signature follows the signer name. */
+	add_fake_rr(contents, apex, KNOT_RRTYPE_RRSIG, rdata, 18 + len + 4);
+}
+
+/* Bake test zone contents after the records are added. */
+static inline void adjust_fake_contents(zone_contents_t *contents)
+{
+	zone_node_t *first_nsec3 = NULL, *last_nsec3 = NULL;
+	zone_contents_adjust_full(contents, &first_nsec3, &last_nsec3);
+}
+
+/* Create test zone with given contents. */
+static inline zone_t *create_fake_zone(const char *name, zone_contents_t *contents)
+{
+	conf_zone_t *conf = malloc(sizeof(conf_zone_t));
+	conf_init_zone(conf);
+	conf->name = strdup(name);
+
+	zone_t *zone = zone_new(conf);
+	zone->contents = contents;
+
+	return zone;
+}
+
+/* Resolve the query, return the parsed answer or NULL. */
+static inline knot_pkt_t *exec_fake_query(knot_layer_t *proc, knot_pkt_t *query,
+                                          knot_pkt_t *answer)
+{
+	knot_layer_reset(proc);
+	knot_pkt_clear(answer);
+	knot_layer_in(proc, query);
+	int state = knot_layer_out(proc, answer);
+	if (state & KNOT_NS_PROC_FAIL) {
+		knot_layer_out(proc, answer);
+	}
+
+	knot_pkt_t *parsed = knot_pkt_new(answer->wire, answer->size, NULL);
+	if (parsed != NULL && knot_pkt_parse(parsed, 0) != KNOT_EOK) {
+		knot_pkt_free(&parsed);
+	}
+
+	return parsed;
+}
@@ -0,0 +1,51 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <tap/basic.h>
+
+#include "libknot/internal/hash.h"
+
+int main(int argc, char *argv[])
+{
+	plan(5);
+
+	/* Reference key and message from the SipHash paper. */
+	hash_key_t key = {
+		.k0 = 0x0706050403020100ULL,
+		.k1 = 0x0f0e0d0c0b0a0908ULL
+	};
+	char msg[15];
+	for (unsigned i = 0; i < sizeof(msg); ++i) {
+		msg[i] = i;
+	}
+
+	ok(hash_keyed(&key, msg, 0) == 0x726fdb47dd0e0e31ULL,
+	   "hash: keyed, empty input");
+	ok(hash_keyed(&key, msg, sizeof(msg)) == 0xa129ca6149be45e5ULL,
+	   "hash: keyed, reference vector");
+
+	key.k1 ^= 1;
+	ok(hash_keyed(&key, msg, sizeof(msg)) != 0xa129ca6149be45e5ULL,
+	   "hash: keyed, different key");
+
+	/* Fast hash. */
+	const char *name = "\x07" "example" "\x03" "com";
+	ok(hash_fast(name, 12) == hash_fast(name, 12), "hash: fast, stable");
+	ok(hash_fast(name, 12) != hash_fast(name, 11), "hash: fast, length");
+
+	return 0;
+}
@@ -19,6 +19,8 @@
 
 #include "knot/zone/node.h"
 #include "libknot/errcode.h"
+#include "libknot/internal/mempattern.h"
+#include "libknot/internal/mempool.h"
 
 static knot_rrset_t *create_dummy_rrset(const knot_dname_t *owner,
                                         uint16_t type)
@@ -48,7 +50,7 @@ static knot_rrset_t *create_dummy_rrsig(const knot_dname_t *owner,
 
 int main(int argc, char *argv[])
 {
-	plan(23);
+	plan(25);
 	
 	knot_dname_t *dummy_owner = knot_dname_from_str_alloc("test.");
 	// Test new
@@ -85,6 +87,18 @@ int main(int argc, char *argv[])
 	
 	node_free(&copy, NULL);
 	
+	// Test zone version copy into a memory pool, RR data are shared
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, MM_DEFAULT_BLKSIZE);
+	copy = node_shallow_copy(node, &mm);
+	ok(copy != NULL, "Node: shallow copy into a memory pool.");
+	assert(copy);
+	ok(copy->rrset_count == node->rrset_count &&
+	   copy->rrs[0].rrs.data == node->rrs[0].rrs.data &&
+	   copy->rrs[0].additional == NULL,
+	   "Node: shallow copy - RR data shared.");
+	mp_delete(mm.ctx);
+	
 	// Test RRSet getters
 	knot_rrset_t *n_rrset = node_create_rrset(node, KNOT_RRTYPE_TXT);
 	ok(n_rrset && knot_rrset_equal(n_rrset, dummy_rrset, KNOT_RRSET_COMPARE_WHOLE),
@@ -0,0 +1,157 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <tap/basic.h>
+
+#include "libknot/descriptor.h"
+#include "libknot/errcode.h"
+#include "libknot/internal/net.h"
+#include "knot/zone/events/notifier.h"
+
+#define ZONE "\x7""example""\x3""com"
+
+/*! \brief Create zone with SOA, notifying given remotes. */
+static void zone_init(zone_t *zone, conf_zone_t *conf, conf_remote_t *remotes,
+                      conf_iface_t *ifaces, int count)
+{
+	memset(zone, 0, sizeof(zone_t));
+	memset(conf, 0, sizeof(conf_zone_t));
+	init_list(&conf->acl.notify_out);
+	for (int i = 0; i < count; ++i) {
+		remotes[i].remote = &ifaces[i];
+		add_tail(&conf->acl.notify_out, &remotes[i].n);
+	}
+
+	zone->name = knot_dname_copy((const uint8_t *)ZONE, NULL);
+	zone->conf = conf;
+	zone->contents = zone_contents_new(zone->name);
+	assert(zone->contents);
+
+	const uint8_t rdata[] = "\x2""ns"ZONE"\x0" "\x4""host"ZONE"\x0"
+	                        "\x0\x0\x0\x1" "\x0\x0\x0\x2" "\x0\x0\x0\x3"
+	                        "\x0\x0\x0\x4" "\x0\x0\x0\x5";
+	knot_rrset_t *soa = knot_rrset_new(zone->name, KNOT_RRTYPE_SOA,
+	                                   KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(soa, rdata, sizeof(rdata) - 1, 3600, NULL);
+	zone_node_t *node = NULL;
+	int ret = zone_contents_add_rr(zone->contents, soa, &node);
+	assert(ret == KNOT_EOK);
+	knot_rrset_free(&soa, NULL);
+}
+
+/*! \brief Bind UDP socket to random port, store its address to the remote. */
+static int remote_init(conf_iface_t *iface)
+{
+	memset(iface, 0, sizeof(conf_iface_t));
+	sockaddr_set(&iface->addr, AF_INET, "127.0.0.1", 0);
+	int fd = net_bound_socket(SOCK_DGRAM, &iface->addr);
+	assert(fd >= 0);
+	socklen_t len = sizeof(iface->addr);
+	getsockname(fd, (struct sockaddr *)&iface->addr, &len);
+	return fd;
+}
+
+/*! \brief Receive NOTIFY, return message ID or -1. Answer if requested. */
+static int remote_recv(int fd, bool answer)
+{
+	uint8_t buf[KNOT_WIRE_MAX_PKTSIZE];
+	struct sockaddr_storage from;
+	socklen_t len = sizeof(from);
+	int ret = recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT,
+	                   (struct sockaddr *)&from, &len);
+	if (ret < KNOT_WIRE_HEADER_SIZE ||
+	    knot_wire_get_opcode(buf) != KNOT_OPCODE_NOTIFY) {
+		return -1;
+	}
+
+	if (answer) {
+		knot_wire_set_qr(buf);
+		sendto(fd, buf, ret, 0, (struct sockaddr *)&from, len);
+	}
+
+	return knot_wire_get_id(buf);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	zone_t zone;
+	conf_zone_t conf;
+	conf_remote_t remotes[2];
+	conf_iface_t ifaces[2];
+	int answering = remote_init(&ifaces[0]);
+	int silent = remote_init(&ifaces[1]);
+	zone_init(&zone, &conf, remotes, ifaces, 2);
+
+	is_int(KNOT_ENOTRUNNING, notifier_enqueue(&zone), "notifier: not running");
+	is_int(KNOT_EOK, notifier_init(), "notifier: init");
+
+	/* Repeated notifications are coalesced while queued. */
+	notifier_enqueue(&zone);
+	notifier_enqueue(&zone);
+	notifier_stats_t stats = { 0 };
+	notifier_stats(&stats);
+	ok(stats.queued == 1 && stats.coalesced == 1, "notifier: queued zone coalesced");
+
+	/* Single message for each remote. */
+	notifier_exec(0);
+	notifier_stats(&stats);
+	ok(stats.queued == 0 && stats.inflight == 2 && stats.sent == 2,
+	   "notifier: messages sent");
+	usleep(10000);
+	ok(remote_recv(answering, true) >= 0, "notifier: remote notified");
+	int silent_id = remote_recv(silent, false);
+	ok(silent_id >= 0 && remote_recv(silent, false) < 0,
+	   "notifier: remote notified once");
+
+	/* Answered message is finished. */
+	int finished = 0;
+	for (int i = 0; i < 10 && finished == 0; ++i) {
+		finished += notifier_exec(100);
+	}
+	notifier_stats(&stats);
+	ok(finished == 1 && stats.answered == 1 && stats.inflight == 1,
+	   "notifier: response matched");
+
+	/* Unanswered message is retransmitted after timeout. */
+	for (int i = 0; i < 20 && stats.retries == 0; ++i) {
+		notifier_exec(100);
+		notifier_stats(&stats);
+	}
+	usleep(10000);
+	ok(stats.retries == 1 && remote_recv(silent, false) == silent_id,
+	   "notifier: retransmission");
+
+	/* New notification supersedes the unanswered one. */
+	notifier_enqueue(&zone);
+	notifier_exec(0);
+	notifier_stats(&stats);
+	ok(stats.inflight == 2 && stats.coalesced == 2,
+	   "notifier: unanswered message superseded");
+
+	notifier_cancel(&zone);
+	notifier_deinit();
+	zone_contents_deep_free(&zone.contents);
+	knot_dname_free(&zone.name, NULL);
+	close(answering);
+	close(silent);
+
+	return 0;
+}
@@ -21,6 +21,7 @@
 #include "libknot/descriptor.h"
 #include "libknot/packet/pkt.h"
 #include "libknot/rrtype/tsig.h"
+#include "libknot/tsig-op.h"
 
 #define TTL 7200
 #define NAMECOUNT 3
@@ -65,7 +66,7 @@ static void packet_match(knot_pkt_t *in, knot_pkt_t *out)
 
 int main(int argc, char *argv[])
 {
-	plan(25);
+	plan(38);
 
 	/* Create memory pool context. */
 	int ret = 0;
@@ -84,7 +85,7 @@ int main(int argc, char *argv[])
 	knot_rrset_t opt_rr;
 	ret = knot_edns_init(&opt_rr, 1024, 0, 0, &mm);
 	if (ret != KNOT_EOK) {
-		skip_block(25, "Failed to initialize OPT RR.");
+		skip_block(38, "Failed to initialize OPT RR.");
 		return 0;
 	}
 	/* Add NSID */
@@ -92,7 +93,7 @@ int main(int argc, char *argv[])
 	                           strlen((char *)edns_str), edns_str, &mm);
 	if (ret != KNOT_EOK) {
 		knot_rrset_clear(&opt_rr, &mm);
-		skip_block(25, "Failed to add NSID to OPT RR.");
+		skip_block(38, "Failed to add NSID to OPT RR.");
 		return 0;
 	}
 
@@ -187,11 +188,73 @@ int main(int argc, char *argv[])
 	/* Compare copied packet to original. */
 	packet_match(in, copy);
 
+	/*
+	 * Lazy parsing tests.
+	 */
+	knot_pkt_t *lazy = knot_pkt_new(out->wire, out->size, &out->mm);
+	ret = knot_pkt_parse(lazy, KNOT_PF_LAZY);
+	ok(ret == KNOT_EOK, "pkt: lazy parse");
+
+	/* Only OPT RR is parsed. */
+	ok(knot_pkt_has_edns(lazy) && lazy->rrset_count == 1 &&
+	   knot_pkt_section(lazy, KNOT_ADDITIONAL)->count == 1,
+	   "pkt: lazy parse OPT RR only");
+
+	/* Parse the rest. */
+	ret = knot_pkt_materialize(lazy);
+	ok(ret == KNOT_EOK, "pkt: materialize lazily parsed packet");
+
+	/* Compare materialized packet to written packet. */
+	packet_match(lazy, out);
+
+	/*
+	 * Lazy parsing of TSIG signed packet.
+	 */
+	knot_pkt_t *query = knot_pkt_new(NULL, MM_DEFAULT_BLKSIZE, &mm);
+	tsig_key.name = knot_dname_from_str_alloc("key.example.com");
+	knot_pkt_put_question(query, tsig_key.name, KNOT_CLASS_IN, KNOT_RRTYPE_SOA);
+	uint8_t digest[64];
+	size_t digest_len = sizeof(digest);
+	ret = knot_tsig_sign(query->wire, &query->size, query->max_size, NULL, 0,
+	                     digest, &digest_len, &tsig_key, 0, 0);
+	ok(ret == KNOT_EOK, "pkt: sign packet");
+
+	/* Parsing strips TSIG RR from the wire, parse separate copies. */
+	uint8_t full_wire[MM_DEFAULT_BLKSIZE], lazy_wire[MM_DEFAULT_BLKSIZE];
+	memcpy(full_wire, query->wire, query->size);
+	memcpy(lazy_wire, query->wire, query->size);
+	knot_pkt_t *full = knot_pkt_new(full_wire, query->size, &mm);
+	knot_pkt_t *signed_lazy = knot_pkt_new(lazy_wire, query->size, &mm);
+	ret = knot_pkt_parse(full, 0);
+	ret |= knot_pkt_parse(signed_lazy, KNOT_PF_LAZY);
+	ok(ret == KNOT_EOK && full->tsig_rr != NULL && signed_lazy->tsig_rr != NULL,
+	   "pkt: lazy parse TSIG RR");
+	ok(signed_lazy->size == full->size && full->size < query->size,
+	   "pkt: lazy parse strips TSIG RR");
+
+	/* TSIG RR and the stripped wire are kept. */
+	ret = knot_pkt_materialize(signed_lazy);
+	ok(ret == KNOT_EOK && signed_lazy->tsig_rr != NULL &&
+	   knot_rrset_equal(signed_lazy->tsig_rr, full->tsig_rr, KNOT_RRSET_COMPARE_WHOLE) > 0 &&
+	   signed_lazy->tsig_rr == &signed_lazy->rr[signed_lazy->rrset_count - 1],
+	   "pkt: materialize restores TSIG RR");
+	ok(signed_lazy->size == full->size &&
+	   knot_wire_get_arcount(signed_lazy->wire) == knot_wire_get_arcount(full->wire) &&
+	   knot_pkt_section(signed_lazy, KNOT_ADDITIONAL)->count ==
+	   knot_pkt_section(full, KNOT_ADDITIONAL)->count,
+	   "pkt: materialize keeps wire size");
+
+	knot_pkt_free(&signed_lazy);
+	knot_pkt_free(&full);
+	knot_pkt_free(&query);
+	knot_dname_free(&tsig_key.name, NULL);
+
 	/* Free packets. */
+	knot_pkt_free(&lazy);
 	knot_pkt_free(&copy);
 	knot_pkt_free(&out);
 	knot_pkt_free(&in);
-	ok(in == NULL && out == NULL && copy == NULL, "pkt: free");
+	ok(in == NULL && out == NULL && copy == NULL && lazy == NULL, "pkt: free");
 
 	/* Free extra data. */
 	for (unsigned i = 0; i < NAMECOUNT; ++i) {
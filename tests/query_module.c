@@ -34,9 +34,20 @@ int state_visit(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
 	return state + 1;
 }
 
+/* Shared step, passes the state. */
+int shared_visit(int state, knot_pkt_t *pkt, struct query_data *qdata, void *ctx)
+{
+	return state;
+}
+
+struct shared_ctx {
+	struct query_shared shared;
+	int value;
+};
+
 int main(int argc, char *argv[])
 {
-	plan(4);
+	plan(10);
 
 	/* Create processing context. */
 	mm_ctx_t mm;
@@ -81,6 +92,37 @@ int main(int argc, char *argv[])
 	}
 	ok(state == QUERY_PLAN_STAGES, "query_plan: executed all callbacks");
 
+	/* Shared step context. */
+	struct shared_ctx *first = NULL, *second = NULL;
+	ret = query_shared_get(plan, QPLAN_END, QSHARED_APPEND, shared_visit,
+	                       sizeof(struct shared_ctx), (void **)&first);
+	ok(ret == KNOT_EOK && first->shared.refs == 1 && first->value == 0 &&
+	   TAIL(plan->stage[QPLAN_END]) == (void *)first->shared.step,
+	   "query_shared: appended step");
+	query_shared_get(plan, QPLAN_END, QSHARED_APPEND, shared_visit,
+	                 sizeof(struct shared_ctx), (void **)&second);
+	ok(second == first && first->shared.refs == 2, "query_shared: step reused");
+	query_shared_release(&second->shared, NULL);
+	ret = query_shared_release(&first->shared, NULL);
+	ok(ret == 0 && list_size(&plan->stage[QPLAN_END]) == 1,
+	   "query_shared: step removed with the last reference");
+
+	/* Replaced step. */
+	struct query_step *head = HEAD(plan->stage[QPLAN_BEGIN]);
+	ret = query_shared_get(plan, QPLAN_BEGIN, QSHARED_REPLACE, shared_visit,
+	                       sizeof(struct shared_ctx), (void **)&first);
+	ok(ret == KNOT_EOK && head->process == shared_visit && head->ctx == first &&
+	   first->shared.next == state_visit && first->shared.next_ctx == state_map,
+	   "query_shared: replaced step");
+	query_shared_release(&first->shared, NULL);
+	ok(head->process == state_visit && head->ctx == state_map,
+	   "query_shared: replaced step restored");
+	struct query_plan *empty = query_plan_create(&mm);
+	ret = query_shared_get(empty, QPLAN_BEGIN, QSHARED_FOLLOW, shared_visit,
+	                       sizeof(struct shared_ctx), (void **)&first);
+	ok(ret == KNOT_ENOTSUP, "query_shared: no step to follow");
+	query_plan_free(empty);
+
 	/* Free the query plan. */
 	query_plan_free(plan);
 
@@ -0,0 +1,133 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <tap/basic.h>
+
+#include "libknot/errcode.h"
+#include "libknot/internal/macros.h"
+#include "knot/conf/conf.h"
+#include "knot/zone/events/refresh.h"
+
+#define RATE 4
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	s_config = conf_new(strdup("rc:/noconf"));
+	conf()->xfers = 8;
+	conf()->master_xfers = 1;
+	conf()->refresh_rate = RATE;
+
+	conf_iface_t master;
+	memset(&master, 0, sizeof(master));
+	sockaddr_set(&master.addr, AF_INET, "127.0.0.1", 53);
+
+	zone_t zones[2 * RATE];
+	memset(zones, 0, sizeof(zones));
+
+	/* Jitter only shortens the interval, by up to 1/10. */
+	bool jitter_ok = true;
+	for (int i = 0; i < 1000; ++i) {
+		uint32_t interval = refresh_jitter(3600);
+		jitter_ok = jitter_ok && interval <= 3600 && interval >= 3240;
+	}
+	ok(jitter_ok, "refresh: jitter within bounds");
+	ok(refresh_spread() <= REFRESH_SPREAD, "refresh: spread within bounds");
+	time_t now = time(NULL);
+	time_t at = refresh_restore(now - 3600);
+	ok(at >= now && at <= now + REFRESH_SPREAD + 1, "refresh: expired timer spread");
+
+	/* Full bucket admits RATE queries, the rest is spread over next seconds. */
+	uint32_t delay = 0;
+	int granted = 0;
+	uint32_t max_delay = 0;
+	for (int i = 0; i < 2 * RATE; ++i) {
+		if (refresh_acquire(&zones[i], &master, REFRESH_QUERY, &delay) == KNOT_EOK) {
+			granted += 1;
+		} else {
+			max_delay = MAX(max_delay, delay);
+		}
+	}
+	is_int(RATE, granted, "refresh: SOA queries limited by rate");
+	ok(max_delay >= 1 && max_delay <= 2, "refresh: postponed queries spread");
+
+	refresh_stats_t stats = { 0 };
+	refresh_stats(&stats);
+	is_int(RATE, stats.pending, "refresh: pending zones");
+	is_int(RATE, stats.inflight[REFRESH_QUERY], "refresh: queries in flight");
+	is_int(1, stats.masters, "refresh: tracked masters");
+
+	for (int i = 0; i < RATE; ++i) {
+		refresh_release(&master, REFRESH_QUERY);
+		refresh_cancel(&zones[RATE + i]);
+	}
+
+	/* Transfer budget. */
+	int ret = refresh_acquire(&zones[0], &master, REFRESH_XFER, &delay);
+	is_int(KNOT_EOK, ret, "refresh: first transfer admitted");
+	ret = refresh_acquire(&zones[1], &master, REFRESH_XFER, &delay);
+	ok(ret == KNOT_ELIMIT && delay >= REFRESH_XFER_DELAY,
+	   "refresh: second transfer postponed");
+	refresh_release(&master, REFRESH_XFER);
+	ret = refresh_acquire(&zones[1], &master, REFRESH_XFER, &delay);
+	is_int(KNOT_EOK, ret, "refresh: transfer admitted after release");
+	refresh_release(&master, REFRESH_XFER);
+
+	/* Queued transfers are admitted in order of arrival. */
+	refresh_acquire(&zones[0], &master, REFRESH_XFER, &delay);
+	refresh_acquire(&zones[1], &master, REFRESH_XFER, &delay);
+	refresh_acquire(&zones[2], &master, REFRESH_XFER, &delay);
+	refresh_stats(&stats);
+	is_int(2, stats.queued, "refresh: transfers queued");
+	refresh_release(&master, REFRESH_XFER);
+	ok(zone_events_get_time(&zones[1], ZONE_EVENT_XFER) > 0 &&
+	   zone_events_get_time(&zones[2], ZONE_EVENT_XFER) == 0,
+	   "refresh: first queued transfer woken");
+	ret = refresh_acquire(&zones[2], &master, REFRESH_XFER, &delay);
+	is_int(KNOT_ELIMIT, ret, "refresh: slot reserved for woken transfer");
+	ret = refresh_acquire(&zones[1], &master, REFRESH_XFER, &delay);
+	is_int(KNOT_EOK, ret, "refresh: woken transfer admitted");
+	refresh_release(&master, REFRESH_XFER);
+	ret = refresh_acquire(&zones[2], &master, REFRESH_XFER, &delay);
+	is_int(KNOT_EOK, ret, "refresh: next queued transfer admitted");
+	refresh_release(&master, REFRESH_XFER);
+
+	/* SOA queries don't count against the global transfer limit. */
+	conf_iface_t other;
+	memset(&other, 0, sizeof(other));
+	sockaddr_set(&other.addr, AF_INET, "127.0.0.2", 53);
+	conf()->xfers = 1;
+	refresh_acquire(&zones[0], &master, REFRESH_XFER, &delay);
+	ret = refresh_acquire(&zones[1], &other, REFRESH_XFER, &delay);
+	is_int(KNOT_ELIMIT, ret, "refresh: transfer over global limit postponed");
+	refresh_cancel(&zones[1]);
+	ret = refresh_acquire(&zones[2], &other, REFRESH_QUERY, &delay);
+	is_int(KNOT_EOK, ret, "refresh: SOA query not limited by transfers");
+	refresh_release(&other, REFRESH_QUERY);
+	refresh_release(&master, REFRESH_XFER);
+
+	refresh_stats(&stats);
+	ok(stats.pending == 0 && stats.queued == 0 &&
+	   stats.inflight[REFRESH_QUERY] == 0 &&
+	   stats.inflight[REFRESH_XFER] == 0, "refresh: all budgets returned");
+
+	refresh_deinit();
+	conf_free(conf());
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <tap/basic.h>
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libknot/descriptor.h"
+#include "libknot/errcode.h"
+#include "libknot/internal/mempool.h"
+#include "libknot/internal/net.h"
+#include "libknot/processing/layer.h"
+#include "libknot/processing/requestor_async.h"
+
+/*! \brief Number of concurrent requests. */
+#define REQUESTS 64
+
+/* @note Mirror is okay, see requestor test. */
+static int reset(knot_layer_t *ctx) { return KNOT_NS_PROC_FULL; }
+static int begin(knot_layer_t *ctx, void *module_param) { return reset(ctx); }
+static int finish(knot_layer_t *ctx) { return KNOT_NS_PROC_NOOP; }
+static int in(knot_layer_t *ctx, knot_pkt_t *pkt) { return KNOT_NS_PROC_DONE; }
+static int out(knot_layer_t *ctx, knot_pkt_t *pkt) { return KNOT_NS_PROC_MORE; }
+
+/*! \brief Dummy answer processing module. */
+const knot_layer_api_t dummy_module = {
+        &begin, &reset, &finish,
+        &in, &out, &knot_layer_noop
+};
+
+/*! \brief Accept all clients first, then answer them in reverse order. */
+static void *responder_thread(void *arg)
+{
+	int fd = *((int *)arg);
+	int clients[REQUESTS];
+	uint8_t buf[KNOT_WIRE_MAX_PKTSIZE];
+
+	for (int i = 0; i < REQUESTS; ++i) {
+		clients[i] = accept(fd, NULL, NULL);
+		assert(clients[i] >= 0);
+	}
+
+	for (int i = REQUESTS - 1; i >= 0; --i) {
+		int len = tcp_recv_msg(clients[i], buf, sizeof(buf), NULL);
+		if (len >= KNOT_WIRE_HEADER_SIZE) {
+			knot_wire_set_qr(buf);
+			tcp_send_msg(clients[i], buf, len);
+		}
+		close(clients[i]);
+	}
+
+	return NULL;
+}
+
+struct result {
+	int done;
+	int failed;
+	int last_ret;
+};
+
+static void request_done(struct knot_async_request *request, int ret)
+{
+	struct result *result = request->data;
+	result->done += 1;
+	result->last_ret = ret;
+	if (ret != KNOT_EOK) {
+		result->failed += 1;
+	}
+}
+
+static struct knot_async_request *make_request(mm_ctx_t *mm,
+                                               struct sockaddr_storage *remote,
+                                               unsigned flags)
+{
+	knot_pkt_t *pkt = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, mm);
+	assert(pkt);
+	knot_pkt_put_question(pkt, (const uint8_t *)"", KNOT_CLASS_IN, KNOT_RRTYPE_SOA);
+
+	struct knot_async_request *request =
+		knot_async_request_make(mm, (struct sockaddr *)remote, NULL, pkt, flags);
+	assert(request);
+	knot_async_request_overlay(request, &dummy_module, NULL);
+
+	return request;
+}
+
+static void run_loop(struct knot_async_requestor *requestor, struct result *result,
+                     int expected)
+{
+	for (int i = 0; i < 100 && result->done < expected; ++i) {
+		knot_async_requestor_exec(requestor, 100);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, MM_DEFAULT_BLKSIZE);
+
+	struct knot_async_requestor requestor;
+	int ret = knot_async_requestor_init(&requestor);
+	is_int(KNOT_EOK, ret, "requestor_async: init");
+
+	/* Bind TCP responder to random port. */
+	struct sockaddr_storage remote;
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 0);
+	int origin_fd = net_bound_socket(SOCK_STREAM, &remote);
+	assert(origin_fd > 0);
+	socklen_t addr_len = sockaddr_len((struct sockaddr *)&remote);
+	getsockname(origin_fd, (struct sockaddr *)&remote, &addr_len);
+	ret = listen(origin_fd, REQUESTS);
+	assert(ret == 0);
+
+	pthread_t thread;
+	pthread_create(&thread, 0, responder_thread, &origin_fd);
+
+	/* Many concurrent requests, answered out of order. */
+	struct result result = { 0 };
+	ret = KNOT_EOK;
+	for (int i = 0; i < REQUESTS; ++i) {
+		struct knot_async_request *request = make_request(&mm, &remote, 0);
+		ret |= knot_async_requestor_enqueue(&requestor, request, 5000,
+		                                    request_done, &result);
+	}
+	is_int(KNOT_EOK, ret, "requestor_async: enqueue concurrent requests");
+	is_int(REQUESTS, knot_async_requestor_pending(&requestor),
+	       "requestor_async: pending requests");
+
+	run_loop(&requestor, &result, REQUESTS);
+	ok(result.done == REQUESTS && result.failed == 0,
+	   "requestor_async: all requests answered");
+	is_int(0, knot_async_requestor_pending(&requestor),
+	       "requestor_async: no pending requests");
+
+	pthread_join(thread, NULL);
+	close(origin_fd);
+
+	/* Silent remote, request must time out. */
+	int silent_fd = net_bound_socket(SOCK_DGRAM, &remote);
+	assert(silent_fd > 0);
+	getsockname(silent_fd, (struct sockaddr *)&remote, &addr_len);
+
+	memset(&result, 0, sizeof(result));
+	struct knot_async_request *request = make_request(&mm, &remote, KNOT_RQ_UDP);
+	ret = knot_async_requestor_enqueue(&requestor, request, 200,
+	                                   request_done, &result);
+	is_int(KNOT_EOK, ret, "requestor_async: enqueue UDP request");
+	run_loop(&requestor, &result, 1);
+	ok(result.done == 1 && result.last_ret == KNOT_ETIMEOUT,
+	   "requestor_async: request timeout");
+
+	/* Outstanding requests are cancelled on deinit. */
+	memset(&result, 0, sizeof(result));
+	request = make_request(&mm, &remote, KNOT_RQ_UDP);
+	knot_async_requestor_enqueue(&requestor, request, 5000, request_done, &result);
+	knot_async_requestor_deinit(&requestor);
+	ok(result.done == 1 && result.last_ret == KNOT_ENOTRUNNING,
+	   "requestor_async: cancelled on deinit");
+
+	close(silent_fd);
+	mp_delete((struct mempool *)mm.ctx);
+
+	return 0;
+}
@@ -0,0 +1,233 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <tap/basic.h>
+
+/* Internals of the module are tested, same as in rosedb_tool. */
+#include "knot/modules/rosedb.c"
+#include "fake_server.h"
+
+static const knot_dname_t BLOCKED[] = "\x07""blocked""\x07""example";
+static const knot_dname_t MALWARE[] = "\x07""malware""\x07""example";
+static const knot_dname_t QUERY[] = "\x03""www""\x07""blocked""\x07""example";
+static const knot_dname_t DEEP[] = "\x04""deep""\x03""sub""\x07""example";
+static const knot_dname_t DEEP_QUERY[] = "\x01""x""\x04""deep""\x03""sub""\x07""example";
+static const knot_dname_t NONTERMINAL[] = "\x05""other""\x03""sub""\x07""example";
+static const knot_dname_t NEWER[] = "\x05""newer""\x07""example";
+static const knot_dname_t NEWER_QUERY[] = "\x03""www""\x05""newer""\x07""example";
+
+/*! \brief Insert an A record into the database in a new transaction. */
+static int db_insert(struct cache *cache, const knot_dname_t *name, uint8_t octet)
+{
+	MDB_txn *txn = NULL;
+	int ret = mdb_txn_begin(cache->env, NULL, 0, &txn);
+	if (ret != 0) {
+		return ret;
+	}
+
+	const uint8_t addr[4] = { 192, 0, 2, octet };
+	knot_rdata_t rr[knot_rdata_array_size(sizeof(addr))];
+	knot_rdata_init(rr, sizeof(addr), addr, 3600);
+
+	struct entry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.data.type = KNOT_RRTYPE_A;
+	knot_rdataset_init(&entry.data.rrs);
+	knot_rdataset_add(&entry.data.rrs, rr, NULL);
+	entry.threat_code = "test";
+	entry.syslog_ip = "127.0.0.1";
+
+	ret = cache_insert(txn, cache->dbi, name, &entry);
+	knot_rdataset_clear(&entry.data.rrs, NULL);
+	if (ret != 0) {
+		mdb_txn_abort(txn);
+		return ret;
+	}
+
+	return mdb_txn_commit(txn);
+}
+
+/*! \brief Build the suffix index like 'rosedb_tool index'. */
+static int db_index(struct cache *cache)
+{
+	MDB_txn *txn = NULL;
+	int ret = mdb_txn_begin(cache->env, NULL, 0, &txn);
+	if (ret != 0) {
+		return ret;
+	}
+
+	ret = index_build(cache, txn);
+	if (ret != KNOT_EOK) {
+		mdb_txn_abort(txn);
+		return ret;
+	}
+
+	return mdb_txn_commit(txn);
+}
+
+/*! \brief Resolve A query with the module, return the resulting state. */
+static int exec_query(struct rosedb *ctx, struct query_data *qdata,
+                      const knot_dname_t *qname, knot_pkt_t *answer)
+{
+	knot_pkt_clear(qdata->query);
+	knot_pkt_put_question(qdata->query, qname, KNOT_CLASS_IN, KNOT_RRTYPE_A);
+	knot_pkt_parse(qdata->query, 0);
+
+	knot_pkt_clear(answer);
+	knot_pkt_init_response(answer, qdata->query);
+
+	return rosedb_query(KNOT_NS_PROC_FULL, answer, qdata, ctx);
+}
+
+static void remove_dir(const char *path)
+{
+	DIR *dir = opendir(path);
+	struct dirent *dp;
+	while (dir != NULL && (dp = readdir(dir)) != NULL) {
+		if (dp->d_name[0] == '.') {
+			continue;
+		}
+		char *file = sprintf_alloc("%s/%s", path, dp->d_name);
+		remove(file);
+		free(file);
+	}
+	if (dir != NULL) {
+		closedir(dir);
+	}
+	remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	server_t server;
+	create_fake_server(&server, NULL);
+	conf()->workers = 1;
+
+	/* Temporary database. */
+	char *tmpdir = test_tmpdir();
+	char dbdir[256];
+	snprintf(dbdir, sizeof(dbdir), "%s/%s", tmpdir, "rosedb.XXXXXX");
+	ok(mkdtemp(dbdir) != NULL, "rosedb: create temporary directory");
+
+	struct query_plan *plan = query_plan_create(NULL);
+	struct query_module module = { .param = dbdir, .config = conf() };
+	ok(rosedb_load(plan, &module) == KNOT_EOK, "rosedb: load");
+	struct rosedb *ctx = module.ctx;
+	struct rosedb_thread *thr = &ctx->threads[0];
+
+	struct sockaddr_storage remote;
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 53);
+	struct process_query_param param = { 0 };
+	param.remote = &remote;
+	param.server = &server;
+	param.socket = -1;
+	param.thread_id = 0;
+	struct query_data qdata;
+	memset(&qdata, 0, sizeof(qdata));
+	qdata.param = &param;
+	qdata.query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_t *answer = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+
+	/* Thread transaction is reset after the query and renewed by the next. */
+	int state = exec_query(ctx, &qdata, QUERY, answer);
+	MDB_txn *txn = thr->txn;
+	ok(state == KNOT_NS_PROC_FULL && txn != NULL, "rosedb: thread transaction started");
+	ok(db_insert(ctx->cache, BLOCKED, 1) == 0, "rosedb: insert entry");
+	state = exec_query(ctx, &qdata, QUERY, answer);
+	ok(state == KNOT_NS_PROC_DONE && knot_wire_get_ancount(answer->wire) == 1,
+	   "rosedb: new entry found after the remembered miss");
+	ok(thr->txn == txn, "rosedb: thread transaction renewed");
+	state = exec_query(ctx, &qdata, QUERY, answer);
+	ok(state == KNOT_NS_PROC_DONE, "rosedb: remembered suffix answered");
+
+	/* Front cache is kept until the database changes. */
+	MDB_envinfo info;
+	mdb_env_info(ctx->cache->env, &info);
+	ok(thread_txn_renew(thr, ctx->cache) == 0 && thr->generation == info.me_last_txnid,
+	   "rosedb: renew with current transaction ID");
+	struct front_entry *front = front_lookup(ctx, thr, QUERY);
+	ok(front->valid, "rosedb: QNAME remembered");
+	mdb_txn_reset(thr->txn);
+	thread_txn_renew(thr, ctx->cache);
+	ok(front->valid, "rosedb: front cache kept without database change");
+	mdb_txn_reset(thr->txn);
+	db_insert(ctx->cache, MALWARE, 2);
+	thread_txn_renew(thr, ctx->cache);
+	mdb_env_info(ctx->cache->env, &info);
+	ok(!front->valid && thr->generation == info.me_last_txnid,
+	   "rosedb: front cache flushed on new transaction ID");
+	mdb_txn_reset(thr->txn);
+
+	/* Log messages are batched, the timer sends those of idle threads. */
+	pthread_mutex_lock(&thr->log_lock);
+	thread_log_flush(thr);
+	pthread_mutex_unlock(&thr->log_lock);
+	ctx->log_armed = false;
+	exec_query(ctx, &qdata, MALWARE, answer);
+	ok(thr->log_count == 1 && ctx->log_armed && ctx->log_timer != NULL,
+	   "rosedb: log message batched, flush timer armed");
+	log_timer_flush(ctx->log_timer);
+	ok(thr->log_count == 0 && !ctx->log_armed, "rosedb: timer sent the batch");
+	for (int i = 0; i < LOG_BATCH; ++i) {
+		exec_query(ctx, &qdata, MALWARE, answer);
+	}
+	ok(thr->log_count == 0, "rosedb: full batch sent at once");
+
+	/* Suffix index built from the database. */
+	db_insert(ctx->cache, DEEP, 3);
+	ok(db_index(ctx->cache) == KNOT_EOK, "rosedb: index built");
+	struct index *idx = index_open(ctx->cache->index_path);
+	mdb_env_info(ctx->cache->env, &info);
+	ok(idx != NULL && idx->txnid == info.me_last_txnid,
+	   "rosedb: index of the current database");
+	if (idx != NULL) {
+		ok(index_find(idx, QUERY) == QUERY + 4, "rosedb: index longest suffix");
+		ok(index_find(idx, BLOCKED) == BLOCKED, "rosedb: index exact match");
+		ok(index_find(idx, DEEP_QUERY) == DEEP_QUERY + 2,
+		   "rosedb: index longest suffix, more labels");
+		ok(index_find(idx, NONTERMINAL) == NULL, "rosedb: index non-terminal not matched");
+		ok(index_find(idx, NEWER) == NULL, "rosedb: index unknown name");
+		index_release(idx);
+	} else {
+		skip_block(5, "rosedb: no index");
+	}
+
+	/* The module picks up the index, a stale one is not used. */
+	ctx->index_checked = 0;
+	state = exec_query(ctx, &qdata, DEEP_QUERY, answer);
+	ok(state == KNOT_NS_PROC_DONE && thr->index != NULL &&
+	   thr->index->txnid == thr->generation, "rosedb: answered with the index");
+	db_insert(ctx->cache, NEWER, 4);
+	state = exec_query(ctx, &qdata, NEWER_QUERY, answer);
+	ok(state == KNOT_NS_PROC_DONE && knot_wire_get_ancount(answer->wire) == 1 &&
+	   thr->index->txnid != thr->generation,
+	   "rosedb: stale index, answered from the database");
+
+	knot_pkt_free(&qdata.query);
+	knot_pkt_free(&answer);
+	rosedb_unload(&module);
+	query_plan_free(plan);
+	remove_dir(dbdir);
+	test_tmpdir_free(tmpdir);
+	server_deinit(&server);
+	conf_free(conf());
+
+	return 0;
+}
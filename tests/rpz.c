@@ -0,0 +1,320 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <tap/basic.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libknot/internal/mempool.h"
+#include "libknot/descriptor.h"
+#include "libknot/rrtype/opt.h"
+#include "knot/modules/rpz.h"
+#include "knot/nameserver/internet.h"
+#include "knot/nameserver/process_query.h"
+#include "knot/updates/apply.h"
+#include "knot/updates/changesets.h"
+#include "fake_server.h"
+
+static const uint8_t ROOT[] = "";
+static const uint8_t ANY_NAME[] = "\x01*";
+static const uint8_t PASSTHRU[] = "\x0c""rpz-passthru";
+
+static const uint8_t EXAMPLE[] = "\x07""example";
+static const uint8_t WWW[] = "\x03""www""\x07""example";
+static const uint8_t BLOCKED[] = "\x07""blocked""\x07""example";
+static const uint8_t EMPTY[] = "\x05""empty""\x07""example";
+static const uint8_t WILD[] = "\x01""a""\x04""wild""\x07""example";
+static const uint8_t OK_WILD[] = "\x02""ok""\x04""wild""\x07""example";
+static const uint8_t GARDEN[] = "\x06""garden""\x07""example";
+static const uint8_t BAD[] = "\x03""bad""\x07""example";
+
+static const uint8_t RPZ[] = "\x03""rpz";
+static const uint8_t RPZ_EXAMPLE[] = "\x07""example""\x03""rpz";
+static const uint8_t RPZ_BLOCKED[] = "\x07""blocked""\x07""example""\x03""rpz";
+static const uint8_t RPZ_EMPTY[] = "\x05""empty""\x07""example""\x03""rpz";
+static const uint8_t RPZ_WILD[] = "\x01""*""\x04""wild""\x07""example""\x03""rpz";
+static const uint8_t RPZ_OK_WILD[] = "\x02""ok""\x04""wild""\x07""example""\x03""rpz";
+static const uint8_t RPZ_GARDEN[] = "\x06""garden""\x07""example""\x03""rpz";
+static const uint8_t RPZ_BAD_IP[] = "\x02""32""\x02""66""\x03""100""\x02""51""\x03""198"
+                                    "\x06""rpz-ip""\x03""rpz";
+static const uint8_t RPZ_NET_IP[] = "\x02""24""\x01""0""\x01""2""\x01""0""\x03""192"
+                                    "\x06""rpz-ip""\x03""rpz";
+
+/*! \brief More local data triggers under a single label than fit 16 bits. */
+#define RPZ_SIBLINGS 70000
+
+/*! \brief Name 'sNNNNN' under given suffix. */
+static void sibling_name(uint8_t *dst, const uint8_t *suffix, unsigned i)
+{
+	char label[8];
+	snprintf(label, sizeof(label), "s%05u", i);
+	dst[0] = 6;
+	memcpy(dst + 1, label, 6);
+	memcpy(dst + 7, suffix, knot_dname_size(suffix));
+}
+
+static void add_a(zone_contents_t *contents, const uint8_t *owner,
+                  uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	uint8_t rdata[4] = { a, b, c, d };
+	add_fake_rr(contents, owner, KNOT_RRTYPE_A, rdata, sizeof(rdata));
+}
+
+static void add_cname(zone_contents_t *contents, const uint8_t *owner,
+                      const uint8_t *target)
+{
+	add_fake_rr(contents, owner, KNOT_RRTYPE_CNAME, target, knot_dname_size(target));
+}
+
+static zone_t *create_zone(const knot_dname_t *apex, const char *name)
+{
+	zone_contents_t *contents = create_fake_contents(apex, 1);
+
+	if (knot_dname_is_equal(apex, EXAMPLE)) {
+		add_a(contents, WWW, 192, 0, 2, 1);
+		add_a(contents, BLOCKED, 192, 0, 2, 2);
+		add_a(contents, EMPTY, 192, 0, 2, 3);
+		add_a(contents, OK_WILD, 192, 0, 2, 4);
+		add_a(contents, BAD, 198, 51, 100, 66);
+		add_fake_soa_rrsig(contents);
+	} else {
+		add_cname(contents, RPZ_BLOCKED, ROOT);
+		add_cname(contents, RPZ_EMPTY, ANY_NAME);
+		add_cname(contents, RPZ_WILD, ROOT);
+		add_cname(contents, RPZ_OK_WILD, PASSTHRU);
+		add_a(contents, RPZ_GARDEN, 192, 0, 2, 100);
+		add_cname(contents, RPZ_BAD_IP, ROOT);
+		for (unsigned i = 0; i < RPZ_SIBLINGS; ++i) {
+			uint8_t owner[KNOT_DNAME_MAXLEN];
+			sibling_name(owner, RPZ_EXAMPLE, i);
+			add_a(contents, owner, 192, 0, 2, 99);
+		}
+	}
+	adjust_fake_contents(contents);
+
+	return create_fake_zone(name, contents);
+}
+
+/*!
+ * \brief Resolve the A query, with the DO bit if requested.
+ *
+ * \return RCODE, the answer A record count and the last octet of the first one.
+ */
+static int exec_query(knot_layer_t *proc, knot_pkt_t *query, knot_pkt_t *answer,
+                      const uint8_t *qname, bool dnssec, int *count, uint8_t *octet)
+{
+	knot_pkt_clear(query);
+	knot_pkt_put_question(query, qname, KNOT_CLASS_IN, KNOT_RRTYPE_A);
+	if (dnssec) {
+		knot_rrset_t opt;
+		knot_edns_init(&opt, 4096, 0, KNOT_EDNS_VERSION, &query->mm);
+		knot_edns_set_do(&opt);
+		knot_pkt_begin(query, KNOT_ADDITIONAL);
+		knot_pkt_put(query, KNOT_COMPR_HINT_NONE, &opt, KNOT_PF_FREE);
+	}
+	knot_pkt_parse(query, 0);
+
+	knot_pkt_t *parsed = exec_fake_query(proc, query, answer);
+	if (parsed == NULL) {
+		return -1;
+	}
+
+	*count = 0;
+	const knot_pktsection_t *an = knot_pkt_section(parsed, KNOT_ANSWER);
+	for (uint16_t i = 0; i < an->count; ++i) {
+		if (an->rr[i].type == KNOT_RRTYPE_A &&
+		    knot_dname_is_equal(an->rr[i].owner, qname)) {
+			const knot_rdata_t *rr = knot_rdataset_at(&an->rr[i].rrs, 0);
+			if (*count == 0) {
+				*octet = knot_rdata_data(rr)[3];
+			}
+			*count += 1;
+		}
+	}
+
+	int rcode = knot_wire_get_rcode(parsed->wire);
+	knot_pkt_free(&parsed);
+	return rcode;
+}
+
+/*! \brief Update the policy zone, store the change in the journal. */
+static int update_policy(zone_t *zone)
+{
+	changeset_t ch;
+	changeset_init(&ch, zone->name);
+
+	ch.soa_from = create_fake_soa(zone->name, 1);
+	ch.soa_to = create_fake_soa(zone->name, 2);
+
+	knot_rrset_t *rr = knot_rrset_new(RPZ_BLOCKED, KNOT_RRTYPE_CNAME, KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(rr, ROOT, sizeof(ROOT), 3600, NULL);
+	changeset_rem_rrset(&ch, rr);
+	knot_rrset_free(&rr, NULL);
+	rr = knot_rrset_new(RPZ_NET_IP, KNOT_RRTYPE_CNAME, KNOT_CLASS_IN, NULL);
+	knot_rrset_add_rdata(rr, ANY_NAME, sizeof(ANY_NAME), 3600, NULL);
+	changeset_add_rrset(&ch, rr);
+	knot_rrset_free(&rr, NULL);
+
+	zone_contents_t *contents = NULL;
+	int ret = apply_changeset(zone, &ch, &contents);
+	if (ret == KNOT_EOK) {
+		ret = zone_change_store(zone, &ch);
+	}
+	if (ret == KNOT_EOK) {
+		zone_contents_t *old = zone_switch_contents(zone, contents);
+		zone_contents_deep_free(&old);
+	} else {
+		zone_contents_deep_free(&contents);
+	}
+
+	changeset_clear(&ch);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, sizeof(knot_pkt_t));
+
+	knot_layer_t proc;
+	memset(&proc, 0, sizeof(knot_layer_t));
+	proc.mm = &mm;
+
+	server_t server;
+	int ret = create_fake_server(&server, proc.mm);
+	ok(ret == KNOT_EOK, "rpz: fake server initialization");
+
+	/* Policy zone with a journal. */
+	char *tmpdir = test_tmpdir();
+	char journal[256];
+	snprintf(journal, sizeof(journal), "%s/%s", tmpdir, "journal.XXXXXX");
+	int tmp_fd = mkstemp(journal);
+	ok(tmp_fd >= 0, "rpz: create temporary file");
+	close(tmp_fd);
+	remove(journal);
+
+	zone_t *zone = create_zone(EXAMPLE, "example.");
+	zone_t *policy = create_zone(RPZ, "rpz.");
+	policy->conf->ixfr_db = strdup(journal);
+	policy->conf->ixfr_fslimit = 1024 * 1024;
+	knot_zonedb_free(&server.zone_db);
+	server.zone_db = knot_zonedb_new(2);
+	knot_zonedb_insert(server.zone_db, zone);
+	knot_zonedb_insert(server.zone_db, policy);
+	knot_zonedb_build_index(server.zone_db);
+
+	struct query_plan *plan = query_plan_create(NULL);
+	internet_query_plan(plan);
+	zone->conf->query_plan = plan;
+
+	char param_bad[] = "";
+	struct query_module module_bad = { .param = param_bad, .config = conf() };
+	ok(rpz_load(plan, &module_bad) != KNOT_EOK, "rpz: missing policy zone");
+	rpz_unload(&module_bad);
+
+	char param[] = "rpz.";
+	struct query_module module = { .param = param, .config = conf(),
+	                               .stats = rpz_stats_print };
+	ok(rpz_load(plan, &module) == KNOT_EOK, "rpz: load");
+
+	struct sockaddr_storage remote;
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 53);
+	struct process_query_param query_param = { 0 };
+	query_param.remote = &remote;
+	query_param.server = &server;
+	knot_layer_begin(&proc, NS_PROC_QUERY, &query_param);
+
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_t *answer = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	int count = 0;
+	uint8_t octet = 0;
+
+	/* The index is compiled when the policy zone is published. */
+	int rcode = exec_query(&proc, query, answer, BLOCKED, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 1 && octet == 2,
+	   "rpz: no index before the policy zone is published");
+	zone_hooks_run(policy);
+
+	rcode = exec_query(&proc, query, answer, WWW, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 1 && octet == 1, "rpz: no trigger");
+	rcode = exec_query(&proc, query, answer, BLOCKED, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NXDOMAIN && count == 0, "rpz: QNAME trigger, NXDOMAIN");
+	rcode = exec_query(&proc, query, answer, EMPTY, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 0, "rpz: QNAME trigger, NODATA");
+	rcode = exec_query(&proc, query, answer, WILD, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NXDOMAIN && count == 0, "rpz: wildcard trigger");
+	rcode = exec_query(&proc, query, answer, OK_WILD, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 1 && octet == 4, "rpz: passthru");
+	rcode = exec_query(&proc, query, answer, GARDEN, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 1 && octet == 100, "rpz: local data");
+	rcode = exec_query(&proc, query, answer, BAD, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NXDOMAIN && count == 0, "rpz: response IP trigger");
+
+	/* Triggers with many siblings under a single label. */
+	const unsigned siblings[] = { 0, 65535, 65536, RPZ_SIBLINGS - 1 };
+	bool matched = true;
+	for (int i = 0; i < 4; ++i) {
+		uint8_t qname[KNOT_DNAME_MAXLEN];
+		sibling_name(qname, EXAMPLE, siblings[i]);
+		rcode = exec_query(&proc, query, answer, qname, false, &count, &octet);
+		matched = matched && rcode == KNOT_RCODE_NOERROR && count == 1 && octet == 99;
+	}
+	ok(matched, "rpz: %u triggers under a single label", RPZ_SIBLINGS);
+
+	/* Policy answers in a signed zone. */
+	rcode = exec_query(&proc, query, answer, BLOCKED, true, &count, &octet);
+	ok(rcode == KNOT_RCODE_NXDOMAIN && count == 0, "rpz: NXDOMAIN with DO bit");
+	rcode = exec_query(&proc, query, answer, EMPTY, true, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 0, "rpz: NODATA with DO bit");
+	rcode = exec_query(&proc, query, answer, WWW, true, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 1 && octet == 1, "rpz: no trigger with DO bit");
+
+	/* Incremental update of the policy zone. */
+	ok(update_policy(policy) == KNOT_EOK, "rpz: update policy zone");
+	rcode = exec_query(&proc, query, answer, BLOCKED, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 0, "rpz: updated response IP trigger");
+	rcode = exec_query(&proc, query, answer, BAD, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NXDOMAIN && count == 0, "rpz: other response IP trigger");
+	rcode = exec_query(&proc, query, answer, EMPTY, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 0, "rpz: unchanged trigger");
+
+	struct rpz_stats stats;
+	rpz_stats_sum(&module, &stats);
+	ok(stats.qname == 11 && stats.wildcard == 1 && stats.ip == 3 && stats.passthru == 1,
+	   "rpz: match counters");
+	char line[256];
+	ret = module.stats(&module, line, sizeof(line));
+	ok(ret > 0 && strcmp(line, "rpz rpz.\tqname=11 wildcard=1 ip=3 passthru=1") == 0,
+	   "rpz: print match counters");
+
+	rpz_unload(&module);
+	rcode = exec_query(&proc, query, answer, BLOCKED, false, &count, &octet);
+	ok(rcode == KNOT_RCODE_NOERROR && count == 1 && octet == 2, "rpz: unload");
+
+	knot_layer_finish(&proc);
+	knot_pkt_free(&query);
+	knot_pkt_free(&answer);
+	mp_delete((struct mempool *)mm.ctx);
+	server_deinit(&server);
+	conf_free(conf());
+	remove(journal);
+	free(tmpdir);
+
+	return 0;
+}
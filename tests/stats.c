@@ -0,0 +1,136 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <tap/basic.h>
+
+#include "libknot/descriptor.h"
+#include "libknot/errcode.h"
+#include "knot/server/stats.h"
+
+/*! \brief Create query for the root zone. */
+static knot_pkt_t *make_query(uint16_t qtype)
+{
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_put_question(query, (const uint8_t *)"", KNOT_CLASS_IN, qtype);
+	return query;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	server_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	is_int(KNOT_EOK, stats_reserve(&stats, 2), "stats: reserve");
+	ok(((uintptr_t)stats_thread(&stats, 1) % STATS_CACHELINE) == 0 &&
+	   sizeof(stats_counters_t) % STATS_CACHELINE == 0,
+	   "stats: thread blocks aligned to cache line");
+	ok(stats_thread(&stats, 2) == NULL, "stats: thread out of range");
+
+	/* Answered query and a dropped one in different threads. */
+	knot_pkt_t *query = make_query(KNOT_RRTYPE_AAAA);
+	knot_pkt_t *resp = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_init_response(resp, query);
+	knot_wire_set_rcode(resp->wire, KNOT_RCODE_NXDOMAIN);
+	knot_wire_set_tc(resp->wire);
+	stats_query(stats_thread(&stats, 0), STATS_UDP6, query, resp, 100, 3);
+	stats_query(stats_thread(&stats, 1), STATS_UDP4, query, NULL, 0, 5000);
+	stats_rrl(stats_thread(&stats, 1), true);
+
+	/* Growing keeps counters. */
+	is_int(KNOT_EOK, stats_reserve(&stats, 4), "stats: grow");
+	stats_query(stats_thread(&stats, 3), STATS_TCP4, query, resp, 70000, 5000000);
+
+	stats_counters_t sum;
+	stats_sum(&stats, &sum);
+	ok(sum.queries == 3 && sum.proto[STATS_UDP6] == 1 &&
+	   sum.proto[STATS_UDP4] == 1 && sum.proto[STATS_TCP4] == 1,
+	   "stats: queries by transport");
+	ok(sum.qtype[KNOT_RRTYPE_AAAA] == 3, "stats: queries by type");
+	ok(sum.rcode[KNOT_RCODE_NXDOMAIN] == 2 && sum.rcode[STATS_RCODES - 1] == 1 &&
+	   sum.truncated == 2 && sum.rrl_slipped == 1,
+	   "stats: responses by rcode");
+	ok(sum.size[7] == 1 && sum.size[STATS_SIZES - 1] == 1,
+	   "stats: response size histogram");
+	ok(sum.latency[2] == 1 && sum.latency[13] == 1 &&
+	   sum.latency[STATS_LATENCIES - 1] == 1, "stats: latency histogram");
+
+	char buf[4096];
+	int len = stats_print(&stats, buf, sizeof(buf));
+	ok(len > 0 && strstr(buf, "queries=3") && strstr(buf, "AAAA=3") &&
+	   strstr(buf, "NXDOMAIN=2"), "stats: print");
+	is_int(KNOT_ESPACE, stats_print(&stats, buf, 16), "stats: print overflow");
+
+	char filename[] = "/tmp/knot-stats.XXXXXX";
+	int fd = mkstemp(filename);
+	close(fd);
+	is_int(KNOT_EOK, stats_dump(&stats, filename), "stats: dump");
+	FILE *fp = fopen(filename, "r");
+	char line[256] = { '\0' };
+	ok(fp != NULL && fgets(line, sizeof(line), fp) != NULL &&
+	   strncmp(line, "uptime=", 7) == 0, "stats: dump content");
+	if (fp != NULL) {
+		fclose(fp);
+	}
+	unlink(filename);
+
+	/* Processing time percentiles. */
+	len = stats_print_latency(&stats, buf, sizeof(buf));
+#ifdef ENABLE_TIMING
+	ok(len > 0 && strstr(buf, "udp6\tcount=1 p50=3.") != NULL &&
+	   strstr(buf, "answer\tcount=0") != NULL, "stats: print latency");
+#else
+	is_int(KNOT_ENOTSUP, len, "stats: latency not compiled in");
+#endif
+
+	/* Log-linear histogram buckets are continuous and bounded. */
+	bool continuous = true;
+	for (unsigned i = 1; i < STATS_HIST_BUCKETS; ++i) {
+		uint64_t lower = stats_hist_upper(i - 1) + 1;
+		continuous = continuous && stats_hist_bucket(lower) == i &&
+		             stats_hist_bucket(stats_hist_upper(i)) == i;
+	}
+	ok(continuous && stats_hist_bucket(UINT64_MAX) == STATS_HIST_BUCKETS - 1,
+	   "stats: histogram buckets");
+	ok(stats_hist_upper(stats_hist_bucket(1000000)) - 1000000 < 1000000 / 8,
+	   "stats: histogram precision");
+
+	/* Percentiles. */
+	stats_hist_t hist;
+	memset(&hist, 0, sizeof(hist));
+	is_int(0, stats_hist_quantile(&hist, 0.5), "stats: empty histogram");
+	for (unsigned i = 0; i < 990; ++i) {
+		stats_hist_add(&hist, 5);
+	}
+	for (unsigned i = 0; i < 10; ++i) {
+		stats_hist_add(&hist, 4000);
+	}
+	ok(stats_hist_quantile(&hist, 0.5) == 5 && stats_hist_quantile(&hist, 0.99) == 5 &&
+	   stats_hist_quantile(&hist, 0.999) == stats_hist_upper(stats_hist_bucket(4000)),
+	   "stats: histogram quantiles");
+
+	knot_pkt_free(&resp);
+	knot_pkt_free(&query);
+	stats_deinit(&stats);
+
+	return 0;
+}
@@ -0,0 +1,294 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <tap/basic.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "libknot/internal/mempool.h"
+#include "libknot/descriptor.h"
+#include "knot/modules/synth_record.h"
+#include "knot/nameserver/internet.h"
+#include "knot/nameserver/process_query.h"
+#include "fake_server.h"
+
+#define IPV6_REVERSE "2.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.8.b.d.0.1.0.0.2.ip6.arpa."
+
+static zone_t *create_zone(const char *name)
+{
+	knot_dname_t *apex = knot_dname_from_str_alloc(name);
+	zone_contents_t *contents = create_fake_contents(apex, 1);
+	adjust_fake_contents(contents);
+	knot_dname_free(&apex, NULL);
+
+	return create_fake_zone(name, contents);
+}
+
+/*! \brief Create the query plan for the zone with given synth_record modules. */
+static int load_modules(zone_t *zone, struct query_module *modules, int count)
+{
+	struct query_plan *plan = query_plan_create(NULL);
+	internet_query_plan(plan);
+	zone->conf->query_plan = plan;
+
+	for (int i = 0; i < count; ++i) {
+		int ret = synth_record_load(plan, &modules[i]);
+		if (ret != KNOT_EOK) {
+			return ret;
+		}
+	}
+
+	return KNOT_EOK;
+}
+
+/*! \brief Expected answer RDATA from the address or name in text form. */
+static int expected_rdata(uint16_t qtype, const char *text, uint8_t *rdata)
+{
+	switch (qtype) {
+	case KNOT_RRTYPE_A:
+		return (inet_pton(AF_INET, text, rdata) == 1) ? 4 : -1;
+	case KNOT_RRTYPE_AAAA:
+		return (inet_pton(AF_INET6, text, rdata) == 1) ? 16 : -1;
+	case KNOT_RRTYPE_PTR:
+		return (knot_dname_from_str(rdata, text, KNOT_DNAME_MAXLEN) != NULL) ?
+		       knot_dname_size(rdata) : -1;
+	default:
+		return -1;
+	}
+}
+
+/*!
+ * \brief Resolve the query, check the RCODE and the synthetic answer.
+ *
+ * No answer is expected if the expected data is NULL.
+ */
+static void check_query(knot_layer_t *proc, knot_pkt_t *query, knot_pkt_t *answer,
+                        const char *qname, uint16_t qtype, int rcode,
+                        const char *data, uint32_t ttl, const char *msg)
+{
+	uint8_t name[KNOT_DNAME_MAXLEN];
+	knot_pkt_clear(query);
+	knot_pkt_put_question(query, knot_dname_from_str(name, qname, sizeof(name)),
+	                      KNOT_CLASS_IN, qtype);
+	knot_pkt_parse(query, 0);
+
+	knot_pkt_t *parsed = exec_fake_query(proc, query, answer);
+	if (parsed == NULL) {
+		ok(0, "synth_record: %s", msg);
+		return;
+	}
+
+	const knot_pktsection_t *an = knot_pkt_section(parsed, KNOT_ANSWER);
+	bool valid = (knot_wire_get_rcode(parsed->wire) == rcode);
+	if (data == NULL) {
+		valid = valid && an->count == 0;
+	} else {
+		uint8_t rdata[KNOT_DNAME_MAXLEN];
+		int rdlen = expected_rdata(qtype, data, rdata);
+		const knot_rdata_t *rr = (an->count == 1) ? knot_rdataset_at(&an->rr[0].rrs, 0) : NULL;
+		valid = valid && rr != NULL && an->rr[0].type == qtype &&
+		        knot_rdata_ttl(rr) == ttl && knot_rdata_rdlen(rr) == rdlen &&
+		        memcmp(knot_rdata_data(rr), rdata, rdlen) == 0;
+	}
+	ok(valid, "synth_record: %s", msg);
+
+	knot_pkt_free(&parsed);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, sizeof(knot_pkt_t));
+
+	knot_layer_t proc;
+	memset(&proc, 0, sizeof(knot_layer_t));
+	proc.mm = &mm;
+
+	server_t server;
+	int ret = create_fake_server(&server, proc.mm);
+	ok(ret == KNOT_EOK, "synth_record: fake server initialization");
+
+	zone_t *forward = create_zone("example.");
+	zone_t *reverse = create_zone("arpa.");
+	knot_zonedb_free(&server.zone_db);
+	server.zone_db = knot_zonedb_new(2);
+	knot_zonedb_insert(server.zone_db, forward);
+	knot_zonedb_insert(server.zone_db, reverse);
+	knot_zonedb_build_index(server.zone_db);
+
+	/* Forward templates with overlapping subnets and two prefix lengths. */
+	char param_net[] = "forward dyn- 400 192.0.2.0/24";
+	char param_half[] = "forward dyn- 500 192.0.2.128/25";
+	char param_host[] = "forward host- 600 192.0.2.0/24";
+	char param_v6[] = "forward dyn- 400 2001:db8::/32";
+	char param_v4map[] = "forward dyn- 700 ::/96";
+	struct query_module forward_modules[] = {
+		{ .param = param_net },
+		{ .param = param_half },
+		{ .param = param_host },
+		{ .param = param_v6 },
+		{ .param = param_v4map }
+	};
+	ret = load_modules(forward, forward_modules, 5);
+	ok(ret == KNOT_EOK, "synth_record: load forward templates");
+
+	char param_rev[] = "reverse dyn- example. 400 192.0.2.0/24";
+	char param_rev6[] = "reverse dyn- example. 400 2001:db8::/32";
+	struct query_module reverse_modules[] = {
+		{ .param = param_rev },
+		{ .param = param_rev6 }
+	};
+	ret = load_modules(reverse, reverse_modules, 2);
+	ok(ret == KNOT_EOK, "synth_record: load reverse templates");
+
+	struct sockaddr_storage remote;
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 53);
+	struct process_query_param param = { 0 };
+	param.remote = &remote;
+	param.server = &server;
+	knot_layer_begin(&proc, NS_PROC_QUERY, &param);
+
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	/* Synthetic RR data is allocated from the answer memory pool. */
+	knot_pkt_t *answer = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, &mm);
+
+	/* IPv4 forward. */
+	check_query(&proc, query, answer, "dyn-192-0-2-1.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NOERROR, "192.0.2.1", 400, "IPv4 forward");
+	check_query(&proc, query, answer, "dyn-192-0-2-200.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NOERROR, "192.0.2.200", 500, "longest prefix wins");
+	check_query(&proc, query, answer, "host-192-0-2-200.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NOERROR, "192.0.2.200", 600, "other prefix length");
+	check_query(&proc, query, answer, "dyn-192-0-2-1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NOERROR, NULL, 0, "IPv4 forward, NODATA");
+	check_query(&proc, query, answer, "dyn-198-51-100-1.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 out of the subnets");
+	check_query(&proc, query, answer, "dyn-192-0-2-01.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 octet with leading zero");
+	check_query(&proc, query, answer, "dyn-192-0-2-256.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 octet out of range");
+	check_query(&proc, query, answer, "dyn-192-0-2-1000.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 octet too long");
+	check_query(&proc, query, answer, "dyn-192-0-2.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 too few octets");
+	check_query(&proc, query, answer, "dyn-192-0-2-1-1.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 too many octets");
+	check_query(&proc, query, answer, "dyn-192-0-2-.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 empty octet");
+	check_query(&proc, query, answer, "dyn-192-0-2-x.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 invalid character");
+	check_query(&proc, query, answer, "dyn-.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "prefix only");
+
+	/* IPv6 forward. */
+	check_query(&proc, query, answer, "dyn-2001-db8-0-0-0-0-0-1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NOERROR, "2001:db8::1", 400, "IPv6 full form");
+	check_query(&proc, query, answer, "dyn-2001-0db8-0000-0000-0000-0000-0000-0001.example.",
+	            KNOT_RRTYPE_AAAA, KNOT_RCODE_NOERROR, "2001:db8::1", 400,
+	            "IPv6 groups with leading zeros");
+	check_query(&proc, query, answer, "dyn-2001-DB8--1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NOERROR, "2001:db8::1", 400, "IPv6 compressed in the middle");
+	check_query(&proc, query, answer, "dyn-2001-db8--.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NOERROR, "2001:db8::", 400, "IPv6 compressed at the end");
+	check_query(&proc, query, answer, "dyn---c000-201.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NOERROR, "::c000:201", 700, "IPv6 compressed at the start");
+	check_query(&proc, query, answer, "dyn---.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NOERROR, "::", 700, "IPv6 unspecified address");
+	check_query(&proc, query, answer, "dyn-2001-db8-1-2-3-4-5--.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NOERROR, "2001:db8:1:2:3:4:5:0", 400,
+	            "IPv6 compressed single group");
+	check_query(&proc, query, answer, "dyn-2001-db8--1.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NOERROR, NULL, 0, "IPv6 forward, NODATA");
+	check_query(&proc, query, answer, "dyn-2001-db9--1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 out of the subnets");
+	check_query(&proc, query, answer, "dyn-2001-00db8--1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 group too long");
+	check_query(&proc, query, answer, "dyn-2001-db8--1--2.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 compressed twice");
+	check_query(&proc, query, answer, "dyn-2001-db8-0-0-0-0-1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 too few groups");
+	check_query(&proc, query, answer, "dyn-2001-db8-0-0-0-0-0-0-1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 too many groups");
+	check_query(&proc, query, answer, "dyn-2001-db8-0-0-0-0-0-1--.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 full form compressed");
+	check_query(&proc, query, answer, "dyn-2001-db8--1-.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 trailing separator");
+	check_query(&proc, query, answer, "dyn--2001-db8--1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 leading separator");
+	check_query(&proc, query, answer, "dyn-2001-db8---1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 triple separator");
+	check_query(&proc, query, answer, "dyn-2001-dg8--1.example.", KNOT_RRTYPE_AAAA,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 invalid character");
+
+	/* IPv4 reverse. */
+	check_query(&proc, query, answer, "1.2.0.192.in-addr.arpa.", KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NOERROR, "dyn-192-0-2-1.example.", 400, "IPv4 reverse");
+	check_query(&proc, query, answer, "1.2.0.192.in-addr.arpa.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NOERROR, NULL, 0, "IPv4 reverse, NODATA");
+	check_query(&proc, query, answer, "1.100.51.198.in-addr.arpa.", KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 reverse out of the subnets");
+	check_query(&proc, query, answer, "01.2.0.192.in-addr.arpa.", KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 reverse leading zero");
+	check_query(&proc, query, answer, "256.2.0.192.in-addr.arpa.", KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 reverse octet out of range");
+	check_query(&proc, query, answer, "2.0.192.in-addr.arpa.", KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 reverse truncated name");
+	check_query(&proc, query, answer, "x.2.0.192.in-addr.arpa.", KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv4 reverse malformed label");
+
+	/* IPv6 reverse. */
+	check_query(&proc, query, answer, "1." IPV6_REVERSE, KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NOERROR, "dyn-2001-0db8-0000-0000-0000-0000-0000-0021.example.",
+	            400, "IPv6 reverse");
+	check_query(&proc, query, answer, "A." IPV6_REVERSE, KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NOERROR, "dyn-2001-0db8-0000-0000-0000-0000-0000-002a.example.",
+	            400, "IPv6 reverse upper case nibble");
+	check_query(&proc, query, answer, IPV6_REVERSE, KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 reverse truncated name");
+	check_query(&proc, query, answer, "0.1." IPV6_REVERSE, KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 reverse too long name");
+	check_query(&proc, query, answer, "g." IPV6_REVERSE, KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 reverse invalid nibble");
+	check_query(&proc, query, answer, "10." IPV6_REVERSE, KNOT_RRTYPE_PTR,
+	            KNOT_RCODE_NXDOMAIN, NULL, 0, "IPv6 reverse two character label");
+
+	/* Templates are compiled again without the unloaded one. */
+	synth_record_unload(&forward_modules[1]);
+	check_query(&proc, query, answer, "dyn-192-0-2-200.example.", KNOT_RRTYPE_A,
+	            KNOT_RCODE_NOERROR, "192.0.2.200", 400, "unloaded template");
+
+	knot_layer_finish(&proc);
+	knot_pkt_free(&query);
+	knot_pkt_free(&answer);
+
+	for (int i = 0; i < 5; ++i) {
+		if (i != 1) {
+			synth_record_unload(&forward_modules[i]);
+		}
+	}
+	for (int i = 0; i < 2; ++i) {
+		synth_record_unload(&reverse_modules[i]);
+	}
+
+	mp_delete((struct mempool *)mm.ctx);
+	server_deinit(&server);
+	conf_free(conf());
+
+	return 0;
+}
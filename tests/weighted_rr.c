@@ -0,0 +1,248 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <arpa/inet.h>
+#include <tap/basic.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "libknot/internal/mempool.h"
+#include "libknot/descriptor.h"
+#include "knot/modules/weighted_rr.h"
+#include "knot/nameserver/internet.h"
+#include "knot/nameserver/process_query.h"
+#include "fake_server.h"
+
+#define ADDR_COUNT 4
+#define QUERY_COUNT 200
+
+static const uint8_t EXAMPLE[] = "\x07""example";
+static const uint8_t WWW[] = "\x03""www""\x07""example";
+static const uint8_t MAIL[] = "\x04""mail""\x07""example";
+
+/*! \brief Add A records 192.0.2.<first>, ... to the owner. */
+static void add_records(zone_contents_t *contents, const uint8_t *owner,
+                        unsigned first, unsigned count)
+{
+	knot_rrset_t *rr = knot_rrset_new(owner, KNOT_RRTYPE_A, KNOT_CLASS_IN, NULL);
+	for (unsigned i = 0; i < count; ++i) {
+		uint8_t rdata[4] = { 192, 0, 2, first + i };
+		knot_rrset_add_rdata(rr, rdata, sizeof(rdata), 3600, NULL);
+	}
+	zone_node_t *node = NULL;
+	zone_contents_add_rr(contents, rr, &node);
+	knot_rrset_free(&rr, NULL);
+}
+
+/*! \brief Create zone contents with 'www' records starting at 'first'. */
+static zone_contents_t *create_contents(const knot_dname_t *apex, unsigned first)
+{
+	zone_contents_t *contents = create_fake_contents(apex, 1);
+	add_records(contents, WWW, first, ADDR_COUNT);
+	add_records(contents, MAIL, 1, 2);
+	adjust_fake_contents(contents);
+
+	return contents;
+}
+
+/*!
+ * \brief Resolve the query, store the last octets of the answer addresses.
+ *
+ * \return Number of addresses, -1 on error.
+ */
+static int exec_query(knot_layer_t *proc, knot_pkt_t *query, knot_pkt_t *answer,
+                      const uint8_t *qname, uint8_t *octets)
+{
+	knot_pkt_clear(query);
+	knot_pkt_put_question(query, qname, KNOT_CLASS_IN, KNOT_RRTYPE_A);
+	knot_pkt_parse(query, 0);
+
+	knot_pkt_t *parsed = exec_fake_query(proc, query, answer);
+	if (parsed == NULL) {
+		return -1;
+	}
+
+	/* Parsed records are not merged into RR sets. */
+	int count = 0;
+	const knot_pktsection_t *an = knot_pkt_section(parsed, KNOT_ANSWER);
+	for (uint16_t i = 0; i < an->count; ++i) {
+		if (an->rr[i].type == KNOT_RRTYPE_A) {
+			const knot_rdata_t *rr = knot_rdataset_at(&an->rr[i].rrs, 0);
+			octets[count++] = knot_rdata_data(rr)[3];
+		}
+	}
+
+	knot_pkt_free(&parsed);
+	return count;
+}
+
+/*! \brief Check that the answer is a rotation of the records. */
+static bool is_rotation(const uint8_t *octets, int count, unsigned first)
+{
+	if (count != ADDR_COUNT || octets[0] < first || octets[0] >= first + count) {
+		return false;
+	}
+
+	for (int i = 1; i < count; ++i) {
+		unsigned expect = first + (octets[0] - first + i) % count;
+		if (octets[i] != expect) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	mm_ctx_t mm;
+	mm_ctx_mempool(&mm, sizeof(knot_pkt_t));
+
+	knot_layer_t proc;
+	memset(&proc, 0, sizeof(knot_layer_t));
+	proc.mm = &mm;
+
+	server_t server;
+	int ret = create_fake_server(&server, proc.mm);
+	ok(ret == KNOT_EOK, "weighted_rr: fake server initialization");
+
+	zone_t *zone = create_fake_zone("example.", create_contents(EXAMPLE, 1));
+	knot_zonedb_free(&server.zone_db);
+	server.zone_db = knot_zonedb_new(1);
+	knot_zonedb_insert(server.zone_db, zone);
+	knot_zonedb_build_index(server.zone_db);
+
+	struct query_plan *plan = query_plan_create(NULL);
+	internet_query_plan(plan);
+	zone->conf->query_plan = plan;
+
+	/* Invalid configuration. */
+	char param_bad[] = "www.example. 0";
+	struct query_module module_bad = { .param = param_bad, .config = conf() };
+	ok(weighted_rr_load(plan, &module_bad) != KNOT_EOK, "weighted_rr: invalid variants");
+	weighted_rr_unload(&module_bad);
+	char param_bad_weight[] = "www.example. 4 192.0.2.1";
+	module_bad.param = param_bad_weight;
+	ok(weighted_rr_load(plan, &module_bad) != KNOT_EOK, "weighted_rr: invalid weight");
+	weighted_rr_unload(&module_bad);
+
+	char param[] = "www.example. 4";
+	struct query_module module = { .param = param, .config = conf() };
+	ok(weighted_rr_load(plan, &module) == KNOT_EOK, "weighted_rr: load");
+	zone_hooks_run(zone);
+
+	struct sockaddr_storage remote;
+	sockaddr_set(&remote, AF_INET, "127.0.0.1", 53);
+	struct process_query_param query_param = { 0 };
+	query_param.remote = &remote;
+	query_param.server = &server;
+	knot_layer_begin(&proc, NS_PROC_QUERY, &query_param);
+
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_t *answer = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	uint8_t octets[ADDR_COUNT];
+
+	/* All rotations are used. */
+	bool rotations = true;
+	unsigned seen[ADDR_COUNT] = { 0 };
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		int count = exec_query(&proc, query, answer, WWW, octets);
+		rotations = rotations && is_rotation(octets, count, 1);
+		if (count > 0) {
+			seen[(octets[0] - 1) % ADDR_COUNT] += 1;
+		}
+	}
+	ok(rotations, "weighted_rr: answers are rotations");
+	ok(seen[0] > 0 && seen[1] > 0 && seen[2] > 0 && seen[3] > 0,
+	   "weighted_rr: all rotations used");
+
+	/* Names not configured are kept in zone order. */
+	bool kept = true;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		int count = exec_query(&proc, query, answer, MAIL, octets);
+		kept = kept && count == 2 && octets[0] == 1 && octets[1] == 2;
+	}
+	ok(kept, "weighted_rr: other names unchanged");
+
+	/* Zone records stay in order. */
+	const zone_node_t *node = zone_contents_find_node(zone->contents, WWW);
+	const knot_rdataset_t *rrs = node_rdataset(node, KNOT_RRTYPE_A);
+	ok(knot_rdata_data(knot_rdataset_at(rrs, 0))[3] == 1,
+	   "weighted_rr: zone contents unchanged");
+
+	/* New zone version, orders are rebuilt. */
+	zone_contents_t *old = zone_switch_contents(zone, create_contents(zone->name, 11));
+	rotations = true;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		int count = exec_query(&proc, query, answer, WWW, octets);
+		rotations = rotations && is_rotation(octets, count, 11);
+	}
+	ok(rotations, "weighted_rr: new zone version");
+	zone_contents_deep_free(&old);
+
+	/* Zones of other query plans are ignored. */
+	zone_contents_t *empty = create_fake_contents(EXAMPLE, 1);
+	adjust_fake_contents(empty);
+	zone_t *other = create_fake_zone("example.", empty);
+	zone_hooks_run(other);
+	memset(seen, 0, sizeof(seen));
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		int count = exec_query(&proc, query, answer, WWW, octets);
+		if (is_rotation(octets, count, 11)) {
+			seen[(octets[0] - 11) % ADDR_COUNT] += 1;
+		}
+	}
+	ok(seen[0] > 0 && seen[1] > 0 && seen[2] > 0 && seen[3] > 0,
+	   "weighted_rr: other zones ignored");
+	zone_free(&other);
+
+	/* Weighted order, the heavy record nearly always comes first. */
+	weighted_rr_unload(&module);
+	char param_weight[] = "www.example. 4 192.0.2.12=65535";
+	module.param = param_weight;
+	ok(weighted_rr_load(plan, &module) == KNOT_EOK, "weighted_rr: load weights");
+	zone_hooks_run(zone);
+	unsigned first = 0;
+	bool complete = true;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		int count = exec_query(&proc, query, answer, WWW, octets);
+		unsigned mask = 0;
+		for (int j = 0; j < count; ++j) {
+			mask |= 1 << (octets[j] - 11);
+		}
+		complete = complete && count == ADDR_COUNT && mask == 0xf;
+		first += (count > 0 && octets[0] == 12);
+	}
+	ok(complete, "weighted_rr: weighted answers are permutations");
+	ok(first > QUERY_COUNT / 2, "weighted_rr: weighted record first");
+
+	/* Unloading keeps the zone order. */
+	weighted_rr_unload(&module);
+	int count = exec_query(&proc, query, answer, WWW, octets);
+	ok(count == ADDR_COUNT && octets[0] == 11 && octets[3] == 14,
+	   "weighted_rr: unload");
+
+	knot_layer_finish(&proc);
+	knot_pkt_free(&query);
+	knot_pkt_free(&answer);
+	mp_delete((struct mempool *)mm.ctx);
+	server_deinit(&server);
+	conf_free(conf());
+
+	return 0;
+}
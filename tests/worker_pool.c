@@ -20,6 +20,7 @@
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <time.h>
 
 #include "knot/worker/pool.h"
@@ -61,6 +62,43 @@ static void task_counting(task_t *task)
 	pthread_mutex_unlock(&log->mx);
 }
 
+/*!
+ * Blocking task, waits until the gate is opened.
+ */
+typedef struct gate {
+	pthread_mutex_t mx;
+	pthread_cond_t cond;
+	bool open;
+} gate_t;
+
+static void task_blocking(task_t *task)
+{
+	gate_t *gate = task->ctx;
+
+	pthread_mutex_lock(&gate->mx);
+	while (!gate->open) {
+		pthread_cond_wait(&gate->cond, &gate->mx);
+	}
+	pthread_mutex_unlock(&gate->mx);
+}
+
+static void task_opening(task_t *task)
+{
+	gate_t *gate = task->ctx;
+
+	pthread_mutex_lock(&gate->mx);
+	gate->open = true;
+	pthread_cond_broadcast(&gate->cond);
+	pthread_mutex_unlock(&gate->mx);
+}
+
+static void assign_batch(worker_pool_t *pool, task_t *tasks, int count)
+{
+	for (int i = 0; i < count; i++) {
+		worker_pool_assign(pool, &tasks[i]);
+	}
+}
+
 static void interrupt_handle(int s)
 {
 }
@@ -89,11 +127,13 @@ int main(void)
 
 	// schedule jobs while pool is stopped
 
-	task_t task = { .run = task_counting, .ctx = &log };
-	for (int i = 0; i < TASKS_BATCH; i++) {
-		worker_pool_assign(pool, &task);
+	task_t tasks[THREADS + TASKS_BATCH];
+	for (int i = 0; i < THREADS + TASKS_BATCH; i++) {
+		tasks[i] = (task_t) { .run = task_counting, .ctx = &log, .type = 1 };
 	}
 
+	assign_batch(pool, tasks, TASKS_BATCH);
+
 	sched_yield();
 	ok(executed_reset(&log) == 0, "executed count before start");
 
@@ -105,9 +145,7 @@ int main(void)
 
 	// add additional jobs while pool is running
 
-	for (int i = 0; i < TASKS_BATCH; i++) {
-		worker_pool_assign(pool, &task);
-	}
+	assign_batch(pool, tasks, TASKS_BATCH);
 
 	worker_pool_wait(pool);
 	ok(executed_reset(&log) == TASKS_BATCH, "executed count after add");
@@ -116,9 +154,7 @@ int main(void)
 
 	worker_pool_suspend(pool);
 
-	for (int i = 0; i < TASKS_BATCH; i++) {
-		worker_pool_assign(pool, &task);
-	}
+	assign_batch(pool, tasks, TASKS_BATCH);
 
 	sched_yield();
 	ok(executed_reset(&log) == 0, "executed count after suspend");
@@ -130,9 +166,7 @@ int main(void)
 	// try clean
 
 	pthread_mutex_lock(&log.mx);
-	for (int i = 0; i < THREADS + TASKS_BATCH; i++) {
-		worker_pool_assign(pool, &task);
-	}
+	assign_batch(pool, tasks, THREADS + TASKS_BATCH);
 	sched_yield();
 	worker_pool_clear(pool);
 	pthread_mutex_unlock(&log.mx);
@@ -140,6 +174,36 @@ int main(void)
 	worker_pool_wait(pool);
 	ok(executed_reset(&log) <= THREADS, "executed count after clear");
 
+	// statistics
+
+	worker_stats_t stats = { 0 };
+	worker_pool_stats(pool, 1, &stats);
+	ok(stats.queued == 0 && stats.executed >= 3 * TASKS_BATCH,
+	   "statistics of executed tasks");
+
+	// bulk tasks don't block high priority tasks
+
+	gate_t gate = {
+		.mx = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	task_t bulk[THREADS];
+	for (int i = 0; i < THREADS; i++) {
+		bulk[i] = (task_t) { .run = task_blocking, .ctx = &gate,
+		                     .prio = TASK_PRIO_BULK };
+	}
+	task_t urgent = { .run = task_opening, .ctx = &gate,
+	                  .prio = TASK_PRIO_HIGH };
+
+	assign_batch(pool, bulk, THREADS);
+	sched_yield();
+	worker_pool_assign(pool, &urgent);
+	worker_pool_wait(pool);
+	ok(gate.open, "high priority task with busy bulk tasks");
+
+	pthread_mutex_destroy(&gate.mx);
+	pthread_cond_destroy(&gate.cond);
+
 	// cleanup
 
 	worker_pool_stop(pool);
@@ -0,0 +1,86 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tap/basic.h>
+
+#include "knot/zone/zonefile.h"
+#include "knot/zone/contents.h"
+#include "libknot/descriptor.h"
+#include "libknot/rdata.h"
+
+static void add_a(zbuilder_t *zb, const knot_dname_t *owner, uint8_t last,
+                  uint32_t ttl)
+{
+	uint8_t addr[4] = { 192, 0, 2, last };
+	knot_rrset_t rr;
+	knot_rrset_init(&rr, (knot_dname_t *)owner, KNOT_RRTYPE_A, KNOT_CLASS_IN);
+	knot_rrset_add_rdata(&rr, addr, sizeof(addr), ttl, NULL);
+	zbuilder_add(zb, &rr);
+	knot_rdataset_clear(&rr.rrs, NULL);
+}
+
+static bool rrs_sorted(const knot_rdataset_t *rrs)
+{
+	for (uint16_t i = 1; i < rrs->rr_count; ++i) {
+		if (knot_rdata_cmp(knot_rdataset_at(rrs, i - 1),
+		                   knot_rdataset_at(rrs, i)) >= 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	plan(6);
+
+	const knot_dname_t *apex = (const uint8_t *)"\x7""example""\x03""com";
+	const knot_dname_t *www = (const uint8_t *)"\x03""www""\x7""example""\x03""com";
+
+	zone_contents_t *zone = zone_contents_new_arena(apex);
+	assert(zone);
+
+	zbuilder_t zb;
+	zbuilder_init(&zb, zone, false);
+
+	/* Unordered records with a duplicate, split by another owner. */
+	add_a(&zb, www, 3, 3600);
+	add_a(&zb, www, 1, 3600);
+	add_a(&zb, www, 2, 3600);
+	add_a(&zb, www, 1, 3600);
+	ok(zone_contents_find_node(zone, www) == NULL, "zbuilder: records pending");
+
+	add_a(&zb, apex, 1, 3600);
+	const zone_node_t *node = zone_contents_find_node(zone, www);
+	const knot_rdataset_t *rrs = node_rdataset(node, KNOT_RRTYPE_A);
+	ok(rrs && rrs->rr_count == 3 && rrs_sorted(rrs),
+	   "zbuilder: owner flushed sorted");
+
+	/* Same owner again is merged on finish. */
+	add_a(&zb, www, 0, 3600);
+	add_a(&zb, www, 4, 3600);
+	ok(zbuilder_finish(&zb) == KNOT_EOK, "zbuilder: finish");
+	rrs = node_rdataset(node, KNOT_RRTYPE_A);
+	ok(rrs && rrs->rr_count == 5 && rrs_sorted(rrs),
+	   "zbuilder: owner merged");
+	ok(node_rdataset(zone->apex, KNOT_RRTYPE_A) != NULL, "zbuilder: apex");
+	ok(zb.rr_count == 7, "zbuilder: record count");
+
+	zbuilder_clear(&zb);
+	zone_contents_deep_free(&zone);
+
+	return 0;
+}
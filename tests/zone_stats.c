@@ -0,0 +1,103 @@
+/*  Copyright (C) 2015 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <tap/basic.h>
+
+#include "libknot/descriptor.h"
+#include "libknot/errcode.h"
+#include "knot/zone/zone.h"
+#include "knot/zone/zone-stats.h"
+
+static knot_pkt_t *make_query(const char *qname, uint16_t qtype)
+{
+	knot_dname_t *name = knot_dname_from_str_alloc(qname);
+	knot_pkt_t *query = knot_pkt_new(NULL, KNOT_WIRE_MAX_PKTSIZE, NULL);
+	knot_pkt_put_question(query, name, KNOT_CLASS_IN, qtype);
+	knot_dname_free(&name, NULL);
+	return query;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	zone_t zone;
+	memset(&zone, 0, sizeof(zone));
+	zone.name = knot_dname_from_str_alloc("example.com.");
+
+	char buf[4096];
+	is_int(0, zone_stats_print(&zone, buf, sizeof(buf)), "zone_stats: not queried");
+
+	zone_stats_t *stats = zone_stats_get(&zone);
+	ok(stats != NULL && zone.stats == stats && zone_stats_get(&zone) == stats,
+	   "zone_stats: allocated once");
+
+	/* Hot name from several threads, sampled for the top list. */
+	knot_pkt_t *hot = make_query("WWW.example.com.", KNOT_RRTYPE_A);
+	for (unsigned i = 0; i < 4 * ZONE_STATS_SAMPLE; ++i) {
+		zone_stats_query(stats, i, hot, KNOT_RCODE_NOERROR);
+	}
+	knot_pkt_t *miss = make_query("nx.example.com.", KNOT_RRTYPE_AAAA);
+	for (unsigned i = 0; i < ZONE_STATS_SAMPLE; ++i) {
+		zone_stats_query(stats, 0, miss, KNOT_RCODE_NXDOMAIN);
+	}
+	knot_pkt_t *other = make_query("example.com.", KNOT_RRTYPE_NAPTR);
+	zone_stats_query(stats, 1, other, KNOT_RCODE_NOTAUTH);
+
+	zone_stats_shard_t sum;
+	zone_stats_sum(stats, &sum);
+	ok(sum.queries == 5 * ZONE_STATS_SAMPLE + 1, "zone_stats: queries");
+	ok(sum.rcode[ZONE_STATS_NOERROR] == 4 * ZONE_STATS_SAMPLE &&
+	   sum.rcode[ZONE_STATS_NXDOMAIN] == ZONE_STATS_SAMPLE &&
+	   sum.rcode[ZONE_STATS_RCODE_OTHER] == 1, "zone_stats: rcodes");
+	ok(sum.qtype[0] == 4 * ZONE_STATS_SAMPLE && sum.qtype[1] == ZONE_STATS_SAMPLE &&
+	   sum.qtype[ZONE_STATS_QTYPES - 1] == 1, "zone_stats: qtypes");
+
+	int len = zone_stats_print(&zone, buf, sizeof(buf));
+	ok(len > 0 && strstr(buf, "example.com.\tqueries=81") != NULL &&
+	   strstr(buf, "NXDOMAIN=16") && strstr(buf, "AAAA=16") &&
+	   strstr(buf, "other=1"), "zone_stats: print counters");
+	const char *top = strstr(buf, "top: www.example.com.~");
+	ok(top != NULL && strstr(top, "nx.example.com.~") != NULL,
+	   "zone_stats: top names ordered");
+	is_int(KNOT_ESPACE, zone_stats_print(&zone, buf, 16), "zone_stats: print overflow");
+
+	/* Space-saving keeps a bounded number of names. */
+	for (unsigned i = 0; i < 4 * ZONE_STATS_TOPK; ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "n%u.example.com.", i);
+		knot_pkt_t *query = make_query(name, KNOT_RRTYPE_TXT);
+		for (unsigned j = 0; j < ZONE_STATS_SAMPLE; ++j) {
+			zone_stats_query(stats, 0, query, KNOT_RCODE_NOERROR);
+		}
+		knot_pkt_free(&query);
+	}
+	unsigned tracked = 0;
+	for (unsigned i = 0; i < ZONE_STATS_TOPK; ++i) {
+		tracked += (stats->top[i].count > 0);
+	}
+	ok(tracked == ZONE_STATS_TOPK, "zone_stats: top names bounded");
+
+	knot_pkt_free(&hot);
+	knot_pkt_free(&miss);
+	knot_pkt_free(&other);
+	zone_stats_free(zone.stats);
+	knot_dname_free(&zone.name, NULL);
+
+	return 0;
+}